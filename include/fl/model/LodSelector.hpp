@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#include "fl/model/Model.hpp"
+
+namespace fl {
+
+/**
+ * @brief Picks the level of detail to draw a submesh with from how large its error looks on screen.
+ *
+ * The error of a level (ModelLod::error) is a distance in object space; at a given distance from a
+ * perspective camera it covers error * scale * projection_scale / distance pixels, projection_scale
+ * being the viewport height over 2 tan(fov_y / 2). select() returns the coarsest level whose error
+ * stays below pixel_error, so a far away model costs a fraction of its triangles and no level change
+ * is visible by more than that many pixels.
+ *
+ * Level 0 is the submesh itself, level n its n-th entry in lods. The selector only reads a ModelView,
+ * so it works the same on a Model and on a MappedModel.
+ */
+class LodSelector {
+public:
+    void set_projection(float fov_y, float viewport_height);  // fov_y in radians
+    void set_pixel_error(float pixels) { pixel_error = pixels; }
+    void set_bias(int32_t levels) { bias = levels; }  // added to every selected level, clamped
+
+    // distance from the camera to the submesh, scale the largest scale of its transform
+    uint32_t select(const ModelView& model, uint32_t submesh, float distance, float scale = 1.0f) const;
+
+    // The index range to draw level of submesh with, relative to its base_vertex as always
+    static void range(const ModelView& model, uint32_t submesh, uint32_t level, uint32_t& first_index,
+                      uint32_t& index_count);
+
+    float projected_error(float error, float distance) const;  // in pixels
+
+protected:
+    float   projection_scale = 540.0f;  // 1080 pixels high with a 90 degree fov
+    float   pixel_error      = 1.0f;
+    int32_t bias             = 0;
+};
+
+}  // namespace fl
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fl/model/Model.hpp"
+#include "glm/glm.hpp"
+
+namespace fl {
+
+struct MeshOptimizerOptions {
+    uint32_t cache_size         = 16;     // vertices in the simulated post-transform cache
+    float    overdraw_threshold = 1.05f;  // ACMR the overdraw order may cost, relative to the vertex cache order
+    bool     vertex_cache       = true;
+    bool     overdraw           = true;  // needs vertex_cache, it sorts the clusters that pass leaves
+    bool     vertex_fetch       = true;
+    bool     meshlets           = true;  // rebuilds Model::meshlets, they are left empty without it
+};
+
+// Transformed counts come from a FIFO cache of cache_size vertices run over the index buffer, levels of
+// detail are not counted
+struct MeshOptimizerStats {
+    uint64_t triangles          = 0;
+    uint64_t vertices           = 0;  // referenced by the indices
+    uint64_t transformed_before = 0;
+    uint64_t transformed_after  = 0;
+    uint64_t clusters           = 0;  // the overdraw pass sorted
+    uint64_t meshlets           = 0;
+
+    double acmr_before() const { return triangles ? (double)transformed_before / (double)triangles : 0.0; }
+    double acmr_after() const { return triangles ? (double)transformed_after / (double)triangles : 0.0; }
+    double atvr_before() const { return vertices ? (double)transformed_before / (double)vertices : 0.0; }
+    double atvr_after() const { return vertices ? (double)transformed_after / (double)vertices : 0.0; }
+};
+
+/**
+ * @brief Reorders the triangles and vertices of a model for the GPU, submesh by submesh.
+ *
+ * Three passes, each optional:
+ * - vertex cache: Tipsify (Sander et al. 2007). Triangles are emitted by fanning around one vertex at a
+ *   time, the next fanning vertex being a neighbour that is still in the cache; a fan that runs dry
+ *   falls back to recently used vertices, then to the next vertex in index order.
+ * - overdraw: the vertex cache order is cut into clusters where the fans ran dry, and further wherever
+ *   the ACMR so far stays within overdraw_threshold of the cluster's. The clusters are then drawn in
+ *   order of how much they face away from the centre of the mesh, so outer surfaces go first and hide
+ *   what is behind them.
+ * - meshlets: the triangles are grouped into meshlets (see MeshletBuilder), each one a consecutive
+ *   range of the submesh's indices so it can be drawn or culled on its own. This runs after the two
+ *   passes above and keeps most of their order, the transformed counts are taken after it.
+ * - vertex fetch: vertices are renumbered in the order the indices first use them, so the vertex
+ *   stream is read front to back. Vertices no index uses keep their order behind the others.
+ *
+ * The simplified levels of a submesh are reordered the same way and follow its new vertex order.
+ * Submeshes are optimized in parallel but each one on its own and with no floating point sums across
+ * them, so the same model always gives the same bytes and the binary cache of it stays stable.
+ */
+class MeshOptimizer {
+public:
+    static MeshOptimizerStats optimize(Model& model, const MeshOptimizerOptions& options = MeshOptimizerOptions());
+
+    // The passes on one triangle list with indices below vertex_count. clusters receives the first
+    // triangle of every cluster, starting with 0.
+    static void optimize_vertex_cache(uint32_t* indices, size_t index_count, uint32_t vertex_count,
+                                      uint32_t cache_size, std::vector<uint32_t>* clusters = nullptr);
+    static void optimize_overdraw(uint32_t* indices, size_t index_count, const glm::vec3* positions,
+                                  uint32_t vertex_count, const std::vector<uint32_t>& clusters, uint32_t cache_size,
+                                  float threshold, uint32_t* cluster_count = nullptr);
+    // remap[old] = new, apply it to the vertex array as vertices[remap[i]] = old_vertices[i]
+    static void optimize_vertex_fetch(uint32_t* indices, size_t index_count, uint32_t vertex_count,
+                                      std::vector<uint32_t>& remap);
+
+    // Vertices transformed with a FIFO post-transform cache of cache_size entries
+    static uint64_t simulate_cache(const uint32_t* indices, size_t index_count, uint32_t vertex_count,
+                                   uint32_t cache_size);
+};
+
+}  // namespace fl
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fl/model/Model.hpp"
+#include "glm/glm.hpp"
+
+namespace fl {
+
+struct MeshSimplifierOptions {
+    uint32_t levels        = 4;      // simplified levels made below every submesh, 0 for none
+    float    ratio         = 0.5f;   // triangles of a level relative to the level above
+    float    max_error     = 0.05f;  // relative to the bounding radius of the submesh, no level goes past it
+    uint32_t min_triangles = 64;     // no level gets smaller than this
+};
+
+// One level of simplify(): a triangle list over the same vertices
+struct SimplifiedMesh {
+    std::vector<uint32_t> indices;
+    float                 error = 0.0f;  // in the units of the positions
+};
+
+/**
+ * @brief Quadric error metric simplification (Garland and Heckbert 1997) into a chain of LODs.
+ *
+ * Every vertex sums the planes of its triangles, weighted by area, and an edge collapse moves one end
+ * onto the other, costing the distance of that position to the planes of both. Collapses are taken
+ * cheapest first from a heap, skipping any that would flip a triangle, until the level's triangle
+ * target is met; the next level carries on from there, so errors only grow down the chain.
+ *
+ * Vertices only ever move onto existing vertices, so the levels are index lists over the vertices of
+ * the full mesh and cost no vertex memory. Vertices on open borders and on attribute seams (several
+ * vertices at one position, with different uvs or normals) never move, which keeps levels free of
+ * cracks; meshes cut into many uv islands simplify less for it.
+ *
+ * Ties in the heap are broken by vertex index, so the same input always gives the same levels.
+ */
+class MeshSimplifier {
+public:
+    // Replaces the LODs of every submesh of model, in parallel over the submeshes
+    static void generate_lods(Model& model, const MeshSimplifierOptions& options = MeshSimplifierOptions());
+
+    // Levels of one triangle list; fewer than options.levels when max_error or min_triangles stop it
+    // or when a level would barely be smaller than the one above
+    static void simplify(const uint32_t* indices, size_t index_count, const glm::vec3* positions,
+                         uint32_t vertex_count, const MeshSimplifierOptions& options, float radius,
+                         std::vector<SimplifiedMesh>& levels);
+};
+
+}  // namespace fl
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fl/model/Model.hpp"
+#include "glm/glm.hpp"
+
+namespace fl {
+
+/**
+ * @brief Splits a triangle list into meshlets of at most meshlet_max_vertices vertices and
+ *        meshlet_max_triangles triangles, and computes what culling them needs.
+ *
+ * A meshlet starts at the first triangle not taken yet, in the order of the index list, and grows
+ * over triangles that share its vertices: the one adding the fewest new vertices first, then the one
+ * whose vertices have the fewest triangles left, so no scraps are stranded for later meshlets, then
+ * the one closest to the meshlet's centre. Small, round and flat meshlets make tight spheres and
+ * narrow cones, which is what lets whole clusters be culled. Inside a meshlet the triangles keep the
+ * order they had, so a list ordered for the vertex cache stays mostly so.
+ *
+ * Bounds are a sphere around the meshlet's vertices and a cone holding every triangle normal. The
+ * meshlet is facing away from a camera at c when
+ *     dot(center - c, cone_axis) >= cone_cutoff * length(center - c) + radius
+ * which shader/meshlet_cull.glsl tests after transforming both to world space.
+ */
+class MeshletBuilder {
+public:
+    // Reorders indices so every meshlet is one consecutive range; first_index of the meshlets is
+    // relative to indices and submesh is left 0
+    static void build(uint32_t* indices, size_t index_count, const glm::vec3* positions, uint32_t vertex_count,
+                      std::vector<ModelMeshlet>& meshlets);
+
+    static void compute_bounds(const uint32_t* indices, size_t index_count, const glm::vec3* positions,
+                               ModelMeshlet& meshlet);
+};
+
+}  // namespace fl
@@ -1,15 +1,151 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
 
-namespace fl
-{
-    
+#include "glm/glm.hpp"
 
+namespace fl {
+
+constexpr uint32_t model_no_texture = ~0u;
+
+// Meshlet limits, those of mesh shader implementations: 124 triangles leave room for the primitive
+// count in a 128 entry output block
+constexpr uint32_t meshlet_max_vertices  = 64;
+constexpr uint32_t meshlet_max_triangles = 124;
+
+// 16 bytes, what the vertex stream of every submesh is made of
+struct ModelVertex {
+    uint16_t position[3];   // unorm16 on the bounds of the submesh
+    int8_t   normal[2];     // octahedral, snorm8
+    int8_t   tangent[2];    // octahedral, snorm8, zero when the mesh has no texture coordinates
+    int8_t   tangent_sign;  // bitangent = tangent_sign * cross(normal, tangent)
+    uint8_t  pad;
+    uint16_t uv[2];  // half floats
+};
+static_assert(sizeof(ModelVertex) == 16, "ModelVertex is meant to be 16 bytes");
+
+// A range of the index and vertex arrays drawn with one material. Indices are relative to base_vertex.
+struct ModelSubmesh {
+    uint32_t  first_index   = 0;
+    uint32_t  index_count   = 0;
+    uint32_t  base_vertex   = 0;
+    uint32_t  vertex_count  = 0;
+    uint32_t  material      = 0;
+    uint32_t  first_lod     = 0;  // in Model::lods, coarsest last
+    uint32_t  lod_count     = 0;
+    uint32_t  first_meshlet = 0;  // in Model::meshlets, together they cover the submesh's own indices
+    uint32_t  meshlet_count = 0;
+    glm::vec3 bounds_min    = glm::vec3(0.0f);  // object space, the range positions are quantized on
+    glm::vec3 bounds_max    = glm::vec3(0.0f);
+};
+
+// A simplified level of a submesh: its own range of the index array, over the submesh's vertices
+struct ModelLod {
+    uint32_t first_index = 0;
+    uint32_t index_count = 0;
+    float    error       = 0.0f;  // how far the surface moved at most, roughly, in object space
+};
+
+// Textures are offsets in Model::strings, model_no_texture for none
+struct ModelMaterial {
+    glm::vec4 base_color                 = glm::vec4(1.0f);
+    glm::vec3 emissive                   = glm::vec3(0.0f);
+    float     metallic                   = 0.0f;
+    float     roughness                  = 1.0f;
+    uint32_t  base_color_texture         = model_no_texture;
+    uint32_t  normal_texture             = model_no_texture;
+    uint32_t  metallic_roughness_texture = model_no_texture;
+    uint32_t  emissive_texture           = model_no_texture;
+};
+
+// A cluster of at most meshlet_max_vertices vertices and meshlet_max_triangles triangles of a submesh,
+// with what culling it as a whole needs. 48 bytes, laid out for std430 as shader/meshlet.glsl reads it.
+struct ModelMeshlet {
+    glm::vec3 center       = glm::vec3(0.0f);  // bounding sphere, object space
+    float     radius       = 0.0f;
+    glm::vec3 cone_axis    = glm::vec3(0.0f);  // average facing of the triangles
+    float     cone_cutoff  = 1.0f;             // sine of the cone's half angle, 1 when too wide to ever cull
+    uint32_t  first_index  = 0;                // a range of the submesh's indices
+    uint32_t  index_count  = 0;
+    uint32_t  vertex_count = 0;  // distinct vertices
+    uint32_t  submesh      = 0;
+};
+static_assert(sizeof(ModelMeshlet) == 48, "ModelMeshlet is shared with shaders");
+
+// One placement of a submesh, the node hierarchy of the source file flattened to world transforms
+struct ModelNode {
+    glm::mat4 transform = glm::mat4(1.0f);
+    uint32_t  submesh   = 0;
+};
+
+// The arrays of a model wherever they live, a Model or a mapped cache file (MappedModel)
+struct ModelView {
+    const ModelVertex*   vertices       = nullptr;
+    const uint8_t*       indices        = nullptr;
+    const ModelSubmesh*  submeshes      = nullptr;
+    const ModelMaterial* materials      = nullptr;
+    const ModelNode*     nodes          = nullptr;
+    const ModelLod*      lods           = nullptr;
+    const ModelMeshlet*  meshlets       = nullptr;
+    const char*          strings        = nullptr;
+    uint32_t             vertex_count   = 0;
+    uint32_t             index_count    = 0;
+    uint32_t             index_size     = 4;
+    uint32_t             submesh_count  = 0;
+    uint32_t             material_count = 0;
+    uint32_t             node_count     = 0;
+    uint32_t             lod_count      = 0;
+    uint32_t             meshlet_count  = 0;
+    uint32_t             string_bytes   = 0;
+};
+
+/**
+ * @brief A mesh in the engine's own layout: a few flat arrays instead of a tree of objects.
+ *
+ * All submeshes share one vertex array and one index array. Vertices are quantized to 16 bytes, see
+ * ModelVertex, and indices are 16 bit when no submesh has more than 65536 vertices, 32 bit otherwise.
+ * Texture paths live in one string table, as written in the source file, so nothing in a model points
+ * anywhere and the arrays can be copied, uploaded or written to disk as they are.
+ *
+ * The indices of all submeshes come first, then those of their simplified levels (ModelLod), which
+ * reuse the vertices of their submesh. Meshlets (ModelMeshlet) split the submeshes' own indices into
+ * consecutive ranges, they are built by MeshOptimizer and only valid for the triangle order it left.
+ */
 class Model {
 public:
+    std::vector<ModelVertex>   vertices;
+    std::vector<uint8_t>       indices;         // index_size bytes each
+    uint32_t                   index_size = 4;  // 2 or 4
+    std::vector<ModelSubmesh>  submeshes;
+    std::vector<ModelMaterial> materials;
+    std::vector<ModelNode>     nodes;
+    std::vector<ModelLod>      lods;
+    std::vector<ModelMeshlet>  meshlets;
+    std::vector<char>          strings;  // null terminated texture paths
+
+    uint32_t    index_count() const { return (uint32_t)(indices.size() / index_size); }
+    uint32_t    index(size_t i) const;  // relative to the base_vertex of its submesh
+    void        set_index(size_t i, uint32_t value);
+    const char* string(uint32_t offset) const { return strings.data() + offset; }
+    uint32_t    add_string(const std::string& text);  // offset of text, stored once
 
+    ModelView view() const;
 
+    glm::vec3 bounds_min() const;  // over all nodes
+    glm::vec3 bounds_max() const;
+    size_t    size_bytes() const;  // of the arrays
+    void      clear();
 };
 
+// Quantization shared by everything that writes or reads ModelVertex
+void      encode_position(const ModelSubmesh& submesh, const glm::vec3& position, ModelVertex& vertex);
+glm::vec3 decode_position(const ModelSubmesh& submesh, const ModelVertex& vertex);
+void      encode_direction(const glm::vec3& direction, int8_t oct[2]);
+glm::vec3 decode_direction(const int8_t oct[2]);
+void      encode_uv(const glm::vec2& uv, ModelVertex& vertex);
+glm::vec2 decode_uv(const ModelVertex& vertex);
 
-} // namespace fl
+}  // namespace fl
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "fl/model/Model.hpp"
+
+namespace fl {
+
+// Bumped whenever a section layout or the import itself changes, older files are imported again
+constexpr uint32_t model_cache_version   = 4;
+constexpr uint32_t model_cache_alignment = 64;  // of every section in the file
+
+enum class ModelSection : uint32_t { Vertices = 1, Indices, Submeshes, Materials, Nodes, Strings, Lods, Meshlets };
+
+/**
+ * @brief Writes a Model as a binary cache file: a header, a section table and the raw arrays.
+ *
+ * Every section starts on a multiple of model_cache_alignment and records the size of its elements,
+ * so a reader maps the file and points straight into it. The key identifies what the file was made
+ * from (the source file's contents and the import options); the file is written next to its final
+ * name, under a name of its own per writer, and renamed over it, so a reader never sees half of one
+ * and concurrent writers of the same cache do not write into each other's file.
+ */
+class ModelCache {
+public:
+    static int write(const std::string& path, const Model& model, uint64_t key);
+};
+
+/**
+ * @brief A model cache file mapped read-only into memory.
+ *
+ * open() checks the header, the key, that every section lies inside the file with the element size
+ * this build expects, and that the ranges and indices in the records stay inside the arrays they
+ * refer to. Then view() points into the mapping: nothing is parsed or copied, and the vertex and index
+ * sections can go to the GPU uploader as they are. The pages are loaded by the OS on first touch and
+ * shared with any other process mapping the same file.
+ */
+class MappedModel {
+public:
+    MappedModel() {}
+    ~MappedModel() { close(); }
+    MappedModel(const MappedModel&) = delete;
+    MappedModel& operator=(const MappedModel&) = delete;
+
+    int  open(const std::string& path, uint64_t key);  // -1 when missing, stale or damaged
+    void close();
+    bool is_open() const { return base != nullptr; }
+
+    const ModelView& view() const { return model; }
+    size_t           size_bytes() const { return size; }
+
+    // Raw section, nullptr when the file has none or its elements are not stride bytes
+    const void* section(ModelSection type, uint32_t stride, size_t& count) const;
+
+    void to_model(Model& out) const;  // copies, for a model that is going to be changed
+
+protected:
+    const uint8_t* base = nullptr;
+    size_t         size = 0;
+    ModelView      model;
+
+    int validate(uint64_t key);
+    int validate_ranges() const;
+};
+
+}  // namespace fl
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "fl/config.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FL_BVH_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace fl {
+
+struct Aabb {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void grow(const glm::vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+    void grow(const Aabb& b) {
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+    bool      empty() const { return min.x > max.x; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    float     area() const {
+        if (empty()) return 0.0f;
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+};
+
+struct BvhSettings {
+    uint32_t bins               = 16;    // SAH candidates per axis
+    uint32_t max_leaf_size      = 8;     // larger leaves are always split
+    float    traversal_cost     = 1.0f;  // relative to one primitive intersection
+    uint32_t parallel_threshold = 4096;  // ranges at least this large are binned and split on several threads
+};
+
+// Node of a binary BVH: a leaf holds count primitives from indices[first], an inner node (count 0) has
+// its children at first and first + 1
+struct BvhNode {
+    Aabb     bounds;
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+struct BvhBuildNode;
+
+/**
+ * @brief Binary BVH over primitive bounds, built top-down with binned SAH.
+ *
+ * Every node is split at the best of bins - 1 planes per axis by the surface area heuristic, or
+ * becomes a leaf when no split is cheaper than intersecting all its primitives. Ranges of at least
+ * parallel_threshold primitives bin on TBB workers and their two halves are built in parallel. The
+ * node order only depends on the input, so any number of threads builds the same tree.
+ *
+ * Children always come after their parent, refit() walks the nodes backwards.
+ */
+class Bvh {
+public:
+    void build(const Aabb* primitives, uint32_t count, const BvhSettings& settings = BvhSettings());
+    void refit(const Aabb* primitives);  // same primitives moved, the topology is kept
+
+    const std::vector<BvhNode>&  get_nodes() const { return nodes; }
+    const std::vector<uint32_t>& get_indices() const { return indices; }  // primitives in leaf order
+
+    uint32_t get_depth() const { return depth; }
+    float    sah_cost() const;  // expected cost of a random ray, relative to one primitive intersection
+
+protected:
+    std::vector<BvhNode>  nodes;
+    std::vector<uint32_t> indices;
+    uint32_t              depth          = 0;
+    float                 traversal_cost = 1.0f;
+
+    uint32_t flatten(const BvhBuildNode& node, uint32_t index, uint32_t level);
+};
+
+// Four children of a BVH4 node in SoA layout, tested against a ray at once. Slot i is a leaf when
+// count[i] is not 0 (count primitives from child[i]), an inner node at child[i] otherwise, or empty
+// when child[i] is BVH4_EMPTY. Empty slots sit at FLT_MAX, traversal skips them when they are hit anyway.
+struct alignas(16) Bvh4Node {
+    float    min_x[4], min_y[4], min_z[4];
+    float    max_x[4], max_y[4], max_z[4];
+    uint32_t child[4];
+    uint32_t count[4];
+};
+constexpr uint32_t BVH4_EMPTY = ~0u;
+
+/**
+ * @brief The BVH collapsed to four children per node, for SIMD traversal.
+ *
+ * Each node takes the children of its binary node and keeps opening the one of largest surface
+ * area, until four remain or all are leaves. Primitive indices stay those of the binary BVH.
+ * refit() takes the bounds of a refit binary BVH and keeps the layout, so nodes uploaded elsewhere
+ * only need their bounds rewritten.
+ */
+class Bvh4 {
+public:
+    void build(const Bvh& bvh);
+    void refit(const Bvh& bvh);  // the BVH build() collapsed, after Bvh::refit()
+
+    const std::vector<Bvh4Node>& get_nodes() const { return nodes; }
+    const std::vector<uint32_t>& get_indices() const { return indices; }
+    bool                         empty() const { return nodes.empty(); }
+
+    // Entries a depth first traversal stack can hold at most: every level below the path keeps at most
+    // three siblings waiting, the deepest node pushes four
+    uint32_t get_stack_size() const { return depth * 3 + 1; }
+
+protected:
+    std::vector<Bvh4Node> nodes;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> sources;  // binary node of every slot, four per node
+    uint32_t              depth = 0;
+
+    uint32_t collapse(const Bvh& bvh, uint32_t node, uint32_t level);
+};
+
+// Ray in the form the box tests want, origin and reciprocal direction
+struct BvhRay {
+    glm::vec3 origin;
+    glm::vec3 inv_dir;
+
+    BvhRay(const glm::vec3& origin, const glm::vec3& dir) : origin(origin) {
+        for (int i = 0; i < 3; i++) {
+            float d    = std::abs(dir[i]) < 1e-30f ? (dir[i] < 0.0f ? -1e-30f : 1e-30f) : dir[i];
+            inv_dir[i] = 1.0f / d;
+        }
+    }
+};
+
+// Bit i of the result is set when the ray enters child i before t_max, t_near[i] is where it enters
+inline int intersect_children(const Bvh4Node& node, const BvhRay& ray, float t_max, float t_near[4]) {
+#ifdef FL_BVH_SSE
+    __m128 o_x = _mm_set1_ps(ray.origin.x), o_y = _mm_set1_ps(ray.origin.y), o_z = _mm_set1_ps(ray.origin.z);
+    __m128 i_x = _mm_set1_ps(ray.inv_dir.x), i_y = _mm_set1_ps(ray.inv_dir.y), i_z = _mm_set1_ps(ray.inv_dir.z);
+
+    __m128 t0_x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_x), o_x), i_x);
+    __m128 t1_x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_x), o_x), i_x);
+    __m128 t0_y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_y), o_y), i_y);
+    __m128 t1_y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_y), o_y), i_y);
+    __m128 t0_z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_z), o_z), i_z);
+    __m128 t1_z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_z), o_z), i_z);
+
+    __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0_x, t1_x), _mm_min_ps(t0_y, t1_y)),
+                              _mm_max_ps(_mm_min_ps(t0_z, t1_z), _mm_setzero_ps()));
+    __m128 leave = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0_x, t1_x), _mm_max_ps(t0_y, t1_y)),
+                              _mm_min_ps(_mm_max_ps(t0_z, t1_z), _mm_set1_ps(t_max)));
+    _mm_storeu_ps(t_near, enter);
+    return _mm_movemask_ps(_mm_cmple_ps(enter, leave));
+#else
+    int mask = 0;
+    for (int i = 0; i < 4; i++) {
+        float t0_x  = (node.min_x[i] - ray.origin.x) * ray.inv_dir.x;
+        float t1_x  = (node.max_x[i] - ray.origin.x) * ray.inv_dir.x;
+        float t0_y  = (node.min_y[i] - ray.origin.y) * ray.inv_dir.y;
+        float t1_y  = (node.max_y[i] - ray.origin.y) * ray.inv_dir.y;
+        float t0_z  = (node.min_z[i] - ray.origin.z) * ray.inv_dir.z;
+        float t1_z  = (node.max_z[i] - ray.origin.z) * ray.inv_dir.z;
+        float enter = std::max(std::max(std::min(t0_x, t1_x), std::min(t0_y, t1_y)),
+                               std::max(std::min(t0_z, t1_z), 0.0f));
+        float leave = std::min(std::min(std::max(t0_x, t1_x), std::max(t0_y, t1_y)),
+                               std::min(std::max(t0_z, t1_z), t_max));
+        t_near[i]   = enter;
+        if (enter <= leave) mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+}  // namespace fl
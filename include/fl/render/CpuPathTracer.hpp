@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vector>
+
+#include "fl/render/Bvh.hpp"
+#include "fl/render/RayTracing.hpp"
+#include "fl/render/VulkanReadback.hpp"
+
+namespace fl {
+
+struct RTHit {
+    float     t         = FLT_MAX;
+    RTHandle  instance  = RT_INVALID;
+    uint32_t  primitive = 0;
+    glm::vec3 normal;  // world space geometric normal, facing the ray
+};
+
+/**
+ * @brief Deterministic CPU ray tracer over the scenes IRayTracingBackend traces, the reference for its images.
+ *
+ * Meshes and instances have the same meaning as on the GPU. commit() builds the BVHs of new meshes
+ * (binned SAH, in parallel over meshes and within large ones), refits those of updated dynamic meshes
+ * and rebuilds the instance BVH. All of them are collapsed to BVH4 and traversed with four box tests
+ * at once.
+ *
+ * render() traces the image of the GPU backends: light visibility, ambient occlusion and coverage per
+ * pixel, from the same primary rays and the same sample sequence, in 16x16 tiles spread over TBB
+ * workers. Each call adds passes to a float accumulation, so the image converges progressively, and
+ * every pixel only depends on its own samples: the result is the same on any number of threads.
+ * image() converts the average to the RGBA8 frame the readback path delivers, ready to compare with
+ * a GPU frame or to write with ImageEncoder.
+ *
+ * intersect() and occluded() are the ray queries for offline work such as lightmap baking. They may
+ * be called from any number of threads between commits.
+ */
+class CpuPathTracer {
+public:
+    RTHandle add_mesh(const RTMeshDesc& desc);
+    void     update_mesh(RTHandle mesh, const glm::vec3* positions);  // dynamic meshes only
+    void     remove_mesh(RTHandle mesh);
+    RTHandle add_instance(const RTInstance& instance);
+    void     set_transform(RTHandle instance, const glm::mat4& transform);
+    void     remove_instance(RTHandle instance);
+
+    void commit(const BvhSettings& settings = BvhSettings());
+
+    bool intersect(const glm::vec3& origin, const glm::vec3& direction, float t_max, RTHit& hit,
+                   uint32_t mask = 0xff) const;
+    bool occluded(const glm::vec3& origin, const glm::vec3& direction, float t_max, uint32_t mask = 0xff) const;
+
+    // Adds passes samples per pixel, starting at sample params.frame + get_samples(). A new size or
+    // reset() starts over. params.output is ignored.
+    void render(const RTTraceParams& params, uint32_t passes = 1);
+    void reset() { samples = 0; }
+
+    ReadbackFrame image();  // valid until the next render() or image()
+    uint32_t      get_samples() const { return samples; }
+
+    struct Stats {
+        double   build_ms    = 0.0;  // last commit
+        double   render_ms   = 0.0;  // last render
+        uint64_t rays        = 0;    // traced by the last render
+        uint32_t blas_builds = 0;    // totals
+        uint32_t blas_refits = 0;
+        uint32_t tlas_builds = 0;
+        uint32_t bvh4_nodes  = 0;  // of all meshes and the instance BVH, after the last commit
+        uint32_t max_depth   = 0;  // of the binary BVHs
+    };
+    const Stats& get_stats() const { return stats; }
+
+    static constexpr uint32_t tile_size = 16;
+
+protected:
+    struct Triangle {
+        glm::vec3 v0, e1, e2;  // v1 - v0, v2 - v0
+    };
+
+    struct Mesh {
+        bool                   live    = false;
+        bool                   dynamic = false;
+        bool                   dirty   = false;  // positions changed since the last commit
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t>  indices;
+        std::vector<Triangle>  triangles;   // in Bvh4 leaf order
+        std::vector<uint32_t>  primitives;  // original index of each triangle
+        Bvh                    bvh;
+        Bvh4                   bvh4;
+    };
+
+    struct Instance {
+        RTInstance desc;
+        glm::mat4  world_to_object = glm::mat4(1.0f);
+        bool       live            = false;
+    };
+
+    std::vector<Mesh>     meshes;
+    std::vector<Instance> instances;
+    std::vector<RTHandle> free_instances;
+    std::vector<RTHandle> tlas_instances;  // the instance of each TLAS primitive
+    Bvh                   tlas;
+    Bvh4                  tlas4;
+
+    uint32_t               width   = 0;
+    uint32_t               height  = 0;
+    uint32_t               samples = 0;
+    std::vector<glm::vec4> accumulation;
+    std::vector<uint8_t>   pixels;
+    Stats                  stats;
+
+    void build_mesh(Mesh& mesh, const BvhSettings& settings);
+    void refit_mesh(Mesh& mesh);
+    void order_triangles(Mesh& mesh);
+    bool trace_mesh(const Mesh& mesh, const BvhRay& ray, const glm::vec3& direction, bool any, float& t_max,
+                    uint32_t& primitive) const;
+    bool trace(const glm::vec3& origin, const glm::vec3& direction, float t_max, uint32_t mask, bool any,
+               RTHit* hit) const;
+    glm::vec4 trace_pixel(const RTTraceParams& params, uint32_t x, uint32_t y, uint32_t frame, uint64_t& rays) const;
+};
+
+}  // namespace fl
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <tbb/task_group.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fl/render/VulkanReadback.hpp"
+#include "fl/system/ImageEncoder.hpp"
+
+namespace fl {
+
+class VulkanRender;
+
+/**
+ * @brief Writes the frames a Vulkan render presents to an image sequence, e.g. sprite sheet frames.
+ *
+ * The render reads each frame back into its readback ring (swapchain or offscreen image alike) and
+ * delivers it once the frame's fence has signaled. The capture copies the pixels into one of its
+ * buffers and hands them to TBB tasks, which encode and write the files in parallel while rendering
+ * goes on. When every buffer is waiting for an encoder the render thread waits for the queued
+ * encoders, running them itself if no worker thread is free, or drops the frame with
+ * setDropWhenBusy(true).
+ */
+class FrameCapture {
+public:
+    FrameCapture();
+    ~FrameCapture() noexcept;  // finish(), the encoders are always waited for
+
+    // path_pattern is a printf pattern for the frame number, the extension of the format is appended,
+    // e.g. "export/walk_%03u" gives export/walk_000.png, export/walk_001.png, ...
+    // max_frames 0 captures until stop(), otherwise readback is turned off once the last one arrived.
+    int  start(VulkanRender* render, const std::string& path_pattern, ImageFormat format, uint32_t max_frames = 0);
+    void stop();    // takes no more frames, queued ones are still written
+    void finish();  // stop, then wait until every queued frame is on disk
+    bool isCapturing() const { return capturing; }
+
+    void setMaxQueued(uint32_t frames) { max_queued = frames ? frames : 1; }  // frames between readback and disk
+    void setDropWhenBusy(bool drop) { drop_when_busy = drop; }
+
+    struct Stats {
+        uint64_t captured   = 0;  // frames copied out of the readback ring
+        uint64_t written    = 0;
+        uint64_t dropped    = 0;  // no free buffer with setDropWhenBusy, or failed to encode or write
+        uint64_t waits      = 0;  // times the render thread waited for a free buffer
+        uint64_t raw_bytes  = 0;
+        uint64_t file_bytes = 0;
+    };
+    Stats getStats() const;
+
+protected:
+    VulkanRender*     render = nullptr;
+    std::string       pattern;
+    ImageFormat       format         = ImageFormat::QOI;
+    uint32_t          max_frames     = 0;
+    uint32_t          frame_number   = 0;
+    std::atomic<bool> capturing{false};
+    bool              drop_when_busy = false;
+    uint32_t          max_queued     = 8;
+
+    tbb::task_group encoders;
+
+    std::mutex                        mutex;
+    std::vector<std::vector<uint8_t>> free_buffers;  // recycled pixel buffers
+    uint32_t                          queued = 0;
+
+    std::atomic<uint64_t> captured{0}, written{0}, dropped{0}, waits{0}, raw_bytes{0}, file_bytes{0};
+
+    void        onFrame(const ReadbackFrame& frame);
+    void        release(std::vector<uint8_t>&& buffer);
+    std::string framePath(uint32_t number) const;
+};
+
+}  // namespace fl
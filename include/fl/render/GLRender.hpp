@@ -13,6 +13,7 @@ public:
     virtual void setRenderTree();
     virtual void clear(glm::vec4 color = glm::vec4(0.2, 0.2, 0.2, 1.0));
     virtual void present() {}
+    virtual void resize(uint32_t width, uint32_t height);
     virtual RenderType getType() { return OpenGL; }
 protected:
     DEPS_ON
@@ -21,7 +22,7 @@ protected:
     bool show_demo_window    = true;
     bool show_another_window = false;
 
-    int display_w, display_h;
+    int display_w = 0, display_h = 0;
 
     virtual void Init();
     virtual void initGL();
@@ -13,6 +13,8 @@ public:
     virtual void setRenderTree() = 0;
     virtual void clear(glm::vec4 color = glm::vec4(0.2, 0.2, 0.2, 1.0)) = 0;
     virtual void present() = 0;
+    // the window's framebuffer size in pixels changed, called by the window's main loop at most once a frame
+    virtual void resize(uint32_t width, uint32_t height) {}
     // get the inner render data from vulkan, return null if not vulkan render
     virtual RenderData* getVulkanRenderData() { return nullptr; }
 
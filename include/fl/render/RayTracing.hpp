@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "fl/config.hpp"
+#include "fl/render/VulkanBindless.hpp"
+
+namespace fl {
+
+class VulkanImpl;
+struct RenderData;
+
+using RTHandle                = uint32_t;
+constexpr RTHandle RT_INVALID = ~0u;
+
+struct RTSceneDesc {
+    uint32_t max_instances = 65536;
+    uint32_t max_meshes    = 4096;
+    uint32_t max_vertices  = 1u << 20;
+    uint32_t max_indices   = 1u << 22;
+};
+
+// Triangle mesh, positions only: all rays need to find hits and geometric normals
+struct RTMeshDesc {
+    const glm::vec3* positions    = nullptr;
+    uint32_t         vertex_count = 0;
+    const uint32_t*  indices      = nullptr;
+    uint32_t         index_count  = 0;
+    bool             dynamic      = false;  // positions change through update_mesh(), refit instead of rebuilt
+};
+
+struct RTInstance {
+    glm::mat4 transform = glm::mat4(1.0f);
+    RTHandle  mesh      = RT_INVALID;
+    uint32_t  mask      = 0xff;  // rays only see instances whose mask shares a bit with theirs, 0xff for all
+};
+
+// Per pixel of the output: r is the direct light visibility, g the ambient occlusion, both 1 when
+// unoccluded, and a the coverage, 0 where the primary ray missed everything.
+struct RTTraceParams {
+    glm::mat4      inverse_view_projection = glm::mat4(1.0f);  // clip space to world, Vulkan clip space
+    glm::vec3      light_direction         = glm::vec3(0.0f, -1.0f, 0.0f);  // the direction light travels
+    float          ao_radius               = 1.0f;
+    BindlessHandle output                  = BINDLESS_INVALID;  // rgba8 storage image, GENERAL layout
+    uint32_t       width                   = 0;
+    uint32_t       height                  = 0;
+    uint32_t       ao_samples              = 4;
+    uint32_t       frame                   = 0;  // seeds the ambient occlusion samples
+};
+
+// Push constants of every trace shader, std430 layout of the Trace block in shader/rt_common.glsl
+struct RTTraceConstants {
+    glm::mat4 inverse_view_projection;
+    glm::vec4 light;     // xyz the direction light travels, w the ambient occlusion radius
+    uint32_t  scene[2];  // what the backend traverses: the TLAS device address, or the compute BVH buffers
+    uint32_t  output;
+    uint32_t  meshes;
+    uint32_t  positions;
+    uint32_t  indices;
+    uint32_t  width;
+    uint32_t  height;
+    uint32_t  ao_samples;
+    uint32_t  frame;
+};
+static_assert(sizeof(RTTraceConstants) <= VulkanBindless::push_constant_size, "trace constants too large");
+
+/**
+ * @brief Ray traced visibility for a scene of triangle meshes, the same interface on every device.
+ *
+ * Meshes and instances are changed from the render thread at any time; record() brings the GPU side up
+ * to date (acceleration structures, BVH or whatever the backend traverses) and traces one ray per
+ * output pixel, with shadow and ambient occlusion rays from what it hits. It records into a command
+ * buffer outside a render pass, usually from the execute callback of a compute render graph pass that
+ * declares the output image with write_storage_image(image, trace_stages()).
+ *
+ * create_ray_tracing_backend() picks the implementation the device supports.
+ */
+class IRayTracingBackend {
+public:
+    virtual ~IRayTracingBackend() {}
+
+    // destroy() belongs to shutdown, once the GPU no longer runs frames that trace
+    virtual int         create(VulkanImpl* impl, RenderData* data, const RTSceneDesc& desc = RTSceneDesc()) = 0;
+    virtual void        destroy()                                                                        = 0;
+    virtual const char* name() const                                                                     = 0;
+
+    virtual RTHandle add_mesh(const RTMeshDesc& desc)                             = 0;
+    virtual void     update_mesh(RTHandle mesh, const glm::vec3* positions)       = 0;  // dynamic meshes only
+    virtual void     remove_mesh(RTHandle mesh)                                   = 0;
+    virtual RTHandle add_instance(const RTInstance& instance)                     = 0;
+    virtual void     set_transform(RTHandle instance, const glm::mat4& transform) = 0;
+    virtual void     remove_instance(RTHandle instance)                           = 0;
+
+    virtual void                 record(VkCommandBuffer cmd, const RTTraceParams& params) = 0;
+    virtual VkPipelineStageFlags trace_stages() const                                     = 0;
+};
+
+// Hardware ray tracing when the device supports it and prefer_compute is not set, the compute shader
+// fallback otherwise. nullptr when neither could be created.
+uptr<IRayTracingBackend> create_ray_tracing_backend(VulkanImpl* impl, RenderData* data, bool prefer_compute = false,
+                                                    const RTSceneDesc& desc = RTSceneDesc());
+
+}  // namespace fl
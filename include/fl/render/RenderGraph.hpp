@@ -0,0 +1,265 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "fl/render/VulkanAllocator.hpp"
+
+namespace fl {
+
+using RGResource                = uint32_t;
+constexpr RGResource RG_INVALID = UINT32_MAX;
+
+enum class RGPassType { Raster, Compute, Transfer };
+
+struct RGImageDesc {
+    VkFormat              format  = VK_FORMAT_UNDEFINED;
+    uint32_t              width   = 0;  // 0 follows the graph extent, i.e. the backbuffer size
+    uint32_t              height  = 0;
+    VkImageUsageFlags     usage   = 0;  // added to the usage derived from the passes
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+// One access of a pass to a resource
+struct RGUse {
+    RGResource           resource = RG_INVALID;
+    VkImageLayout        layout   = VK_IMAGE_LAYOUT_UNDEFINED;  // always UNDEFINED for buffers
+    VkPipelineStageFlags stages   = 0;
+    VkAccessFlags        access   = 0;
+    bool                 write    = false;
+
+    bool                attachment = false;  // color or depth attachment of a raster pass
+    VkAttachmentLoadOp  load_op    = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    VkAttachmentStoreOp store_op   = VK_ATTACHMENT_STORE_OP_STORE;  // decided by compile()
+    VkClearValue        clear      = {};
+
+    // a write that keeps or reads the previous content depends on the pass that produced it
+    bool reads_previous() const { return !write || load_op == VK_ATTACHMENT_LOAD_OP_LOAD; }
+};
+
+class RenderGraph;
+
+struct RGContext {
+    VkCommandBuffer cmd;
+    VkRenderPass    render_pass;  // VK_NULL_HANDLE outside raster passes
+    uint32_t        subpass;
+    VkFramebuffer   framebuffer;
+    VkExtent2D      extent;
+    RenderGraph*    graph;
+};
+
+using RGExecuteFn = std::function<void(RGContext&)>;
+
+// Takes the destruction of objects frames in flight may still use, and runs it once they are done
+using RGRetireFn = std::function<void(std::function<void()>)>;
+
+class RGPass {
+public:
+    std::string name;
+    RGPassType  type;
+    RGExecuteFn execute;
+
+    // raster passes only: set to SECONDARY_COMMAND_BUFFERS before execution when execute only records
+    // vkCmdExecuteCommands
+    VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+
+    void write_color(RGResource image, VkAttachmentLoadOp load = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                     VkClearColorValue clear = {{0.0f, 0.0f, 0.0f, 1.0f}});
+    void write_depth(RGResource image, VkAttachmentLoadOp load = VK_ATTACHMENT_LOAD_OP_CLEAR, float clear = 1.0f);
+    void read_depth(RGResource image);  // depth test only
+    void read_image(RGResource image, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    void write_storage_image(RGResource image, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    void read_buffer(RGResource buffer, VkPipelineStageFlags stages, VkAccessFlags access = VK_ACCESS_SHADER_READ_BIT);
+    void write_buffer(RGResource buffer, VkPipelineStageFlags stages,
+                      VkAccessFlags access = VK_ACCESS_SHADER_WRITE_BIT);
+    void copy_from(RGResource resource);  // transfer source
+    void copy_to(RGResource resource);    // transfer destination
+
+    void set_side_effect() { side_effect = true; }  // never culled, e.g. readback or debug output
+
+    void set_clear(RGResource attachment, VkClearValue clear);
+
+    const std::vector<RGUse>& get_uses() const { return uses; }
+    VkRenderPass              get_render_pass() const { return render_pass; }
+    uint32_t                  get_subpass() const { return subpass; }  // pipelines are created for this subpass
+
+protected:
+    friend class RenderGraph;
+
+    uint32_t           index;
+    std::vector<RGUse> uses;
+    bool               side_effect = false;
+    bool               live        = false;
+    VkRenderPass       render_pass = VK_NULL_HANDLE;
+    uint32_t           subpass     = 0;  // > 0 when merged into the render pass of the previous raster pass
+    VkExtent2D         extent      = {0, 0};
+
+    RGUse& add(RGResource resource, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access,
+               bool write);
+    std::vector<const RGUse*> attachments() const;  // color attachments in declaration order, then depth
+};
+
+// Attachment traffic of one frame as implied by the load and store ops, what a tiler moves between
+// tile memory and DRAM. Clears and DONT_CARE ops are free.
+struct RGStats {
+    uint32_t render_passes = 0;
+    uint32_t subpasses     = 0;
+    uint64_t load_bytes    = 0;
+    uint64_t store_bytes   = 0;
+};
+
+/**
+ * @brief Frame render graph: passes declare the resources they read and write, the graph orders them,
+ *        drops what does not contribute to an output and inserts every barrier and layout transition.
+ *
+ * The graph is built once (passes keep their execute callbacks) and compiled when it changes:
+ *  - passes not reachable from an output or a side-effect pass through read-after-write edges are culled;
+ *  - the remaining passes are sorted topologically on their read/write hazards, ties keep declaration
+ *    order, so two writers of the same resource run in the order they were added;
+ *  - transient images get one VkImage each, and images whose lifetimes do not overlap share memory;
+ *  - each raster pass gets a VkRenderPass, cached by attachment setup, with DONT_CARE stores for
+ *    attachments no later pass reads;
+ *  - image and buffer barriers are derived by replaying the uses in order.
+ * With set_merge_subpasses(), a raster pass that only loads and writes the attachments of the raster
+ * pass right before it becomes another subpass of the same VkRenderPass. The attachments then stay in
+ * tile memory in between, the by-region subpass dependency replaces the barrier.
+ * Imported images (the backbuffer) are rebound every frame with set_image().
+ *
+ * A new extent only recreates the transient images and the framebuffers on the next execute, sorting,
+ * render passes and barriers are kept. With set_retire() the replaced objects are handed to the retire
+ * function instead of being destroyed right away, so resizing does not have to wait for the GPU.
+ *
+ * Transient images are shared by all frames in flight. Their first barrier in a frame waits on every
+ * stage that touches their memory, which orders them against the previous frame on the same queue.
+ */
+class RenderGraph {
+public:
+    RenderGraph();
+    ~RenderGraph();
+
+    void init(VkDevice device, VulkanAllocator* allocator);
+    void destroy();
+
+    RGResource import_image(const std::string& name, const RGImageDesc& desc, VkImageLayout initial_layout,
+                            VkImageLayout final_layout, VkPipelineStageFlags initial_stages);
+    RGResource import_buffer(const std::string& name, VkBuffer buffer, VkDeviceSize size);
+    RGResource create_image(const std::string& name, const RGImageDesc& desc);
+    void       set_image(RGResource resource, VkImage image, VkImageView view);
+    void       mark_output(RGResource resource);
+
+    RGPass&    add_pass(const std::string& name, RGPassType type);
+    RGPass&    add_pass_before(const std::string& name, RGPassType type, const std::string& before);  // or last
+    RGPass*    find_pass(const std::string& name);
+    RGResource find_resource(const std::string& name) const;
+
+    void set_retire(RGRetireFn fn) { retire = fn; }
+
+    // Without a retire function the caller makes sure the GPU no longer uses resources of the previous
+    // compile. destroy() always destroys right away.
+    void set_extent(VkExtent2D extent);
+    int  compile();
+    int  resize();  // size dependent resources only, execute() calls it after set_extent()
+    bool is_dirty() const { return dirty; }
+
+    int  execute(VkCommandBuffer cmd);
+    void invalidate_framebuffers(bool deferred = true);  // imported views changed, e.g. after swapchain recreation
+
+    // Takes effect on the next compile, pipelines of merged passes must be created for get_subpass()
+    void set_merge_subpasses(bool merge);
+
+    VkRenderPass   get_render_pass(const std::string& pass);
+    const RGStats& get_stats() const { return stats; }
+    void           dump(std::ostream& os) const;
+
+protected:
+    struct Resource {
+        std::string          name;
+        bool                 is_image       = true;
+        bool                 imported       = false;
+        bool                 output         = false;
+        RGImageDesc          desc;
+        VkExtent2D           extent         = {0, 0};
+        VkImage              image          = VK_NULL_HANDLE;
+        VkImageView          view           = VK_NULL_HANDLE;
+        VkBuffer             buffer         = VK_NULL_HANDLE;
+        VkDeviceSize         size           = 0;
+        VkImageLayout        initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout        final_layout   = VK_IMAGE_LAYOUT_UNDEFINED;  // UNDEFINED keeps the last layout
+        VkPipelineStageFlags initial_stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        VkImageUsageFlags  usage  = 0;
+        VkImageAspectFlags aspect = 0;
+        uint32_t           first  = UINT32_MAX;  // lifetime in sorted pass positions
+        uint32_t           last   = 0;
+        int                slot   = -1;  // memory slot of a transient image
+    };
+
+    // Memory shared by transient images with disjoint lifetimes
+    struct MemorySlot {
+        VulkanAllocation                           allocation;
+        VkDeviceSize                               size      = 0;
+        VkDeviceSize                               alignment = 1;
+        uint32_t                                   type_bits = ~0u;
+        VkPipelineStageFlags                       stages    = 0;  // every stage any occupant is used in
+        VkAccessFlags                              access    = 0;  // every write access of any occupant
+        std::vector<std::pair<uint32_t, uint32_t>> lifetimes;
+    };
+
+    struct Barrier {
+        RGResource    resource;
+        VkImageLayout old_layout;
+        VkImageLayout new_layout;
+        VkAccessFlags src_access;
+        VkAccessFlags dst_access;
+    };
+
+    struct BarrierBatch {
+        VkPipelineStageFlags src_stages = 0;
+        VkPipelineStageFlags dst_stages = 0;
+        std::vector<Barrier> barriers;
+    };
+
+    VkDevice         device    = VK_NULL_HANDLE;
+    VulkanAllocator* allocator = nullptr;
+    VkExtent2D       extent    = {0, 0};
+    bool             dirty     = true;
+    bool             resized   = false;
+    bool             merge     = false;
+    RGStats          stats;
+    RGRetireFn       retire;
+
+    std::vector<Resource>                resources;
+    std::vector<std::unique_ptr<RGPass>> passes;          // stable, add_pass hands out references
+    std::vector<uint32_t>                order;           // live passes in execution order
+    std::vector<BarrierBatch>            pass_barriers;   // recorded before each pass in order
+    BarrierBatch                         final_barriers;
+    std::vector<MemorySlot>              slots;
+
+    std::map<std::vector<uint64_t>, VkRenderPass>  render_passes;
+    std::map<std::vector<uint64_t>, VkFramebuffer> framebuffers;
+
+    void cull_and_sort();
+    void resolve_extents();
+    void compute_lifetimes();
+    void decide_store_ops();
+    void merge_subpasses();
+    int  create_transients();
+    void destroy_transients(bool deferred = true);
+    int  create_render_passes();
+    void build_barriers();
+    void compute_stats();
+
+    uint32_t      group_size(uint32_t pos) const;  // number of subpasses of the render pass begun at pos
+    bool          can_merge(const RGPass& prev, const RGPass& pass) const;
+    VkRenderPass  render_pass_for(uint32_t pos);
+    VkFramebuffer framebuffer_for(const RGPass& pass);
+    void          record_barriers(VkCommandBuffer cmd, const BarrierBatch& batch);
+};
+
+}  // namespace fl
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fl {
+
+// One GLSL file compiled to SPIR-V, the arguments of add_spirv_shader in src/CMakeLists.txt
+struct ShaderSource {
+    std::string glsl;   // relative to the shader directory
+    std::string stage;  // glslc -fshader-stage name: vertex, fragment, compute, rgen, rmiss, rchit, ...
+    std::string spirv;  // what the pipeline reads, relative to the output directory
+};
+
+/**
+ * @brief Recompiles GLSL when it changes on disk and rebuilds the pipelines using it between frames.
+ *
+ * A background thread watches the shader directory (inotify on Linux, file times polled elsewhere)
+ * and compiles every watched shader whose source or one of its #includes changed, in process with
+ * shaderc when the build found it (FL_HAS_SHADERC) or by running glslc otherwise. Compile errors are
+ * printed and leave the old SPIR-V in place.
+ *
+ * apply() is called by the render thread at the frame boundary: the new SPIR-V becomes what
+ * compiled() returns, which VulkanImpl::getShaderModule prefers over the embedded and file versions,
+ * and the reload function of every pipeline using it runs. A reload builds the new pipeline first and
+ * only then swaps it in, retiring the old one, so a failed reload keeps drawing with what it had.
+ * The scene pipeline, VulkanGpuScene, VulkanMeshletCull and both ray tracing backends watch the
+ * shaders they are built from; pipelines that do not call watch() are not reloaded.
+ */
+class ShaderManager {
+public:
+    ShaderManager() {}
+    ~ShaderManager() { stop(); }
+
+    int  start(const std::string& shader_dir, const std::string& output_dir = ".");  // output for glslc
+    void stop();
+    bool running() const { return worker.joinable(); }
+
+    // After start(). reload runs from apply() once any of sources compiled again and returns 0 when it
+    // swapped the pipeline. The id is for unwatch, before whatever reload refers to goes away.
+    uint32_t watch(const std::vector<ShaderSource>& sources, std::function<int()> reload);
+    void     unwatch(uint32_t id);
+
+    // Number of pipelines reloaded
+    uint32_t apply();
+
+    // The newest SPIR-V apply() took in for a watched shader, nullptr before it was first saved
+    const std::vector<uint32_t>* compiled(const std::string& spirv) const;
+
+    struct Stats {
+        uint32_t compiles   = 0;
+        uint32_t failures   = 0;  // compile errors
+        uint32_t reloads    = 0;
+        double   compile_ms = 0;  // of the last batch of changes
+    };
+    Stats get_stats();
+
+protected:
+    struct Shader {
+        ShaderSource          source;
+        std::set<std::string> includes;  // every file it includes, directly or not
+    };
+
+    struct Watcher {
+        uint32_t                 id;
+        std::vector<std::string> spirv;
+        std::function<int()>     reload;
+    };
+
+    std::string      shader_dir, output_dir;
+    std::thread      worker;
+    std::atomic_bool quit{false};
+    int              notify_fd = -1;  // inotify instance on Linux
+
+    // render thread only
+    std::vector<Watcher>                         watchers;
+    uint32_t                                     next_id = 0;
+    std::map<std::string, std::vector<uint32_t>> applied;
+
+    std::mutex                                   mutex;    // everything below, shared with the worker
+    std::map<std::string, Shader>                shaders;  // by spirv
+    std::map<std::string, std::vector<uint32_t>> ready;    // compiled, waiting for apply()
+    Stats                                        stats;
+
+    void run();
+    void compile_changed(const std::set<std::string>& changed);
+    int  compile(const ShaderSource& source, std::vector<uint32_t>& code, std::string& log);
+    void scan_includes(const std::string& glsl, std::set<std::string>& includes);
+};
+
+}  // namespace fl
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fl/system/Hash.hpp"
+
+namespace fl {
+
+// SPIR-V compiled into the binary by tools/embed_spirv.py, hash is fnv1a of the code
+struct EmbeddedShader {
+    const char*     name;  // file name the build wrote, e.g. "vert.spv"
+    const uint32_t* code;
+    size_t          words;
+    uint64_t        hash;
+};
+
+extern const EmbeddedShader embedded_shaders[];
+extern const size_t         embedded_shader_count;
+
+const EmbeddedShader* find_embedded_shader(const std::string& name);
+
+/**
+ * @brief Shader modules shared by every pipeline, one per distinct SPIR-V.
+ *
+ * Modules are looked up by the hash of their code, compared word by word on a hash match, and live
+ * until destroy(): pipelines built from the same shader share the module, and rebuilding a pipeline
+ * (a new render pass, a hot reload) does not create it again. Safe to call from any thread.
+ */
+class ShaderModuleRegistry {
+public:
+    void create(VkDevice device);
+    void destroy();
+
+    VkShaderModule get(const uint32_t* code, size_t words, uint64_t hash);
+    VkShaderModule get(const std::vector<uint32_t>& code);
+
+    struct Stats {
+        uint32_t modules = 0;
+        uint32_t hits    = 0;  // gets answered with an existing module
+        uint32_t misses  = 0;
+    };
+    Stats get_stats();
+
+protected:
+    struct Module {
+        std::vector<uint32_t> code;
+        VkShaderModule        module;
+    };
+
+    VkDevice                                          device = VK_NULL_HANDLE;
+    std::mutex                                        mutex;
+    std::unordered_map<uint64_t, std::vector<Module>> modules;  // by hash, more than one on a collision
+    Stats                                             stats;
+};
+
+}  // namespace fl
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <vector>
+
+#include "fl/render/RayTracing.hpp"
+#include "fl/render/VulkanAllocator.hpp"
+#include "fl/render/VulkanFrame.hpp"
+
+namespace fl {
+
+// Entry points of VK_KHR_acceleration_structure and VK_KHR_ray_tracing_pipeline, which the loader
+// does not export and have to be fetched from the device
+struct RayTracingFunctions {
+    PFN_vkCreateAccelerationStructureKHR              create_acceleration_structure                = nullptr;
+    PFN_vkDestroyAccelerationStructureKHR             destroy_acceleration_structure               = nullptr;
+    PFN_vkGetAccelerationStructureBuildSizesKHR       get_acceleration_structure_build_sizes       = nullptr;
+    PFN_vkGetAccelerationStructureDeviceAddressKHR    get_acceleration_structure_device_address    = nullptr;
+    PFN_vkCmdBuildAccelerationStructuresKHR           cmd_build_acceleration_structures            = nullptr;
+    PFN_vkCmdCopyAccelerationStructureKHR             cmd_copy_acceleration_structure              = nullptr;
+    PFN_vkCmdWriteAccelerationStructuresPropertiesKHR cmd_write_acceleration_structures_properties = nullptr;
+    PFN_vkCreateRayTracingPipelinesKHR                create_ray_tracing_pipelines                 = nullptr;
+    PFN_vkGetRayTracingShaderGroupHandlesKHR          get_ray_tracing_shader_group_handles         = nullptr;
+    PFN_vkCmdTraceRaysKHR                             cmd_trace_rays                               = nullptr;
+
+    int load(VkDevice device);
+};
+
+/**
+ * @brief Bottom and top level acceleration structures of a ray traced scene.
+ *
+ * Mesh positions and indices are appended to shared buffers, which the hit shaders also read through
+ * the bindless set. New geometry is copied at the start of the next record() through a per-frame
+ * staging buffer, and every BLAS waiting for its first build is built in the same batch, one
+ * vkCmdBuildAccelerationStructuresKHR for all of them.
+ *
+ * Static meshes are built for fast tracing with compaction allowed; their compacted size is queried
+ * in the building frame and, once that frame has retired, the BLAS is copied into a compacted one. Dynamic
+ * meshes are built for fast builds with updates allowed, and refit in place after update_mesh().
+ *
+ * The TLAS is rebuilt every frame from the live instances, written into a host visible instance
+ * buffer per frame slot, so moving instances only costs a memcpy on the CPU.
+ *
+ * Removed meshes keep their space in the geometry buffers. All functions are meant to be called by
+ * the render thread.
+ */
+class VulkanAccelerationStructures {
+public:
+    VulkanAccelerationStructures();
+    ~VulkanAccelerationStructures();
+
+    int  create(VulkanImpl* impl, RenderData* data, const RayTracingFunctions* fn, const RTSceneDesc& desc);
+    void destroy();
+
+    RTHandle add_mesh(const RTMeshDesc& desc);
+    void     update_mesh(RTHandle mesh, const glm::vec3* positions);
+    void     remove_mesh(RTHandle mesh);
+    RTHandle add_instance(const RTInstance& instance);
+    void     set_transform(RTHandle instance, const glm::mat4& transform);
+    void     remove_instance(RTHandle instance);
+
+    // Copies, builds, refits, compacts and rebuilds the TLAS, outside a render pass. Ends with the TLAS
+    // visible to ray tracing shaders.
+    void record(VkCommandBuffer cmd);
+
+    VkDeviceAddress get_tlas_address() const { return tlas.address; }
+
+    // Bindless storage buffers the hit shaders fetch triangles from, see shader/rt_common.glsl
+    BindlessHandle get_meshes() const { return mesh_buffer.handle; }
+    BindlessHandle get_positions() const { return position_buffer.handle; }
+    BindlessHandle get_indices() const { return index_buffer.handle; }
+
+    struct Stats {
+        uint64_t blas_builds     = 0;
+        uint64_t build_batches   = 0;  // vkCmdBuildAccelerationStructuresKHR calls for new BLASes
+        uint64_t refits          = 0;
+        uint64_t compactions     = 0;
+        uint64_t compacted_bytes = 0;  // BLAS memory given back by compaction
+        uint64_t tlas_builds     = 0;
+        uint32_t instances       = 0;  // in the last TLAS
+    };
+    const Stats& get_stats() const { return stats; }
+
+protected:
+    struct Buffer {
+        VkBuffer         buffer = VK_NULL_HANDLE;
+        VulkanAllocation allocation;
+        VkDeviceSize     size    = 0;
+        VkDeviceAddress  address = 0;
+        BindlessHandle   handle  = BINDLESS_INVALID;
+    };
+
+    struct AccelerationStructure {
+        VkAccelerationStructureKHR handle = VK_NULL_HANDLE;
+        Buffer                     buffer;
+        VkDeviceAddress            address = 0;
+    };
+
+    enum class MeshState { Free, Pending, Built, Compacted };
+
+    struct Mesh {
+        MeshState             state        = MeshState::Free;
+        bool                  dynamic      = false;
+        bool                  refit        = false;  // positions changed since the last build
+        uint32_t              first_vertex = 0;
+        uint32_t              vertex_count = 0;
+        uint32_t              first_index  = 0;
+        uint32_t              index_count  = 0;
+        AccelerationStructure blas;
+    };
+
+    struct Instance {
+        RTInstance desc;
+        bool       live = false;
+    };
+
+    // Geometry waiting to be copied, its bytes are in pending_bytes
+    struct PendingCopy {
+        VkBuffer     buffer;
+        VkDeviceSize offset;
+        size_t       source;
+        VkDeviceSize size;
+    };
+
+    // BLASes whose compacted size is written into pool by the frame with the given serial
+    struct Compaction {
+        VkQueryPool           pool   = VK_NULL_HANDLE;
+        uint64_t              serial = 0;
+        std::vector<RTHandle> meshes;
+    };
+
+    VulkanImpl*                impl = nullptr;
+    RenderData*                data = nullptr;
+    const RayTracingFunctions* fn   = nullptr;
+    RTSceneDesc                desc;
+    VkDeviceSize               scratch_alignment = 256;
+
+    Buffer                position_buffer, index_buffer, mesh_buffer, scratch;
+    Buffer                staging[MAX_FRAMES_IN_FLIGHT];
+    Buffer                instance_buffers[MAX_FRAMES_IN_FLIGHT];  // host visible VkAccelerationStructureInstanceKHR
+    AccelerationStructure tlas;
+    uint32_t              tlas_capacity = 0;
+
+    std::vector<Mesh>                  meshes;
+    std::vector<Instance>              instances;
+    std::vector<RTHandle>              free_instances;
+    std::vector<PendingCopy>           pending;
+    std::vector<uint8_t>               pending_bytes;
+    std::vector<Compaction>            compactions;
+    std::vector<std::function<void()>> replaced;  // frees what the frame being recorded may still use, next frame
+    uint32_t                           vertex_count = 0;
+    uint32_t                           index_count  = 0;
+    Stats                              stats;
+
+    int  create_buffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool host_visible = false);
+    void destroy_buffer(Buffer& buffer);
+    int  create_structure(AccelerationStructure& as, VkAccelerationStructureTypeKHR type, VkDeviceSize size);
+    void destroy_structure(AccelerationStructure& as);
+    void replace_structure(AccelerationStructure& as);  // destroyed once the frames that may use it are done
+    int  reserve_scratch(VkDeviceSize size);
+    void queue_copy(VkBuffer buffer, VkDeviceSize offset, const void* bytes, VkDeviceSize size);
+
+    VkAccelerationStructureGeometryKHR mesh_geometry(const Mesh& mesh) const;
+
+    void record_copies(VkCommandBuffer cmd);
+    void record_blas_builds(VkCommandBuffer cmd);
+    void record_compactions(VkCommandBuffer cmd);
+    void record_tlas_build(VkCommandBuffer cmd);
+};
+
+}  // namespace fl
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace fl {
+
+struct MemoryBlock;
+
+// Linear resources (buffers, linear images) and optimal-tiling images never share a block, which keeps
+// every allocation clear of bufferImageGranularity conflicts without tracking neighbours.
+enum class AllocationKind { Linear = 0, Optimal = 1 };
+
+struct VulkanAllocation {
+    VkDeviceMemory memory      = VK_NULL_HANDLE;
+    VkDeviceSize   offset      = 0;
+    VkDeviceSize   size        = 0;        // size requested by the resource
+    void*          mapped      = nullptr;  // host address of offset, only for host visible memory
+    uint32_t       memory_type = 0;
+
+    MemoryBlock* block = nullptr;  // owning block, nullptr for a dedicated allocation
+    uint32_t     order = 0;        // buddy order inside the block
+
+    bool valid() const { return memory != VK_NULL_HANDLE; }
+};
+
+/**
+ * @brief Sub-allocates device memory for buffers and images.
+ *
+ * Memory is taken from the driver in large blocks (block_size, power of two) per memory type and
+ * handed out with a buddy allocator: sizes are rounded up to a power of two of at least min_size, so
+ * every range is naturally aligned to its own size and any alignment up to that size comes for free.
+ * Requests larger than half a block, or resources the driver prefers to own their memory
+ * (VkMemoryDedicatedRequirements), get a dedicated vkAllocateMemory. Host visible blocks stay mapped.
+ *
+ * Defragmentation is driven by the caller: begin_defragmentation() picks allocations from the
+ * emptiest blocks and reserves new ranges for them in fuller blocks, the caller copies the contents
+ * and rebinds its resources, then end_defragmentation() releases the old ranges and empty blocks once
+ * the GPU no longer reads them.
+ *
+ * All public functions are thread safe.
+ */
+class VulkanAllocator {
+public:
+    struct Stats {
+        uint32_t     block_count        = 0;
+        uint32_t     allocation_count   = 0;
+        uint32_t     dedicated_count    = 0;
+        VkDeviceSize block_bytes        = 0;
+        VkDeviceSize used_bytes         = 0;  // bytes handed out of blocks, including buddy rounding
+        VkDeviceSize dedicated_bytes    = 0;
+        VkDeviceSize largest_free_range = 0;
+    };
+
+    struct DefragMove {
+        VulkanAllocation* allocation;   // the caller's allocation, updated to the new range on end
+        VulkanAllocation  destination;  // already reserved, copy the contents here
+    };
+
+    VulkanAllocator();
+    ~VulkanAllocator();
+
+    // device_address: linear memory is allocated with VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT, so buffers
+    // created with SHADER_DEVICE_ADDRESS usage can be bound anywhere. Needs the bufferDeviceAddress feature.
+    void init(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize block_size = 64ull << 20,
+              bool device_address = false);
+    void destroy();
+
+    int  allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+                  VkMemoryPropertyFlags preferred, AllocationKind kind, bool dedicated, VulkanAllocation& out);
+    void free(VulkanAllocation& allocation);
+
+    int  create_buffer(const VkBufferCreateInfo& info, VkMemoryPropertyFlags required, VkBuffer& buffer,
+                       VulkanAllocation& allocation, VkMemoryPropertyFlags preferred = 0);
+    int  create_image(const VkImageCreateInfo& info, VkMemoryPropertyFlags required, VkImage& image,
+                      VulkanAllocation& allocation);
+    void destroy_buffer(VkBuffer buffer, VulkanAllocation& allocation);
+    void destroy_image(VkImage image, VulkanAllocation& allocation);
+
+    std::vector<DefragMove> begin_defragmentation(const std::vector<VulkanAllocation*>& movable,
+                                                  VkDeviceSize                          max_bytes);
+    void                    end_defragmentation(std::vector<DefragMove>& moves);
+    void                    release_empty_blocks();
+
+    Stats get_stats(uint32_t memory_type) const;
+    void  dump_stats(std::ostream& out) const;
+
+    VkDeviceSize min_size = 256;
+
+protected:
+    VkPhysicalDevice                 physical_device   = VK_NULL_HANDLE;
+    VkDevice                         device            = VK_NULL_HANDLE;
+    VkDeviceSize                     block_size        = 0;
+    bool                             device_address    = false;
+    VkPhysicalDeviceMemoryProperties memory_properties = {};
+
+    std::vector<std::unique_ptr<MemoryBlock>> blocks;
+    Stats                                     dedicated_stats[VK_MAX_MEMORY_TYPES];
+    uint32_t                                  memory_objects = 0;  // counts against maxMemoryAllocationCount
+    mutable std::mutex                        mutex;
+
+    int  find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred);
+    int  allocate_dedicated(const VkMemoryRequirements& requirements, uint32_t memory_type, VkBuffer buffer,
+                            VkImage image, VulkanAllocation& out);
+    int  allocate_locked(const VkMemoryRequirements& requirements, uint32_t memory_type, AllocationKind kind,
+                         const MemoryBlock* exclude, VulkanAllocation& out);
+    void free_locked(VulkanAllocation& allocation);
+
+    MemoryBlock* create_block(uint32_t memory_type, AllocationKind kind);
+    void         destroy_block(MemoryBlock* block);
+
+    uint32_t     order_for(VkDeviceSize size) const;
+    VkDeviceSize size_of(uint32_t order) const { return min_size << order; }
+};
+
+// Internal per-block bookkeeping, exposed so VulkanAllocation can point at it
+struct MemoryBlock {
+    VkDeviceMemory memory      = VK_NULL_HANDLE;
+    VkDeviceSize   size        = 0;
+    void*          mapped      = nullptr;
+    uint32_t       memory_type = 0;
+    AllocationKind kind        = AllocationKind::Linear;
+
+    std::vector<std::set<VkDeviceSize>> free_lists;  // free offsets per buddy order
+    VkDeviceSize                        used             = 0;
+    uint32_t                            allocation_count = 0;
+};
+
+}  // namespace fl
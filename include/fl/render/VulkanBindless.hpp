@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace fl {
+
+// Index into one of the bindless arrays, what shaders receive through push constants or buffers
+using BindlessHandle = uint32_t;
+
+constexpr BindlessHandle BINDLESS_INVALID = ~0u;
+
+// Bindings of the bindless set, must match shader/bindless.glsl
+enum BindlessBinding : uint32_t {
+    BINDLESS_SAMPLED_IMAGES  = 0,
+    BINDLESS_SAMPLERS        = 1,
+    BINDLESS_STORAGE_BUFFERS = 2,
+    BINDLESS_STORAGE_IMAGES  = 3,
+    BINDLESS_BINDING_COUNT
+};
+
+// Array sizes asked for, clamped to the device's update-after-bind limits by VulkanBindless::create()
+struct BindlessLimits {
+    uint32_t sampled_images  = 16384;
+    uint32_t samplers        = 256;
+    uint32_t storage_buffers = 8192;
+    uint32_t storage_images  = 1024;
+};
+
+/**
+ * @brief One large update-after-bind descriptor set that every pipeline shares, indexed by integer handles.
+ *
+ * The set holds an array per descriptor kind: sampled images, samplers, storage buffers and storage
+ * images. add_*() reserves a slot and returns its index; shaders index the arrays with it, so a draw
+ * only pushes a few handles instead of binding descriptor sets, and thousands of sprites or materials
+ * can share one pipeline and one bind per command buffer.
+ *
+ * The bindings are UPDATE_AFTER_BIND and PARTIALLY_BOUND: slots may be written while frames that use
+ * the set are recorded or in flight, as long as those frames do not access them. Writes are queued and
+ * applied by flush() once per frame. A removed slot is only reused after the frames that may still
+ * reference it retired, through the retire function VulkanImpl provides.
+ *
+ * The pipeline layout is the bindless set plus a push constant range for every stage; every pipeline
+ * built on it is layout compatible, so the set stays bound across pipeline switches.
+ *
+ * add and remove are thread safe, flush() and bind() are meant to be called by the render thread.
+ */
+class VulkanBindless {
+public:
+    VulkanBindless();
+    ~VulkanBindless();
+
+    static constexpr uint32_t push_constant_size = 128;  // the minimum every device supports
+
+    int  create(VkPhysicalDevice physical_device, VkDevice device, const BindlessLimits& limits = BindlessLimits());
+    void destroy();
+
+    // Called with the deferred release of removed slots, which must run once the frames submitted so
+    // far have finished. Without one, slots are released immediately.
+    void set_retire(std::function<void(std::function<void()>)> fn) { retire = fn; }
+
+    BindlessHandle add_texture(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    BindlessHandle add_sampler(VkSampler sampler);
+    BindlessHandle add_buffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+    BindlessHandle add_storage_image(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+
+    // Points an existing slot at another resource, e.g. after a texture was streamed in
+    void update_texture(BindlessHandle handle, VkImageView view,
+                        VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    void update_buffer(BindlessHandle handle, VkBuffer buffer, VkDeviceSize offset = 0,
+                       VkDeviceSize range = VK_WHOLE_SIZE);
+
+    void remove_texture(BindlessHandle handle) { remove(BINDLESS_SAMPLED_IMAGES, handle); }
+    void remove_sampler(BindlessHandle handle) { remove(BINDLESS_SAMPLERS, handle); }
+    void remove_buffer(BindlessHandle handle) { remove(BINDLESS_STORAGE_BUFFERS, handle); }
+    void remove_storage_image(BindlessHandle handle) { remove(BINDLESS_STORAGE_IMAGES, handle); }
+    // Removing BINDLESS_INVALID does nothing, removing a slot that is not live is reported and ignored
+
+    void flush();  // applies the queued writes with one vkUpdateDescriptorSets
+    void bind(VkCommandBuffer cmd, VkPipelineBindPoint bind_point) const;
+
+    VkDescriptorSetLayout get_set_layout() const { return set_layout; }
+    VkPipelineLayout      get_pipeline_layout() const { return pipeline_layout; }
+    VkDescriptorSet       get_set() const { return set; }
+    uint32_t              capacity(BindlessBinding binding) const { return arrays[binding].capacity; }
+    bool                  is_created() const { return set != VK_NULL_HANDLE; }
+
+    struct Stats {
+        uint64_t writes  = 0;  // descriptors written by flush()
+        uint64_t flushes = 0;  // flushes that had something to write
+        uint64_t full    = 0;  // adds that failed because the array was full
+        uint32_t live[BINDLESS_BINDING_COUNT] = {};  // slots handed out and not removed, per binding
+    };
+    Stats get_stats();
+
+protected:
+    struct Array {
+        uint32_t              capacity = 0;
+        uint32_t              next     = 0;  // slots below next have been handed out at least once
+        std::vector<uint32_t> free;
+        std::vector<bool>     live;  // per slot below next, handed out and not removed
+    };
+
+    struct Write {
+        BindlessBinding binding;
+        uint32_t        index;
+        union {
+            VkDescriptorImageInfo  image;
+            VkDescriptorBufferInfo buffer;
+        };
+    };
+
+    VkDevice              device          = VK_NULL_HANDLE;
+    VkDescriptorSetLayout set_layout      = VK_NULL_HANDLE;
+    VkPipelineLayout      pipeline_layout = VK_NULL_HANDLE;
+    VkDescriptorPool      pool            = VK_NULL_HANDLE;
+    VkDescriptorSet       set             = VK_NULL_HANDLE;
+
+    std::mutex         mutex;
+    Array              arrays[BINDLESS_BINDING_COUNT];
+    std::vector<Write> pending;
+    Stats              stats;
+
+    std::function<void(std::function<void()>)> retire;
+
+    BindlessHandle allocate(BindlessBinding binding);
+    void           queue(const Write& write);
+    void           remove(BindlessBinding binding, BindlessHandle handle);
+};
+
+}  // namespace fl
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "fl/render/VulkanAllocator.hpp"
+#include "fl/render/VulkanBindless.hpp"
+
+namespace fl {
+
+class VulkanImpl;
+
+// Completion handle of compute work: the compute timeline semaphore reaching value
+struct ComputeToken {
+    uint64_t value = 0;
+};
+
+/**
+ * @brief A compute pipeline created from SPIR-V on the shared bindless layout.
+ *
+ * Shaders reach their buffers and images through bindless handles passed in push constants, so a
+ * pipeline needs no descriptor setup of its own and any number of them share one bind of the set.
+ */
+class ComputePipeline {
+public:
+    int  create(VulkanImpl* impl, const std::string& spirv_path, const char* entry = "main");
+    int  create(VulkanImpl* impl, const std::vector<uint32_t>& code, const char* entry = "main");
+    void destroy();
+
+    VkPipeline get() const { return pipeline; }
+
+protected:
+    VulkanImpl* impl     = nullptr;
+    VkPipeline  pipeline = VK_NULL_HANDLE;
+
+    int create_pipeline(VkShaderModule module, const char* entry);
+};
+
+/**
+ * @brief Storage buffer shared by the compute and graphics queues, registered in the bindless set.
+ *
+ * When the two queues come from different families the buffer is created with concurrent sharing, so
+ * no ownership transfers are needed between a dispatch and the draws that read its results.
+ */
+class ComputeBufferBase {
+public:
+    int  create(VulkanImpl* impl, VkDeviceSize size, VkBufferUsageFlags usage = 0, bool host_visible = false);
+    void destroy();
+
+    VkBuffer       buffer() const { return buf; }
+    VkDeviceSize   size_bytes() const { return bytes; }
+    BindlessHandle handle() const { return bindless; }  // what shaders index the storage buffer array with
+
+protected:
+    VulkanImpl*      impl = nullptr;
+    VkBuffer         buf  = VK_NULL_HANDLE;
+    VulkanAllocation allocation;
+    VkDeviceSize     bytes    = 0;
+    BindlessHandle   bindless = BINDLESS_INVALID;
+};
+
+// Array of count elements of T, T laid out like the std430 struct the shader declares
+template <typename T>
+class ComputeBuffer : public ComputeBufferBase {
+public:
+    int create(VulkanImpl* impl, size_t count, VkBufferUsageFlags usage = 0, bool host_visible = false) {
+        elements = count;
+        return ComputeBufferBase::create(impl, (VkDeviceSize)(count * sizeof(T)), usage, host_visible);
+    }
+
+    size_t size() const { return elements; }
+    T*     data() { return (T*)allocation.mapped; }  // host visible buffers only, nullptr otherwise
+
+protected:
+    size_t elements = 0;
+};
+
+/**
+ * @brief Records compute work and submits it to a dedicated async compute queue when the device has one.
+ *
+ * Work is recorded into a batch with dispatch() and barrier() and submitted by submit(), which signals
+ * the next value of the context's timeline semaphore and returns it as a ComputeToken. The graphics side
+ * makes a frame wait for a token with VulkanImpl::wait_compute(), on the GPU only. The other direction
+ * goes through the frame timeline: wait_frame(serial) makes the next submit wait until the graphics
+ * queue finished that frame, e.g. to post-process what it rendered.
+ *
+ * Without a dedicated queue the compute work goes to a compute capable queue of another family, or to
+ * the graphics queue itself; the semaphores keep the same ordering in every case, only the overlap is
+ * lost. Batches are recycled once their timeline value has been reached.
+ *
+ * Meant to be used by the render thread, which also owns the graphics queue.
+ */
+class ComputeContext {
+public:
+    ComputeContext();
+    ~ComputeContext();
+
+    int  create(VulkanImpl* impl, VkQueue queue, uint32_t queue_family, VkQueue graphics_queue,
+                uint32_t graphics_family);
+    void destroy();
+
+    void set_frame_timeline(VkSemaphore semaphore) { frame_timeline = semaphore; }
+
+    VkCommandBuffer begin();  // the batch being recorded, begun on first use
+    void            dispatch(const ComputePipeline& pipeline, uint32_t x, uint32_t y = 1, uint32_t z = 1);
+    template <typename T>
+    void dispatch(const ComputePipeline& pipeline, const T& constants, uint32_t x, uint32_t y = 1, uint32_t z = 1) {
+        static_assert(sizeof(T) <= VulkanBindless::push_constant_size, "push constants are limited to 128 bytes");
+        push(&constants, sizeof(T));
+        dispatch(pipeline, x, y, z);
+    }
+    void barrier();  // orders the dispatches before it against the ones after it
+    void wait_frame(uint64_t serial);
+
+    ComputeToken submit();
+    bool         is_complete(ComputeToken token);
+    void         wait(ComputeToken token);
+
+    VkSemaphore timeline() const { return semaphore; }
+    bool        is_async() const { return queue != graphics_queue; }  // may run alongside the graphics queue
+    uint32_t    get_family() const { return family; }
+    uint32_t    get_graphics_family() const { return graphics_family; }
+
+    struct Stats {
+        uint64_t batches     = 0;
+        uint64_t dispatches  = 0;
+        uint64_t frame_waits = 0;  // batches that waited on the graphics queue
+    };
+    Stats stats;
+
+protected:
+    struct Batch {
+        VkCommandBuffer cmd   = VK_NULL_HANDLE;
+        uint64_t        value = 0;
+    };
+
+    VulkanImpl*   impl            = nullptr;
+    VkDevice      device          = VK_NULL_HANDLE;
+    VkQueue       queue           = VK_NULL_HANDLE;
+    VkQueue       graphics_queue  = VK_NULL_HANDLE;
+    uint32_t      family          = 0;
+    uint32_t      graphics_family = 0;
+    VkCommandPool command_pool    = VK_NULL_HANDLE;
+    VkSemaphore   semaphore       = VK_NULL_HANDLE;
+    VkSemaphore   frame_timeline  = VK_NULL_HANDLE;
+
+    Batch                        current;
+    uint64_t                     frame_wait = 0;  // frame serial the current batch waits for, 0 for none
+    std::deque<Batch>            in_flight;
+    std::vector<VkCommandBuffer> free_cmds;
+    uint64_t                     next_value = 1;
+
+    void     push(const void* constants, uint32_t size);
+    void     retire();
+    void     drop_batch();  // after a failed submit
+    uint64_t completed_value();
+};
+
+}  // namespace fl
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+#include "fl/render/Bvh.hpp"
+#include "fl/render/RayTracing.hpp"
+#include "fl/render/VulkanCompute.hpp"
+#include "fl/render/VulkanFrame.hpp"
+
+namespace fl {
+
+/**
+ * @brief Ray tracing in a compute shader, for devices without the ray tracing extensions.
+ *
+ * Meshes get a binned SAH BVH built on the CPU, in parallel over the meshes waiting at the next
+ * record(), collapsed to four children per node and stored with the child bounds quantized to
+ * 8 bits per axis on a grid over the node, 64 bytes per node. The nodes and the triangle indices, in
+ * leaf order, are appended to storage buffers through a per-frame staging buffer; dynamic meshes
+ * are refit on the CPU and only their positions and node bounds are copied again.
+ *
+ * The instance BVH is rebuilt on the CPU when instances moved, appeared or went away, and written to
+ * a host visible buffer per frame slot together with the instance records its leaves point at.
+ * shader/rt_compute.glsl traverses both levels and writes the same image as the hardware backend,
+ * from the same primary rays and sample sequence.
+ *
+ * Removed meshes keep their space in the buffers. All functions are meant to be called by the render
+ * thread.
+ */
+class VulkanComputeRayTracing : public IRayTracingBackend {
+public:
+    VulkanComputeRayTracing();
+    ~VulkanComputeRayTracing();
+
+    int         create(VulkanImpl* impl, RenderData* data, const RTSceneDesc& desc = RTSceneDesc()) override;
+    void        destroy() override;
+    const char* name() const override { return "compute"; }
+
+    RTHandle add_mesh(const RTMeshDesc& desc) override;
+    void     update_mesh(RTHandle mesh, const glm::vec3* positions) override;
+    void     remove_mesh(RTHandle mesh) override;
+    RTHandle add_instance(const RTInstance& instance) override;
+    void     set_transform(RTHandle instance, const glm::mat4& transform) override;
+    void     remove_instance(RTHandle instance) override;
+
+    void                 record(VkCommandBuffer cmd, const RTTraceParams& params) override;
+    VkPipelineStageFlags trace_stages() const override { return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT; }
+
+    static constexpr uint32_t group_size = 8;  // local size of rt_compute.glsl in x and y
+
+    struct Stats {
+        uint64_t blas_builds = 0;
+        uint64_t refits      = 0;
+        uint64_t tlas_builds = 0;
+        uint32_t instances   = 0;    // in the last instance BVH
+        uint32_t nodes       = 0;    // mesh BVH nodes in the node buffer
+        double   build_ms    = 0.0;  // CPU time of the last record() that built or refit anything
+    };
+    const Stats& get_stats() const { return stats; }
+
+protected:
+    struct Mesh {
+        bool                   live         = false;
+        bool                   dynamic      = false;
+        bool                   built        = false;
+        bool                   refit        = false;  // positions changed since the last build
+        uint32_t               first_vertex = 0;
+        uint32_t               first_index  = 0;
+        uint32_t               first_node   = 0;
+        Aabb                   bounds;     // object space, for the instance BVH
+        std::vector<glm::vec3> positions;  // until built, kept by dynamic meshes to refit
+        std::vector<uint32_t>  indices;
+        Bvh                    bvh;
+        Bvh4                   bvh4;
+    };
+
+    struct Instance {
+        RTInstance desc;
+        bool       live = false;
+    };
+
+    // Bytes waiting in pending_bytes to be copied to buffer at offset
+    struct PendingCopy {
+        VkBuffer     buffer;
+        VkDeviceSize offset;
+        size_t       source;
+        VkDeviceSize size;
+    };
+
+    VulkanImpl* impl = nullptr;
+    RenderData* data = nullptr;
+    RTSceneDesc desc;
+    uint32_t    max_nodes    = 0;
+    uint32_t    shader_watch = ~0u;  // ShaderManager id of the pipeline reload
+
+    ComputePipeline          pipeline;
+    ComputeBufferBase        position_buffer, index_buffer, node_buffer;
+    ComputeBuffer<uint8_t>   staging[MAX_FRAMES_IN_FLIGHT];
+    ComputeBuffer<uint8_t>   top_buffers[MAX_FRAMES_IN_FLIGHT];  // host visible, the instance BVH and records
+    std::vector<Mesh>        meshes;
+    std::vector<Instance>    instances;
+    std::vector<RTHandle>    free_instances;
+    std::vector<PendingCopy> pending;
+    std::vector<uint8_t>     pending_bytes;
+    Bvh                      tlas;
+    Bvh4                     tlas4;
+    std::vector<uint8_t>     top;  // what every frame slot gets, rebuilt when top_dirty
+    bool                     top_dirty    = true;
+    uint32_t                 vertex_count = 0;
+    uint32_t                 index_count  = 0;
+    Stats                    stats;
+
+    void queue_copy(VkBuffer buffer, VkDeviceSize offset, const void* bytes, VkDeviceSize size);
+    void queue_nodes(const Mesh& mesh);
+
+    void build_meshes();
+    void build_top();
+    void record_copies(VkCommandBuffer cmd);
+};
+
+}  // namespace fl
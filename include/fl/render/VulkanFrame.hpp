@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace fl {
+
+constexpr int MAX_FRAMES_IN_FLIGHT = 3;
+
+/**
+ * @brief Linear allocator for CPU data that only lives while a frame is recorded and in flight.
+ *
+ * Memory is handed out by bumping an offset and released all at once by reset(), which the frame
+ * context calls after the GPU has finished the frame. Pages are kept between frames, so after the
+ * first few frames no heap allocation happens at all.
+ */
+class FrameAllocator {
+public:
+    explicit FrameAllocator(size_t page_size = 64 * 1024);
+    ~FrameAllocator();
+
+    FrameAllocator(const FrameAllocator&) = delete;
+    FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // storage for count trivially destructible objects, nothing is destroyed on reset
+    template <typename T>
+    T* allocate_array(size_t count) {
+        T* items = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; i++) new (items + i) T();
+        return items;
+    }
+
+    void reset();
+
+    size_t used() const;
+    size_t capacity() const;
+
+protected:
+    struct Page {
+        char*  memory;
+        size_t size;
+        size_t offset;
+    };
+    std::vector<Page> pages;
+    size_t            current = 0;
+    size_t            page_size;
+};
+
+/**
+ * @brief Everything owned by one frame slot.
+ *
+ * The command pool is transient and reset as a whole when the slot is reused, after in_flight has
+ * signaled, so command buffers never need VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT and a
+ * buffer can never be re-recorded while the GPU still executes it.
+ */
+struct FrameContext {
+    VkCommandPool   command_pool   = VK_NULL_HANDLE;
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;  // every pass of the render graph is recorded here
+
+    VkSemaphore image_available = VK_NULL_HANDLE;
+    VkSemaphore render_finished = VK_NULL_HANDLE;
+    VkFence     in_flight       = VK_NULL_HANDLE;
+
+    uint64_t serial        = 0;  // number of the frame last submitted from this slot
+    uint64_t transfer_wait = 0;  // upload timeline value the frame's submit waits on, 0 for none
+    uint64_t compute_wait  = 0;  // compute timeline value the frame's submit waits on, 0 for none
+
+    FrameAllocator allocator;
+
+    int  create(VkDevice device, uint32_t queue_family);
+    void reset(VkDevice device);  // only valid once in_flight has signaled
+    void destroy(VkDevice device);
+};
+
+}  // namespace fl
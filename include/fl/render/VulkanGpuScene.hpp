@@ -0,0 +1,171 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+#include "fl/render/VulkanAllocator.hpp"
+#include "fl/render/VulkanBindless.hpp"
+#include "fl/render/VulkanFrame.hpp"
+#include "glm/glm.hpp"
+
+namespace fl {
+
+class VulkanImpl;
+struct RenderData;
+class RGPass;
+
+using GpuHandle                 = uint32_t;
+constexpr GpuHandle GPU_INVALID = ~0u;
+
+// Layouts shared with shader/gpu_scene.glsl, std430
+struct GpuVertex {
+    glm::vec3 position;
+    float     u;
+    glm::vec3 normal;
+    float     v;
+};
+
+struct GpuInstance {
+    glm::mat4 transform;
+    glm::vec4 color;
+    GpuHandle mesh     = GPU_INVALID;  // GPU_INVALID for a free slot, never drawn
+    GpuHandle material = 0;
+    uint32_t  texture  = BINDLESS_INVALID;  // bindless handles, BINDLESS_INVALID draws the plain color
+    uint32_t  sampler  = BINDLESS_INVALID;
+};
+
+struct GpuMesh {
+    glm::vec4 bounds;  // bounding sphere in model space, center and radius
+    uint32_t  index_count;
+    uint32_t  first_index;
+    int32_t   vertex_offset;
+    uint32_t  pad;
+};
+
+// Shaders are SPIR-V files; the vertex shader pulls vertices and instances from the bindless set
+struct GpuMaterial {
+    std::string vertex_shader   = "gpu_scene_vert.spv";
+    std::string fragment_shader = "gpu_scene_frag.spv";
+    bool        alpha_blend     = false;
+};
+
+struct GpuSceneDesc {
+    uint32_t max_instances = 65536;
+    uint32_t max_meshes    = 4096;
+    uint32_t max_materials = 64;
+    uint32_t max_vertices  = 1u << 20;
+    uint32_t max_indices   = 1u << 22;
+};
+
+/**
+ * @brief GPU driven scene: instances live in a storage buffer, a compute pass culls them and writes the
+ *        draw commands, and the CPU records one indirect draw per material whatever the instance count.
+ *
+ * Meshes are appended to one vertex and one index buffer through the uploader. Instances are kept in a
+ * CPU copy; changed ones are copied into the device buffer at the start of the "cull" compute pass, so
+ * a frame only costs what changed since the previous one.
+ *
+ * Every frame the cull pass tests each instance's bounding sphere against the view frustum. A visible
+ * instance takes the next slot of its material's range in the draw buffer (an atomic counter per
+ * material) and gets a VkDrawIndexedIndirectCommand whose firstInstance is the instance index. The
+ * scene pass then records, per material with instances, one vkCmdDrawIndexedIndirectCount that reads
+ * the count back from the same counter. Slots are taken in no particular order, so draws of a material
+ * are not ordered among themselves.
+ *
+ * All functions are meant to be called by the render thread.
+ */
+class VulkanGpuScene {
+public:
+    VulkanGpuScene();
+    ~VulkanGpuScene();
+
+    // Adds the cull pass and the scene draw to the render graph of data. The graph keeps both, so
+    // destroy() belongs to shutdown, before VulkanImpl::cleanup().
+    int  create(VulkanImpl* impl, RenderData* data, const GpuSceneDesc& desc = GpuSceneDesc());
+    void destroy();
+
+    // GPU_INVALID when the mesh is empty, does not fit or cannot be uploaded
+    GpuHandle add_mesh(const GpuVertex* vertices, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count);
+    GpuHandle add_material(const GpuMaterial& material);
+
+    GpuHandle add_instance(const GpuInstance& instance);
+    void      set_instance(GpuHandle handle, const GpuInstance& instance);
+    void      set_transform(GpuHandle handle, const glm::mat4& transform);
+    void      remove_instance(GpuHandle handle);
+
+    const GpuInstance& get_instance(GpuHandle handle) const { return instances[handle]; }
+
+    void set_view_projection(const glm::mat4& view_projection);  // culls against its frustum, clip space is Vulkan's
+    void set_culling(bool enable) { culling = enable; }
+
+    struct Stats {
+        uint32_t instances    = 0;  // live instances
+        uint32_t meshes       = 0;
+        uint32_t materials    = 0;
+        uint32_t draw_calls   = 0;  // indirect draws recorded last frame, one per material with instances
+        uint64_t upload_bytes = 0;  // instance and bucket bytes copied to the GPU, in total
+        uint64_t frames       = 0;
+    };
+    const Stats& get_stats() const { return stats; }
+
+protected:
+    struct Buffer {
+        VkBuffer         buffer = VK_NULL_HANDLE;
+        VulkanAllocation allocation;
+        VkDeviceSize     size   = 0;
+        BindlessHandle   handle = BINDLESS_INVALID;
+    };
+
+    struct Material {
+        GpuMaterial desc;
+        VkPipeline  pipeline  = VK_NULL_HANDLE;
+        uint32_t    instances = 0;  // live instances using it, the size of its range in the draw buffer
+    };
+
+    VulkanImpl*  impl = nullptr;
+    RenderData*  data = nullptr;
+    GpuSceneDesc desc;
+
+    Buffer vertex_buffer, index_buffer, mesh_buffer, instance_buffer, bucket_buffer, draw_buffer, count_buffer;
+    Buffer staging[MAX_FRAMES_IN_FLIGHT];  // host visible, the changes a frame copies into the device buffers
+
+    VkPipeline   cull_pipeline        = VK_NULL_HANDLE;
+    VkRenderPass pipeline_render_pass = VK_NULL_HANDLE;  // render pass the material pipelines were built for
+    RGPass*      cull_pass            = nullptr;
+    uint32_t     cull_watch           = ~0u;  // ShaderManager ids of the pipeline reloads
+    uint32_t     material_watch       = ~0u;
+
+    std::vector<GpuMesh>     meshes;
+    std::vector<uint64_t>    mesh_ready;  // serial of the first frame that has acquired the mesh's uploads
+    std::vector<Material>    materials;
+    std::vector<GpuInstance> instances;  // CPU copy of the instance buffer, slots below instance_count in use
+    std::vector<uint32_t>    free_instances;
+    std::vector<uint32_t>    dirty;  // instance slots to upload, each once
+    std::vector<uint8_t>     dirty_flags;
+    uint32_t                 instance_count = 0;
+    uint32_t                 vertex_count   = 0;
+    uint32_t                 index_count    = 0;
+    bool                     buckets_dirty  = true;
+
+    glm::vec4 planes[6];
+    glm::mat4 view_projection = glm::mat4(1.0f);
+    bool      culling         = true;
+    Stats     stats;
+
+    int  create_buffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool host_visible = false);
+    void destroy_buffer(Buffer& buffer);
+    int  create_cull_pipeline();
+    int  create_material_pipeline(Material& material);
+    int  update_pipelines();
+    int  reload_cull_pipeline();
+    int  reload_material_pipelines();
+    void mark_dirty(uint32_t slot);
+
+    void record_cull(VkCommandBuffer cmd);
+    void record_draws(VkCommandBuffer cmd);
+    int  record_uploads(VkCommandBuffer cmd);
+};
+
+}  // namespace fl
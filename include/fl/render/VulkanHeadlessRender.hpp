@@ -0,0 +1,23 @@
+#pragma once
+
+#include "fl/render/VulkanRender.hpp"
+
+namespace fl {
+
+/**
+ * @brief Vulkan render for HeadlessWindow: frames go into a ring of offscreen images and are read back.
+ *
+ * Readback is always on. The "readback" pass is appended to the render graph once the other passes are in
+ * (setRenderTree or the first present), so it copies the finished frame, UI included. Frames reach the
+ * readback callback once their fence has signaled, the render never waits for them.
+ */
+class VulkanHeadlessRender : public VulkanRender {
+public:
+    VulkanHeadlessRender();
+    virtual ~VulkanHeadlessRender();
+
+protected:
+    virtual void Init();
+};
+
+}  // namespace fl
@@ -4,13 +4,42 @@
 #include <vulkan/vulkan.h>
 #include "vkbuilder.hpp"
 
+#include <functional>
+#include <mutex>
+#include <utility>
 #include <vector>
 
+#include "fl/render/RenderGraph.hpp"
+#include "fl/render/ShaderManager.hpp"
+#include "fl/render/ShaderModuleRegistry.hpp"
+#include "fl/render/VulkanAllocator.hpp"
+#include "fl/render/VulkanBindless.hpp"
+#include "fl/render/VulkanCompute.hpp"
+#include "fl/render/VulkanFrame.hpp"
+#include "fl/render/VulkanPipelineCache.hpp"
+#include "fl/render/VulkanRecorder.hpp"
+#include "fl/render/VulkanUploader.hpp"
 #include "fl/window/IWindow.hpp"
 
 namespace fl {
 
-constexpr int MAX_FRAMES_IN_FLIGHT = 3;
+// Counters used to confirm that the CPU records frame N+1 while the GPU still executes frame N.
+struct FrameStats {
+    uint64_t submitted   = 0;  // frames handed to the graphics queue
+    uint64_t retired     = 0;  // newest frame whose in-flight fence has been observed signaled
+    uint64_t overlapped  = 0;  // submits issued while an older frame was still executing on the GPU
+    uint32_t latency     = 0;  // frames in flight right after the last submit, including that frame
+    uint32_t max_latency = 0;
+    uint64_t resizes     = 0;  // swapchain recreations, one per frame at most however many events came in
+
+    double overlapRatio() const { return submitted ? (double)overlapped / (double)submitted : 0.0; }
+};
+
+// Optional device capabilities detected in bootstrap
+struct DeviceCaps {
+    bool pipeline_creation_feedback = false;
+    bool ray_tracing                = false;  // acceleration structures and ray tracing pipelines
+};
 
 class VulkanImpl;
 struct RenderData {
@@ -21,31 +50,52 @@ struct RenderData {
     uint32_t graphics_queue_family;
     uint32_t present_queue_family;
 
-    std::vector<VkImage>       swapchain_images;
-    std::vector<VkImageView>   swapchain_image_views;
-    std::vector<VkFramebuffer> framebuffers;
+    // Images frames are rendered into: the swapchain images, or the offscreen ring when headless
+    std::vector<VkImage>          swapchain_images;
+    std::vector<VkImageView>      swapchain_image_views;
+    std::vector<VulkanAllocation> offscreen_memory;
+    VkExtent2D                    extent = {0, 0};
+    VkFormat                      format = VK_FORMAT_UNDEFINED;
 
-    VkRenderPass     render_pass;
-    VkPipelineLayout pipeline_layout;
-    VkPipeline       graphics_pipeline;
+    VkPipelineLayout pipeline_layout      = VK_NULL_HANDLE;  // the bindless layout, owned by VulkanImpl::bindless
+    VkPipeline       graphics_pipeline    = VK_NULL_HANDLE;
+    VkRenderPass     pipeline_render_pass = VK_NULL_HANDLE;  // render pass the scene pipeline was built for
 
-    VkCommandPool                command_pool;
-    std::vector<VkCommandBuffer> command_buffers;
+    FrameContext         frames[MAX_FRAMES_IN_FLIGHT];
+    std::vector<VkFence> image_in_flight;
+    VkSemaphore          frame_timeline = VK_NULL_HANDLE;  // reaches a frame's serial when its submit has finished
 
-    std::vector<VkSemaphore> available_semaphores;
-    std::vector<VkSemaphore> finished_semaphore;
+    // The frame is recorded by the render graph. The swapchain image is imported as "backbuffer", the
+    // scene is drawn by the "scene" pass and modules add their own passes before setRenderTree().
+    RenderGraph       graph;
+    RGResource        backbuffer  = RG_INVALID;
+    RGPass*           scene_pass  = nullptr;
+    VkClearColorValue clear_color = {{0.0f, 0.0f, 0.0f, 1.0f}};
 
-    std::vector<VkFence> in_flight_fences;
-    std::vector<VkFence> image_in_flight;
+    size_t   current_frame  = 0;
+    uint32_t image_index    = 0;
+    bool     frame_acquired = false;  // a swapchain image is held by the frame being recorded
 
-    std::vector<VkFramebuffer>   imgui_framebuffers;
-    std::vector<VkCommandBuffer> imgui_command_buffers;
-    VkRenderPass                 imgui_render_pass;
+    // Resizes are only recorded when requested and applied by the next begin_frame, so a burst of
+    // window events costs one swapchain recreation. A zero extent (minimized) skips frames.
+    VkExtent2D requested_extent = {0, 0};
+    bool       resize_pending   = false;
 
-    size_t current_frame = 0;
+    // Objects frames in flight may still use, destroyed once the frame with the given serial retired
+    std::vector<std::pair<uint64_t, std::function<void()>>> retiring;
+
+    FrameStats frame_stats;
+
+    // Scene draw items recorded every frame. Lists longer than parallel_threshold are split over TBB
+    // workers into secondary command buffers, shorter ones are recorded inline.
+    std::vector<RecordFn> draw_items;
+    size_t                parallel_threshold = 256;
+    ParallelRecorder      recorder;
+
+    FrameContext& frame() { return frames[current_frame]; }
 
     VkImage getCurrentImage() {
-        return swapchain_images[current_frame];
+        return swapchain_images[image_index];
     }
 
 
@@ -73,37 +123,73 @@ public:
     
     VkDescriptorPool descriptor_pool;
 
+    DeviceCaps           caps;
+    VulkanAllocator      allocator;
+    VulkanUploader       uploader;
+    std::mutex           queue_mutex;  // held for every queue submit, present and device wait idle
+    VulkanBindless       bindless;
+    ComputeContext       compute;
+    VulkanPipelineCache  pipeline_cache;
+    std::string          pipeline_cache_path = "pipeline_cache.bin";
+    ShaderModuleRegistry shader_modules;
+
+    // Headless rendering, chosen by bootstrap when there is no window. The offscreen settings are read
+    // by createRenderData.
+    bool       headless            = false;
+    VkExtent2D offscreen_extent    = {1920, 1080};
+    VkFormat   offscreen_format    = VK_FORMAT_R8G8B8A8_UNORM;
+    uint32_t   offscreen_ring_size = 3;
+
+    // In order of preference, read by create_swapchain. FIFO is always supported and always tried last.
+    std::vector<VkPresentModeKHR> present_modes = {VK_PRESENT_MODE_FIFO_KHR};
+
+    // Read by bootstrap, false leaves the ray tracing extensions off and ray tracing on the compute path
+    bool hardware_ray_tracing = true;
+
+    // Read by createRenderData: recompile shaders saved in shader_dir, pipelines swap in begin_frame
+    ShaderManager shaders;
+    bool          shader_hot_reload = false;
+    std::string   shader_dir        = "shader";
+
     virtual RenderData* createRenderData();
 
     virtual void bootstrap(VulkanLoader loader, void* window);
 
+    virtual int begin_frame(RenderData& data);
     virtual int draw_frame(RenderData& data);
     virtual int begin(RenderData& data);
     virtual int end(RenderData& data);
+    virtual void update_frame_stats(RenderData& data);
+    virtual void wait_compute(RenderData& data, ComputeToken token);  // the frame being recorded waits on the GPU
+    virtual void wait_idle();  // vkDeviceWaitIdle, which must not run alongside an upload submit
 
-    virtual int create_swapchain();
+    virtual int create_swapchain(VkExtent2D desired = {0, 0});  // the current swapchain becomes the old one
     virtual int get_queues(RenderData& data);
-    virtual int create_render_pass(RenderData& data);
+    virtual int get_swapchain_images(RenderData& data);
+    virtual int create_offscreen_targets(RenderData& data);
+    virtual int create_render_graph(RenderData& data);
+    virtual int compile_render_graph(RenderData& data);
 
     virtual std::vector<uint32_t> readFile(const std::string& filename);
-    virtual VkShaderModule        createShaderModule(const std::vector<uint32_t>& code);
+
+    // Owned by shader_modules, shared by every pipeline using the same code. By name the newest hot
+    // reloaded version comes first, then the one embedded in the binary, then the file.
+    virtual VkShaderModule getShaderModule(const std::string& name);
+    virtual VkShaderModule getShaderModule(const std::vector<uint32_t>& code);
 
     virtual int  create_graphics_pipeline(RenderData& data);
-    virtual int  create_framebuffers(RenderData& data);
-    virtual int  create_command_pool(RenderData& data);
-    virtual int  create_command_buffers(RenderData& data);
-    virtual int  create_sync_objects(RenderData& data);
+    virtual int  reload_graphics_pipeline(RenderData& data);  // old one retired, kept if the new one fails
+    virtual int  create_frames(RenderData& data);
     virtual int  recreate_swapchain(RenderData& data);
+    virtual void request_resize(RenderData& data, uint32_t width, uint32_t height);
     virtual void cleanup(RenderData& data);
 
-    virtual int create_imgui_render_pass(RenderData& data);
-    virtual int create_imgui_command_buffers(RenderData& data);
-    virtual int create_imgui_framebuffers(RenderData& data);
-
-    virtual int imgui_begin(RenderData& data);
-    virtual int imgui_end(RenderData& data);
+    // Runs fn once every frame submitted so far has finished on the GPU, checked by begin_frame
+    virtual void retire(RenderData& data, std::function<void()> fn);
+    virtual void collect_retired(RenderData& data, bool all = false);
 
     virtual void createDescriptorPool();
+    static bool has_device_extension(VkPhysicalDevice physical_device, const char* name);
 };
 
 }  // namespace fl
\ No newline at end of file
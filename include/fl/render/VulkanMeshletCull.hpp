@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+#include "fl/model/Model.hpp"
+#include "fl/render/VulkanAllocator.hpp"
+#include "fl/render/VulkanBindless.hpp"
+#include "fl/render/VulkanFrame.hpp"
+#include "glm/glm.hpp"
+
+namespace fl {
+
+class VulkanImpl;
+class VulkanModel;
+struct RenderData;
+class RGPass;
+
+/**
+ * @brief Draws a model meshlet by meshlet, with a compute pass culling every meshlet of every instance
+ *        against the view frustum and its normal cone before anything is drawn.
+ *
+ * The work items are clusters, a meshlet placed by one node of the model, times the instances set
+ * with set_instances(). The "meshlet_cull" pass runs one invocation per cluster and instance; one that
+ * survives appends a VkDrawIndexedIndirectCommand for the meshlet's range of the index buffer and the
+ * scene pass records a single vkCmdDrawIndexedIndirectCount for all of them. The vertex shader pulls
+ * and decodes ModelVertex from the bindless set, so this is the vertex shader path of meshlet
+ * rendering; the meshlet limits fit mesh shaders, which could take the same cluster list later.
+ *
+ * A cluster is culled when its bounding sphere is outside a frustum plane, or when the camera is
+ * inside the cone behind it, where every one of its triangles faces away (see MeshletBuilder). The
+ * cone test assumes transforms without shear or non-uniform scale; turn it off for others. Mirroring
+ * transforms are fine, the cone is flipped with them.
+ *
+ * The model's uploads must have been acquired before its clusters are drawn, which happens on its own
+ * a frame after create(). All functions are meant to be called by the render thread.
+ */
+class VulkanMeshletCull {
+public:
+    VulkanMeshletCull() {}
+    ~VulkanMeshletCull() {}
+
+    // Adds the cull pass and the draw to the render graph of data. model must have been created from
+    // view and outlive this; view is only read by create().
+    int  create(VulkanImpl* impl, RenderData* data, const VulkanModel& model, const ModelView& view,
+                uint32_t max_instances = 1);
+    void destroy();
+
+    void set_instances(const glm::mat4* transforms, uint32_t count);  // at most max_instances, each of the model
+    void set_view(const glm::mat4& view_projection, const glm::vec3& camera);  // clip space is Vulkan's
+    void set_culling(bool enable) { culling = enable; }
+    void set_cone_culling(bool enable) { cone_culling = enable; }
+    void set_show_meshlets(bool enable) { show_meshlets = enable; }  // every meshlet gets a color of its own
+
+    struct Stats {
+        uint32_t clusters   = 0;  // meshlets times the nodes that place them
+        uint32_t instances  = 0;
+        uint64_t work_items = 0;  // clusters times instances, tested last frame
+        uint64_t frames     = 0;
+    };
+    const Stats& get_stats() const { return stats; }
+
+protected:
+    struct Buffer {
+        VkBuffer         buffer = VK_NULL_HANDLE;
+        VulkanAllocation allocation;
+        VkDeviceSize     size   = 0;
+        BindlessHandle   handle = BINDLESS_INVALID;
+    };
+
+    VulkanImpl*        impl  = nullptr;
+    RenderData*        data  = nullptr;
+    const VulkanModel* model = nullptr;
+
+    Buffer node_buffer, cluster_buffer, draw_buffer, visible_buffer, count_buffer;
+    Buffer frames[MAX_FRAMES_IN_FLIGHT];  // host visible, the view and instance transforms of a frame
+
+    VkPipeline   cull_pipeline        = VK_NULL_HANDLE;
+    VkPipeline   draw_pipeline        = VK_NULL_HANDLE;
+    VkRenderPass pipeline_render_pass = VK_NULL_HANDLE;
+    RGPass*      cull_pass            = nullptr;
+    uint32_t     cull_watch           = ~0u;  // ShaderManager ids of the pipeline reloads
+    uint32_t     draw_watch           = ~0u;
+
+    std::vector<glm::mat4> transforms;
+    uint32_t               max_instances = 1;
+    uint32_t               cluster_count = 0;
+    uint64_t               ready         = 0;  // serial of the first frame that has acquired the uploads
+
+    glm::vec4 planes[6];
+    glm::mat4 view_projection = glm::mat4(1.0f);
+    glm::vec3 camera          = glm::vec3(0.0f);
+    bool      culling         = true;
+    bool      cone_culling    = true;
+    bool      show_meshlets   = false;
+    Stats     stats;
+
+    int  create_buffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool host_visible = false);
+    void destroy_buffer(Buffer& buffer);
+    int  create_cull_pipeline();
+    int  create_draw_pipeline();
+    int  update_pipeline();
+    int  reload_pipeline(VkPipeline& pipeline, int (VulkanMeshletCull::*create)());
+
+    void record_cull(VkCommandBuffer cmd);
+    void record_draws(VkCommandBuffer cmd);
+};
+
+}  // namespace fl
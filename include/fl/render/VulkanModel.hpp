@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "fl/model/Model.hpp"
+#include "fl/render/VulkanAllocator.hpp"
+#include "fl/render/VulkanBindless.hpp"
+#include "fl/render/VulkanUploader.hpp"
+
+namespace fl {
+
+class VulkanImpl;
+
+/**
+ * @brief The vertex, index, submesh and meshlet arrays of a model in device local buffers.
+ *
+ * create() hands the arrays of the view to the uploader as they are, so for a MappedModel the bytes go
+ * from the page cache into the staging ring with no copy or conversion on the way; the view only has
+ * to stay valid until create() returns. The buffers are in the bindless set, the vertex shader decodes
+ * ModelVertex itself. They can be used once the graphics queue has acquired the returned token.
+ */
+class VulkanModel {
+public:
+    VulkanModel() {}
+    ~VulkanModel() {}
+
+    int  create(VulkanImpl* impl, const ModelView& model);
+    void destroy();  // once the GPU is done with the buffers
+
+    VkBuffer    vertices() const { return vertex_buffer.buffer; }
+    VkBuffer    indices() const { return index_buffer.buffer; }
+    VkIndexType index_type() const { return index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32; }
+
+    BindlessHandle vertex_handle() const { return vertex_buffer.handle; }
+    BindlessHandle index_handle() const { return index_buffer.handle; }
+    BindlessHandle submesh_handle() const { return submesh_buffer.handle; }
+    BindlessHandle meshlet_handle() const { return meshlet_buffer.handle; }
+
+    UploadToken upload_token() const { return token; }
+
+protected:
+    struct Buffer {
+        VkBuffer         buffer = VK_NULL_HANDLE;
+        VulkanAllocation allocation;
+        BindlessHandle   handle = BINDLESS_INVALID;
+    };
+
+    VulkanImpl* impl = nullptr;
+    Buffer      vertex_buffer, index_buffer, submesh_buffer, meshlet_buffer;
+    uint32_t    index_size = 4;
+    UploadToken token;
+
+    int  create_buffer(Buffer& buffer, const void* data, VkDeviceSize size, VkBufferUsageFlags usage);
+    void destroy_buffer(Buffer& buffer);
+};
+
+}  // namespace fl
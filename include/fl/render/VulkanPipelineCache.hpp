@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <iosfwd>
+#include <string>
+
+namespace fl {
+
+/**
+ * @brief A VkPipelineCache shared by every pipeline the renderer creates, persisted between runs.
+ *
+ * load() reads the blob written by a previous run and only hands it to the driver when the header
+ * matches this device (vendor, device id and pipeline cache UUID), otherwise it starts empty.
+ * save() writes to a temporary file first and renames it over the old one, so a crash while saving
+ * never leaves a truncated cache behind.
+ *
+ * Every creation is timed. With VK_EXT_pipeline_creation_feedback the driver also tells whether the
+ * pipeline came out of the cache, which splits the timings into hits and misses.
+ */
+class VulkanPipelineCache {
+public:
+    struct Stats {
+        uint32_t hits       = 0;
+        uint32_t misses     = 0;
+        uint32_t unknown    = 0;  // created without creation feedback support
+        double   hit_ms     = 0;
+        double   miss_ms    = 0;
+        double   unknown_ms = 0;
+
+        size_t loaded_bytes = 0;  // size of the blob accepted at load, 0 for a cold start
+    };
+
+    int  load(VkDevice device, VkPhysicalDevice physical_device, const std::string& path, bool creation_feedback);
+    int  save();
+    void destroy();
+
+    VkPipelineCache get() const { return cache; }
+
+    VkResult create_graphics_pipeline(const VkGraphicsPipelineCreateInfo& info, VkPipeline* pipeline);
+    VkResult create_compute_pipeline(const VkComputePipelineCreateInfo& info, VkPipeline* pipeline);
+    VkResult create_ray_tracing_pipeline(PFN_vkCreateRayTracingPipelinesKHR create,
+                                         const VkRayTracingPipelineCreateInfoKHR& info, VkPipeline* pipeline);
+
+    const Stats& stats() const { return stat; }
+    void         report(std::ostream& os) const;
+
+protected:
+    VkDevice        device   = VK_NULL_HANDLE;
+    VkPipelineCache cache    = VK_NULL_HANDLE;
+    bool            feedback = false;
+    std::string     path;
+
+    VkPhysicalDeviceProperties properties = {};
+    Stats                      stat;
+
+    bool validate_header(const char* blob, size_t size) const;
+    void record(const VkPipelineCreationFeedbackEXT& result, double ms);
+};
+
+}  // namespace fl
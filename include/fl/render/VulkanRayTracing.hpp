@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+#include "fl/render/RayTracing.hpp"
+#include "fl/render/VulkanAccelerationStructures.hpp"
+
+namespace fl {
+
+/**
+ * @brief A ray tracing pipeline on the shared bindless layout and its shader binding table.
+ *
+ * Shader groups are added before create(), which builds the pipeline through the pipeline cache and
+ * writes the group handles into a host visible binding table: every raygen group in a region of its
+ * own, then the miss groups, then the hit groups. Rays pick their miss shader with the missIndex of
+ * traceRayEXT, in the order add_miss() was called, and instances all use hit group 0 plus their sbtRecordOffset.
+ */
+class VulkanRayTracingPipeline {
+public:
+    uint32_t add_raygen(const std::string& spirv_path);
+    uint32_t add_miss(const std::string& spirv_path);
+    uint32_t add_hit_group(const std::string& closest_hit_path, const std::string& any_hit_path = "");
+
+    int  create(VulkanImpl* impl, const RayTracingFunctions* fn, uint32_t max_recursion = 1);
+    void destroy();
+
+    VkPipeline get() const { return pipeline; }
+
+    // Binds nothing, the pipeline and the bindless set are bound by the caller
+    void trace(VkCommandBuffer cmd, uint32_t width, uint32_t height, uint32_t raygen = 0) const;
+
+protected:
+    struct Group {
+        std::string general;  // raygen or miss shader
+        std::string closest_hit;
+        std::string any_hit;
+    };
+
+    VulkanImpl*                impl     = nullptr;
+    const RayTracingFunctions* fn       = nullptr;
+    VkPipeline                 pipeline = VK_NULL_HANDLE;
+
+    std::vector<Group> raygen_groups, miss_groups, hit_groups;
+
+    VkBuffer                        sbt = VK_NULL_HANDLE;
+    VulkanAllocation                sbt_allocation;
+    VkStridedDeviceAddressRegionKHR raygen_region = {}, miss_region = {}, hit_region = {}, callable_region = {};
+
+    int create_binding_table(uint32_t group_count);
+};
+
+/**
+ * @brief Hardware ray tracing through VK_KHR_ray_tracing_pipeline.
+ *
+ * The scene lives in a VulkanAccelerationStructures, the trace shaders are shader/rt_raygen.glsl,
+ * rt_miss.glsl, rt_shadow_miss.glsl and rt_hit.glsl. Only created when the device reported the
+ * acceleration structure and ray tracing pipeline features, see DeviceCaps::ray_tracing. With shader
+ * hot reload on, saving any of them rebuilds the pipeline and its binding table between frames.
+ */
+class VulkanRayTracing : public IRayTracingBackend {
+public:
+    int         create(VulkanImpl* impl, RenderData* data, const RTSceneDesc& desc = RTSceneDesc()) override;
+    void        destroy() override;
+    const char* name() const override { return "hardware"; }
+
+    RTHandle add_mesh(const RTMeshDesc& desc) override { return scene.add_mesh(desc); }
+    void update_mesh(RTHandle mesh, const glm::vec3* positions) override { scene.update_mesh(mesh, positions); }
+    void remove_mesh(RTHandle mesh) override { scene.remove_mesh(mesh); }
+    RTHandle add_instance(const RTInstance& instance) override { return scene.add_instance(instance); }
+    void set_transform(RTHandle instance, const glm::mat4& transform) override {
+        scene.set_transform(instance, transform);
+    }
+    void remove_instance(RTHandle instance) override { scene.remove_instance(instance); }
+
+    void                 record(VkCommandBuffer cmd, const RTTraceParams& params) override;
+    VkPipelineStageFlags trace_stages() const override { return VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR; }
+
+    const VulkanAccelerationStructures& get_scene() const { return scene; }
+
+protected:
+    VulkanImpl*                  impl = nullptr;
+    RenderData*                  data = nullptr;
+    RayTracingFunctions          fn;
+    VulkanAccelerationStructures scene;
+    VulkanRayTracingPipeline     pipeline;
+    uint32_t                     shader_watch = ~0u;  // ShaderManager id of the pipeline reload
+
+    int create_pipeline(VulkanRayTracingPipeline& target);
+};
+
+}  // namespace fl
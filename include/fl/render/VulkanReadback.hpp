@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <vector>
+
+#include "fl/render/VulkanAllocator.hpp"
+
+namespace fl {
+
+// Pixels of one rendered frame, valid until the callback returns
+struct ReadbackFrame {
+    uint64_t       serial;  // frame serial, see FrameStats::submitted
+    uint32_t       width;
+    uint32_t       height;
+    VkFormat       format;
+    uint32_t       row_pitch;  // bytes, tightly packed rows
+    const uint8_t* pixels;
+};
+
+using ReadbackFn = std::function<void(const ReadbackFrame&)>;
+
+/**
+ * @brief Copies rendered images into a ring of host visible buffers and hands them out once the GPU is done.
+ *
+ * record() puts the copy into the frame's command buffer, tagged with the serial the frame will be
+ * submitted as. poll() delivers every copy whose frame has retired, in serial order, without waiting
+ * on the GPU. Nothing here ever waits: when the next buffer still holds an undelivered copy the frame
+ * is dropped. Polling after begin_frame() with a ring of at least MAX_FRAMES_IN_FLIGHT buffers never drops.
+ */
+class VulkanReadback {
+public:
+    VulkanReadback();
+    ~VulkanReadback();
+
+    // format must have 4 bytes per texel, e.g. the RGBA8 and BGRA8 formats swapchains use
+    int  create(VkDevice device, VulkanAllocator* allocator, VkExtent2D extent, VkFormat format, uint32_t ring_size);
+    void destroy();
+
+    void set_callback(ReadbackFn fn) { callback = fn; }
+
+    VkExtent2D get_extent() const { return extent; }
+    bool       is_created() const { return !slots.empty(); }
+
+    // The image must be in TRANSFER_SRC_OPTIMAL layout. Returns -1 when the ring is full, the frame is
+    // then dropped and counted.
+    int  record(VkCommandBuffer cmd, VkImage image, uint64_t serial);
+    void poll(uint64_t retired_serial);
+
+    struct Stats {
+        uint64_t delivered = 0;
+        uint64_t dropped   = 0;
+        uint64_t bytes     = 0;
+    };
+    Stats stats;
+
+protected:
+    struct Slot {
+        VkBuffer         buffer = VK_NULL_HANDLE;
+        VulkanAllocation allocation;
+        uint64_t         serial  = 0;
+        bool             pending = false;
+    };
+
+    VkDevice          device    = VK_NULL_HANDLE;
+    VulkanAllocator*  allocator = nullptr;
+    VkExtent2D        extent    = {0, 0};
+    VkFormat          format    = VK_FORMAT_UNDEFINED;
+    VkDeviceSize      size      = 0;
+    std::vector<Slot> slots;
+    uint32_t          next      = 0;  // slots are used round robin, so pending ones are in serial order
+    ReadbackFn        callback;
+};
+
+}  // namespace fl
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <functional>
+#include <vector>
+
+#include "fl/config.hpp"
+#include "fl/render/VulkanFrame.hpp"
+
+namespace fl {
+
+using RecordFn = std::function<void(VkCommandBuffer)>;
+
+/**
+ * @brief Records draw items into secondary command buffers on TBB worker threads.
+ *
+ * The item list is cut into fixed-size chunks. Each chunk is recorded by whichever worker picks it up,
+ * using a command pool owned by that worker thread, and the resulting secondary buffers are executed
+ * by the primary buffer in chunk order. The output is therefore identical to recording the items one
+ * after another on a single thread.
+ *
+ * Every worker keeps one pool per frame slot, reset(slot) recycles them once that slot's fence has
+ * signaled. Viewport, scissor and bound pipeline are not inherited by secondary buffers, so the
+ * prologue runs at the start of every chunk to set them.
+ */
+class ParallelRecorder {
+public:
+    ParallelRecorder();
+    ~ParallelRecorder();
+
+    void create(VkDevice device, uint32_t queue_family);
+    void destroy();
+    void reset(size_t frame_slot);
+
+    // The render pass must have been begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+    int record(size_t frame_slot, VkCommandBuffer primary, const VkCommandBufferInheritanceInfo& inheritance,
+               const RecordFn& prologue, const std::vector<RecordFn>& items);
+
+    size_t chunk_size = 64;  // draw items per secondary command buffer
+
+protected:
+    struct ThreadPools {
+        VkCommandPool                pools[MAX_FRAMES_IN_FLIGHT] = {};
+        std::vector<VkCommandBuffer> buffers[MAX_FRAMES_IN_FLIGHT];
+        size_t                       used[MAX_FRAMES_IN_FLIGHT] = {};
+    };
+
+    VkDevice device       = VK_NULL_HANDLE;
+    uint32_t queue_family = 0;
+
+    tbb::enumerable_thread_specific<ThreadPools> thread_pools;
+
+    VkCommandBuffer acquire(ThreadPools& local, size_t frame_slot);
+};
+
+}  // namespace fl
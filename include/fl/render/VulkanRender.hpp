@@ -1,12 +1,15 @@
 #pragma once
 #include "fl/config.hpp"
 #include "fl/render/IRender.hpp"
+#include "fl/render/VulkanReadback.hpp"
+#include "fl/system/Config.hpp"
 #include "fl/window/IWindow.hpp"
 
 namespace fl {
 
 class VulkanImpl;
 struct RenderData;
+class RGPass;
 
 class VulkanRender : public IModule, public IRender {
 public:
@@ -16,20 +19,44 @@ public:
     virtual void setRenderTree();
     virtual void clear(glm::vec4 color = glm::vec4(0.2, 0.2, 0.2, 1.0));
     virtual void present();
+    virtual void resize(uint32_t width, uint32_t height);  // applied when the next frame begins
     
     virtual RenderType getType() { return Vulkan; }
 
     virtual RenderData* getVulkanRenderData() { return data; }
+
+    // Reads every presented frame back into host memory, see VulkanReadback. The readback pass is added
+    // to the render graph after the passes present at that point, or with setRenderTree when enabled
+    // before it. Ring size 0 takes Config::offscreen_ring_size. Frames are delivered from clear() and
+    // present().
+    int  enableReadback(uint32_t ring_size = 0);
+    void disableReadback() { readback_enabled = false; }  // the pass stays in the graph but records nothing
+    void setReadbackCallback(ReadbackFn fn) { readback.set_callback(fn); }
+    void flush();  // waits for the GPU and delivers every frame still in flight
+
+    const VulkanReadback& getReadback() const { return readback; }
+
 protected:
     DEPS_ON
     sptr<IWindow> window;
+    sptr<Config>  config;
 
     int display_w, display_h;
 
     virtual void Init();
 
-    VulkanImpl* impl;
-    RenderData* data;
+    VulkanImpl* impl = nullptr;
+    RenderData* data = nullptr;
+
+    VulkanReadback readback;
+    RGPass*        readback_pass    = nullptr;
+    bool           readback_enabled = false;
+    uint32_t       readback_ring    = 0;
+
+    void addReadbackPass();
+    int  resizeReadback();
+
+    static std::vector<VkPresentModeKHR> presentModes(const Config& config);
 };
 
 }  // namespace fl
\ No newline at end of file
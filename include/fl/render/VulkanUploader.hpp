@@ -0,0 +1,129 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "fl/render/VulkanAllocator.hpp"
+
+namespace fl {
+
+// Completion handle of an upload: the uploader's timeline semaphore reaching value
+struct UploadToken {
+    uint64_t value = 0;
+};
+
+/**
+ * @brief Streams buffer and image data to the GPU on the dedicated transfer queue.
+ *
+ * Source data is copied into a persistently mapped staging ring and the copy commands are batched
+ * into one transfer command buffer until flush(). Each submitted batch signals the next value of a
+ * timeline semaphore, which is what UploadToken refers to, and its ring space is reclaimed once that
+ * value has been reached. Data that does not fit in the ring gets a temporary staging buffer that is
+ * freed with its batch.
+ *
+ * The destination resources are released from the transfer queue family; acquire() records the
+ * matching acquire barriers into a graphics command buffer and returns the timeline value that
+ * submit has to wait on, so the graphics queue only waits on the GPU and the CPU never does.
+ *
+ * The upload functions are thread safe, acquire() is meant to be called by the render thread. Submits
+ * to the transfer queue take queue_mutex, which the render thread also holds for its own submits when
+ * the device has no dedicated transfer queue and uploads go to the graphics queue.
+ */
+class VulkanUploader {
+public:
+    VulkanUploader();
+    ~VulkanUploader();
+
+    int  create(VkDevice device, VulkanAllocator* allocator, VkQueue transfer_queue, uint32_t transfer_family,
+                uint32_t graphics_family, std::mutex* queue_mutex = nullptr, VkDeviceSize ring_size = 32ull << 20);
+    void destroy();
+
+    // The buffer must not be in use by the graphics queue until the upload has been acquired.
+    UploadToken upload_buffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+    // Uploads tightly packed texels into one subresource and moves it to final_layout.
+    UploadToken upload_image(VkImage image, const VkImageSubresourceLayers& subresource, VkExtent3D extent,
+                             const void* data, VkDeviceSize size,
+                             VkImageLayout final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    UploadToken flush();  // submits the pending batch, returns the token of everything uploaded so far
+
+    bool is_complete(UploadToken token);
+    void wait(UploadToken token);
+
+    // Submits pending uploads and records the acquire barriers for everything submitted since the last
+    // call. The returned timeline value (0 for none) must be waited on at consumer_stages by the submit.
+    uint64_t acquire(VkCommandBuffer graphics_cmd);
+    // Drops the acquire barriers still pending for a buffer that is destroyed before any frame acquired
+    // it, after wait() on its uploads
+    void forget(VkBuffer buffer);
+
+    VkSemaphore timeline() const { return semaphore; }
+
+    static constexpr VkPipelineStageFlags consumer_stages =
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    struct Stats {
+        uint64_t     batches     = 0;
+        uint64_t     copies      = 0;
+        VkDeviceSize bytes       = 0;
+        VkDeviceSize overflow    = 0;  // bytes that went through temporary staging buffers
+        uint64_t     ring_stalls = 0;  // uploads that had to wait for ring space
+    };
+    Stats stats;
+
+protected:
+    struct Staging {
+        VkBuffer         buffer = VK_NULL_HANDLE;
+        VulkanAllocation allocation;
+    };
+
+    struct Batch {
+        VkCommandBuffer      cmd      = VK_NULL_HANDLE;
+        uint64_t             value    = 0;  // timeline value signaled when the batch is done
+        VkDeviceSize         ring_end = 0;  // ring head after the batch, becomes the tail on retire
+        std::vector<Staging> overflow;
+
+        // release half of the queue family ownership transfer, recorded at the end of the batch
+        std::vector<VkBufferMemoryBarrier> release_buffers;
+        std::vector<VkImageMemoryBarrier>  release_images;
+    };
+
+    VkDevice         device          = VK_NULL_HANDLE;
+    VulkanAllocator* allocator       = nullptr;
+    VkQueue          queue           = VK_NULL_HANDLE;
+    std::mutex*      queue_mutex     = nullptr;  // external synchronization of queue, see create()
+    uint32_t         transfer_family = 0;
+    uint32_t         graphics_family = 0;
+    VkCommandPool    command_pool    = VK_NULL_HANDLE;
+    VkSemaphore      semaphore       = VK_NULL_HANDLE;
+
+    Staging      ring;
+    char*        ring_memory = nullptr;
+    VkDeviceSize ring_size   = 0;
+    VkDeviceSize ring_head   = 0;   // bytes ever reserved, the write position is ring_head % ring_size
+    VkDeviceSize ring_tail   = 0;   // bytes ever reclaimed
+    VkDeviceSize alignment   = 16;  // multiple of every texel block size and of the 4 bytes buffer copies need
+
+    Batch                        current;
+    std::deque<Batch>            in_flight;  // submitted, ring space not reclaimed yet
+    std::vector<VkCommandBuffer> free_cmds;
+    uint64_t                     next_value = 1;
+    std::mutex                   mutex;
+
+    // acquire half of the ownership transfer for submitted batches, recorded by acquire()
+    std::vector<VkBufferMemoryBarrier> acquire_buffers;
+    std::vector<VkImageMemoryBarrier>  acquire_images;
+
+    bool     ownership_transfer() const { return transfer_family != graphics_family; }
+    int      begin_batch();
+    int      submit_locked();
+    void     retire_locked();
+    uint64_t completed_value();
+    int      stage_locked(const void* data, VkDeviceSize size, VkBuffer& src, VkDeviceSize& src_offset);
+};
+
+}  // namespace fl
@@ -6,6 +6,10 @@
 namespace fl {
 constexpr int32_t autocenter = 1009800898;
 
+// Vulkan presentation. Auto is FIFO with enable_vsync, otherwise the first of MAILBOX, IMMEDIATE the
+// surface supports. Modes the surface does not support fall back to the next one, FIFO at the end.
+enum class PresentMode { Auto, Fifo, Mailbox, Immediate };
+
 class Config : public IModule {
 public:
     uint32_t width, height;
@@ -28,9 +32,24 @@ public:
     bool enable_vsync;              // keep 60fps same as your monitor
     bool enable_default_keyaction;  // enable default handle for ESC to exit app
 
+    PresentMode present_mode;  // Vulkan only, see PresentMode
+    double      target_fps;    // frame rate limit, 0 for none
+    bool        low_latency;   // start each frame just in time for its deadline, paces to the monitor refresh
+                               // rate when there is no target_fps
+
     bool enable_vulkan_support;
     bool enable_opengl_support;
 
+    bool merge_ui_subpass;      // Vulkan: draw the UI as a second subpass of the scene render pass
+    bool hardware_ray_tracing;  // Vulkan: use VK_KHR_ray_tracing_pipeline when the device has it, false forces
+                                // the compute fallback
+
+    bool        shader_hot_reload;  // Vulkan: recompile shaders saved in shader_dir and swap the pipelines
+    std::string shader_dir;         // GLSL sources, the source tree's shader/ by default
+
+    uint32_t offscreen_ring_size;  // headless: offscreen images and readback buffers rendered into in turn
+    uint32_t headless_frames;      // headless: frames the main loop runs, 0 runs until the window is closed
+
     std::string window_title;
 
     uint32_t OpenGL_Version_Major;
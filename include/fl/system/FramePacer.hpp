@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace fl {
+
+/**
+ * @brief Frame rate limiter and just-in-time frame start for the window main loops.
+ *
+ * beginFrame() is called before input is polled and endFrame() after present. With a target rate,
+ * frame starts are spaced one interval apart: the pacer sleeps until shortly before the start and
+ * spins the rest, the sleep margin adapts to the oversleep the OS scheduler showed so far. A frame
+ * that starts more than an interval late restarts the cadence instead of rushing to catch up.
+ *
+ * In low latency mode the start moves later within the interval, by the interval minus a high
+ * percentile of recent CPU frame times, so that the frame is finished just in time for the next
+ * cadence point. Input is then sampled close to the moment the frame is submitted instead of a
+ * whole interval earlier.
+ */
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FramePacer();
+    ~FramePacer();
+
+    // target_fps 0 runs unlimited, low latency needs a rate to aim for
+    void configure(double target_fps, bool low_latency);
+    bool isActive() const { return interval > 0.0; }
+
+    void beginFrame();
+    void endFrame();
+
+    // Over the last frames, in milliseconds. Jitter is how far frame starts were from their schedule.
+    struct Stats {
+        uint64_t frames      = 0;
+        uint64_t late        = 0;  // frames that started more than 1 ms after their schedule
+        double   interval    = 0;  // mean time between frame starts
+        double   interval_sd = 0;
+        double   jitter_mean = 0;
+        double   jitter_p99  = 0;
+        double   jitter_max  = 0;
+        double   cpu_time    = 0;  // mean time between beginFrame (after the wait) and endFrame
+    };
+    Stats getStats() const;
+    void  resetStats();
+
+protected:
+    double interval    = 0.0;  // seconds, 0 disables pacing
+    bool   low_latency = false;
+
+    Clock::time_point next_start;  // cadence point of the next frame
+    Clock::time_point frame_start;
+    Clock::time_point last_start;
+    bool              started = false;
+
+    double sleep_margin = 0.001;    // seconds before the deadline the sleep ends, the rest is spun
+    void*  timer        = nullptr;  // Windows: high resolution waitable timer, Sleep() is 1 ms at best
+
+    static constexpr size_t history = 240;
+    std::vector<double>     intervals;  // rings of the last frames, seconds
+    std::vector<double>     jitters;
+    std::vector<double>     cpu_times;
+    size_t                  cursor = 0;
+    uint64_t                frames = 0;
+    uint64_t                late   = 0;
+
+    double predictWork() const;
+    void   waitUntil(Clock::time_point deadline);
+    void   sleepFor(double seconds);
+};
+
+}  // namespace fl
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fl {
+
+constexpr uint64_t fnv1a_offset = 0xcbf29ce484222325ull;
+
+// 64-bit FNV-1a, pass the previous result as hash to continue over more data
+uint64_t fnv1a(const void* data, size_t bytes, uint64_t hash = fnv1a_offset);
+
+}  // namespace fl
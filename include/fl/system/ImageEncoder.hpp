@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fl {
+
+enum class ImageFormat { PNG, QOI };
+
+// 8 bit RGBA or BGRA pixels, rows row_pitch bytes apart
+struct ImagePixels {
+    const uint8_t* pixels;
+    uint32_t       width;
+    uint32_t       height;
+    uint32_t       row_pitch;
+    bool           bgra;
+};
+
+/**
+ * @brief Image encoders without third party dependencies, each call encodes one image into a byte buffer.
+ *
+ * QOI is the fast choice for capturing many frames: one pass, a few operations per pixel, files
+ * about the size of a fast PNG. PNG is for images that other tools have to open. It uses the Sub
+ * filter and a single fixed-Huffman deflate block with greedy LZ77 matching. That is much faster
+ * than zlib's default level and a good deal larger, but flat sprite backgrounds still shrink well.
+ * The calls only touch their arguments and may run on any number of threads at once.
+ */
+class ImageEncoder {
+public:
+    static int encode(ImageFormat format, const ImagePixels& image, std::vector<uint8_t>& out);
+    static int encode_qoi(const ImagePixels& image, std::vector<uint8_t>& out);
+    static int encode_png(const ImagePixels& image, std::vector<uint8_t>& out);
+
+    static const char* extension(ImageFormat format);  // without the dot
+
+    static int write_file(const std::string& path, const std::vector<uint8_t>& data);
+};
+
+}  // namespace fl
@@ -1,11 +1,51 @@
 #pragma once
 
-namespace fl
-{
-    
+#include <string>
+
+#include "fl/model/MeshSimplifier.hpp"
+#include "fl/model/Model.hpp"
+#include "fl/model/ModelCache.hpp"
+
+namespace fl {
+
+struct ModelLoadOptions {
+    bool        flatten  = false;  // bake node transforms into the vertices, leaving one identity node per submesh
+    bool        flip_uvs = false;  // v = 1 - v, for files written with the origin at the bottom left
+    bool        optimize = true;   // run MeshOptimizer with its default options over the result, builds meshlets
+    std::string cache_dir;         // binary model caches are read from and written to here, empty for none
+
+    MeshSimplifierOptions lods;  // the LOD chain of every submesh, levels = 0 for none
+};
+
+/**
+ * @brief Imports any format assimp reads and converts it to a Model.
+ *
+ * assimp triangulates, welds identical vertices, generates missing normals and tangents and reorders
+ * the triangles for the vertex cache; points and lines are dropped. The conversion then quantizes the
+ * vertices of every mesh on its own bounds, in parallel over the meshes, and flattens the node tree
+ * into world transforms. MeshSimplifier then adds the LOD chain of every submesh and MeshOptimizer
+ * reorders the triangles and vertices of all levels and groups the base level into meshlets. The
+ * aiScene is released before load returns, nothing of it is kept.
+ *
+ * With a cache_dir the result is also written as a ModelCache file named after the source file and
+ * keyed by the hash of its contents and the options, and later loads map that file instead of
+ * importing. Changing the source or the options makes a new key, the old file is simply not used.
+ */
 class ModelLoader {
 public:
-    
+    // Imports, or copies the model out of an up to date cache. A cache_dir that cannot be written
+    // only costs the cache, the imported model is still returned.
+    static int load(const std::string& path, Model& model, const ModelLoadOptions& options = ModelLoadOptions());
+
+    // Maps the cache, importing and writing it first when it is missing or stale. Needs a cache_dir
+    // that can be written, the mapping is of the file.
+    static int load(const std::string& path, MappedModel& model, const ModelLoadOptions& options);
+
+    static uint64_t    cache_key(const std::string& path, const ModelLoadOptions& options);  // 0 when unreadable
+    static std::string cache_path(const std::string& path, const ModelLoadOptions& options, uint64_t key);
+
+protected:
+    static int import_file(const std::string& path, Model& model, const ModelLoadOptions& options);
 };
 
-} // namespace fl
+}  // namespace fl
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vulkan/vulkan.h>
+
 #include "fl/config.hpp"
 #include "fl/render/IRender.hpp"
 #include "fl/window/IWindow.hpp"
@@ -38,8 +40,13 @@ protected:
     virtual void initGLFW();
 
     void uploadFontsForVulkan();
+    void finishFontUpload(bool wait);
 
     RenderData* vulkan_data;
+
+    // the font texture upload runs asynchronously, its staging objects are freed once the fence signals
+    VkCommandPool font_upload_pool  = VK_NULL_HANDLE;
+    VkFence       font_upload_fence = VK_NULL_HANDLE;
 };
 
 } // namespace fl
@@ -3,6 +3,7 @@
 #include "fl/config.hpp"
 #include "fl/window/IWindow.hpp"
 #include "fl/system/Config.hpp"
+#include "fl/system/FramePacer.hpp"
 
 struct GLFWwindow;
 
@@ -27,6 +28,9 @@ public:
     virtual VulkanLoader getVulkanLoader();
 
     virtual WindowType getType() { return GLFW; }
+
+    void onFramebufferResize(int width, int height);
+
 protected:
     DEPS_ON
     sptr<Config> config;
@@ -41,6 +45,15 @@ protected:
     virtual void cleanUp();
     virtual void processInput();
 
+    // framebuffer size, resize events only store it and the main loop hands the latest one to the render
+    int  framebuffer_width  = 0;
+    int  framebuffer_height = 0;
+    bool resize_pending     = false;
+
+    FramePacer pacer;  // Config::target_fps and low_latency
+
+    virtual void applyResize();
+
     IRender* render = nullptr;
     IWindowRenderCallback*   render_cb   = nullptr;
     IWindowKeyboardCallback* keyboard_cb = nullptr;
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+
+#include "fl/config.hpp"
+#include "fl/system/Config.hpp"
+#include "fl/system/FramePacer.hpp"
+#include "fl/window/IWindow.hpp"
+
+namespace fl {
+
+class IRender;
+
+/**
+ * @brief Window without a window: no surface, no input, no presentation.
+ *
+ * Pairs with VulkanHeadlessRender, which renders into offscreen images. The main loop runs the render
+ * callback and the render's present back to back, as fast as the GPU allows, for Config::headless_frames
+ * frames or until close() is called.
+ */
+class HeadlessWindow : public IModule, public IWindow {
+public:
+    HeadlessWindow();
+    virtual ~HeadlessWindow();
+
+    virtual void mainLoop();
+    virtual void close() { should_close = true; }  // the frame being rendered is still finished
+
+    virtual void setPresentCallback(IRender* render);
+    virtual void setRenderCallback(IWindowRenderCallback* callback);
+    virtual void setKeyboardCallback(IWindowKeyboardCallback* callback);
+    virtual void setMouseCallback(IWindowMouseCallback* callback);
+
+    virtual void*        getWindow() { return nullptr; }
+    virtual GLLoader     getGLLoader() { return nullptr; }
+    virtual VulkanLoader getVulkanLoader() { return nullptr; }
+
+    virtual WindowType getType() { return Headless; }
+
+    uint64_t getFrameCount() const { return frame_count; }
+
+protected:
+    DEPS_ON
+    sptr<Config> config;
+
+    std::atomic<bool> should_close{false};
+    uint64_t          frame_count = 0;
+    FramePacer        pacer;  // only with Config::target_fps, headless runs at full speed otherwise
+
+    IRender*               render    = nullptr;
+    IWindowRenderCallback* render_cb = nullptr;
+};
+
+}  // namespace fl
@@ -51,7 +51,8 @@ public:
     enum WindowType {
         None = 0,
         GLFW = 1,
-        SDL2 = 2
+        SDL2 = 2,
+        Headless = 3
     };
 
     virtual WindowType getType() = 0;
@@ -3,6 +3,7 @@
 #include "fl/config.hpp"
 #include "fl/window/IWindow.hpp"
 #include "fl/system/Config.hpp"
+#include "fl/system/FramePacer.hpp"
 
 struct SDL_Window;
 
@@ -33,6 +34,9 @@ protected:
 
     SDL_Window* window;
     bool done = false;
+    bool resize_pending = false;
+
+    FramePacer pacer;  // Config::target_fps and low_latency
     
     virtual void Init();
     virtual void createWindow();
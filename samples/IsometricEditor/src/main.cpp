@@ -1,4 +1,5 @@
 
+#include "fl/render/FrameCapture.hpp"
 #include "fl/render/VulkanRender.hpp"
 #include "fl/render/VulkanImpl.hpp"
 #include "fl/system/App.hpp"
@@ -49,6 +50,27 @@ public:
             ImGui::End();
         }
 
+        {
+            ImGui::Begin("Export");
+            ImGui::InputInt("frames", &export_frames);
+            ImGui::Checkbox("PNG (QOI otherwise)", &export_png);
+            if (!capture.isCapturing()) {
+                if (ImGui::Button("Capture")) {
+                    std::filesystem::create_directories("export");
+                    auto render = std::static_pointer_cast<VulkanRender>(di.get<IRender>("IRender"));
+                    capture.start(render.get(), "export/frame_%04u", export_png ? ImageFormat::PNG : ImageFormat::QOI,
+                                  (uint32_t)std::max(export_frames, 0));
+                }
+            } else if (ImGui::Button("Stop")) {
+                capture.stop();
+            }
+            auto stats = capture.getStats();
+            ImGui::Text("written %llu / %llu, dropped %llu, %.1f MB", (unsigned long long)stats.written,
+                        (unsigned long long)stats.captured, (unsigned long long)stats.dropped,
+                        stats.file_bytes / (1024.0 * 1024.0));
+            ImGui::End();
+        }
+
         // 3. Show another simple window.
         if (show_another_window) {
             ImGui::Begin("Another Window",
@@ -67,6 +89,10 @@ protected:
     bool  show_another_window = false;
     float f       = 0.0f;
     int   counter = 0;
+
+    FrameCapture capture;
+    int          export_frames = 64;
+    bool         export_png    = true;
 };
 
 void configDI(DI& di) {
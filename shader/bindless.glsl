@@ -0,0 +1,21 @@
+// Bindless resources, include after #version. Must match VulkanBindless.hpp: set 0, one array per
+// binding, indexed by the handles add_texture(), add_sampler(), add_buffer() and add_storage_image()
+// return. Handles that differ between invocations of a draw must be wrapped in nonuniformEXT().
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (set = 0, binding = 0) uniform texture2D bindless_textures[];
+layout (set = 0, binding = 1) uniform sampler bindless_samplers[];
+layout (set = 0, binding = 3, rgba8) uniform image2D bindless_images[];
+
+// Storage buffers are declared per element type by the shader that reads them, aliasing binding 2:
+//   layout (set = 0, binding = 2, std430) readonly buffer SpriteBuffer { Sprite data[]; } sprite_buffers[];
+//   ... sprite_buffers[nonuniformEXT (handle)].data[i] ...
+
+vec4 bindless_sample (uint tex, uint smp, vec2 uv)
+{
+	return texture (sampler2D (bindless_textures[nonuniformEXT (tex)], bindless_samplers[nonuniformEXT (smp)]), uv);
+}
+
+// Push constants are 128 bytes shared by every stage, VulkanBindless::push_constant_size. Shaders
+// declare their own block within that size, usually the handles of the draw:
+//   layout (push_constant) uniform Draw { uint tex; uint smp; uint instances; } draw;
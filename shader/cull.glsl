@@ -0,0 +1,49 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#include "gpu_scene.glsl"
+
+// One invocation per instance slot: frustum test of the bounding sphere, then a draw command in the
+// material's range of the draw buffer. The count of each range is what the indirect draw reads.
+layout (local_size_x = 64) in;
+
+layout (push_constant) uniform Cull
+{
+	vec4 planes[6];
+	uint instances;
+	uint meshes;
+	uint buckets;
+	uint draws;
+	uint counts;
+	uint instance_count;
+	uint culling;
+} cull;
+
+void main ()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= cull.instance_count) return;
+
+	Instance instance = instance_buffers[cull.instances].data[index];
+	if (instance.mesh == GPU_INVALID) return;
+	Mesh mesh = mesh_buffers[cull.meshes].data[instance.mesh];
+
+	if (cull.culling != 0) {
+		vec3 center = (instance.transform * vec4 (mesh.bounds.xyz, 1.0)).xyz;
+		float scale = max (max (length (instance.transform[0].xyz), length (instance.transform[1].xyz)),
+		                   length (instance.transform[2].xyz));
+		float radius = mesh.bounds.w * scale;
+		for (int i = 0; i < 6; i++) {
+			if (dot (cull.planes[i].xyz, center) + cull.planes[i].w < -radius) return;
+		}
+	}
+
+	uint slot = atomicAdd (count_buffers[cull.counts].count[instance.material], 1u);
+
+	DrawCommand draw;
+	draw.index_count    = mesh.index_count;
+	draw.instance_count = 1;
+	draw.first_index    = mesh.first_index;
+	draw.vertex_offset  = mesh.vertex_offset;
+	draw.first_instance = index;
+	draw_buffers[cull.draws].data[bucket_buffers[cull.buckets].first[instance.material] + slot] = draw;
+}
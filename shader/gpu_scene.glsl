@@ -0,0 +1,45 @@
+// GPU scene data, include after #version. Layouts must match VulkanGpuScene.hpp; all buffers are
+// bindless storage buffers aliasing binding 2, indexed by the handles in the push constants.
+#include "bindless.glsl"
+
+#define GPU_INVALID 0xffffffffu
+
+struct Vertex {
+	vec3 position;
+	float u;
+	vec3 normal;
+	float v;
+};
+
+struct Instance {
+	mat4 transform;
+	vec4 color;
+	uint mesh;
+	uint material;
+	uint tex;
+	uint smp;
+};
+
+struct Mesh {
+	vec4 bounds;
+	uint index_count;
+	uint first_index;
+	int vertex_offset;
+	uint pad;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+	uint index_count;
+	uint instance_count;
+	uint first_index;
+	int vertex_offset;
+	uint first_instance;
+};
+
+layout (set = 0, binding = 2, std430) readonly buffer VertexBuffer { Vertex data[]; } vertex_buffers[];
+layout (set = 0, binding = 2, std430) readonly buffer InstanceBuffer { Instance data[]; } instance_buffers[];
+layout (set = 0, binding = 2, std430) readonly buffer MeshBuffer { Mesh data[]; } mesh_buffers[];
+layout (set = 0, binding = 2, std430) readonly buffer BucketBuffer { uint first[]; } bucket_buffers[];
+layout (set = 0, binding = 2, std430) writeonly buffer DrawBuffer { DrawCommand data[]; } draw_buffers[];
+layout (set = 0, binding = 2, std430) buffer CountBuffer { uint count[]; } count_buffers[];
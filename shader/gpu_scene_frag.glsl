@@ -0,0 +1,15 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#include "bindless.glsl"
+
+layout (location = 0) in vec2 fragUV;
+layout (location = 1) in vec4 fragColor;
+layout (location = 2) flat in uvec2 fragTexture;
+
+layout (location = 0) out vec4 outColor;
+
+void main ()
+{
+	outColor = fragColor;
+	if (fragTexture.x != 0xffffffffu) outColor *= bindless_sample (fragTexture.x, fragTexture.y, fragUV);
+}
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#include "gpu_scene.glsl"
+
+layout (push_constant) uniform Draw
+{
+	mat4 view_projection;
+	uint vertices;
+	uint instances;
+} draw;
+
+layout (location = 0) out vec2 fragUV;
+layout (location = 1) out vec4 fragColor;
+layout (location = 2) flat out uvec2 fragTexture;
+
+// gl_VertexIndex includes the mesh's vertex offset, gl_InstanceIndex is the instance slot
+void main ()
+{
+	Vertex vertex = vertex_buffers[draw.vertices].data[gl_VertexIndex];
+	Instance instance = instance_buffers[draw.instances].data[gl_InstanceIndex];
+
+	gl_Position = draw.view_projection * instance.transform * vec4 (vertex.position, 1.0);
+	fragUV = vec2 (vertex.u, vertex.v);
+	fragColor = instance.color;
+	fragTexture = uvec2 (instance.tex, instance.smp);
+}
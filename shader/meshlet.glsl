@@ -0,0 +1,67 @@
+// Meshlet rendering data, include after #version. Layouts must match Model.hpp and
+// VulkanMeshletCull.cpp; all buffers are bindless storage buffers aliasing binding 2, indexed by the
+// handles in the push constants.
+#include "bindless.glsl"
+
+// ModelSubmesh is read as words: base_vertex is word 2, bounds_min words 9 to 11, bounds_max 12 to 14
+#define SUBMESH_WORDS 15
+#define SUBMESH_BASE_VERTEX 2
+#define SUBMESH_BOUNDS_MIN 9
+#define SUBMESH_BOUNDS_MAX 12
+
+#define MESHLET_CULLING 1u
+#define MESHLET_CONE_CULLING 2u
+#define MESHLET_SHOW 4u
+
+struct Meshlet {
+	vec3 center;
+	float radius;
+	vec3 cone_axis;
+	float cone_cutoff;
+	uint first_index;
+	uint index_count;
+	uint vertex_count;
+	uint submesh;
+};
+
+struct Node {
+	mat4 transform;
+	uint submesh;
+	uint pad0;
+	uint pad1;
+	uint pad2;
+};
+
+layout (push_constant) uniform MeshletHandles
+{
+	uint frame;
+	uint vertices;
+	uint submeshes;
+	uint meshlets;
+	uint nodes;
+	uint clusters;
+	uint draws;
+	uint visible;
+	uint counts;
+} handles;
+
+layout (set = 0, binding = 2, std430) readonly buffer FrameBuffer
+{
+	mat4 view_projection;
+	vec4 planes[6];
+	vec4 camera;
+	uint instance_count;
+	uint cluster_count;
+	uint flags;
+	uint max_draws;
+	mat4 transforms[];
+} frame_buffers[];
+
+layout (set = 0, binding = 2, std430) readonly buffer ModelVertexBuffer { uvec4 data[]; } model_vertex_buffers[];
+layout (set = 0, binding = 2, std430) readonly buffer SubmeshBuffer { uint words[]; } submesh_buffers[];
+layout (set = 0, binding = 2, std430) readonly buffer MeshletBuffer { Meshlet data[]; } meshlet_buffers[];
+layout (set = 0, binding = 2, std430) readonly buffer NodeBuffer { Node data[]; } node_buffers[];
+// (meshlet, node) of every cluster, then (cluster, instance) of every draw the cull pass wrote. The
+// cull pass declares the buffers it writes itself, the vertex stage may only read storage buffers.
+layout (set = 0, binding = 2, std430) readonly buffer ClusterBuffer { uvec2 data[]; } cluster_buffers[];
+layout (set = 0, binding = 2, std430) readonly buffer VisibleBuffer { uvec2 data[]; } visible_buffers[];
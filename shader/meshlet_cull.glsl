@@ -0,0 +1,63 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#include "meshlet.glsl"
+
+// One invocation per cluster, one row of groups per instance: frustum test of the bounding sphere and
+// normal cone test in world space, then a draw command for the meshlet's range of the index buffer.
+layout (local_size_x = 64) in;
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand {
+	uint index_count;
+	uint instance_count;
+	uint first_index;
+	int vertex_offset;
+	uint first_instance;
+};
+
+layout (set = 0, binding = 2, std430) writeonly buffer DrawBuffer { DrawCommand data[]; } draw_buffers[];
+layout (set = 0, binding = 2, std430) writeonly buffer DrawnBuffer { uvec2 data[]; } drawn_buffers[];
+layout (set = 0, binding = 2, std430) buffer CountBuffer { uint count[]; } count_buffers[];
+
+void main ()
+{
+	uint index = gl_GlobalInvocationID.x;
+	uint instance = gl_WorkGroupID.y;
+	if (index >= frame_buffers[handles.frame].cluster_count) return;
+
+	uvec2 cluster = cluster_buffers[handles.clusters].data[index];
+	Meshlet meshlet = meshlet_buffers[handles.meshlets].data[cluster.x];
+	Node node = node_buffers[handles.nodes].data[cluster.y];
+	mat4 world = frame_buffers[handles.frame].transforms[instance] * node.transform;
+	uint flags = frame_buffers[handles.frame].flags;
+
+	vec3 center = (world * vec4 (meshlet.center, 1.0)).xyz;
+	float scale = max (max (length (world[0].xyz), length (world[1].xyz)), length (world[2].xyz));
+	float radius = meshlet.radius * scale;
+	if ((flags & MESHLET_CULLING) != 0u) {
+		for (int i = 0; i < 6; i++) {
+			vec4 plane = frame_buffers[handles.frame].planes[i];
+			if (dot (plane.xyz, center) + plane.w < -radius) return;
+		}
+	}
+	// a mirroring transform turns the triangles inside out, and their cone with them
+	if ((flags & MESHLET_CONE_CULLING) != 0u && meshlet.cone_cutoff < 1.0) {
+		float mirror = determinant (mat3 (world)) < 0.0 ? -1.0 : 1.0;
+		vec3 axis = normalize (mat3 (world) * meshlet.cone_axis) * mirror;
+		vec3 offset = center - frame_buffers[handles.frame].camera.xyz;
+		if (dot (offset, axis) >= meshlet.cone_cutoff * length (offset) + radius) return;
+	}
+
+	uint slot = atomicAdd (count_buffers[handles.counts].count[0], 1u);
+	if (slot >= frame_buffers[handles.frame].max_draws) return;
+
+	uint submesh = meshlet.submesh * SUBMESH_WORDS;
+	DrawCommand draw;
+	draw.index_count    = meshlet.index_count;
+	draw.instance_count = 1;
+	draw.first_index    = meshlet.first_index;
+	draw.vertex_offset  = int (submesh_buffers[handles.submeshes].words[submesh + SUBMESH_BASE_VERTEX]);
+	draw.first_instance = slot;
+	draw_buffers[handles.draws].data[slot] = draw;
+	drawn_buffers[handles.visible].data[slot] = uvec2 (index, instance);
+}
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#include "meshlet.glsl"
+
+layout (location = 0) in vec3 fragNormal;
+layout (location = 1) flat in uint fragMeshlet;
+
+layout (location = 0) out vec4 outColor;
+
+void main ()
+{
+	vec3 color = vec3 (0.8);
+	if ((frame_buffers[handles.frame].flags & MESHLET_SHOW) != 0u) {
+		uint hash = fragMeshlet * 2654435761u;
+		color = vec3 ((hash >> 8) & 255u, (hash >> 16) & 255u, hash >> 24) / 255.0;
+	}
+	float light = max (dot (normalize (fragNormal), normalize (vec3 (0.4, 0.8, 0.45))), 0.0);
+	outColor = vec4 (color * (0.2 + 0.8 * light), 1.0);
+}
@@ -0,0 +1,40 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#include "meshlet.glsl"
+
+layout (location = 0) out vec3 fragNormal;
+layout (location = 1) flat out uint fragMeshlet;
+
+// Octahedral, as decode_direction in Model.cpp
+vec3 decode_direction (vec2 p)
+{
+	vec3 n = vec3 (p, 1.0 - abs (p.x) - abs (p.y));
+	if (n.z < 0.0) n.xy = (1.0 - abs (p.yx)) * vec2 (p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+	return normalize (n);
+}
+
+// gl_VertexIndex includes the submesh's base vertex, gl_InstanceIndex is the draw's slot. ModelVertex is
+// 16 bytes: unorm16 position on the submesh bounds, then the octahedral snorm8 normal.
+void main ()
+{
+	uvec2 visible = visible_buffers[handles.visible].data[gl_InstanceIndex];
+	uvec2 cluster = cluster_buffers[handles.clusters].data[visible.x];
+	Node node = node_buffers[handles.nodes].data[cluster.y];
+
+	uint submesh = node.submesh * SUBMESH_WORDS;
+	vec3 lo, hi;
+	for (int i = 0; i < 3; i++) {
+		lo[i] = uintBitsToFloat (submesh_buffers[handles.submeshes].words[submesh + SUBMESH_BOUNDS_MIN + i]);
+		hi[i] = uintBitsToFloat (submesh_buffers[handles.submeshes].words[submesh + SUBMESH_BOUNDS_MAX + i]);
+	}
+
+	uvec4 vertex = model_vertex_buffers[handles.vertices].data[gl_VertexIndex];
+	vec3 t = vec3 (vertex.x & 0xffffu, vertex.x >> 16, vertex.y & 0xffffu) / 65535.0;
+	vec3 normal = decode_direction (unpackSnorm4x8 (vertex.y).zw);
+
+	mat4 world = frame_buffers[handles.frame].transforms[visible.y] * node.transform;
+	float mirror = determinant (mat3 (world)) < 0.0 ? -1.0 : 1.0;
+	gl_Position = frame_buffers[handles.frame].view_projection * world * vec4 (mix (lo, hi, t), 1.0);
+	fragNormal = mat3 (world) * normal * mirror;
+	fragMeshlet = cluster.x;
+}
@@ -0,0 +1,36 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#include "bindless.glsl"
+
+// Explicit Euler step of a particle system, one invocation per particle. Dispatched through
+// ComputeContext, usually on the async compute queue while the graphics queue renders.
+layout (local_size_x = 64) in;
+
+struct Particle {
+	vec4 position;  // w: remaining life in seconds, dead at or below zero
+	vec4 velocity;
+};
+
+layout (set = 0, binding = 2, std430) buffer ParticleBuffer { Particle data[]; } particle_buffers[];
+
+layout (push_constant) uniform Step
+{
+	vec4 gravity;  // xyz
+	uint particles;
+	uint count;
+	float dt;
+} step;
+
+void main ()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= step.count) return;
+
+	Particle particle = particle_buffers[step.particles].data[index];
+	if (particle.position.w <= 0.0) return;
+
+	particle.velocity.xyz += step.gravity.xyz * step.dt;
+	particle.position.xyz += particle.velocity.xyz * step.dt;
+	particle.position.w -= step.dt;
+	particle_buffers[step.particles].data[index] = particle;
+}
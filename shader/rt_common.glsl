@@ -0,0 +1,91 @@
+// Shared by the ray tracing shaders, include after bindless.glsl. The Trace block must match
+// RTTraceConstants in RayTracing.hpp, the mesh records RTMeshRecord in VulkanAccelerationStructures.cpp.
+
+layout (push_constant) uniform Trace
+{
+	mat4 inverse_view_projection;
+	vec4 light;  // xyz: the direction light travels, w: ambient occlusion radius
+	uvec2 scene;  // hardware: the TLAS device address, compute: the top and node buffers
+	uint target;  // storage image written, rgba8
+	uint meshes;
+	uint positions;
+	uint indices;
+	uint width;
+	uint height;
+	uint ao_samples;
+	uint frame;
+} trace;
+
+struct RTMesh {
+	uint first_index;
+	int vertex_offset;
+	uint index_count;
+	uint pad;
+};
+
+layout (set = 0, binding = 2, std430) readonly buffer RTMeshBuffer { RTMesh data[]; } rt_mesh_buffers[];
+layout (set = 0, binding = 2, std430) readonly buffer RTPositionBuffer { float data[]; } rt_position_buffers[];
+layout (set = 0, binding = 2, std430) readonly buffer RTIndexBuffer { uint data[]; } rt_index_buffers[];
+
+vec3 rt_position (uint vertex)
+{
+	return vec3 (rt_position_buffers[trace.positions].data[vertex * 3 + 0],
+	             rt_position_buffers[trace.positions].data[vertex * 3 + 1],
+	             rt_position_buffers[trace.positions].data[vertex * 3 + 2]);
+}
+
+// Object space normal of a triangle of a mesh, not normalized
+vec3 rt_triangle_normal (uint mesh, uint primitive)
+{
+	RTMesh record = rt_mesh_buffers[trace.meshes].data[mesh];
+	uint first = record.first_index + primitive * 3;
+	vec3 a = rt_position (uint (int (rt_index_buffers[trace.indices].data[first + 0]) + record.vertex_offset));
+	vec3 b = rt_position (uint (int (rt_index_buffers[trace.indices].data[first + 1]) + record.vertex_offset));
+	vec3 c = rt_position (uint (int (rt_index_buffers[trace.indices].data[first + 2]) + record.vertex_offset));
+	return cross (b - a, c - a);
+}
+
+// World space ray through the center of a pixel, from the near plane
+void rt_primary_ray (uvec2 pixel, out vec3 origin, out vec3 direction)
+{
+	vec2 ndc = (vec2 (pixel) + 0.5) / vec2 (trace.width, trace.height) * 2.0 - 1.0;
+	vec4 near = trace.inverse_view_projection * vec4 (ndc, 0.0, 1.0);
+	vec4 far = trace.inverse_view_projection * vec4 (ndc, 1.0, 1.0);
+	origin = near.xyz / near.w;
+	direction = normalize (far.xyz / far.w - origin);
+}
+
+// PCG hash, one random uint per call
+uint rt_random (inout uint state)
+{
+	state = state * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+float rt_random_float (inout uint state)
+{
+	return float (rt_random (state) >> 8) * (1.0 / 16777216.0);
+}
+
+uint rt_seed (uvec2 pixel)
+{
+	uint state = pixel.y * trace.width + pixel.x;
+	rt_random (state);
+	state += trace.frame * 1973u;
+	rt_random (state);
+	return state;
+}
+
+// Cosine weighted direction in the hemisphere around normal
+vec3 rt_cosine_hemisphere (vec3 normal, inout uint state)
+{
+	float u = rt_random_float (state);
+	float v = rt_random_float (state);
+	float r = sqrt (u);
+	float phi = 6.28318530718 * v;
+
+	vec3 tangent = normalize (abs (normal.x) > 0.5 ? cross (normal, vec3 (0.0, 1.0, 0.0)) : cross (normal, vec3 (1.0, 0.0, 0.0)));
+	vec3 bitangent = cross (normal, tangent);
+	return normalize (tangent * (r * cos (phi)) + bitangent * (r * sin (phi)) + normal * sqrt (max (0.0, 1.0 - u)));
+}
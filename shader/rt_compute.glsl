@@ -0,0 +1,242 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#include "bindless.glsl"
+#include "rt_common.glsl"
+
+// The image of rt_raygen.glsl without ray tracing hardware, for VulkanComputeRayTracing: both BVH
+// levels are traversed here. trace.scene.x is the top buffer of the frame, the instance BVH from node 0
+// followed by the instance records its leaves index; trace.scene.y holds the nodes of every mesh BVH,
+// whose leaves index triangles of trace.indices, stored in leaf order with absolute vertex indices.
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// RTWideNode in VulkanComputeRayTracing.cpp
+struct RTNode {
+	vec3 origin;     // minimum of the node bounds
+	uint exponents;  // byte per axis: the child grid spacing is 2^(byte - 127)
+	uint min_x;      // byte i: child i bounds on the grid, rounded outwards
+	uint min_y;
+	uint min_z;
+	uint max_x;
+	uint max_y;
+	uint max_z;
+	uint counts;  // byte i: primitives of leaf child i, 0 for an inner node
+	uint pad;
+	uvec4 child;  // node or first primitive, ~0 for an empty slot
+};
+
+// RTInstanceRecord in VulkanComputeRayTracing.cpp
+struct RTInstanceRecord {
+	vec4 world_to_object[3];  // rows
+	uint root;
+	uint mask;
+	uint pad0;
+	uint pad1;
+};
+
+layout (set = 0, binding = 2, std430) readonly buffer RTNodeBuffer { RTNode data[]; } rt_node_buffers[];
+layout (set = 0, binding = 2, std430) readonly buffer RTInstanceBuffer { RTInstanceRecord data[]; } rt_instance_buffers[];
+
+#define RT_STACK_SIZE 64
+#define RT_EMPTY 0xffffffffu
+
+vec3 rt_inverse_direction (vec3 direction)
+{
+	vec3 d = mix (vec3 (1.0e-30), vec3 (-1.0e-30), lessThan (direction, vec3 (0.0)));
+	return 1.0 / mix (direction, d, lessThan (abs (direction), vec3 (1.0e-30)));
+}
+
+// Bit i is set when the ray enters child i before t_max, t_near[i] is where it enters
+uint rt_intersect_children (RTNode node, vec3 origin, vec3 inv_dir, float t_max, out vec4 t_near)
+{
+	uvec3 biased = (uvec3 (node.exponents) >> uvec3 (0, 8, 16)) & 0xffu;
+	vec3 scale = uintBitsToFloat (biased << 23);
+	uvec3 lows = uvec3 (node.min_x, node.min_y, node.min_z);
+	uvec3 highs = uvec3 (node.max_x, node.max_y, node.max_z);
+
+	uint mask = 0u;
+	t_near = vec4 (1.0e30);
+	for (uint i = 0u; i < 4u; i++) {
+		if (node.child[i] == RT_EMPTY) continue;
+		vec3 low = node.origin + vec3 ((lows >> (i * 8u)) & 0xffu) * scale;
+		vec3 high = node.origin + vec3 ((highs >> (i * 8u)) & 0xffu) * scale;
+		vec3 t0 = (low - origin) * inv_dir;
+		vec3 t1 = (high - origin) * inv_dir;
+		vec3 near = min (t0, t1);
+		vec3 far = max (t0, t1);
+		float enter = max (max (near.x, near.y), max (near.z, 0.0));
+		float leave = min (min (far.x, far.y), min (far.z, t_max));
+		t_near[i] = enter;
+		if (enter <= leave) mask |= 1u << i;
+	}
+	return mask;
+}
+
+// Moller-Trumbore, both faces, t shrinks to the hit
+bool rt_intersect_triangle (vec3 origin, vec3 direction, uint triangle, inout float t)
+{
+	vec3 v0 = rt_position (rt_index_buffers[trace.indices].data[triangle * 3u + 0u]);
+	vec3 e1 = rt_position (rt_index_buffers[trace.indices].data[triangle * 3u + 1u]) - v0;
+	vec3 e2 = rt_position (rt_index_buffers[trace.indices].data[triangle * 3u + 2u]) - v0;
+
+	vec3 p = cross (direction, e2);
+	float det = dot (e1, p);
+	if (abs (det) < 1.0e-20) return false;
+	float inv = 1.0 / det;
+	vec3 s = origin - v0;
+	float u = dot (s, p) * inv;
+	if (u < 0.0 || u > 1.0) return false;
+	vec3 q = cross (s, e1);
+	float v = dot (direction, q) * inv;
+	if (v < 0.0 || u + v > 1.0) return false;
+	float d = dot (e2, q) * inv;
+	if (d <= 0.0 || d >= t) return false;
+	t = d;
+	return true;
+}
+
+// Nearest hit of an object space ray in a mesh BVH, or with any set the first one found. Nearer
+// children are visited first.
+bool rt_trace_mesh (uint root, vec3 origin, vec3 direction, bool any, inout float t, inout uint triangle)
+{
+	vec3 inv_dir = rt_inverse_direction (direction);
+	uint stack[RT_STACK_SIZE];
+	int top = 0;
+	stack[top++] = root;
+	bool found = false;
+	while (top > 0) {
+		RTNode node = rt_node_buffers[trace.scene.y].data[stack[--top]];
+		vec4 t_near;
+		uint mask = rt_intersect_children (node, origin, inv_dir, t, t_near);
+
+		uint order[4];
+		int count = 0;
+		for (uint i = 0u; i < 4u; i++) {
+			if ((mask & (1u << i)) == 0u) continue;
+			uint leaf = (node.counts >> (i * 8u)) & 0xffu;
+			if (leaf != 0u) {
+				for (uint p = node.child[i]; p < node.child[i] + leaf; p++) {
+					if (rt_intersect_triangle (origin, direction, p, t)) {
+						triangle = p;
+						found = true;
+						if (any) return true;
+					}
+				}
+				continue;
+			}
+			// sorted farthest first, so the nearest is popped first
+			int j = count++;
+			while (j > 0 && t_near[order[j - 1]] < t_near[i]) {
+				order[j] = order[j - 1];
+				j--;
+			}
+			order[j] = i;
+		}
+		for (int k = 0; k < count; k++) {
+			if (t_near[order[k]] <= t && top < RT_STACK_SIZE) stack[top++] = node.child[order[k]];
+		}
+	}
+	return found;
+}
+
+// Both levels: the instance BVH, then the mesh BVH of every instance whose box the ray enters. The
+// object space direction is not normalized, so t means the same in both spaces.
+bool rt_trace (vec3 origin, vec3 direction, bool any, inout float t, out uint instance, out uint triangle)
+{
+	vec3 inv_dir = rt_inverse_direction (direction);
+	uint stack[RT_STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0u;
+	bool found = false;
+	instance = 0u;
+	triangle = 0u;
+	while (top > 0) {
+		RTNode node = rt_node_buffers[trace.scene.x].data[stack[--top]];
+		vec4 t_near;
+		uint mask = rt_intersect_children (node, origin, inv_dir, t, t_near);
+
+		uint order[4];
+		int count = 0;
+		for (uint i = 0u; i < 4u; i++) {
+			if ((mask & (1u << i)) == 0u) continue;
+			uint leaf = (node.counts >> (i * 8u)) & 0xffu;
+			if (leaf != 0u) {
+				for (uint r = node.child[i]; r < node.child[i] + leaf; r++) {
+					RTInstanceRecord record = rt_instance_buffers[trace.scene.x].data[r];
+					if ((record.mask & 0xffu) == 0u) continue;
+					vec3 local_origin = vec3 (dot (record.world_to_object[0], vec4 (origin, 1.0)),
+					                          dot (record.world_to_object[1], vec4 (origin, 1.0)),
+					                          dot (record.world_to_object[2], vec4 (origin, 1.0)));
+					vec3 local_direction = vec3 (dot (record.world_to_object[0].xyz, direction),
+					                             dot (record.world_to_object[1].xyz, direction),
+					                             dot (record.world_to_object[2].xyz, direction));
+					if (rt_trace_mesh (record.root, local_origin, local_direction, any, t, triangle)) {
+						instance = r;
+						found = true;
+						if (any) return true;
+					}
+				}
+				continue;
+			}
+			int j = count++;
+			while (j > 0 && t_near[order[j - 1]] < t_near[i]) {
+				order[j] = order[j - 1];
+				j--;
+			}
+			order[j] = i;
+		}
+		for (int k = 0; k < count; k++) {
+			if (t_near[order[k]] <= t && top < RT_STACK_SIZE) stack[top++] = node.child[order[k]];
+		}
+	}
+	return found;
+}
+
+// World space normal of a triangle of an instance, facing the ray
+vec3 rt_hit_normal (uint instance, uint triangle, vec3 direction)
+{
+	RTInstanceRecord record = rt_instance_buffers[trace.scene.x].data[instance];
+	vec3 v0 = rt_position (rt_index_buffers[trace.indices].data[triangle * 3u + 0u]);
+	vec3 v1 = rt_position (rt_index_buffers[trace.indices].data[triangle * 3u + 1u]);
+	vec3 v2 = rt_position (rt_index_buffers[trace.indices].data[triangle * 3u + 2u]);
+	vec3 n = cross (v1 - v0, v2 - v0);
+
+	// the transpose of the object to world inverse, the rows weighted by the object space normal
+	vec3 normal = normalize (n.x * record.world_to_object[0].xyz + n.y * record.world_to_object[1].xyz +
+	                         n.z * record.world_to_object[2].xyz);
+	return dot (normal, direction) > 0.0 ? -normal : normal;
+}
+
+float rt_visibility (vec3 origin, vec3 direction, float t_max)
+{
+	float t = t_max;
+	uint instance, triangle;
+	return rt_trace (origin, direction, true, t, instance, triangle) ? 0.0 : 1.0;
+}
+
+void main ()
+{
+	uvec2 pixel = gl_GlobalInvocationID.xy;
+	if (pixel.x >= trace.width || pixel.y >= trace.height) return;
+
+	vec3 origin, direction;
+	rt_primary_ray (pixel, origin, direction);
+
+	vec4 result = vec4 (1.0, 1.0, 0.0, 0.0);
+	float t = 1.0e30;
+	uint instance, triangle;
+	if (rt_trace (origin, direction, false, t, instance, triangle)) {
+		vec3 normal = rt_hit_normal (instance, triangle, direction);
+		vec3 position = origin + direction * t + normal * 1.0e-3;
+
+		result.x = rt_visibility (position, -trace.light.xyz, 1.0e30);
+
+		uint state = rt_seed (pixel);
+		float open = 0.0;
+		for (uint i = 0; i < trace.ao_samples; i++) {
+			open += rt_visibility (position, rt_cosine_hemisphere (normal, state), trace.light.w);
+		}
+		result.y = trace.ao_samples > 0 ? open / float (trace.ao_samples) : 1.0;
+		result.w = 1.0;
+	}
+	imageStore (bindless_images[trace.target], ivec2 (pixel), result);
+}
@@ -0,0 +1,25 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : require
+#include "bindless.glsl"
+#include "rt_common.glsl"
+
+// Closest hit of primary rays: the geometric normal of the triangle, turned to face the ray. The
+// instance custom index is the mesh, see VulkanAccelerationStructures::record_tlas_build().
+
+struct PrimaryPayload {
+	vec3 normal;
+	float t;
+};
+
+layout (location = 0) rayPayloadInEXT PrimaryPayload primary;
+
+void main ()
+{
+	vec3 normal = rt_triangle_normal (gl_InstanceCustomIndexEXT, gl_PrimitiveID);
+	normal = normalize (transpose (mat3 (gl_WorldToObjectEXT)) * normal);
+	if (dot (normal, gl_WorldRayDirectionEXT) > 0.0) normal = -normal;
+
+	primary.normal = normal;
+	primary.t = gl_HitTEXT;
+}
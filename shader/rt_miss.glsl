@@ -0,0 +1,16 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+
+// Miss shader 0, primary rays that leave the scene
+
+struct PrimaryPayload {
+	vec3 normal;
+	float t;
+};
+
+layout (location = 0) rayPayloadInEXT PrimaryPayload primary;
+
+void main ()
+{
+	primary.t = -1.0;
+}
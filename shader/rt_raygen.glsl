@@ -0,0 +1,55 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+#extension GL_GOOGLE_include_directive : require
+#include "bindless.glsl"
+#include "rt_common.glsl"
+
+// One primary ray per pixel, then a shadow ray towards the light and ao_samples ambient occlusion
+// rays from what it hit. Writes (light visibility, ambient occlusion, 0, coverage) to the target.
+
+struct PrimaryPayload {
+	vec3 normal;  // world space, facing the ray
+	float t;      // negative on a miss
+};
+
+layout (location = 0) rayPayloadEXT PrimaryPayload primary;
+layout (location = 1) rayPayloadEXT uint visible;
+
+// Any hit ends the ray, only the shadow miss shader (miss index 1) sets visible
+float visibility (accelerationStructureEXT scene, vec3 origin, vec3 direction, float t_max)
+{
+	visible = 0u;
+	traceRayEXT (scene, gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsSkipClosestHitShaderEXT | gl_RayFlagsOpaqueEXT,
+	             0xff, 0, 0, 1, origin, 0.0, direction, t_max, 1);
+	return float (visible);
+}
+
+void main ()
+{
+	uvec2 pixel = gl_LaunchIDEXT.xy;
+	if (pixel.x >= trace.width || pixel.y >= trace.height) return;
+
+	accelerationStructureEXT scene = accelerationStructureEXT (trace.scene);
+
+	vec3 origin, direction;
+	rt_primary_ray (pixel, origin, direction);
+	primary.t = -1.0;
+	traceRayEXT (scene, gl_RayFlagsOpaqueEXT, 0xff, 0, 0, 0, origin, 0.0, direction, 1.0e30, 0);
+
+	vec4 result = vec4 (1.0, 1.0, 0.0, 0.0);
+	if (primary.t >= 0.0) {
+		vec3 normal = primary.normal;
+		vec3 position = origin + direction * primary.t + normal * 1.0e-3;
+
+		result.x = visibility (scene, position, -trace.light.xyz, 1.0e30);
+
+		uint state = rt_seed (pixel);
+		float open = 0.0;
+		for (uint i = 0; i < trace.ao_samples; i++) {
+			open += visibility (scene, position, rt_cosine_hemisphere (normal, state), trace.light.w);
+		}
+		result.y = trace.ao_samples > 0 ? open / float (trace.ao_samples) : 1.0;
+		result.w = 1.0;
+	}
+	imageStore (bindless_images[trace.target], ivec2 (pixel), result);
+}
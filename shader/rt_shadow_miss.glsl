@@ -0,0 +1,11 @@
+#version 460
+#extension GL_EXT_ray_tracing : require
+
+// Miss shader 1, shadow and ambient occlusion rays that reached their end unoccluded
+
+layout (location = 1) rayPayloadInEXT uint visible;
+
+void main ()
+{
+	visible = 1u;
+}
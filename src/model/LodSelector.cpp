@@ -0,0 +1,43 @@
+#include "fl/model/LodSelector.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+void LodSelector::set_projection(float fov_y, float viewport_height) {
+    projection_scale = viewport_height / (2.0f * std::tan(fov_y * 0.5f));
+}
+
+float LodSelector::projected_error(float error, float distance) const {
+    if (distance <= 0.0f) return error > 0.0f ? INFINITY : 0.0f;  // the camera is inside the bounds
+    return error * projection_scale / distance;
+}
+
+uint32_t LodSelector::select(const ModelView& model, uint32_t submesh, float distance, float scale) const {
+    const ModelSubmesh& mesh  = model.submeshes[submesh];
+    uint32_t            level = 0;
+    // errors grow down the chain, so the first level that is too coarse ends the search
+    while (level < mesh.lod_count &&
+           projected_error(model.lods[mesh.first_lod + level].error * scale, distance) <= pixel_error) {
+        level++;
+    }
+    return (uint32_t)std::clamp((int32_t)level + bias, 0, (int32_t)mesh.lod_count);
+}
+
+void LodSelector::range(const ModelView& model, uint32_t submesh, uint32_t level, uint32_t& first_index,
+                        uint32_t& index_count) {
+    const ModelSubmesh& mesh = model.submeshes[submesh];
+    if (level == 0 || level > mesh.lod_count) {
+        first_index = mesh.first_index;
+        index_count = mesh.index_count;
+        return;
+    }
+    const ModelLod& lod = model.lods[mesh.first_lod + level - 1];
+    first_index         = lod.first_index;
+    index_count         = lod.index_count;
+}
+
+}  // namespace fl
@@ -0,0 +1,292 @@
+#include "fl/model/MeshOptimizer.hpp"
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+
+#include "fl/model/MeshletBuilder.hpp"
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+// FIFO post-transform cache: a vertex is cached while fewer than size misses happened since its own
+struct VertexCache {
+    std::vector<uint32_t> stamps;
+    uint32_t              size;
+    uint32_t              time;
+
+    VertexCache(uint32_t vertex_count, uint32_t size) : stamps(vertex_count, 0), size(size), time(size + 1) {}
+
+    uint32_t age(uint32_t v) const { return time - stamps[v]; }
+    bool     access(uint32_t v) {  // true on a miss
+        if (age(v) <= size) return false;
+        stamps[v] = time++;
+        return true;
+    }
+    uint32_t access_triangle(const uint32_t* triangle) {
+        return (uint32_t)access(triangle[0]) + access(triangle[1]) + access(triangle[2]);
+    }
+    void flush() { time += size + 1; }
+};
+
+uint64_t MeshOptimizer::simulate_cache(const uint32_t* indices, size_t index_count, uint32_t vertex_count,
+                                       uint32_t cache_size) {
+    VertexCache cache(vertex_count, cache_size);
+    uint64_t    misses = 0;
+    for (size_t i = 0; i < index_count; i++) misses += cache.access(indices[i]);
+    return misses;
+}
+
+void MeshOptimizer::optimize_vertex_cache(uint32_t* indices, size_t index_count, uint32_t vertex_count,
+                                          uint32_t cache_size, std::vector<uint32_t>* clusters) {
+    const size_t triangle_count = index_count / 3;
+    if (clusters) clusters->clear();
+    if (!triangle_count) return;
+    if (clusters) clusters->push_back(0);
+
+    // the triangles around every vertex, in triangle order, and how many of them are still to be emitted
+    std::vector<uint32_t> live(vertex_count, 0), offsets(vertex_count + 1, 0), adjacency(triangle_count * 3);
+    for (size_t i = 0; i < triangle_count * 3; i++) live[indices[i]]++;
+    for (uint32_t v = 0; v < vertex_count; v++) offsets[v + 1] = offsets[v] + live[v];
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangle_count * 3; i++) adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+    VertexCache           cache(vertex_count, cache_size);
+    std::vector<uint8_t>  emitted(triangle_count, 0);
+    std::vector<uint32_t> output(triangle_count * 3), dead_end, candidates;
+    dead_end.reserve(triangle_count * 3);
+    size_t   written = 0;
+    uint32_t cursor  = 0;
+    uint32_t fanning = indices[0];
+    for (;;) {
+        candidates.clear();
+        for (uint32_t k = offsets[fanning]; k < offsets[fanning + 1]; k++) {
+            uint32_t triangle = adjacency[k];
+            if (emitted[triangle]) continue;
+            emitted[triangle] = 1;
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t v        = indices[triangle * 3 + corner];
+                output[written++] = v;
+                live[v]--;
+                cache.access(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+            }
+        }
+
+        // Prefer the neighbour that has been in the cache longest but will still be there after
+        // emitting its remaining triangles (each can push at most two new vertices)
+        uint32_t next = ~0u;
+        int64_t  best = -1;
+        for (uint32_t v : candidates) {
+            if (!live[v]) continue;
+            int64_t priority = cache.age(v) + 2 * live[v] <= cache_size ? cache.age(v) : 0;
+            if (priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+        if (next == ~0u) {
+            while (!dead_end.empty() && !live[dead_end.back()]) dead_end.pop_back();
+            if (!dead_end.empty()) {
+                next = dead_end.back();
+                dead_end.pop_back();
+            } else {
+                while (cursor < vertex_count && !live[cursor]) cursor++;
+                if (cursor == vertex_count) break;
+                next = cursor;
+            }
+            if (clusters) clusters->push_back((uint32_t)(written / 3));
+        }
+        fanning = next;
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshOptimizer::optimize_overdraw(uint32_t* indices, size_t index_count, const glm::vec3* positions,
+                                      uint32_t vertex_count, const std::vector<uint32_t>& clusters,
+                                      uint32_t cache_size, float threshold, uint32_t* cluster_count) {
+    const size_t triangle_count = index_count / 3;
+    if (cluster_count) *cluster_count = 0;
+    if (!triangle_count || clusters.empty()) return;
+
+    // Split every cluster again once the ACMR from its start, with a cold cache, is within the threshold
+    // of the whole cluster's: every cut costs a cache flush but that much stays bounded
+    VertexCache           cache(vertex_count, cache_size);
+    std::vector<uint32_t> starts;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        size_t begin = clusters[c], end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+        cache.flush();
+        uint64_t total = 0;
+        for (size_t t = begin; t < end; t++) total += cache.access_triangle(indices + t * 3);
+        double limit = threshold * (double)total / (double)(end - begin);
+
+        cache.flush();
+        uint64_t misses = 0;
+        size_t   start  = begin;
+        for (size_t t = begin; t < end; t++) {
+            misses += cache.access_triangle(indices + t * 3);
+            if (t + 1 == end || (double)misses <= limit * (double)(t + 1 - start)) {
+                starts.push_back((uint32_t)start);
+                start  = t + 1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+    }
+    const size_t count = starts.size();
+    starts.push_back((uint32_t)triangle_count);
+
+    // Area weighted centroid and normal of the mesh and of every cluster, in double so the order does
+    // not hinge on the rounding of long sums
+    struct Cluster {
+        glm::dvec3 centroid = glm::dvec3(0.0);
+        glm::dvec3 normal   = glm::dvec3(0.0);
+        double     area     = 0.0;
+    };
+    std::vector<Cluster> info(count);
+    glm::dvec3           mesh_centroid(0.0);
+    double               mesh_area = 0.0;
+    for (size_t c = 0; c < count; c++) {
+        for (uint32_t t = starts[c]; t < starts[c + 1]; t++) {
+            glm::dvec3 a(positions[indices[t * 3]]), b(positions[indices[t * 3 + 1]]), d(positions[indices[t * 3 + 2]]);
+            glm::dvec3 normal = glm::cross(b - a, d - a);
+            double     area   = glm::length(normal);
+            info[c].centroid += (a + b + d) * (area / 3.0);
+            info[c].normal += normal;
+            info[c].area += area;
+        }
+        mesh_centroid += info[c].centroid;
+        mesh_area += info[c].area;
+    }
+    if (mesh_area > 0.0) mesh_centroid /= mesh_area;
+
+    std::vector<double> facing(count, 0.0);
+    for (size_t c = 0; c < count; c++) {
+        double length = glm::length(info[c].normal);
+        if (info[c].area <= 0.0 || length <= 0.0) continue;
+        facing[c] = glm::dot(info[c].centroid / info[c].area - mesh_centroid, info[c].normal / length);
+    }
+
+    std::vector<uint32_t> order(count);
+    for (size_t c = 0; c < count; c++) order[c] = (uint32_t)c;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return facing[a] > facing[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(triangle_count * 3);
+    for (uint32_t c : order) output.insert(output.end(), indices + starts[c] * 3, indices + starts[c + 1] * 3);
+    std::copy(output.begin(), output.end(), indices);
+    if (cluster_count) *cluster_count = (uint32_t)count;
+}
+
+void MeshOptimizer::optimize_vertex_fetch(uint32_t* indices, size_t index_count, uint32_t vertex_count,
+                                          std::vector<uint32_t>& remap) {
+    remap.assign(vertex_count, ~0u);
+    uint32_t next = 0;
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t& target = remap[indices[i]];
+        if (target == ~0u) target = next++;
+        indices[i] = target;
+    }
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        if (remap[v] == ~0u) remap[v] = next++;
+    }
+}
+
+// Vertex cache and overdraw order of one triangle list, returns the number of overdraw clusters
+static uint32_t reorder(std::vector<uint32_t>& indices, uint32_t vertex_count, const glm::vec3* positions,
+                        const MeshOptimizerOptions& options) {
+    if (!options.vertex_cache) return 0;
+    std::vector<uint32_t> clusters;
+    MeshOptimizer::optimize_vertex_cache(indices.data(), indices.size(), vertex_count, options.cache_size, &clusters);
+    if (!options.overdraw) return 0;
+    uint32_t count = 0;
+    MeshOptimizer::optimize_overdraw(indices.data(), indices.size(), positions, vertex_count, clusters,
+                                     options.cache_size, options.overdraw_threshold, &count);
+    return count;
+}
+
+// The levels of the submesh get the same treatment as the submesh, and its vertex order
+static void optimize_submesh(Model& model, uint32_t index, const MeshOptimizerOptions& options,
+                             MeshOptimizerStats& stats, std::vector<ModelMeshlet>& meshlets) {
+    const ModelSubmesh&   submesh      = model.submeshes[index];
+    const uint32_t        vertex_count = submesh.vertex_count;
+    const size_t          index_count  = submesh.index_count - submesh.index_count % 3;
+    std::vector<uint32_t> indices(index_count);
+    for (size_t i = 0; i < index_count; i++) indices[i] = model.index(submesh.first_index + i);
+
+    std::vector<glm::vec3> positions;
+    if ((options.vertex_cache && options.overdraw) || options.meshlets) {
+        positions.resize(vertex_count);
+        for (uint32_t v = 0; v < vertex_count; v++) {
+            positions[v] = decode_position(submesh, model.vertices[submesh.base_vertex + v]);
+        }
+    }
+
+    std::vector<uint8_t> used(vertex_count, 0);
+    for (uint32_t v : indices) used[v] = 1;
+    stats.triangles          = index_count / 3;
+    stats.vertices           = (uint64_t)std::count(used.begin(), used.end(), 1);
+    stats.transformed_before = MeshOptimizer::simulate_cache(indices.data(), index_count, vertex_count,
+                                                             options.cache_size);
+    stats.clusters           = reorder(indices, vertex_count, positions.data(), options);
+
+    if (options.meshlets) {
+        MeshletBuilder::build(indices.data(), index_count, positions.data(), vertex_count, meshlets);
+        for (auto& meshlet : meshlets) {
+            meshlet.first_index += submesh.first_index;
+            meshlet.submesh = index;
+        }
+        stats.meshlets = meshlets.size();
+    }
+    stats.transformed_after = MeshOptimizer::simulate_cache(indices.data(), index_count, vertex_count,
+                                                            options.cache_size);
+
+    std::vector<uint32_t> remap;
+    if (options.vertex_fetch) {
+        MeshOptimizer::optimize_vertex_fetch(indices.data(), index_count, vertex_count, remap);
+        ModelVertex*             vertices = model.vertices.data() + submesh.base_vertex;
+        std::vector<ModelVertex> source(vertices, vertices + vertex_count);
+        for (uint32_t v = 0; v < vertex_count; v++) vertices[remap[v]] = source[v];
+    }
+    for (size_t i = 0; i < index_count; i++) model.set_index(submesh.first_index + i, indices[i]);
+
+    for (uint32_t l = 0; l < submesh.lod_count; l++) {
+        const ModelLod& lod = model.lods[submesh.first_lod + l];
+        indices.resize(lod.index_count - lod.index_count % 3);
+        for (size_t i = 0; i < indices.size(); i++) indices[i] = model.index(lod.first_index + i);
+        reorder(indices, vertex_count, positions.data(), options);
+        for (size_t i = 0; i < indices.size(); i++) {
+            model.set_index(lod.first_index + i, remap.empty() ? indices[i] : remap[indices[i]]);
+        }
+    }
+}
+
+MeshOptimizerStats MeshOptimizer::optimize(Model& model, const MeshOptimizerOptions& options) {
+    std::vector<MeshOptimizerStats>        results(model.submeshes.size());
+    std::vector<std::vector<ModelMeshlet>> meshlets(model.submeshes.size());
+    tbb::parallel_for(size_t(0), model.submeshes.size(), [&](size_t i) {
+        optimize_submesh(model, (uint32_t)i, options, results[i], meshlets[i]);
+    });
+
+    // meshlets are laid out in submesh order, whichever thread built them
+    model.meshlets.clear();
+    for (size_t i = 0; i < model.submeshes.size(); i++) {
+        model.submeshes[i].first_meshlet = (uint32_t)model.meshlets.size();
+        model.submeshes[i].meshlet_count = (uint32_t)meshlets[i].size();
+        model.meshlets.insert(model.meshlets.end(), meshlets[i].begin(), meshlets[i].end());
+    }
+
+    MeshOptimizerStats stats;
+    for (auto& result : results) {
+        stats.triangles += result.triangles;
+        stats.vertices += result.vertices;
+        stats.transformed_before += result.transformed_before;
+        stats.transformed_after += result.transformed_after;
+        stats.clusters += result.clusters;
+        stats.meshlets += result.meshlets;
+    }
+    return stats;
+}
+
+}  // namespace fl
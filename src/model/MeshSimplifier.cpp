@@ -0,0 +1,282 @@
+#include "fl/model/MeshSimplifier.hpp"
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+// Sum of squared distances to weighted planes, as the symmetric matrix A, the vector b and c of
+// x'Ax + 2b'x + c; weight is the total area, so cost / weight is a mean squared distance
+struct Quadric {
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0, c = 0.0;
+    double weight = 0.0;
+
+    void add_plane(const glm::dvec3& n, double d, double w) {
+        a00 += w * n.x * n.x, a01 += w * n.x * n.y, a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y, a12 += w * n.y * n.z, a22 += w * n.z * n.z;
+        b0 += w * n.x * d, b1 += w * n.y * d, b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00, a01 += q.a01, a02 += q.a02, a11 += q.a11, a12 += q.a12, a22 += q.a22;
+        b0 += q.b0, b1 += q.b1, b2 += q.b2, c += q.c;
+        weight += q.weight;
+    }
+
+    double error(const glm::dvec3& p) const {  // root mean distance
+        double cost = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+                      2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+                      2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return weight > 0.0 ? std::sqrt(std::max(cost, 0.0) / weight) : 0.0;
+    }
+};
+
+struct Collapse {
+    double   error;
+    uint32_t from, to;
+    uint32_t version;  // of from when the collapse was found
+};
+
+// Cheapest first, ties by index so the order never depends on the heap's internals
+struct CollapseOrder {
+    bool operator()(const Collapse& a, const Collapse& b) const {
+        if (a.error != b.error) return a.error > b.error;
+        if (a.from != b.from) return a.from > b.from;
+        return a.to > b.to;
+    }
+};
+
+// Vertices sharing a position with another vertex, or on an edge that does not have exactly two
+// triangles once vertices are welded by position
+static std::vector<uint8_t> find_locked(const uint32_t* indices, size_t index_count, const glm::vec3* positions,
+                                        uint32_t vertex_count) {
+    std::vector<uint32_t> order(vertex_count);
+    for (uint32_t v = 0; v < vertex_count; v++) order[v] = v;
+    auto less = [&](uint32_t a, uint32_t b) {
+        const glm::vec3 &p = positions[a], &q = positions[b];
+        if (p.x != q.x) return p.x < q.x;
+        if (p.y != q.y) return p.y < q.y;
+        if (p.z != q.z) return p.z < q.z;
+        return a < b;
+    };
+    std::sort(order.begin(), order.end(), less);
+
+    std::vector<uint8_t>  locked(vertex_count, 0);
+    std::vector<uint32_t> weld(vertex_count);
+    for (uint32_t i = 0, first = 0; i < vertex_count; i++) {
+        if (i > 0 && positions[order[i]] != positions[order[i - 1]]) first = i;
+        weld[order[i]] = order[first];
+        if (i > first) locked[order[i]] = locked[order[first]] = 1;
+    }
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        if (locked[weld[v]]) locked[v] = 1;
+    }
+
+    std::vector<uint64_t> edges;
+    edges.reserve(index_count);
+    for (size_t t = 0; t + 2 < index_count; t += 3) {
+        for (int corner = 0; corner < 3; corner++) {
+            uint32_t a = weld[indices[t + corner]], b = weld[indices[t + (corner + 1) % 3]];
+            edges.push_back((uint64_t)std::min(a, b) << 32 | std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    std::vector<uint8_t> welded_locked(vertex_count, 0);
+    for (size_t i = 0; i < edges.size();) {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i]) j++;
+        if (j - i != 2) welded_locked[edges[i] >> 32] = welded_locked[edges[i] & 0xffffffffu] = 1;
+        i = j;
+    }
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        if (welded_locked[weld[v]]) locked[v] = 1;
+    }
+    return locked;
+}
+
+void MeshSimplifier::simplify(const uint32_t* indices, size_t index_count, const glm::vec3* positions,
+                              uint32_t vertex_count, const MeshSimplifierOptions& options, float radius,
+                              std::vector<SimplifiedMesh>& levels) {
+    levels.clear();
+    const size_t triangle_count = index_count / 3;
+    if (!options.levels || triangle_count <= options.min_triangles) return;
+
+    std::vector<uint32_t>              triangles(indices, indices + triangle_count * 3);
+    std::vector<uint8_t>               alive(triangle_count, 1), removed(vertex_count, 0);
+    std::vector<uint32_t>              versions(vertex_count, 0);
+    std::vector<std::vector<uint32_t>> around(vertex_count);  // triangles of each vertex, may hold dead ones
+    std::vector<Quadric>               quadrics(vertex_count);
+    std::vector<uint8_t>               locked = find_locked(indices, triangle_count * 3, positions, vertex_count);
+
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        const uint32_t* tri = &triangles[t * 3];
+        glm::dvec3      a(positions[tri[0]]), b(positions[tri[1]]), c(positions[tri[2]]);
+        glm::dvec3      normal = glm::cross(b - a, c - a);
+        double          length = glm::length(normal);
+        for (int corner = 0; corner < 3; corner++) around[tri[corner]].push_back(t);
+        if (length <= 0.0) continue;
+        normal /= length;
+        double distance = -glm::dot(normal, a);
+        for (int corner = 0; corner < 3; corner++) quadrics[tri[corner]].add_plane(normal, distance, length);
+    }
+
+    // Moving from onto to must leave every other triangle of from facing the same way
+    auto flips = [&](uint32_t from, uint32_t to) {
+        glm::dvec3 target(positions[to]);
+        for (uint32_t t : around[from]) {
+            const uint32_t* tri = &triangles[t * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+            glm::dvec3 p[3], q[3];
+            for (int corner = 0; corner < 3; corner++) {
+                p[corner] = glm::dvec3(positions[tri[corner]]);
+                q[corner] = tri[corner] == from ? target : p[corner];
+            }
+            glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::dvec3 after  = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 0.0) return true;
+        }
+        return false;
+    };
+
+    // The heap holds the cheapest collapse of every vertex that can move. Whenever the neighbourhood
+    // of a vertex changes its version goes up and its collapse is found again, so a popped collapse
+    // with the current version is still valid and still the cheapest of its vertex.
+    std::priority_queue<Collapse, std::vector<Collapse>, CollapseOrder> heap;
+    std::vector<uint32_t>                                               neighbours;
+    auto gather = [&](uint32_t v) {
+        auto& list = around[v];
+        list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t t) { return !alive[t]; }), list.end());
+        std::sort(list.begin(), list.end());
+        list.erase(std::unique(list.begin(), list.end()), list.end());
+        neighbours.clear();
+        for (uint32_t t : list) neighbours.insert(neighbours.end(), &triangles[t * 3], &triangles[t * 3 + 3]);
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    };
+    auto push = [&](uint32_t from) {
+        if (locked[from] || removed[from]) return;
+        gather(from);
+        Collapse best = {0.0, from, ~0u, versions[from]};
+        for (uint32_t to : neighbours) {
+            if (to == from) continue;
+            Quadric q = quadrics[from];
+            q.add(quadrics[to]);
+            double error = q.error(glm::dvec3(positions[to]));
+            if ((best.to == ~0u || error < best.error) && !flips(from, to)) {
+                best.error = error;
+                best.to    = to;
+            }
+        }
+        if (best.to != ~0u) heap.push(best);
+    };
+    for (uint32_t v = 0; v < vertex_count; v++) push(v);
+
+    const double          max_error = (double)options.max_error * radius;
+    size_t                live      = triangle_count;
+    double                error     = 0.0;
+    bool                  done      = false;
+    std::vector<uint32_t> changed;
+    for (uint32_t level = 0; level < options.levels && !done; level++) {
+        size_t previous = levels.empty() ? triangle_count : levels.back().indices.size() / 3;
+        size_t target   = std::max<size_t>((size_t)((double)previous * options.ratio), options.min_triangles);
+        if (target >= previous) break;
+
+        while (live > target) {
+            if (heap.empty()) {
+                done = true;
+                break;
+            }
+            Collapse collapse = heap.top();
+            if (collapse.error > max_error) {
+                done = true;
+                break;
+            }
+            heap.pop();
+            uint32_t from = collapse.from, to = collapse.to;
+            if (removed[from] || versions[from] != collapse.version) continue;
+
+            for (uint32_t t : around[from]) {
+                if (!alive[t]) continue;
+                uint32_t* tri = &triangles[t * 3];
+                if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                    alive[t] = 0;
+                    live--;
+                    continue;
+                }
+                for (int corner = 0; corner < 3; corner++) {
+                    if (tri[corner] == from) tri[corner] = to;
+                }
+                around[to].push_back(t);
+            }
+            removed[from] = 1;
+            around[from].clear();
+            quadrics[to].add(quadrics[from]);
+            error = std::max(error, collapse.error);
+
+            // to and everything around it has new triangles or a new quadric next door
+            gather(to);
+            changed = neighbours;
+            for (uint32_t v : changed) versions[v]++;
+            for (uint32_t v : changed) push(v);
+        }
+
+        // a level that is hardly smaller than the one above is not worth its indices
+        if (live * 10 > previous * 9) break;
+        SimplifiedMesh mesh;
+        mesh.error = (float)error;
+        mesh.indices.reserve(live * 3);
+        for (uint32_t t = 0; t < triangle_count; t++) {
+            if (alive[t]) mesh.indices.insert(mesh.indices.end(), &triangles[t * 3], &triangles[t * 3 + 3]);
+        }
+        levels.push_back(std::move(mesh));
+    }
+}
+
+// The submeshes' own indices stay where they are, any previous levels behind them are dropped
+void MeshSimplifier::generate_lods(Model& model, const MeshSimplifierOptions& options) {
+    size_t base_indices = 0;
+    for (auto& submesh : model.submeshes) {
+        base_indices = std::max(base_indices, (size_t)submesh.first_index + submesh.index_count);
+    }
+    model.indices.resize(base_indices * model.index_size);
+    model.lods.clear();
+
+    std::vector<std::vector<SimplifiedMesh>> results(model.submeshes.size());
+    tbb::parallel_for(size_t(0), model.submeshes.size(), [&](size_t i) {
+        const ModelSubmesh&   submesh = model.submeshes[i];
+        std::vector<uint32_t> indices(submesh.index_count);
+        for (uint32_t k = 0; k < submesh.index_count; k++) indices[k] = model.index(submesh.first_index + k);
+        std::vector<glm::vec3> positions(submesh.vertex_count);
+        for (uint32_t v = 0; v < submesh.vertex_count; v++) {
+            positions[v] = decode_position(submesh, model.vertices[submesh.base_vertex + v]);
+        }
+        float radius = 0.5f * glm::length(submesh.bounds_max - submesh.bounds_min);
+        simplify(indices.data(), indices.size(), positions.data(), submesh.vertex_count, options, radius,
+                 results[i]);
+    });
+
+    for (size_t i = 0; i < model.submeshes.size(); i++) {
+        ModelSubmesh& submesh = model.submeshes[i];
+        submesh.first_lod     = (uint32_t)model.lods.size();
+        submesh.lod_count     = (uint32_t)results[i].size();
+        for (auto& level : results[i]) {
+            ModelLod lod;
+            lod.first_index = (uint32_t)(model.indices.size() / model.index_size);
+            lod.index_count = (uint32_t)level.indices.size();
+            lod.error       = level.error;
+            model.lods.push_back(lod);
+            model.indices.resize(model.indices.size() + level.indices.size() * model.index_size);
+            for (size_t k = 0; k < level.indices.size(); k++) model.set_index(lod.first_index + k, level.indices[k]);
+        }
+    }
+}
+
+}  // namespace fl
@@ -0,0 +1,140 @@
+#include "fl/model/MeshletBuilder.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <tuple>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+void MeshletBuilder::build(uint32_t* indices, size_t index_count, const glm::vec3* positions, uint32_t vertex_count,
+                           std::vector<ModelMeshlet>& meshlets) {
+    meshlets.clear();
+    const size_t triangle_count = index_count / 3;
+    if (!triangle_count) return;
+
+    std::vector<uint32_t> offsets(vertex_count + 1, 0), adjacency(triangle_count * 3);
+    for (size_t i = 0; i < triangle_count * 3; i++) offsets[indices[i] + 1]++;
+    for (uint32_t v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangle_count * 3; i++) adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+    std::vector<glm::vec3> centroids(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++) {
+        const uint32_t* tri = indices + t * 3;
+        centroids[t]        = (positions[tri[0]] + positions[tri[1]] + positions[tri[2]]) / 3.0f;
+    }
+
+    std::vector<uint8_t>  used(triangle_count, 0);
+    std::vector<uint32_t> owner(vertex_count, ~0u);  // the meshlet a vertex was last added to
+    std::vector<uint32_t> live(vertex_count);        // triangles around a vertex no meshlet has taken
+    for (uint32_t v = 0; v < vertex_count; v++) live[v] = offsets[v + 1] - offsets[v];
+    std::vector<uint32_t> output, members, candidates;
+    output.reserve(triangle_count * 3);
+    size_t cursor = 0;
+    for (;;) {
+        while (cursor < triangle_count && used[cursor]) cursor++;
+        if (cursor == triangle_count) break;
+
+        const uint32_t id       = (uint32_t)meshlets.size();
+        uint32_t       vertices = 0;
+        glm::vec3      sum(0.0f);
+        members.clear();
+        candidates.clear();
+        auto add = [&](uint32_t t) {
+            used[t] = 1;
+            members.push_back(t);
+            sum += centroids[t];
+            for (int corner = 0; corner < 3; corner++) {
+                uint32_t v = indices[t * 3 + corner];
+                live[v]--;
+                if (owner[v] == id) continue;
+                owner[v] = id;
+                vertices++;
+                for (uint32_t k = offsets[v]; k < offsets[v + 1]; k++) {
+                    if (!used[adjacency[k]]) candidates.push_back(adjacency[k]);
+                }
+            }
+        };
+        add((uint32_t)cursor);
+
+        while (members.size() < meshlet_max_triangles) {
+            glm::vec3 center        = sum / (float)members.size();
+            uint32_t  best          = ~0u;
+            uint32_t  best_new      = 4;
+            uint32_t  best_live     = ~0u;
+            float     best_distance = FLT_MAX;
+            size_t    kept          = 0;
+            for (uint32_t t : candidates) {
+                if (used[t]) continue;
+                candidates[kept++] = t;
+                const uint32_t* tri   = indices + t * 3;
+                uint32_t        fresh = (owner[tri[0]] != id) + (owner[tri[1]] != id) + (owner[tri[2]] != id);
+                if (vertices + fresh > meshlet_max_vertices) continue;
+                uint32_t  left     = live[tri[0]] + live[tri[1]] + live[tri[2]];
+                glm::vec3 offset   = centroids[t] - center;
+                float     distance = glm::dot(offset, offset);
+                if (std::tie(fresh, left, distance, t) < std::tie(best_new, best_live, best_distance, best)) {
+                    best          = t;
+                    best_new      = fresh;
+                    best_live     = left;
+                    best_distance = distance;
+                }
+            }
+            candidates.resize(kept);
+            if (best == ~0u) break;
+            add(best);
+        }
+
+        std::sort(members.begin(), members.end());
+        ModelMeshlet meshlet;
+        meshlet.first_index  = (uint32_t)output.size();
+        meshlet.index_count  = (uint32_t)members.size() * 3;
+        meshlet.vertex_count = vertices;
+        for (uint32_t t : members) output.insert(output.end(), indices + t * 3, indices + t * 3 + 3);
+        compute_bounds(output.data() + meshlet.first_index, meshlet.index_count, positions, meshlet);
+        meshlets.push_back(meshlet);
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void MeshletBuilder::compute_bounds(const uint32_t* indices, size_t index_count, const glm::vec3* positions,
+                                    ModelMeshlet& meshlet) {
+    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+    for (size_t i = 0; i < index_count; i++) {
+        low  = glm::min(low, positions[indices[i]]);
+        high = glm::max(high, positions[indices[i]]);
+    }
+    meshlet.center = (low + high) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (size_t i = 0; i < index_count; i++) {
+        meshlet.radius = std::max(meshlet.radius, glm::length(positions[indices[i]] - meshlet.center));
+    }
+
+    // the axis is the mean of the unit normals, the cone opens as far as the normal furthest from it
+    std::vector<glm::vec3> normals;
+    normals.reserve(index_count / 3);
+    glm::vec3 axis(0.0f);
+    for (size_t t = 0; t + 2 < index_count; t += 3) {
+        glm::vec3 a = positions[indices[t]], b = positions[indices[t + 1]], c = positions[indices[t + 2]];
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float     length = glm::length(normal);
+        if (length <= 0.0f) continue;
+        normals.push_back(normal / length);
+        axis += normals.back();
+    }
+    meshlet.cone_axis   = glm::vec3(0.0f);
+    meshlet.cone_cutoff = 1.0f;
+    float length        = glm::length(axis);
+    if (length <= 1e-6f) return;
+    axis /= length;
+
+    float min_dot = 1.0f;
+    for (auto& normal : normals) min_dot = std::min(min_dot, glm::dot(axis, normal));
+    meshlet.cone_axis = axis;
+    if (min_dot > 0.0f) meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+}  // namespace fl
@@ -0,0 +1,162 @@
+#include "fl/model/Model.hpp"
+
+#include <cfloat>
+#include <cstring>
+
+#include "glm/gtc/packing.hpp"
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+uint32_t Model::index(size_t i) const {
+    if (index_size == 2) {
+        uint16_t value;
+        memcpy(&value, indices.data() + i * 2, 2);
+        return value;
+    }
+    uint32_t value;
+    memcpy(&value, indices.data() + i * 4, 4);
+    return value;
+}
+
+void Model::set_index(size_t i, uint32_t value) {
+    if (index_size == 2) {
+        uint16_t narrow = (uint16_t)value;
+        memcpy(indices.data() + i * 2, &narrow, 2);
+        return;
+    }
+    memcpy(indices.data() + i * 4, &value, 4);
+}
+
+uint32_t Model::add_string(const std::string& text) {
+    for (size_t offset = 0; offset < strings.size(); offset += strlen(strings.data() + offset) + 1) {
+        if (text == strings.data() + offset) return (uint32_t)offset;
+    }
+    uint32_t offset = (uint32_t)strings.size();
+    strings.insert(strings.end(), text.begin(), text.end());
+    strings.push_back('\0');
+    return offset;
+}
+
+ModelView Model::view() const {
+    ModelView result;
+    result.vertices       = vertices.data();
+    result.indices        = indices.data();
+    result.submeshes      = submeshes.data();
+    result.materials      = materials.data();
+    result.nodes          = nodes.data();
+    result.lods           = lods.data();
+    result.meshlets       = meshlets.data();
+    result.strings        = strings.data();
+    result.vertex_count   = (uint32_t)vertices.size();
+    result.index_count    = index_count();
+    result.index_size     = index_size;
+    result.submesh_count  = (uint32_t)submeshes.size();
+    result.material_count = (uint32_t)materials.size();
+    result.node_count     = (uint32_t)nodes.size();
+    result.lod_count      = (uint32_t)lods.size();
+    result.meshlet_count  = (uint32_t)meshlets.size();
+    result.string_bytes   = (uint32_t)strings.size();
+    return result;
+}
+
+glm::vec3 Model::bounds_min() const {
+    glm::vec3 result(FLT_MAX);
+    for (auto& node : nodes) {
+        auto& submesh = submeshes[node.submesh];
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 p(corner & 1 ? submesh.bounds_max.x : submesh.bounds_min.x,
+                        corner & 2 ? submesh.bounds_max.y : submesh.bounds_min.y,
+                        corner & 4 ? submesh.bounds_max.z : submesh.bounds_min.z);
+            result = glm::min(result, glm::vec3(node.transform * glm::vec4(p, 1.0f)));
+        }
+    }
+    return result;
+}
+
+glm::vec3 Model::bounds_max() const {
+    glm::vec3 result(-FLT_MAX);
+    for (auto& node : nodes) {
+        auto& submesh = submeshes[node.submesh];
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 p(corner & 1 ? submesh.bounds_max.x : submesh.bounds_min.x,
+                        corner & 2 ? submesh.bounds_max.y : submesh.bounds_min.y,
+                        corner & 4 ? submesh.bounds_max.z : submesh.bounds_min.z);
+            result = glm::max(result, glm::vec3(node.transform * glm::vec4(p, 1.0f)));
+        }
+    }
+    return result;
+}
+
+size_t Model::size_bytes() const {
+    return vertices.size() * sizeof(ModelVertex) + indices.size() + submeshes.size() * sizeof(ModelSubmesh) +
+           materials.size() * sizeof(ModelMaterial) + nodes.size() * sizeof(ModelNode) +
+           lods.size() * sizeof(ModelLod) + meshlets.size() * sizeof(ModelMeshlet) + strings.size();
+}
+
+void Model::clear() {
+    vertices.clear();
+    indices.clear();
+    index_size = 4;
+    submeshes.clear();
+    materials.clear();
+    nodes.clear();
+    lods.clear();
+    meshlets.clear();
+    strings.clear();
+}
+
+void encode_position(const ModelSubmesh& submesh, const glm::vec3& position, ModelVertex& vertex) {
+    glm::vec3 extent = submesh.bounds_max - submesh.bounds_min;
+    for (int i = 0; i < 3; i++) {
+        float t            = extent[i] > 0.0f ? (position[i] - submesh.bounds_min[i]) / extent[i] : 0.0f;
+        vertex.position[i] = (uint16_t)glm::round(glm::clamp(t, 0.0f, 1.0f) * 65535.0f);
+    }
+}
+
+glm::vec3 decode_position(const ModelSubmesh& submesh, const ModelVertex& vertex) {
+    glm::vec3 t(vertex.position[0], vertex.position[1], vertex.position[2]);
+    return submesh.bounds_min + t / 65535.0f * (submesh.bounds_max - submesh.bounds_min);
+}
+
+// Octahedral mapping: the unit sphere projected on the octahedron, the lower half folded outwards
+void encode_direction(const glm::vec3& direction, int8_t oct[2]) {
+    float l1 = glm::abs(direction.x) + glm::abs(direction.y) + glm::abs(direction.z);
+    if (l1 == 0.0f) {
+        oct[0] = oct[1] = 0;
+        return;
+    }
+    glm::vec3 n = direction / l1;
+    glm::vec2 p(n.x, n.y);
+    if (n.z < 0.0f) {
+        glm::vec2 sign(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+        p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * sign;
+    }
+    oct[0] = (int8_t)glm::round(glm::clamp(p.x, -1.0f, 1.0f) * 127.0f);
+    oct[1] = (int8_t)glm::round(glm::clamp(p.y, -1.0f, 1.0f) * 127.0f);
+}
+
+glm::vec3 decode_direction(const int8_t oct[2]) {
+    glm::vec2 p(oct[0] / 127.0f, oct[1] / 127.0f);
+    glm::vec3 n(p.x, p.y, 1.0f - glm::abs(p.x) - glm::abs(p.y));
+    if (n.z < 0.0f) {
+        glm::vec2 sign(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+        glm::vec2 folded = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * sign;
+        n.x              = folded.x;
+        n.y              = folded.y;
+    }
+    float length = glm::length(n);
+    return length > 0.0f ? n / length : n;
+}
+
+void encode_uv(const glm::vec2& uv, ModelVertex& vertex) {
+    vertex.uv[0] = glm::packHalf1x16(uv.x);
+    vertex.uv[1] = glm::packHalf1x16(uv.y);
+}
+
+glm::vec2 decode_uv(const ModelVertex& vertex) {
+    return glm::vec2(glm::unpackHalf1x16(vertex.uv[0]), glm::unpackHalf1x16(vertex.uv[1]));
+}
+
+}  // namespace fl
@@ -0,0 +1,304 @@
+#include "fl/model/ModelCache.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+static const char model_cache_magic[8] = {'F', 'L', 'M', 'O', 'D', 'E', 'L', '\0'};
+
+struct ModelCacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t key;
+    uint64_t file_size;
+    uint32_t index_size;
+    uint32_t reserved[7];
+};
+
+struct ModelCacheSection {
+    uint32_t type;    // ModelSection
+    uint32_t stride;  // element size
+    uint64_t offset;  // from the start of the file
+    uint64_t size;    // bytes
+};
+
+static_assert(sizeof(ModelCacheHeader) == 64 && sizeof(ModelCacheSection) == 24, "model cache layout");
+
+static uint64_t process_id() {
+#ifdef _WIN32
+    return (uint64_t)GetCurrentProcessId();
+#else
+    return (uint64_t)getpid();
+#endif
+}
+
+static uint64_t align_up(uint64_t value) {
+    return (value + model_cache_alignment - 1) & ~(uint64_t)(model_cache_alignment - 1);
+}
+
+int ModelCache::write(const std::string& path, const Model& model, uint64_t key) {
+    struct Source {
+        ModelSection type;
+        uint32_t     stride;
+        const void*  data;
+        uint64_t     size;
+    };
+    const Source sources[] = {
+        {ModelSection::Vertices, sizeof(ModelVertex), model.vertices.data(),
+         model.vertices.size() * sizeof(ModelVertex)},
+        {ModelSection::Indices, model.index_size, model.indices.data(), model.indices.size()},
+        {ModelSection::Submeshes, sizeof(ModelSubmesh), model.submeshes.data(),
+         model.submeshes.size() * sizeof(ModelSubmesh)},
+        {ModelSection::Materials, sizeof(ModelMaterial), model.materials.data(),
+         model.materials.size() * sizeof(ModelMaterial)},
+        {ModelSection::Nodes, sizeof(ModelNode), model.nodes.data(), model.nodes.size() * sizeof(ModelNode)},
+        {ModelSection::Strings, 1, model.strings.data(), model.strings.size()},
+        {ModelSection::Lods, sizeof(ModelLod), model.lods.data(), model.lods.size() * sizeof(ModelLod)},
+        {ModelSection::Meshlets, sizeof(ModelMeshlet), model.meshlets.data(),
+         model.meshlets.size() * sizeof(ModelMeshlet)},
+    };
+    const uint32_t count = (uint32_t)(sizeof(sources) / sizeof(sources[0]));
+
+    ModelCacheHeader header = {};
+    memcpy(header.magic, model_cache_magic, sizeof(header.magic));
+    header.version       = model_cache_version;
+    header.section_count = count;
+    header.key           = key;
+    header.index_size    = model.index_size;
+
+    std::vector<ModelCacheSection> table(count);
+    uint64_t                       offset = align_up(sizeof(header) + count * sizeof(ModelCacheSection));
+    for (uint32_t i = 0; i < count; i++) {
+        table[i].type   = (uint32_t)sources[i].type;
+        table[i].stride = sources[i].stride;
+        table[i].offset = offset;
+        table[i].size   = sources[i].size;
+        offset          = align_up(offset + sources[i].size);
+    }
+    header.file_size = offset;
+
+    // unique per writer, processes and threads writing the same cache each rename a file of their own
+    static std::atomic<uint32_t> writes{0};
+    std::string tmp_path = path + "." + std::to_string(process_id()) + "." + std::to_string(writes++) + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)table.data(), (std::streamsize)(count * sizeof(ModelCacheSection)));
+        static const char zeros[model_cache_alignment] = {};
+        uint64_t          written                      = sizeof(header) + count * sizeof(ModelCacheSection);
+        for (uint32_t i = 0; i < count; i++) {
+            file.write(zeros, (std::streamsize)(table[i].offset - written));
+            file.write((const char*)sources[i].data, (std::streamsize)sources[i].size);
+            written = table[i].offset + sources[i].size;
+        }
+        file.write(zeros, (std::streamsize)(header.file_size - written));
+        if (!file) {
+            std::cout << "failed to write model cache " << tmp_path << "\n";
+            return -1;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec) {
+        std::cout << "failed to replace model cache " << path << ": " << ec.message() << "\n";
+        std::filesystem::remove(tmp_path, ec);
+        return -1;
+    }
+    return 0;
+}
+
+int MappedModel::open(const std::string& path, uint64_t key) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return -1;
+    LARGE_INTEGER length;
+    HANDLE        mapping = nullptr;
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    CloseHandle(file);
+    if (!mapping) return -1;
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);  // the view keeps the mapping alive
+    if (!view) return -1;
+    size = (size_t)length.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat info;
+    void*       view = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);  // the mapping stays valid
+    if (view == MAP_FAILED) return -1;
+    size = (size_t)info.st_size;
+#endif
+    base = (const uint8_t*)view;
+
+    if (validate(key)) {
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+void MappedModel::close() {
+    if (!base) return;
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+#else
+    munmap((void*)base, size);
+#endif
+    base  = nullptr;
+    size  = 0;
+    model = ModelView();
+}
+
+// A stale key is the normal case after the source changed, only damage is worth a message
+int MappedModel::validate(uint64_t key) {
+    if (size < sizeof(ModelCacheHeader)) return -1;
+    auto& header = *(const ModelCacheHeader*)base;
+    if (memcmp(header.magic, model_cache_magic, sizeof(header.magic)) != 0 || header.version != model_cache_version ||
+        header.key != key) {
+        return -1;
+    }
+    if (header.file_size != size || sizeof(header) + header.section_count * sizeof(ModelCacheSection) > size ||
+        (header.index_size != 2 && header.index_size != 4)) {
+        std::cout << "ignoring damaged model cache\n";
+        return -1;
+    }
+    auto* table = (const ModelCacheSection*)(base + sizeof(header));
+    for (uint32_t i = 0; i < header.section_count; i++) {
+        auto& entry = table[i];
+        if (entry.offset % model_cache_alignment || entry.offset > size || entry.size > size - entry.offset ||
+            !entry.stride || entry.size % entry.stride) {
+            std::cout << "ignoring damaged model cache\n";
+            return -1;
+        }
+    }
+
+    size_t count;
+    model.index_size     = header.index_size;
+    model.vertices       = (const ModelVertex*)section(ModelSection::Vertices, sizeof(ModelVertex), count);
+    model.vertex_count   = (uint32_t)count;
+    model.indices        = (const uint8_t*)section(ModelSection::Indices, header.index_size, count);
+    model.index_count    = (uint32_t)count;
+    model.submeshes      = (const ModelSubmesh*)section(ModelSection::Submeshes, sizeof(ModelSubmesh), count);
+    model.submesh_count  = (uint32_t)count;
+    model.materials      = (const ModelMaterial*)section(ModelSection::Materials, sizeof(ModelMaterial), count);
+    model.material_count = (uint32_t)count;
+    model.nodes          = (const ModelNode*)section(ModelSection::Nodes, sizeof(ModelNode), count);
+    model.node_count     = (uint32_t)count;
+    model.strings        = (const char*)section(ModelSection::Strings, 1, count);
+    model.string_bytes   = (uint32_t)count;
+    model.lods           = (const ModelLod*)section(ModelSection::Lods, sizeof(ModelLod), count);
+    model.lod_count      = (uint32_t)count;
+    model.meshlets       = (const ModelMeshlet*)section(ModelSection::Meshlets, sizeof(ModelMeshlet), count);
+    model.meshlet_count  = (uint32_t)count;
+    if (!model.vertices || !model.indices || !model.submeshes || !model.materials || !model.nodes || !model.strings ||
+        !model.lods || !model.meshlets) {
+        std::cout << "ignoring model cache with missing sections\n";
+        return -1;
+    }
+    if (validate_ranges()) {
+        std::cout << "ignoring model cache with ranges outside its arrays\n";
+        return -1;
+    }
+    return 0;
+}
+
+static bool in_range(uint64_t first, uint64_t count, uint64_t total) {
+    return first <= total && count <= total - first;
+}
+
+// Everything that indexes another array, so readers of the view never leave the mapping. The index
+// values themselves are not scanned, that would touch every page of the file.
+int MappedModel::validate_ranges() const {
+    for (uint32_t i = 0; i < model.submesh_count; i++) {
+        const ModelSubmesh& submesh = model.submeshes[i];
+        if (!in_range(submesh.first_index, submesh.index_count, model.index_count) ||
+            !in_range(submesh.base_vertex, submesh.vertex_count, model.vertex_count) ||
+            !in_range(submesh.first_lod, submesh.lod_count, model.lod_count) ||
+            !in_range(submesh.first_meshlet, submesh.meshlet_count, model.meshlet_count) ||
+            submesh.material >= model.material_count) {
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < model.lod_count; i++) {
+        if (!in_range(model.lods[i].first_index, model.lods[i].index_count, model.index_count)) return -1;
+    }
+    for (uint32_t i = 0; i < model.meshlet_count; i++) {
+        const ModelMeshlet& meshlet = model.meshlets[i];
+        if (meshlet.submesh >= model.submesh_count) return -1;
+        const ModelSubmesh& submesh = model.submeshes[meshlet.submesh];
+        if (meshlet.first_index < submesh.first_index ||
+            !in_range(meshlet.first_index - submesh.first_index, meshlet.index_count, submesh.index_count)) {
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < model.node_count; i++) {
+        if (model.nodes[i].submesh >= model.submesh_count) return -1;
+    }
+
+    // texture paths are offsets into the string table, which has to end with a terminator
+    if (model.string_bytes && model.strings[model.string_bytes - 1] != '\0') return -1;
+    for (uint32_t i = 0; i < model.material_count; i++) {
+        const ModelMaterial& material = model.materials[i];
+        for (uint32_t texture : {material.base_color_texture, material.normal_texture,
+                                 material.metallic_roughness_texture, material.emissive_texture}) {
+            if (texture != model_no_texture && texture >= model.string_bytes) return -1;
+        }
+    }
+    return 0;
+}
+
+const void* MappedModel::section(ModelSection type, uint32_t stride, size_t& count) const {
+    count = 0;
+    if (!base) return nullptr;
+    auto& header = *(const ModelCacheHeader*)base;
+    auto* table  = (const ModelCacheSection*)(base + sizeof(header));
+    for (uint32_t i = 0; i < header.section_count; i++) {
+        if (table[i].type != (uint32_t)type) continue;
+        if (table[i].stride != stride) return nullptr;
+        count = (size_t)(table[i].size / stride);
+        return base + table[i].offset;
+    }
+    return nullptr;
+}
+
+void MappedModel::to_model(Model& out) const {
+    out.clear();
+    out.vertices.assign(model.vertices, model.vertices + model.vertex_count);
+    out.indices.assign(model.indices, model.indices + (size_t)model.index_count * model.index_size);
+    out.index_size = model.index_size;
+    out.submeshes.assign(model.submeshes, model.submeshes + model.submesh_count);
+    out.materials.assign(model.materials, model.materials + model.material_count);
+    out.nodes.assign(model.nodes, model.nodes + model.node_count);
+    out.lods.assign(model.lods, model.lods + model.lod_count);
+    out.meshlets.assign(model.meshlets, model.meshlets + model.meshlet_count);
+    out.strings.assign(model.strings, model.strings + model.string_bytes);
+}
+
+}  // namespace fl
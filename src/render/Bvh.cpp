@@ -0,0 +1,323 @@
+#include "fl/render/Bvh.hpp"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/parallel_reduce.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+constexpr uint32_t MAX_BINS = 64;
+
+struct BvhBuildNode {
+    Aabb                          bounds;
+    uint32_t                      first = 0;
+    uint32_t                      count = 0;
+    std::unique_ptr<BvhBuildNode> children[2];
+};
+
+namespace {
+
+struct Bin {
+    Aabb     bounds;
+    uint32_t count = 0;
+};
+
+// Bins of the three axes for one range of primitives
+struct Binning {
+    Bin bins[3][MAX_BINS];
+
+    void merge(const Binning& other, uint32_t bin_count) {
+        for (int axis = 0; axis < 3; axis++) {
+            for (uint32_t b = 0; b < bin_count; b++) {
+                bins[axis][b].bounds.grow(other.bins[axis][b].bounds);
+                bins[axis][b].count += other.bins[axis][b].count;
+            }
+        }
+    }
+};
+
+struct Builder {
+    const Aabb*            primitives;
+    std::vector<glm::vec3> centers;
+    uint32_t*              indices;
+    BvhSettings            settings;
+
+    void bin_range(Binning& binning, uint32_t begin, uint32_t end, const Aabb& centroid_bounds,
+                   const glm::vec3& scale) const {
+        for (uint32_t i = begin; i < end; i++) {
+            uint32_t         primitive = indices[i];
+            const glm::vec3& c         = centers[primitive];
+            for (int axis = 0; axis < 3; axis++) {
+                uint32_t b = (uint32_t)((c[axis] - centroid_bounds.min[axis]) * scale[axis]);
+                b          = std::min(b, settings.bins - 1);
+                binning.bins[axis][b].bounds.grow(primitives[primitive]);
+                binning.bins[axis][b].count++;
+            }
+        }
+    }
+
+    std::unique_ptr<BvhBuildNode> build(uint32_t begin, uint32_t end);
+};
+
+std::unique_ptr<BvhBuildNode> make_leaf(const Aabb& bounds, uint32_t begin, uint32_t end) {
+    auto node    = std::make_unique<BvhBuildNode>();
+    node->bounds = bounds;
+    node->first  = begin;
+    node->count  = end - begin;
+    return node;
+}
+
+}  // namespace
+
+std::unique_ptr<BvhBuildNode> Builder::build(uint32_t begin, uint32_t end) {
+    uint32_t count = end - begin;
+
+    Aabb bounds, centroid_bounds;
+    for (uint32_t i = begin; i < end; i++) {
+        bounds.grow(primitives[indices[i]]);
+        centroid_bounds.grow(centers[indices[i]]);
+    }
+    if (count <= 1) return make_leaf(bounds, begin, end);
+
+    glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; axis++) {
+        scale[axis] = extent[axis] > 0.0f ? (float)settings.bins * 0.9999f / extent[axis] : 0.0f;
+    }
+
+    // large ranges bin on several workers, bins only hold counts and bounds so any merge order gives
+    // the same result
+    Binning binning;
+    if (count >= settings.parallel_threshold) {
+        binning = tbb::parallel_reduce(
+            tbb::blocked_range<uint32_t>(begin, end, std::max(settings.parallel_threshold / 4, 1u)), Binning(),
+            [&](const tbb::blocked_range<uint32_t>& range, Binning partial) {
+                bin_range(partial, range.begin(), range.end(), centroid_bounds, scale);
+                return partial;
+            },
+            [&](Binning a, const Binning& b) {
+                a.merge(b, settings.bins);
+                return a;
+            });
+    } else {
+        bin_range(binning, begin, end, centroid_bounds, scale);
+    }
+
+    // sweep every axis from both ends, the cost of the plane after bin b is left[b] + right[b + 1]
+    float    best_cost  = FLT_MAX;
+    int      best_axis  = -1;
+    uint32_t best_split = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        if (scale[axis] == 0.0f) continue;
+        const Bin* bins = binning.bins[axis];
+
+        float    right_cost[MAX_BINS];
+        Aabb     right_bounds;
+        uint32_t right_count = 0;
+        for (uint32_t b = settings.bins - 1; b > 0; b--) {
+            right_bounds.grow(bins[b].bounds);
+            right_count += bins[b].count;
+            right_cost[b] = right_bounds.area() * (float)right_count;
+        }
+
+        Aabb     left_bounds;
+        uint32_t left_count = 0;
+        for (uint32_t b = 0; b + 1 < settings.bins; b++) {
+            left_bounds.grow(bins[b].bounds);
+            left_count += bins[b].count;
+            float cost = left_bounds.area() * (float)left_count + right_cost[b + 1];
+            if (left_count > 0 && left_count < count && cost < best_cost) {
+                best_cost  = cost;
+                best_axis  = axis;
+                best_split = b + 1;
+            }
+        }
+    }
+
+    float leaf_cost = (float)count;
+    float area      = bounds.area();
+    if (best_axis >= 0 && area > 0.0f) best_cost = settings.traversal_cost + best_cost / area;
+
+    uint32_t middle;
+    if (best_axis < 0) {
+        // all centers in one point, only the leaf size limit splits them
+        if (count <= settings.max_leaf_size) return make_leaf(bounds, begin, end);
+        middle = begin + count / 2;
+    } else {
+        if (best_cost >= leaf_cost && count <= settings.max_leaf_size) return make_leaf(bounds, begin, end);
+        float     origin     = centroid_bounds.min[best_axis];
+        float     axis_scale = scale[best_axis];
+        uint32_t* split      = std::stable_partition(indices + begin, indices + end, [&](uint32_t primitive) {
+            uint32_t b = (uint32_t)((centers[primitive][best_axis] - origin) * axis_scale);
+            return std::min(b, settings.bins - 1) < best_split;
+        });
+        middle = (uint32_t)(split - indices);
+    }
+
+    auto node    = std::make_unique<BvhBuildNode>();
+    node->bounds = bounds;
+    if (count >= settings.parallel_threshold) {
+        tbb::parallel_invoke([&] { node->children[0] = build(begin, middle); },
+                             [&] { node->children[1] = build(middle, end); });
+    } else {
+        node->children[0] = build(begin, middle);
+        node->children[1] = build(middle, end);
+    }
+    return node;
+}
+
+void Bvh::build(const Aabb* primitives, uint32_t count, const BvhSettings& settings) {
+    nodes.clear();
+    indices.resize(count);
+    depth          = 0;
+    traversal_cost = settings.traversal_cost;
+    if (count == 0) return;
+
+    Builder builder;
+    builder.primitives             = primitives;
+    builder.indices                = indices.data();
+    builder.settings               = settings;
+    builder.settings.bins          = std::max(2u, std::min(settings.bins, MAX_BINS));
+    builder.settings.max_leaf_size = std::max(1u, settings.max_leaf_size);
+    builder.centers.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        indices[i]         = i;
+        builder.centers[i] = primitives[i].center();
+    }
+
+    auto root = builder.build(0, count);
+    nodes.emplace_back();
+    flatten(*root, 0, 1);
+}
+
+// Children are placed as a pair after everything allocated so far, so a parent always precedes them
+uint32_t Bvh::flatten(const BvhBuildNode& node, uint32_t index, uint32_t level) {
+    depth               = std::max(depth, level);
+    nodes[index].bounds = node.bounds;
+    nodes[index].count  = node.count;
+    if (!node.children[0]) {
+        nodes[index].first = node.first;
+        return index;
+    }
+    uint32_t first     = (uint32_t)nodes.size();
+    nodes[index].first = first;
+    nodes.resize(nodes.size() + 2);
+    flatten(*node.children[0], first, level + 1);
+    flatten(*node.children[1], first + 1, level + 1);
+    return index;
+}
+
+void Bvh::refit(const Aabb* primitives) {
+    for (size_t i = nodes.size(); i-- > 0;) {
+        BvhNode& node = nodes[i];
+        Aabb     bounds;
+        if (node.count) {
+            for (uint32_t p = node.first; p < node.first + node.count; p++) bounds.grow(primitives[indices[p]]);
+        } else {
+            bounds = nodes[node.first].bounds;
+            bounds.grow(nodes[node.first + 1].bounds);
+        }
+        node.bounds = bounds;
+    }
+}
+
+float Bvh::sah_cost() const {
+    if (nodes.empty() || nodes[0].bounds.area() <= 0.0f) return 0.0f;
+    float cost = 0.0f;
+    for (auto& node : nodes) {
+        cost += node.bounds.area() * (node.count ? (float)node.count : traversal_cost);
+    }
+    return cost / nodes[0].bounds.area();
+}
+
+void Bvh4::build(const Bvh& bvh) {
+    nodes.clear();
+    sources.clear();
+    depth   = 0;
+    indices = bvh.get_indices();
+    if (bvh.get_nodes().empty()) return;
+    collapse(bvh, 0, 1);
+}
+
+void Bvh4::refit(const Bvh& bvh) {
+    const auto& binary = bvh.get_nodes();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        Bvh4Node& node = nodes[i];
+        for (uint32_t slot = 0; slot < 4; slot++) {
+            if (node.child[slot] == BVH4_EMPTY) continue;
+            const Aabb& bounds = binary[sources[i * 4 + slot]].bounds;
+            node.min_x[slot]   = bounds.min.x;
+            node.min_y[slot]   = bounds.min.y;
+            node.min_z[slot]   = bounds.min.z;
+            node.max_x[slot]   = bounds.max.x;
+            node.max_y[slot]   = bounds.max.y;
+            node.max_z[slot]   = bounds.max.z;
+        }
+    }
+}
+
+uint32_t Bvh4::collapse(const Bvh& bvh, uint32_t node, uint32_t level) {
+    const auto& binary = bvh.get_nodes();
+    depth              = std::max(depth, level);
+
+    // a leaf root still gets a node, with one slot
+    uint32_t slots[4]   = {};
+    uint32_t slot_count = 0;
+    if (binary[node].count) {
+        slots[slot_count++] = node;
+    } else {
+        slots[slot_count++] = binary[node].first;
+        slots[slot_count++] = binary[node].first + 1;
+    }
+    while (slot_count < 4) {
+        int   largest = -1;
+        float area    = -1.0f;
+        for (uint32_t i = 0; i < slot_count; i++) {
+            const BvhNode& child = binary[slots[i]];
+            if (!child.count && child.bounds.area() > area) {
+                largest = (int)i;
+                area    = child.bounds.area();
+            }
+        }
+        if (largest < 0) break;
+        uint32_t opened     = binary[slots[largest]].first;
+        slots[largest]      = opened;
+        slots[slot_count++] = opened + 1;
+    }
+
+    uint32_t index = (uint32_t)nodes.size();
+    nodes.emplace_back();
+    sources.insert(sources.end(), slots, slots + 4);
+    for (uint32_t i = 0; i < 4; i++) {
+        Bvh4Node& out = nodes[index];
+        if (i >= slot_count) {
+            out.min_x[i] = out.min_y[i] = out.min_z[i] = FLT_MAX;
+            out.max_x[i] = out.max_y[i] = out.max_z[i] = FLT_MAX;
+            out.child[i] = BVH4_EMPTY;
+            out.count[i] = 0;
+            continue;
+        }
+        const BvhNode& child = binary[slots[i]];
+        out.min_x[i]         = child.bounds.min.x;
+        out.min_y[i]         = child.bounds.min.y;
+        out.min_z[i]         = child.bounds.min.z;
+        out.max_x[i]         = child.bounds.max.x;
+        out.max_y[i]         = child.bounds.max.y;
+        out.max_z[i]         = child.bounds.max.z;
+        out.count[i]         = child.count;
+        if (child.count) {
+            out.child[i] = child.first;
+        } else {
+            uint32_t collapsed    = collapse(bvh, slots[i], level + 1);  // may reallocate nodes
+            nodes[index].child[i] = collapsed;
+        }
+    }
+    return index;
+}
+
+}  // namespace fl
@@ -0,0 +1,407 @@
+#include "fl/render/CpuPathTracer.hpp"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+// The sample sequence of shader/rt_common.glsl, so CPU and GPU images converge to the same values
+static uint32_t rt_random(uint32_t& state) {
+    state         = state * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+static float rt_random_float(uint32_t& state) {
+    return (float)(rt_random(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+static uint32_t rt_seed(uint32_t x, uint32_t y, uint32_t width, uint32_t frame) {
+    uint32_t state = y * width + x;
+    rt_random(state);
+    state += frame * 1973u;
+    rt_random(state);
+    return state;
+}
+
+static glm::vec3 rt_cosine_hemisphere(const glm::vec3& normal, uint32_t& state) {
+    float u   = rt_random_float(state);
+    float v   = rt_random_float(state);
+    float r   = std::sqrt(u);
+    float phi = 6.28318530718f * v;
+
+    glm::vec3 tangent = glm::normalize(std::abs(normal.x) > 0.5f ? glm::cross(normal, glm::vec3(0.0f, 1.0f, 0.0f))
+                                                                 : glm::cross(normal, glm::vec3(1.0f, 0.0f, 0.0f)));
+    glm::vec3 bitangent = glm::cross(normal, tangent);
+    return glm::normalize(tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) +
+                          normal * std::sqrt(std::max(0.0f, 1.0f - u)));
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+RTHandle CpuPathTracer::add_mesh(const RTMeshDesc& desc) {
+    if (desc.index_count == 0 || desc.index_count % 3) {
+        std::cout << "ray tracing meshes are triangle lists\n";
+        return RT_INVALID;
+    }
+    Mesh mesh;
+    mesh.live    = true;
+    mesh.dynamic = desc.dynamic;
+    mesh.positions.assign(desc.positions, desc.positions + desc.vertex_count);
+    mesh.indices.assign(desc.indices, desc.indices + desc.index_count);
+    for (uint32_t index : mesh.indices) {
+        if (index >= desc.vertex_count) {
+            std::cout << "ray tracing mesh index out of range\n";
+            return RT_INVALID;
+        }
+    }
+    meshes.push_back(std::move(mesh));
+    return (RTHandle)meshes.size() - 1;
+}
+
+void CpuPathTracer::update_mesh(RTHandle handle, const glm::vec3* positions) {
+    if (handle >= meshes.size() || !meshes[handle].live || !meshes[handle].dynamic) return;
+    Mesh& mesh = meshes[handle];
+    std::copy(positions, positions + mesh.positions.size(), mesh.positions.begin());
+    mesh.dirty = true;
+}
+
+void CpuPathTracer::remove_mesh(RTHandle handle) {
+    if (handle >= meshes.size()) return;
+    meshes[handle] = Mesh();
+}
+
+RTHandle CpuPathTracer::add_instance(const RTInstance& instance) {
+    if (instance.mesh >= meshes.size()) return RT_INVALID;
+    RTHandle handle;
+    if (!free_instances.empty()) {
+        handle = free_instances.back();
+        free_instances.pop_back();
+    } else {
+        handle = (RTHandle)instances.size();
+        instances.emplace_back();
+    }
+    instances[handle].desc            = instance;
+    instances[handle].world_to_object = glm::inverse(instance.transform);
+    instances[handle].live            = true;
+    return handle;
+}
+
+void CpuPathTracer::set_transform(RTHandle handle, const glm::mat4& transform) {
+    if (handle >= instances.size()) return;
+    instances[handle].desc.transform  = transform;
+    instances[handle].world_to_object = glm::inverse(transform);
+}
+
+void CpuPathTracer::remove_instance(RTHandle handle) {
+    if (handle >= instances.size() || !instances[handle].live) return;
+    instances[handle].live = false;
+    free_instances.push_back(handle);
+}
+
+static void triangle_bounds(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                            std::vector<Aabb>& bounds) {
+    bounds.resize(indices.size() / 3);
+    for (size_t i = 0; i < bounds.size(); i++) {
+        bounds[i] = Aabb();
+        for (int k = 0; k < 3; k++) bounds[i].grow(positions[indices[i * 3 + k]]);
+    }
+}
+
+void CpuPathTracer::build_mesh(Mesh& mesh, const BvhSettings& settings) {
+    std::vector<Aabb> bounds;
+    triangle_bounds(mesh.positions, mesh.indices, bounds);
+    mesh.bvh.build(bounds.data(), (uint32_t)bounds.size(), settings);
+    mesh.bvh4.build(mesh.bvh);
+    order_triangles(mesh);
+    mesh.dirty = false;
+}
+
+void CpuPathTracer::refit_mesh(Mesh& mesh) {
+    std::vector<Aabb> bounds;
+    triangle_bounds(mesh.positions, mesh.indices, bounds);
+    mesh.bvh.refit(bounds.data());
+    mesh.bvh4.refit(mesh.bvh);
+    order_triangles(mesh);
+    mesh.dirty = false;
+}
+
+// Triangles are stored in leaf order, a leaf reads a contiguous run of them
+void CpuPathTracer::order_triangles(Mesh& mesh) {
+    const auto& order = mesh.bvh4.get_indices();
+    mesh.triangles.resize(order.size());
+    mesh.primitives = order;
+    for (size_t i = 0; i < order.size(); i++) {
+        const uint32_t* index = &mesh.indices[order[i] * 3];
+        glm::vec3       v0    = mesh.positions[index[0]];
+        mesh.triangles[i]     = {v0, mesh.positions[index[1]] - v0, mesh.positions[index[2]] - v0};
+    }
+}
+
+void CpuPathTracer::commit(const BvhSettings& settings) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Mesh*> builds, refits;
+    for (auto& mesh : meshes) {
+        if (!mesh.live) continue;
+        if (mesh.bvh4.empty()) {
+            builds.push_back(&mesh);
+        } else if (mesh.dirty) {
+            refits.push_back(&mesh);
+        }
+    }
+    tbb::parallel_for(size_t(0), builds.size(), [&](size_t i) { build_mesh(*builds[i], settings); });
+    tbb::parallel_for(size_t(0), refits.size(), [&](size_t i) { refit_mesh(*refits[i]); });
+    stats.blas_builds += (uint32_t)builds.size();
+    stats.blas_refits += (uint32_t)refits.size();
+
+    // the instance BVH is rebuilt from the world bounds of every live instance
+    std::vector<Aabb> bounds;
+    tlas_instances.clear();
+    for (RTHandle i = 0; i < instances.size(); i++) {
+        const Instance& instance = instances[i];
+        if (!instance.live || !meshes[instance.desc.mesh].live || meshes[instance.desc.mesh].bvh4.empty()) continue;
+
+        const Aabb& local = meshes[instance.desc.mesh].bvh.get_nodes()[0].bounds;
+        Aabb        world;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 p(corner & 1 ? local.max.x : local.min.x, corner & 2 ? local.max.y : local.min.y,
+                        corner & 4 ? local.max.z : local.min.z);
+            world.grow(glm::vec3(instance.desc.transform * glm::vec4(p, 1.0f)));
+        }
+        bounds.push_back(world);
+        tlas_instances.push_back(i);
+    }
+    tlas.build(bounds.data(), (uint32_t)bounds.size(), settings);
+    tlas4.build(tlas);
+    stats.tlas_builds++;
+
+    stats.bvh4_nodes = (uint32_t)tlas4.get_nodes().size();
+    stats.max_depth  = tlas.get_depth();
+    for (auto& mesh : meshes) {
+        stats.bvh4_nodes += (uint32_t)mesh.bvh4.get_nodes().size();
+        stats.max_depth = std::max(stats.max_depth, mesh.bvh.get_depth());
+    }
+    stats.build_ms = elapsed_ms(start);
+}
+
+// Nearest children are visited first, so closest hit queries shrink t_max early
+template <typename Visit>
+static bool traverse(const Bvh4& bvh, const BvhRay& ray, float& t_max, bool any, Visit visit) {
+    if (bvh.empty()) return false;
+    const auto& nodes = bvh.get_nodes();
+
+    // deep trees, e.g. over badly distributed primitives, get a stack on the heap instead of losing nodes
+    uint32_t              local[256];
+    std::vector<uint32_t> heap;
+    uint32_t*             stack = local;
+    if (bvh.get_stack_size() > 256) {
+        heap.resize(bvh.get_stack_size());
+        stack = heap.data();
+    }
+    uint32_t top   = 0;
+    bool     found = false;
+    stack[top++]   = 0;
+    while (top > 0) {
+        const Bvh4Node& node = nodes[stack[--top]];
+        float           t_near[4];
+        int             mask = intersect_children(node, ray, t_max, t_near);
+
+        uint32_t order[4];
+        int      count = 0;
+        for (int i = 0; i < 4; i++) {
+            if (!(mask & (1 << i)) || node.child[i] == BVH4_EMPTY) continue;
+            if (node.count[i]) {
+                if (visit(node.child[i], node.count[i], t_max)) {
+                    found = true;
+                    if (any) return true;
+                }
+                continue;
+            }
+            order[count++] = i;
+        }
+        // farthest pushed first, popped last
+        std::sort(order, order + count, [&](uint32_t a, uint32_t b) { return t_near[a] > t_near[b]; });
+        for (int i = 0; i < count; i++) {
+            if (t_near[order[i]] <= t_max) stack[top++] = node.child[order[i]];
+        }
+    }
+    return found;
+}
+
+bool CpuPathTracer::trace_mesh(const Mesh& mesh, const BvhRay& ray, const glm::vec3& direction, bool any,
+                               float& t_max, uint32_t& primitive) const {
+    return traverse(mesh.bvh4, ray, t_max, any, [&](uint32_t first, uint32_t count, float& t) {
+        bool hit = false;
+        for (uint32_t i = first; i < first + count; i++) {
+            // Moller-Trumbore, both faces
+            const Triangle& tri = mesh.triangles[i];
+            glm::vec3       p   = glm::cross(direction, tri.e2);
+            float           det = glm::dot(tri.e1, p);
+            if (std::abs(det) < 1e-20f) continue;
+            float     inv = 1.0f / det;
+            glm::vec3 s   = ray.origin - tri.v0;
+            float     u   = glm::dot(s, p) * inv;
+            if (u < 0.0f || u > 1.0f) continue;
+            glm::vec3 q = glm::cross(s, tri.e1);
+            float     v = glm::dot(direction, q) * inv;
+            if (v < 0.0f || u + v > 1.0f) continue;
+            float d = glm::dot(tri.e2, q) * inv;
+            if (d <= 0.0f || d >= t) continue;
+            t         = d;
+            primitive = i;
+            hit       = true;
+            if (any) break;
+        }
+        return hit;
+    });
+}
+
+bool CpuPathTracer::trace(const glm::vec3& origin, const glm::vec3& direction, float t_max, uint32_t mask, bool any,
+                          RTHit* hit) const {
+    BvhRay   world_ray(origin, direction);
+    RTHandle hit_instance  = RT_INVALID;
+    uint32_t hit_primitive = 0;
+
+    bool found = traverse(tlas4, world_ray, t_max, any, [&](uint32_t first, uint32_t count, float& t) {
+        bool hit_any = false;
+        for (uint32_t i = first; i < first + count; i++) {
+            RTHandle        handle   = tlas_instances[tlas4.get_indices()[i]];
+            const Instance& instance = instances[handle];
+            if (!(instance.desc.mask & mask)) continue;
+
+            // the object space direction is not normalized, so t means the same in both spaces
+            glm::vec3 local_origin    = glm::vec3(instance.world_to_object * glm::vec4(origin, 1.0f));
+            glm::vec3 local_direction = glm::mat3(instance.world_to_object) * direction;
+            uint32_t  primitive;
+            if (trace_mesh(meshes[instance.desc.mesh], BvhRay(local_origin, local_direction), local_direction, any,
+                           t, primitive)) {
+                hit_instance  = handle;
+                hit_primitive = primitive;
+                hit_any       = true;
+                if (any) break;
+            }
+        }
+        return hit_any;
+    });
+    if (!found || !hit) return found;
+
+    const Instance& instance = instances[hit_instance];
+    const Mesh&     mesh     = meshes[instance.desc.mesh];
+    const Triangle& tri      = mesh.triangles[hit_primitive];
+    glm::vec3       normal   = glm::transpose(glm::mat3(instance.world_to_object)) * glm::cross(tri.e1, tri.e2);
+    normal                   = glm::normalize(normal);
+    if (glm::dot(normal, direction) > 0.0f) normal = -normal;
+
+    hit->t         = t_max;
+    hit->instance  = hit_instance;
+    hit->primitive = mesh.primitives[hit_primitive];
+    hit->normal    = normal;
+    return true;
+}
+
+bool CpuPathTracer::intersect(const glm::vec3& origin, const glm::vec3& direction, float t_max, RTHit& hit,
+                              uint32_t mask) const {
+    return trace(origin, direction, t_max, mask, false, &hit);
+}
+
+bool CpuPathTracer::occluded(const glm::vec3& origin, const glm::vec3& direction, float t_max, uint32_t mask) const {
+    return trace(origin, direction, t_max, mask, true, nullptr);
+}
+
+// One sample of shader/rt_raygen.glsl
+glm::vec4 CpuPathTracer::trace_pixel(const RTTraceParams& params, uint32_t x, uint32_t y, uint32_t frame,
+                                     uint64_t& rays) const {
+    glm::vec2 ndc  = (glm::vec2((float)x, (float)y) + 0.5f) / glm::vec2((float)width, (float)height) * 2.0f - 1.0f;
+    glm::vec4 near = params.inverse_view_projection * glm::vec4(ndc, 0.0f, 1.0f);
+    glm::vec4 far  = params.inverse_view_projection * glm::vec4(ndc, 1.0f, 1.0f);
+    glm::vec3 origin    = glm::vec3(near) / near.w;
+    glm::vec3 direction = glm::normalize(glm::vec3(far) / far.w - origin);
+
+    RTHit hit;
+    rays++;
+    if (!intersect(origin, direction, 1.0e30f, hit)) return glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+
+    glm::vec3 position = origin + direction * hit.t + hit.normal * 1.0e-3f;
+    glm::vec4 result(0.0f, 1.0f, 0.0f, 1.0f);
+
+    glm::vec3 to_light = -glm::normalize(params.light_direction);
+    result.x           = occluded(position, to_light, 1.0e30f) ? 0.0f : 1.0f;
+    rays++;
+
+    uint32_t state = rt_seed(x, y, width, frame);
+    float    open  = 0.0f;
+    for (uint32_t i = 0; i < params.ao_samples; i++) {
+        if (!occluded(position, rt_cosine_hemisphere(hit.normal, state), params.ao_radius)) open += 1.0f;
+    }
+    rays += params.ao_samples;
+    result.y = params.ao_samples ? open / (float)params.ao_samples : 1.0f;
+    return result;
+}
+
+void CpuPathTracer::render(const RTTraceParams& params, uint32_t passes) {
+    auto start = std::chrono::steady_clock::now();
+    if (params.width != width || params.height != height) {
+        width  = params.width;
+        height = params.height;
+        accumulation.assign((size_t)width * height, glm::vec4(0.0f));
+        samples = 0;
+    }
+    if (samples == 0) std::fill(accumulation.begin(), accumulation.end(), glm::vec4(0.0f));
+
+    uint32_t tiles_x = (width + tile_size - 1) / tile_size;
+    uint32_t tiles_y = (height + tile_size - 1) / tile_size;
+    uint32_t first   = params.frame + samples;
+
+    // a tile is one task, each pixel is written by exactly one of them
+    std::atomic<uint64_t> rays{0};
+    auto trace_tiles = [&](const tbb::blocked_range<uint32_t>& range) {
+        uint64_t tile_rays = 0;
+        for (uint32_t tile = range.begin(); tile != range.end(); tile++) {
+            uint32_t x0 = (tile % tiles_x) * tile_size, y0 = (tile / tiles_x) * tile_size;
+            uint32_t x1 = std::min(x0 + tile_size, width), y1 = std::min(y0 + tile_size, height);
+            for (uint32_t y = y0; y < y1; y++) {
+                for (uint32_t x = x0; x < x1; x++) {
+                    glm::vec4& sum = accumulation[(size_t)y * width + x];
+                    for (uint32_t pass = 0; pass < passes; pass++) {
+                        sum += trace_pixel(params, x, y, first + pass, tile_rays);
+                    }
+                }
+            }
+        }
+        rays += tile_rays;
+    };
+    tbb::parallel_for(tbb::blocked_range<uint32_t>(0, tiles_x * tiles_y, 1), trace_tiles);
+
+    samples += passes;
+    stats.rays      = rays;
+    stats.render_ms = elapsed_ms(start);
+}
+
+ReadbackFrame CpuPathTracer::image() {
+    pixels.resize((size_t)width * height * 4);
+    float scale = samples ? 1.0f / (float)samples : 0.0f;
+    for (size_t i = 0; i < accumulation.size(); i++) {
+        glm::vec4 value = glm::clamp(accumulation[i] * scale, 0.0f, 1.0f);
+        for (int c = 0; c < 4; c++) pixels[i * 4 + c] = (uint8_t)(value[c] * 255.0f + 0.5f);
+    }
+
+    ReadbackFrame frame = {};
+    frame.serial        = samples;
+    frame.width         = width;
+    frame.height        = height;
+    frame.format        = VK_FORMAT_R8G8B8A8_UNORM;
+    frame.row_pitch     = width * 4;
+    frame.pixels        = pixels.data();
+    return frame;
+}
+
+}  // namespace fl
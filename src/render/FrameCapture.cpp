@@ -0,0 +1,136 @@
+#include "fl/render/FrameCapture.hpp"
+
+#include <cstring>
+#include <memory>
+
+#include "fl/render/VulkanRender.hpp"
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+FrameCapture::FrameCapture() {}
+
+FrameCapture::~FrameCapture() noexcept { finish(); }
+
+int FrameCapture::start(VulkanRender* render, const std::string& path_pattern, ImageFormat format,
+                        uint32_t max_frames) {
+    finish();
+    if (!render) return -1;
+
+    this->render     = render;
+    this->pattern    = path_pattern;
+    this->format     = format;
+    this->max_frames = max_frames;
+    frame_number     = 0;
+
+    render->flush();  // frames an earlier readback left in the ring are not part of this capture
+    render->setReadbackCallback([this](const ReadbackFrame& frame) { onFrame(frame); });
+    if (render->enableReadback()) {
+        render->setReadbackCallback(nullptr);
+        return -1;
+    }
+    capturing = true;
+    return 0;
+}
+
+void FrameCapture::stop() {
+    capturing = false;
+    if (!render) return;
+    render->setReadbackCallback(nullptr);
+    render = nullptr;
+}
+
+void FrameCapture::finish() {
+    // frames still in the readback ring are delivered before the callback goes away
+    if (render && capturing) render->flush();
+    stop();
+    encoders.wait();
+}
+
+FrameCapture::Stats FrameCapture::getStats() const {
+    Stats stats;
+    stats.captured   = captured;
+    stats.written    = written;
+    stats.dropped    = dropped;
+    stats.waits      = waits;
+    stats.raw_bytes  = raw_bytes;
+    stats.file_bytes = file_bytes;
+    return stats;
+}
+
+// Runs on the render thread, the readback buffer is reused as soon as this returns
+void FrameCapture::onFrame(const ReadbackFrame& frame) {
+    if (!capturing) return;
+
+    // When full, wait on the group rather than for one buffer: the waiting thread runs queued encoders
+    // itself, so this cannot hang when every TBB worker is busy elsewhere or there are none
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        full = queued >= max_queued;
+    }
+    if (full) {
+        if (drop_when_busy) {
+            dropped++;
+            return;
+        }
+        waits++;
+        encoders.wait();
+    }
+
+    std::vector<uint8_t> buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued++;
+        if (!free_buffers.empty()) {
+            buffer = std::move(free_buffers.back());
+            free_buffers.pop_back();
+        }
+    }
+
+    size_t row_bytes = (size_t)frame.width * 4;
+    buffer.resize(row_bytes * frame.height);
+    for (uint32_t y = 0; y < frame.height; y++)
+        memcpy(&buffer[y * row_bytes], frame.pixels + (size_t)y * frame.row_pitch, row_bytes);
+    captured++;
+    raw_bytes += buffer.size();
+
+    uint32_t    number = frame_number++;
+    std::string path   = framePath(number);
+    if (max_frames && frame_number >= max_frames) {
+        // the last frame: the render stops copying frames into the ring from the next one on, the
+        // callback itself is only removed by stop(), not from inside itself
+        capturing = false;
+        render->disableReadback();
+    }
+    bool        bgra   = frame.format == VK_FORMAT_B8G8R8A8_UNORM || frame.format == VK_FORMAT_B8G8R8A8_SRGB;
+    uint32_t    width = frame.width, height = frame.height;
+
+    // tbb runs const tasks, the buffer travels behind a shared_ptr
+    auto pixels = std::make_shared<std::vector<uint8_t>>(std::move(buffer));
+    encoders.run([this, pixels, path, bgra, width, height]() {
+        ImagePixels          image = {pixels->data(), width, height, width * 4, bgra};
+        std::vector<uint8_t> file;
+        if (ImageEncoder::encode(format, image, file) || ImageEncoder::write_file(path, file)) {
+            dropped++;
+        } else {
+            written++;
+            file_bytes += file.size();
+        }
+        release(std::move(*pixels));
+    });
+}
+
+void FrameCapture::release(std::vector<uint8_t>&& buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    free_buffers.push_back(std::move(buffer));
+    queued--;
+}
+
+std::string FrameCapture::framePath(uint32_t number) const {
+    std::vector<char> name(pattern.size() + 32);
+    snprintf(name.data(), name.size(), pattern.c_str(), number);
+    return std::string(name.data()) + "." + ImageEncoder::extension(format);
+}
+
+}  // namespace fl
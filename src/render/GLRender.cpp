@@ -15,6 +15,7 @@ GLRender::~GLRender() {}
 
 void GLRender::Init() {
     initGL();
+    window->setPresentCallback(this);  // for resize(), the GL window swaps buffers itself
 }
 
 void GLRender::setRenderTree() { printf("set Render Tree!\n"); }
@@ -28,6 +29,11 @@ void GLRender::initGL() {
     }
 }
 
+void GLRender::resize(uint32_t width, uint32_t height) {
+    display_w = (int)width;
+    display_h = (int)height;
+}
+
 void GLRender::clear(glm::vec4 color) {
     glViewport(0, 0, display_w, display_h);
     glClearColor(color.x, color.y, color.z, color.w);
@@ -0,0 +1,26 @@
+#include "fl/render/RayTracing.hpp"
+
+#include "fl/render/VulkanComputeRayTracing.hpp"
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/render/VulkanRayTracing.hpp"
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+uptr<IRayTracingBackend> create_ray_tracing_backend(VulkanImpl* impl, RenderData* data, bool prefer_compute,
+                                                    const RTSceneDesc& desc) {
+    if (impl->caps.ray_tracing && !prefer_compute) {
+        auto backend = std::make_unique<VulkanRayTracing>();
+        if (backend->create(impl, data, desc) == 0) return backend;
+        std::cout << "failed to create the hardware ray tracing backend\n";
+        backend->destroy();
+    }
+
+    auto backend = std::make_unique<VulkanComputeRayTracing>();
+    if (backend->create(impl, data, desc) == 0) return backend;
+    std::cout << "failed to create the compute ray tracing backend\n";
+    backend->destroy();
+    return nullptr;
+}
+
+}  // namespace fl
@@ -0,0 +1,1002 @@
+#include "fl/render/RenderGraph.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+static bool is_depth_format(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool has_stencil(VkFormat format) {
+    return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT ||
+           format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+// bytes per texel of the formats used for attachments, the rest counts as 4
+static uint32_t format_size(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+        case VK_FORMAT_D16_UNORM:
+            return 2;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return 4;
+    }
+}
+
+static VkImageUsageFlags usage_for(VkImageLayout layout) {
+    switch (layout) {
+        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+            return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+            return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+            return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case VK_IMAGE_LAYOUT_GENERAL:
+            return VK_IMAGE_USAGE_STORAGE_BIT;
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+            return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+            return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        default:
+            return 0;
+    }
+}
+
+static const VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                          VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+                                          VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+RGUse& RGPass::add(RGResource resource, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access,
+                   bool write) {
+    RGUse use;
+    use.resource = resource;
+    use.layout   = layout;
+    use.stages   = stages;
+    use.access   = access;
+    use.write    = write;
+    use.load_op  = VK_ATTACHMENT_LOAD_OP_LOAD;  // anything but a cleared attachment keeps the old content
+    uses.push_back(use);
+    return uses.back();
+}
+
+void RGPass::write_color(RGResource image, VkAttachmentLoadOp load, VkClearColorValue clear) {
+    VkAccessFlags access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    if (load == VK_ATTACHMENT_LOAD_OP_LOAD) access |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+    RGUse& use = add(image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                     access, true);
+    use.attachment  = true;
+    use.load_op     = load;
+    use.clear.color = clear;
+}
+
+void RGPass::write_depth(RGResource image, VkAttachmentLoadOp load, float clear) {
+    RGUse& use = add(image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true);
+    use.attachment         = true;
+    use.load_op            = load;
+    use.clear.depthStencil = {clear, 0};
+}
+
+void RGPass::read_depth(RGResource image) {
+    RGUse& use = add(image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                     VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, false);
+    use.attachment = true;
+}
+
+void RGPass::read_image(RGResource image, VkPipelineStageFlags stages) {
+    add(image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, stages, VK_ACCESS_SHADER_READ_BIT, false);
+}
+
+void RGPass::write_storage_image(RGResource image, VkPipelineStageFlags stages) {
+    add(image, VK_IMAGE_LAYOUT_GENERAL, stages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true);
+}
+
+void RGPass::read_buffer(RGResource buffer, VkPipelineStageFlags stages, VkAccessFlags access) {
+    add(buffer, VK_IMAGE_LAYOUT_UNDEFINED, stages, access, false);
+}
+
+void RGPass::write_buffer(RGResource buffer, VkPipelineStageFlags stages, VkAccessFlags access) {
+    add(buffer, VK_IMAGE_LAYOUT_UNDEFINED, stages, access, true);
+}
+
+// buffers ignore the layout, build_barriers only tracks layouts of images
+void RGPass::copy_from(RGResource resource) {
+    add(resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+        false);
+}
+
+void RGPass::copy_to(RGResource resource) {
+    add(resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        true);
+}
+
+void RGPass::set_clear(RGResource attachment, VkClearValue clear) {
+    for (auto& use : uses) {
+        if (use.resource == attachment && use.attachment) use.clear = clear;
+    }
+}
+
+std::vector<const RGUse*> RGPass::attachments() const {
+    std::vector<const RGUse*> result;
+    const RGUse*              depth = nullptr;
+    for (auto& use : uses) {
+        if (!use.attachment) continue;
+        if (use.layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+            result.push_back(&use);
+        else
+            depth = &use;
+    }
+    if (depth) result.push_back(depth);
+    return result;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+RenderGraph::RenderGraph() {}
+
+RenderGraph::~RenderGraph() {}
+
+void RenderGraph::init(VkDevice device, VulkanAllocator* allocator) {
+    this->device    = device;
+    this->allocator = allocator;
+}
+
+void RenderGraph::destroy() {
+    invalidate_framebuffers(false);
+    for (auto& it : render_passes) vkDestroyRenderPass(device, it.second, nullptr);
+    render_passes.clear();
+    destroy_transients(false);
+    dirty = true;
+}
+
+RGResource RenderGraph::import_image(const std::string& name, const RGImageDesc& desc, VkImageLayout initial_layout,
+                                     VkImageLayout final_layout, VkPipelineStageFlags initial_stages) {
+    Resource resource;
+    resource.name           = name;
+    resource.imported       = true;
+    resource.desc           = desc;
+    resource.initial_layout = initial_layout;
+    resource.final_layout   = final_layout;
+    resource.initial_stages = initial_stages;
+    resources.push_back(resource);
+    dirty = true;
+    return (RGResource)resources.size() - 1;
+}
+
+RGResource RenderGraph::import_buffer(const std::string& name, VkBuffer buffer, VkDeviceSize size) {
+    Resource resource;
+    resource.name     = name;
+    resource.is_image = false;
+    resource.imported = true;
+    resource.buffer   = buffer;
+    resource.size     = size;
+    resources.push_back(resource);
+    dirty = true;
+    return (RGResource)resources.size() - 1;
+}
+
+RGResource RenderGraph::create_image(const std::string& name, const RGImageDesc& desc) {
+    Resource resource;
+    resource.name = name;
+    resource.desc = desc;
+    resources.push_back(resource);
+    dirty = true;
+    return (RGResource)resources.size() - 1;
+}
+
+void RenderGraph::set_image(RGResource resource, VkImage image, VkImageView view) {
+    resources[resource].image = image;
+    resources[resource].view  = view;
+}
+
+void RenderGraph::mark_output(RGResource resource) {
+    resources[resource].output = true;
+    dirty                      = true;
+}
+
+RGPass& RenderGraph::add_pass(const std::string& name, RGPassType type) {
+    passes.push_back(std::make_unique<RGPass>());
+    RGPass& pass = *passes.back();
+    pass.name    = name;
+    pass.type    = type;
+    pass.index   = (uint32_t)passes.size() - 1;
+    dirty        = true;
+    return pass;
+}
+
+// Declaration order decides who reads whose writes, so a producer added late goes in front of its consumer
+RGPass& RenderGraph::add_pass_before(const std::string& name, RGPassType type, const std::string& before) {
+    auto it = std::find_if(passes.begin(), passes.end(),
+                           [&](const std::unique_ptr<RGPass>& p) { return p->name == before; });
+    it           = passes.insert(it, std::make_unique<RGPass>());
+    RGPass& pass = **it;
+    pass.name    = name;
+    pass.type    = type;
+    for (uint32_t i = 0; i < passes.size(); i++) passes[i]->index = i;
+    dirty = true;
+    return pass;
+}
+
+RGPass* RenderGraph::find_pass(const std::string& name) {
+    for (auto& pass : passes) {
+        if (pass->name == name) return pass.get();
+    }
+    return nullptr;
+}
+
+RGResource RenderGraph::find_resource(const std::string& name) const {
+    for (size_t i = 0; i < resources.size(); i++) {
+        if (resources[i].name == name) return (RGResource)i;
+    }
+    return RG_INVALID;
+}
+
+void RenderGraph::set_merge_subpasses(bool merge) {
+    if (this->merge == merge) return;
+    this->merge = merge;
+    dirty       = true;
+}
+
+void RenderGraph::set_extent(VkExtent2D extent) {
+    if (extent.width == this->extent.width && extent.height == this->extent.height) return;
+    this->extent = extent;
+    resized      = true;
+}
+
+VkRenderPass RenderGraph::get_render_pass(const std::string& name) {
+    if (dirty && compile()) return VK_NULL_HANDLE;
+    RGPass* pass = find_pass(name);
+    return pass ? pass->render_pass : VK_NULL_HANDLE;
+}
+
+int RenderGraph::compile() {
+    cull_and_sort();
+    compute_lifetimes();
+    decide_store_ops();
+    merge_subpasses();
+    resolve_extents();
+
+    // framebuffers reference transient views, both are rebuilt
+    invalidate_framebuffers();
+    destroy_transients();
+    if (create_transients()) return -1;
+    if (create_render_passes()) return -1;
+    build_barriers();
+    compute_stats();
+
+    dirty   = false;
+    resized = false;
+    return 0;
+}
+
+// Render passes do not depend on the size and barriers refer to resources, not to their images
+int RenderGraph::resize() {
+    if (dirty) return compile();
+
+    resolve_extents();
+    invalidate_framebuffers();
+    destroy_transients();
+    if (create_transients()) return -1;
+    compute_stats();
+
+    resized = false;
+    return 0;
+}
+
+// Images without a size of their own follow the graph extent, raster passes the size of their attachments
+void RenderGraph::resolve_extents() {
+    for (auto& resource : resources) {
+        if (!resource.is_image) continue;
+        resource.extent.width  = resource.desc.width ? resource.desc.width : extent.width;
+        resource.extent.height = resource.desc.height ? resource.desc.height : extent.height;
+    }
+
+    for (uint32_t pos = 0; pos < order.size(); pos++) {
+        RGPass& pass = *passes[order[pos]];
+        if (pass.type != RGPassType::Raster || pass.subpass > 0) continue;
+
+        auto attachments = pass.attachments();
+        if (attachments.empty()) continue;  // reported by create_render_passes
+        pass.extent = resources[attachments[0]->resource].extent;
+        for (uint32_t i = 1; i < group_size(pos); i++) passes[order[pos + i]]->extent = pass.extent;
+    }
+}
+
+// Edges come from hazards on each resource in declaration order: a reader depends on the last writer, a
+// writer on the last writer and on every reader since. Only read-after-write edges make a producer live.
+void RenderGraph::cull_and_sort() {
+    size_t                             count = passes.size();
+    std::vector<std::vector<uint32_t>> producers(count), successors(count);
+    std::vector<int>                   last_writer(resources.size(), -1);
+    std::vector<std::vector<uint32_t>> readers(resources.size());
+
+    auto add_edge = [&](uint32_t from, uint32_t to) {
+        if (from != to) successors[from].push_back(to);
+    };
+
+    for (uint32_t p = 0; p < count; p++) {
+        for (auto& use : passes[p]->uses) {
+            int writer = last_writer[use.resource];
+            if (use.reads_previous() && writer >= 0 && (uint32_t)writer != p) {
+                producers[p].push_back((uint32_t)writer);
+                add_edge((uint32_t)writer, p);
+            }
+            if (use.write) {
+                if (writer >= 0) add_edge((uint32_t)writer, p);
+                for (uint32_t reader : readers[use.resource]) add_edge(reader, p);
+                readers[use.resource].clear();
+                last_writer[use.resource] = (int)p;
+            } else {
+                readers[use.resource].push_back(p);
+            }
+        }
+    }
+
+    std::vector<uint32_t> stack;
+    for (auto& pass : passes) {
+        pass->live = false;
+        if (pass->side_effect) stack.push_back(pass->index);
+    }
+    for (size_t r = 0; r < resources.size(); r++) {
+        if (resources[r].output && last_writer[r] >= 0) stack.push_back((uint32_t)last_writer[r]);
+    }
+    while (!stack.empty()) {
+        uint32_t p = stack.back();
+        stack.pop_back();
+        if (passes[p]->live) continue;
+        passes[p]->live = true;
+        for (uint32_t producer : producers[p]) stack.push_back(producer);
+    }
+
+    // Kahn's algorithm over the live passes, the smallest declaration index goes first among ready passes
+    std::vector<uint32_t> in_degree(count, 0);
+    for (uint32_t p = 0; p < count; p++) {
+        if (!passes[p]->live) continue;
+        for (uint32_t s : successors[p]) {
+            if (passes[s]->live) in_degree[s]++;
+        }
+    }
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+    for (uint32_t p = 0; p < count; p++) {
+        if (passes[p]->live && in_degree[p] == 0) ready.push(p);
+    }
+    order.clear();
+    while (!ready.empty()) {
+        uint32_t p = ready.top();
+        ready.pop();
+        order.push_back(p);
+        for (uint32_t s : successors[p]) {
+            if (passes[s]->live && --in_degree[s] == 0) ready.push(s);
+        }
+    }
+}
+
+void RenderGraph::compute_lifetimes() {
+    for (auto& resource : resources) {
+        resource.first  = UINT32_MAX;
+        resource.last   = 0;
+        resource.usage  = resource.desc.usage;
+        resource.aspect = 0;
+        if (resource.is_image) {
+            VkFormat format = resource.desc.format;
+            if (is_depth_format(format)) {
+                resource.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+                if (has_stencil(format)) resource.aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+            } else {
+                resource.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+            }
+        }
+    }
+
+    for (uint32_t pos = 0; pos < order.size(); pos++) {
+        for (auto& use : passes[order[pos]]->uses) {
+            Resource& resource = resources[use.resource];
+            resource.first     = std::min(resource.first, pos);
+            resource.last      = std::max(resource.last, pos);
+            if (resource.is_image) resource.usage |= usage_for(use.layout);
+        }
+    }
+}
+
+// An attachment is stored only when something after the pass can observe it
+void RenderGraph::decide_store_ops() {
+    for (uint32_t pos = 0; pos < order.size(); pos++) {
+        for (auto& use : passes[order[pos]]->uses) {
+            if (!use.attachment) continue;
+            const Resource& resource = resources[use.resource];
+            bool            needed   = resource.imported || resource.output;
+            for (uint32_t later = pos + 1; later < order.size() && !needed; later++) {
+                bool overwritten = false;
+                for (auto& next : passes[order[later]]->uses) {
+                    if (next.resource != use.resource) continue;
+                    if (next.reads_previous()) needed = true;
+                    else if (next.write) overwritten = true;
+                }
+                if (overwritten) break;
+            }
+            use.store_op = needed ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        }
+    }
+}
+
+// Raster passes are chained while each one only loads and writes the attachments of the pass before it,
+// with the same layouts. Anything else would need a barrier inside the render pass.
+void RenderGraph::merge_subpasses() {
+    for (auto& pass : passes) pass->subpass = 0;
+    if (!merge) return;
+    for (uint32_t pos = 1; pos < order.size(); pos++) {
+        RGPass& prev = *passes[order[pos - 1]];
+        RGPass& pass = *passes[order[pos]];
+        if (can_merge(prev, pass)) pass.subpass = prev.subpass + 1;
+    }
+}
+
+bool RenderGraph::can_merge(const RGPass& prev, const RGPass& pass) const {
+    if (prev.type != RGPassType::Raster || pass.type != RGPassType::Raster) return false;
+
+    auto prev_attachments = prev.attachments();
+    auto attachments      = pass.attachments();
+    if (attachments.empty() || attachments.size() != pass.uses.size()) return false;
+    if (attachments.size() != prev_attachments.size()) return false;
+    for (size_t i = 0; i < attachments.size(); i++) {
+        if (attachments[i]->resource != prev_attachments[i]->resource) return false;
+        if (attachments[i]->layout != prev_attachments[i]->layout) return false;
+        if (!attachments[i]->reads_previous()) return false;
+    }
+    return true;
+}
+
+uint32_t RenderGraph::group_size(uint32_t pos) const {
+    uint32_t count = 1;
+    while (pos + count < order.size() && passes[order[pos + count]]->subpass > 0) count++;
+    return count;
+}
+
+// One image per transient, memory shared between images whose pass ranges do not overlap. Largest
+// images are placed first, each one goes into the first slot that is free for its whole lifetime.
+int RenderGraph::create_transients() {
+    std::vector<RGResource>           transients;
+    std::vector<VkMemoryRequirements> requirements(resources.size());
+    for (size_t r = 0; r < resources.size(); r++) {
+        Resource& resource = resources[r];
+        if (resource.imported || !resource.is_image || resource.first == UINT32_MAX) continue;
+
+        VkImageCreateInfo info = {};
+        info.sType             = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        info.imageType         = VK_IMAGE_TYPE_2D;
+        info.format            = resource.desc.format;
+        info.extent            = {resource.extent.width, resource.extent.height, 1};
+        info.mipLevels         = 1;
+        info.arrayLayers       = 1;
+        info.samples           = resource.desc.samples;
+        info.tiling            = VK_IMAGE_TILING_OPTIMAL;
+        info.usage             = resource.usage;
+        info.sharingMode       = VK_SHARING_MODE_EXCLUSIVE;
+        info.initialLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(device, &info, nullptr, &resource.image) != VK_SUCCESS) {
+            std::cout << "failed to create transient image " << resource.name << "\n";
+            return -1;
+        }
+        vkGetImageMemoryRequirements(device, resource.image, &requirements[r]);
+        transients.push_back((RGResource)r);
+    }
+
+    std::stable_sort(transients.begin(), transients.end(),
+                     [&](RGResource a, RGResource b) { return requirements[a].size > requirements[b].size; });
+
+    for (RGResource r : transients) {
+        Resource&                   resource = resources[r];
+        const VkMemoryRequirements& req      = requirements[r];
+        for (size_t s = 0; s < slots.size() && resource.slot < 0; s++) {
+            if (!(slots[s].type_bits & req.memoryTypeBits)) continue;
+            bool overlaps = false;
+            for (auto& lifetime : slots[s].lifetimes) {
+                if (resource.first <= lifetime.second && lifetime.first <= resource.last) overlaps = true;
+            }
+            if (!overlaps) resource.slot = (int)s;
+        }
+        if (resource.slot < 0) {
+            slots.emplace_back();
+            resource.slot = (int)slots.size() - 1;
+        }
+
+        MemorySlot& slot = slots[resource.slot];
+        slot.size        = std::max(slot.size, req.size);
+        slot.alignment   = std::max(slot.alignment, req.alignment);
+        slot.type_bits &= req.memoryTypeBits;
+        slot.lifetimes.push_back({resource.first, resource.last});
+    }
+
+    for (auto& slot : slots) {
+        VkMemoryRequirements req = {};
+        req.size                 = slot.size;
+        req.alignment            = slot.alignment;
+        req.memoryTypeBits       = slot.type_bits;
+        if (allocator->allocate(req, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, AllocationKind::Optimal, false,
+                                slot.allocation)) {
+            std::cout << "failed to allocate render graph memory\n";
+            return -1;
+        }
+    }
+
+    for (RGResource r : transients) {
+        Resource&   resource = resources[r];
+        MemorySlot& slot     = slots[resource.slot];
+        if (vkBindImageMemory(device, resource.image, slot.allocation.memory, slot.allocation.offset) != VK_SUCCESS) {
+            std::cout << "failed to bind transient image " << resource.name << "\n";
+            return -1;
+        }
+
+        VkImageViewCreateInfo view_info           = {};
+        view_info.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image                           = resource.image;
+        view_info.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format                          = resource.desc.format;
+        view_info.subresourceRange.aspectMask     = resource.aspect;
+        view_info.subresourceRange.baseMipLevel   = 0;
+        view_info.subresourceRange.levelCount     = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount     = 1;
+        if (vkCreateImageView(device, &view_info, nullptr, &resource.view) != VK_SUCCESS) {
+            std::cout << "failed to create transient image view " << resource.name << "\n";
+            return -1;
+        }
+    }
+
+    // everything that touches a slot, so the first use of an occupant waits for all of it
+    for (uint32_t p : order) {
+        for (auto& use : passes[p]->uses) {
+            const Resource& resource = resources[use.resource];
+            if (resource.slot < 0) continue;
+            slots[resource.slot].stages |= use.stages;
+            slots[resource.slot].access |= use.access & WRITE_ACCESS;
+        }
+    }
+    return 0;
+}
+
+void RenderGraph::destroy_transients(bool deferred) {
+    std::vector<VkImageView>      views;
+    std::vector<VkImage>          images;
+    std::vector<VulkanAllocation> allocations;
+    for (auto& resource : resources) {
+        if (resource.imported || !resource.is_image) continue;
+        if (resource.view != VK_NULL_HANDLE) views.push_back(resource.view);
+        if (resource.image != VK_NULL_HANDLE) images.push_back(resource.image);
+        resource.view  = VK_NULL_HANDLE;
+        resource.image = VK_NULL_HANDLE;
+        resource.slot  = -1;
+    }
+    for (auto& slot : slots) allocations.push_back(slot.allocation);
+    slots.clear();
+    if (views.empty() && images.empty() && allocations.empty()) return;
+
+    VkDevice         device    = this->device;
+    VulkanAllocator* allocator = this->allocator;
+    auto             destroy   = [device, allocator, views, images, allocations]() mutable {
+        for (auto view : views) vkDestroyImageView(device, view, nullptr);
+        for (auto image : images) vkDestroyImage(device, image, nullptr);
+        for (auto& allocation : allocations) allocator->free(allocation);
+    };
+    if (deferred && retire)
+        retire(destroy);
+    else
+        destroy();
+}
+
+int RenderGraph::create_render_passes() {
+    for (auto& pass : passes) pass->render_pass = VK_NULL_HANDLE;
+    for (uint32_t pos = 0; pos < order.size(); pos++) {
+        RGPass& pass = *passes[order[pos]];
+        if (pass.type != RGPassType::Raster || pass.subpass > 0) continue;
+
+        auto attachments = pass.attachments();
+        if (attachments.empty()) {
+            std::cout << "raster pass " << pass.name << " has no attachments\n";
+            return -1;
+        }
+        pass.render_pass = render_pass_for(pos);
+        if (pass.render_pass == VK_NULL_HANDLE) return -1;
+
+        for (uint32_t i = 1; i < group_size(pos); i++) passes[order[pos + i]]->render_pass = pass.render_pass;
+    }
+    return 0;
+}
+
+// Attachments keep their layout for the whole render pass, transitions are done by the graph's barriers.
+// A merged render pass loads as its first subpass and stores as its last one.
+VkRenderPass RenderGraph::render_pass_for(uint32_t pos) {
+    const RGPass& first = *passes[order[pos]];
+    uint32_t      count = group_size(pos);
+
+    auto attachments = first.attachments();
+    auto last        = passes[order[pos + count - 1]]->attachments();
+
+    std::vector<uint64_t> key = {count};
+    for (size_t i = 0; i < attachments.size(); i++) {
+        const Resource& resource = resources[attachments[i]->resource];
+        key.insert(key.end(), {(uint64_t)resource.desc.format, (uint64_t)resource.desc.samples,
+                               (uint64_t)attachments[i]->load_op, (uint64_t)last[i]->store_op,
+                               (uint64_t)attachments[i]->layout});
+    }
+    auto it = render_passes.find(key);
+    if (it != render_passes.end()) return it->second;
+
+    std::vector<VkAttachmentDescription> descriptions;
+    std::vector<VkAttachmentReference>   color_refs;
+    VkAttachmentReference                depth_ref = {};
+    bool                                 has_depth = false;
+    for (size_t i = 0; i < attachments.size(); i++) {
+        const RGUse*            use         = attachments[i];
+        const Resource&         resource    = resources[use->resource];
+        VkAttachmentDescription description = {};
+        description.format                  = resource.desc.format;
+        description.samples                 = resource.desc.samples;
+        description.loadOp                  = use->load_op;
+        description.storeOp                 = last[i]->store_op;
+        description.stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        description.stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        if (has_stencil(resource.desc.format)) {
+            description.stencilLoadOp  = description.loadOp;
+            description.stencilStoreOp = description.storeOp;
+        }
+        description.initialLayout = use->layout;
+        description.finalLayout   = use->layout;
+
+        VkAttachmentReference ref = {(uint32_t)descriptions.size(), use->layout};
+        if (use->layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
+            color_refs.push_back(ref);
+        } else {
+            depth_ref = ref;
+            has_depth = true;
+        }
+        descriptions.push_back(description);
+    }
+
+    // merged passes use the same attachments the same way, so all subpasses share the references
+    VkSubpassDescription subpass    = {};
+    subpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount    = (uint32_t)color_refs.size();
+    subpass.pColorAttachments       = color_refs.data();
+    subpass.pDepthStencilAttachment = has_depth ? &depth_ref : nullptr;
+    std::vector<VkSubpassDescription> subpasses(count, subpass);
+
+    std::vector<VkSubpassDependency> dependencies;
+    for (uint32_t i = 1; i < count; i++) {
+        VkSubpassDependency dependency = {};
+        dependency.srcSubpass          = i - 1;
+        dependency.dstSubpass          = i;
+        dependency.dependencyFlags     = VK_DEPENDENCY_BY_REGION_BIT;
+        for (auto& use : passes[order[pos + i - 1]]->uses) {
+            dependency.srcStageMask |= use.stages;
+            dependency.srcAccessMask |= use.access & WRITE_ACCESS;
+        }
+        for (auto& use : passes[order[pos + i]]->uses) {
+            dependency.dstStageMask |= use.stages;
+            dependency.dstAccessMask |= use.access;
+        }
+        dependencies.push_back(dependency);
+    }
+
+    VkRenderPassCreateInfo info = {};
+    info.sType                  = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    info.attachmentCount        = (uint32_t)descriptions.size();
+    info.pAttachments           = descriptions.data();
+    info.subpassCount           = (uint32_t)subpasses.size();
+    info.pSubpasses             = subpasses.data();
+    info.dependencyCount        = (uint32_t)dependencies.size();
+    info.pDependencies          = dependencies.data();
+
+    VkRenderPass render_pass;
+    if (vkCreateRenderPass(device, &info, nullptr, &render_pass) != VK_SUCCESS) {
+        std::cout << "failed to create render pass for " << first.name << "\n";
+        return VK_NULL_HANDLE;
+    }
+    render_passes[key] = render_pass;
+    return render_pass;
+}
+
+VkFramebuffer RenderGraph::framebuffer_for(const RGPass& pass) {
+    auto attachments = pass.attachments();
+
+    std::vector<uint64_t>    key = {(uint64_t)pass.render_pass, pass.extent.width, pass.extent.height};
+    std::vector<VkImageView> views;
+    for (auto use : attachments) {
+        views.push_back(resources[use->resource].view);
+        key.push_back((uint64_t)views.back());
+    }
+    auto it = framebuffers.find(key);
+    if (it != framebuffers.end()) return it->second;
+
+    VkFramebufferCreateInfo info = {};
+    info.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    info.renderPass              = pass.render_pass;
+    info.attachmentCount         = (uint32_t)views.size();
+    info.pAttachments            = views.data();
+    info.width                   = pass.extent.width;
+    info.height                  = pass.extent.height;
+    info.layers                  = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(device, &info, nullptr, &framebuffer) != VK_SUCCESS) {
+        std::cout << "failed to create framebuffer for " << pass.name << "\n";
+        return VK_NULL_HANDLE;
+    }
+    framebuffers[key] = framebuffer;
+    return framebuffer;
+}
+
+void RenderGraph::invalidate_framebuffers(bool deferred) {
+    if (framebuffers.empty()) return;
+
+    std::vector<VkFramebuffer> old;
+    for (auto& it : framebuffers) old.push_back(it.second);
+    framebuffers.clear();
+
+    VkDevice device  = this->device;
+    auto     destroy = [device, old]() {
+        for (auto framebuffer : old) vkDestroyFramebuffer(device, framebuffer, nullptr);
+    };
+    if (deferred && retire)
+        retire(destroy);
+    else
+        destroy();
+}
+
+// Replays every use in execution order and tracks, per resource, its layout, the last write and the
+// reads that already saw it. A barrier is needed for a layout change, for any write after earlier
+// accesses, and for a read the last write has not been made visible to yet.
+void RenderGraph::build_barriers() {
+    struct State {
+        VkImageLayout        layout       = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags write_stages = 0;
+        VkAccessFlags        write_access = 0;
+        VkPipelineStageFlags read_stages  = 0;
+        VkAccessFlags        read_access  = 0;
+    };
+
+    std::vector<State> states(resources.size());
+    for (size_t r = 0; r < resources.size(); r++) {
+        const Resource& resource = resources[r];
+        State&          state    = states[r];
+        if (resource.slot >= 0) {
+            state.write_stages = slots[resource.slot].stages;
+            state.write_access = slots[resource.slot].access;
+        } else if (resource.is_image) {
+            state.layout       = resource.initial_layout;
+            state.write_stages = resource.initial_stages;
+            state.write_access = resource.initial_layout == VK_IMAGE_LAYOUT_UNDEFINED ? 0 : VK_ACCESS_MEMORY_WRITE_BIT;
+        } else {
+            state.write_stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            state.write_access = VK_ACCESS_MEMORY_WRITE_BIT;
+        }
+    }
+
+    pass_barriers.assign(order.size(), BarrierBatch());
+    for (uint32_t pos = 0; pos < order.size(); pos++) {
+        BarrierBatch& batch = pass_barriers[pos];
+        for (auto& use : passes[order[pos]]->uses) {
+            const Resource& resource = resources[use.resource];
+            State&          state    = states[use.resource];
+            bool            change   = resource.is_image && use.layout != state.layout;
+
+            Barrier barrier    = {};
+            barrier.resource   = use.resource;
+            barrier.old_layout = change && !use.reads_previous() ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+            barrier.new_layout = resource.is_image ? use.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.dst_access = use.access;
+
+            VkPipelineStageFlags src_stages = 0;
+            if (use.write || change) {
+                src_stages         = state.write_stages | state.read_stages;
+                barrier.src_access = state.write_access;
+                state.layout       = barrier.new_layout;
+                state.write_stages = use.stages;
+                state.write_access = use.access & WRITE_ACCESS;
+                state.read_stages  = use.write ? 0 : use.stages;
+                state.read_access  = use.write ? 0 : use.access;
+                if (!src_stages && !change) continue;
+            } else {
+                bool visible = !(use.stages & ~state.read_stages) && !(use.access & ~state.read_access);
+                state.read_stages |= use.stages;
+                state.read_access |= use.access;
+                if (!state.write_stages || visible) continue;
+                src_stages         = state.write_stages;
+                barrier.src_access = state.write_access;
+            }
+
+            batch.src_stages |= src_stages ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            batch.dst_stages |= use.stages;
+            batch.barriers.push_back(barrier);
+        }
+
+        // covered by the subpass dependency, a merged pass only touches attachments of the render pass
+        if (passes[order[pos]]->subpass > 0) batch = BarrierBatch();
+    }
+
+    final_barriers = BarrierBatch();
+    for (size_t r = 0; r < resources.size(); r++) {
+        const Resource& resource = resources[r];
+        const State&    state    = states[r];
+        if (!resource.is_image || resource.final_layout == VK_IMAGE_LAYOUT_UNDEFINED) continue;
+        if (state.layout == resource.final_layout) continue;
+
+        Barrier barrier    = {};
+        barrier.resource   = (RGResource)r;
+        barrier.old_layout = state.layout;
+        barrier.new_layout = resource.final_layout;
+        barrier.src_access = state.write_access;
+        barrier.dst_access = 0;
+
+        VkPipelineStageFlags src_stages = state.write_stages | state.read_stages;
+        final_barriers.src_stages |= src_stages ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        final_barriers.dst_stages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        final_barriers.barriers.push_back(barrier);
+    }
+}
+
+void RenderGraph::compute_stats() {
+    stats = RGStats();
+    for (uint32_t pos = 0; pos < order.size(); pos++) {
+        const RGPass& pass = *passes[order[pos]];
+        if (pass.type != RGPassType::Raster) continue;
+        stats.subpasses++;
+        if (pass.subpass > 0) continue;
+        stats.render_passes++;
+
+        auto attachments = pass.attachments();
+        auto last        = passes[order[pos + group_size(pos) - 1]]->attachments();
+        for (size_t i = 0; i < attachments.size(); i++) {
+            const Resource& resource = resources[attachments[i]->resource];
+            uint64_t        texels   = (uint64_t)resource.extent.width * resource.extent.height * resource.desc.samples;
+            uint64_t        bytes    = texels * format_size(resource.desc.format);
+            if (attachments[i]->load_op == VK_ATTACHMENT_LOAD_OP_LOAD) stats.load_bytes += bytes;
+            if (last[i]->store_op == VK_ATTACHMENT_STORE_OP_STORE) stats.store_bytes += bytes;
+        }
+    }
+}
+
+void RenderGraph::record_barriers(VkCommandBuffer cmd, const BarrierBatch& batch) {
+    if (batch.barriers.empty()) return;
+
+    std::vector<VkImageMemoryBarrier>  image_barriers;
+    std::vector<VkBufferMemoryBarrier> buffer_barriers;
+    for (auto& barrier : batch.barriers) {
+        const Resource& resource = resources[barrier.resource];
+        if (resource.is_image) {
+            VkImageMemoryBarrier image_barrier            = {};
+            image_barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            image_barrier.srcAccessMask                   = barrier.src_access;
+            image_barrier.dstAccessMask                   = barrier.dst_access;
+            image_barrier.oldLayout                       = barrier.old_layout;
+            image_barrier.newLayout                       = barrier.new_layout;
+            image_barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.image                           = resource.image;
+            image_barrier.subresourceRange.aspectMask     = resource.aspect;
+            image_barrier.subresourceRange.baseMipLevel   = 0;
+            image_barrier.subresourceRange.levelCount     = VK_REMAINING_MIP_LEVELS;
+            image_barrier.subresourceRange.baseArrayLayer = 0;
+            image_barrier.subresourceRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+            image_barriers.push_back(image_barrier);
+        } else {
+            VkBufferMemoryBarrier buffer_barrier = {};
+            buffer_barrier.sType                 = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            buffer_barrier.srcAccessMask         = barrier.src_access;
+            buffer_barrier.dstAccessMask         = barrier.dst_access;
+            buffer_barrier.srcQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier.dstQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier.buffer                = resource.buffer;
+            buffer_barrier.offset                = 0;
+            buffer_barrier.size                  = VK_WHOLE_SIZE;
+            buffer_barriers.push_back(buffer_barrier);
+        }
+    }
+    vkCmdPipelineBarrier(cmd, batch.src_stages, batch.dst_stages, 0, 0, nullptr, (uint32_t)buffer_barriers.size(),
+                         buffer_barriers.data(), (uint32_t)image_barriers.size(), image_barriers.data());
+}
+
+int RenderGraph::execute(VkCommandBuffer cmd) {
+    if (dirty && compile()) return -1;
+    if (resized && resize()) return -1;
+
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    for (uint32_t pos = 0; pos < order.size(); pos++) {
+        RGPass& pass = *passes[order[pos]];
+
+        RGContext context = {};
+        context.cmd       = cmd;
+        context.extent    = pass.extent;
+        context.graph     = this;
+        if (pass.type != RGPassType::Raster) {
+            record_barriers(cmd, pass_barriers[pos]);
+            if (pass.execute) pass.execute(context);
+            continue;
+        }
+
+        if (pass.subpass > 0) {
+            vkCmdNextSubpass(cmd, pass.contents);
+        } else {
+            record_barriers(cmd, pass_barriers[pos]);
+            framebuffer = framebuffer_for(pass);
+            if (framebuffer == VK_NULL_HANDLE) return -1;
+
+            std::vector<VkClearValue> clear_values;
+            for (auto use : pass.attachments()) clear_values.push_back(use->clear);
+
+            VkRenderPassBeginInfo begin_info = {};
+            begin_info.sType                 = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            begin_info.renderPass            = pass.render_pass;
+            begin_info.framebuffer           = framebuffer;
+            begin_info.renderArea.offset     = {0, 0};
+            begin_info.renderArea.extent     = pass.extent;
+            begin_info.clearValueCount       = (uint32_t)clear_values.size();
+            begin_info.pClearValues          = clear_values.data();
+            vkCmdBeginRenderPass(cmd, &begin_info, pass.contents);
+        }
+
+        context.render_pass = pass.render_pass;
+        context.subpass     = pass.subpass;
+        context.framebuffer = framebuffer;
+        if (pass.execute) pass.execute(context);
+
+        bool last = pos + 1 == order.size() || passes[order[pos + 1]]->subpass == 0;
+        if (last) vkCmdEndRenderPass(cmd);
+    }
+
+    record_barriers(cmd, final_barriers);
+    return 0;
+}
+
+void RenderGraph::dump(std::ostream& os) const {
+    os << "render graph: " << order.size() << " of " << passes.size() << " passes live\n";
+    for (uint32_t pos = 0; pos < order.size(); pos++) {
+        const RGPass& pass = *passes[order[pos]];
+        os << "  " << pos << " " << pass.name << ", " << pass_barriers[pos].barriers.size() << " barriers";
+        if (pass.subpass > 0) os << ", subpass " << pass.subpass;
+        os << "\n";
+    }
+    os << "  " << stats.render_passes << " render passes, attachment traffic " << (stats.load_bytes >> 10)
+       << " KB loaded, " << (stats.store_bytes >> 10) << " KB stored per frame\n";
+    for (auto& pass : passes) {
+        if (!pass->live) os << "  culled " << pass->name << "\n";
+    }
+    for (size_t s = 0; s < slots.size(); s++) {
+        os << "  memory slot " << s << ": " << (slots[s].size >> 10) << " KB shared by";
+        for (auto& resource : resources) {
+            if (resource.slot == (int)s) os << " " << resource.name;
+        }
+        os << "\n";
+    }
+}
+
+}  // namespace fl
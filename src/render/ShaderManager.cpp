@@ -0,0 +1,356 @@
+#include "fl/render/ShaderManager.hpp"
+
+#include <tbb/parallel_for.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <regex>
+#include <sstream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef FL_HAS_SHADERC
+#include <shaderc/shaderc.hpp>
+#endif
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+using Clock = std::chrono::steady_clock;
+
+static bool read_text(const std::string& path, std::string& text) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::stringstream stream;
+    stream << file.rdbuf();
+    text = stream.str();
+    return true;
+}
+
+#ifdef FL_HAS_SHADERC
+static bool shader_kind(const std::string& stage, shaderc_shader_kind& kind) {
+    static const std::pair<const char*, shaderc_shader_kind> kinds[] = {
+        {"vertex", shaderc_vertex_shader},
+        {"vert", shaderc_vertex_shader},
+        {"fragment", shaderc_fragment_shader},
+        {"frag", shaderc_fragment_shader},
+        {"compute", shaderc_compute_shader},
+        {"comp", shaderc_compute_shader},
+        {"geometry", shaderc_geometry_shader},
+        {"geom", shaderc_geometry_shader},
+        {"tesscontrol", shaderc_tess_control_shader},
+        {"tesc", shaderc_tess_control_shader},
+        {"tesseval", shaderc_tess_evaluation_shader},
+        {"tese", shaderc_tess_evaluation_shader},
+        {"rgen", shaderc_raygen_shader},
+        {"rmiss", shaderc_miss_shader},
+        {"rchit", shaderc_closesthit_shader},
+        {"rahit", shaderc_anyhit_shader},
+        {"rint", shaderc_intersection_shader},
+        {"rcall", shaderc_callable_shader},
+        {"task", shaderc_task_shader},
+        {"mesh", shaderc_mesh_shader},
+    };
+    for (auto& entry : kinds) {
+        if (stage == entry.first) {
+            kind = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Resolves #include "x" in the shader directory, where every shader and its includes live
+class ShaderIncluder : public shaderc::CompileOptions::IncluderInterface {
+public:
+    explicit ShaderIncluder(const std::string& dir) : dir(dir) {}
+
+    shaderc_include_result* GetInclude(const char* requested, shaderc_include_type, const char*, size_t) override {
+        auto* include = new Include();
+        include->name = requested;
+        if (!read_text(dir + "/" + include->name, include->content)) {
+            include->content = "cannot open " + dir + "/" + include->name;
+            include->name.clear();  // an empty name tells shaderc the content is the error
+        }
+        include->result.source_name        = include->name.c_str();
+        include->result.source_name_length = include->name.size();
+        include->result.content            = include->content.c_str();
+        include->result.content_length     = include->content.size();
+        include->result.user_data          = include;
+        return &include->result;
+    }
+
+    void ReleaseInclude(shaderc_include_result* result) override { delete (Include*)result->user_data; }
+
+protected:
+    struct Include {
+        std::string            name, content;
+        shaderc_include_result result;
+    };
+
+    std::string dir;
+};
+#endif
+
+int ShaderManager::start(const std::string& shader_dir, const std::string& output_dir) {
+    if (running()) return 0;
+    this->shader_dir = shader_dir;
+    this->output_dir = output_dir;
+
+#ifdef __linux__
+    notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notify_fd < 0 || inotify_add_watch(notify_fd, shader_dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cout << "failed to watch shader directory " << shader_dir << "\n";
+        if (notify_fd >= 0) close(notify_fd);
+        notify_fd = -1;
+        return -1;
+    }
+#else
+    if (!std::filesystem::is_directory(shader_dir)) {
+        std::cout << "failed to watch shader directory " << shader_dir << "\n";
+        return -1;
+    }
+#endif
+
+    quit   = false;
+    worker = std::thread(&ShaderManager::run, this);
+    return 0;
+}
+
+void ShaderManager::stop() {
+    if (!running()) return;
+    quit = true;
+    worker.join();
+#ifdef __linux__
+    close(notify_fd);
+    notify_fd = -1;
+#endif
+}
+
+uint32_t ShaderManager::watch(const std::vector<ShaderSource>& sources, std::function<int()> reload) {
+    Watcher watcher;
+    watcher.id     = next_id++;
+    watcher.reload = std::move(reload);
+    for (auto& source : sources) {
+        Shader shader;
+        shader.source = source;
+        scan_includes(source.glsl, shader.includes);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        shaders[source.spirv] = std::move(shader);
+        watcher.spirv.push_back(source.spirv);
+    }
+    watchers.push_back(std::move(watcher));
+    return watchers.back().id;
+}
+
+// The shaders stay compiled on change, unused SPIR-V is harmless
+void ShaderManager::unwatch(uint32_t id) {
+    for (size_t i = 0; i < watchers.size(); i++) {
+        if (watchers[i].id == id) {
+            watchers.erase(watchers.begin() + i);
+            return;
+        }
+    }
+}
+
+uint32_t ShaderManager::apply() {
+    std::map<std::string, std::vector<uint32_t>> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ready.empty()) return 0;
+        batch.swap(ready);
+    }
+    for (auto& entry : batch) applied[entry.first] = std::move(entry.second);
+
+    uint32_t reloaded = 0;
+    for (auto& watcher : watchers) {
+        bool changed = false;
+        for (auto& spirv : watcher.spirv) changed |= batch.count(spirv) != 0;
+        if (!changed) continue;
+        if (watcher.reload() == 0)
+            reloaded++;
+        else
+            std::cout << "failed to reload pipeline of " << watcher.spirv[0] << ", keeping the old one\n";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.reloads += reloaded;
+    return reloaded;
+}
+
+const std::vector<uint32_t>* ShaderManager::compiled(const std::string& spirv) const {
+    auto it = applied.find(spirv);
+    return it != applied.end() ? &it->second : nullptr;
+}
+
+ShaderManager::Stats ShaderManager::get_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+// Editors save in several steps (write, rename, touch), changes are collected until the directory has
+// been quiet for a moment and compiled as one batch
+void ShaderManager::run() {
+    const auto quiet = std::chrono::milliseconds(50);
+
+    std::set<std::string> changed;
+    Clock::time_point     last_change = Clock::now();
+
+#ifndef __linux__
+    std::map<std::string, std::filesystem::file_time_type> times;
+    bool                                                   first = true;
+#endif
+
+    while (!quit) {
+#ifdef __linux__
+        pollfd request = {notify_fd, POLLIN, 0};
+        if (poll(&request, 1, 20) > 0) {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t                     length;
+            while ((length = read(notify_fd, buffer, sizeof(buffer))) > 0) {
+                for (char* p = buffer; p < buffer + length;) {
+                    auto* event = (inotify_event*)p;
+                    if (event->len) changed.insert(event->name);
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+            last_change = Clock::now();
+        }
+#else
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        std::error_code ec;
+        for (auto& entry : std::filesystem::directory_iterator(shader_dir, ec)) {
+            auto name = entry.path().filename().string();
+            auto time = entry.last_write_time(ec);
+            auto it   = times.find(name);
+            if (it != times.end() && it->second == time) continue;
+            times[name] = time;
+            if (!first) {
+                changed.insert(name);
+                last_change = Clock::now();
+            }
+        }
+        first = false;
+#endif
+        if (!changed.empty() && Clock::now() - last_change >= quiet) {
+            compile_changed(changed);
+            changed.clear();
+        }
+    }
+}
+
+void ShaderManager::compile_changed(const std::set<std::string>& changed) {
+    std::vector<ShaderSource> sources;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& entry : shaders) {
+            bool dirty = changed.count(entry.second.source.glsl) != 0;
+            for (auto& include : entry.second.includes) dirty |= changed.count(include) != 0;
+            if (dirty) sources.push_back(entry.second.source);
+        }
+    }
+    if (sources.empty()) return;
+
+    auto                               begin = Clock::now();
+    std::vector<std::vector<uint32_t>> codes(sources.size());
+    std::vector<std::string>           logs(sources.size());
+    std::vector<std::set<std::string>> includes(sources.size());
+    std::vector<int>                   results(sources.size());
+    tbb::parallel_for(size_t(0), sources.size(), [&](size_t i) {
+        results[i] = compile(sources[i], codes[i], logs[i]);
+        scan_includes(sources[i].glsl, includes[i]);  // an edit may have added or removed some
+    });
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < sources.size(); i++) {
+        auto it = shaders.find(sources[i].spirv);
+        if (it != shaders.end()) it->second.includes = std::move(includes[i]);
+        stats.compiles++;
+        if (results[i]) {
+            stats.failures++;
+            std::cout << "failed to compile " << sources[i].glsl << "\n" << logs[i];
+            continue;
+        }
+        ready[sources[i].spirv] = std::move(codes[i]);
+    }
+    stats.compile_ms = ms;
+    std::cout << "recompiled " << sources.size() << " shaders in " << ms << " ms\n";
+}
+
+// Same target as add_spirv_shader: Vulkan 1.2, SPIR-V 1.5
+int ShaderManager::compile(const ShaderSource& source, std::vector<uint32_t>& code, std::string& log) {
+    std::string path = shader_dir + "/" + source.glsl;
+#ifdef FL_HAS_SHADERC
+    shaderc_shader_kind kind;
+    if (!shader_kind(source.stage, kind)) {
+        log = "unknown shader stage " + source.stage + "\n";
+        return -1;
+    }
+    std::string text;
+    if (!read_text(path, text)) {
+        log = "cannot open " + path + "\n";
+        return -1;
+    }
+
+    shaderc::Compiler       compiler;
+    shaderc::CompileOptions options;
+    options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+    options.SetTargetSpirv(shaderc_spirv_version_1_5);
+    options.SetIncluder(std::make_unique<ShaderIncluder>(shader_dir));
+    auto result = compiler.CompileGlslToSpv(text, kind, source.glsl.c_str(), options);
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+        log = result.GetErrorMessage();
+        return -1;
+    }
+    code.assign(result.cbegin(), result.cend());
+    return 0;
+#else
+    // no shaderc in this build, glslc prints its errors itself
+    std::string output  = output_dir + "/" + source.spirv + ".compile";
+    std::string command = "glslc --target-env=vulkan1.2 -fshader-stage=" + source.stage + " \"" + path + "\" -o \"" +
+                          output + "\"";
+    int status = std::system(command.c_str());
+    if (status != 0) {
+        log = "glslc returned " + std::to_string(status) + "\n";
+        return -1;
+    }
+    std::string     bytes;
+    bool            read = read_text(output, bytes);
+    std::error_code ec;
+    std::filesystem::remove(output, ec);
+    if (!read || bytes.empty() || bytes.size() % 4) {
+        log = "cannot read " + output + "\n";
+        return -1;
+    }
+    code.resize(bytes.size() / 4);
+    memcpy(code.data(), bytes.data(), bytes.size());
+    return 0;
+#endif
+}
+
+void ShaderManager::scan_includes(const std::string& glsl, std::set<std::string>& includes) {
+    static const std::regex directive("^\\s*#\\s*include\\s*\"([^\"]+)\"");
+
+    std::string text;
+    if (!read_text(shader_dir + "/" + glsl, text)) return;
+    std::istringstream lines(text);
+    std::string        line;
+    std::smatch        match;
+    while (std::getline(lines, line)) {
+        if (!std::regex_search(line, match, directive)) continue;
+        if (includes.insert(match[1].str()).second) scan_includes(match[1].str(), includes);
+    }
+}
+
+}  // namespace fl
@@ -0,0 +1,62 @@
+#include "fl/render/ShaderModuleRegistry.hpp"
+
+#include <cstring>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+const EmbeddedShader* find_embedded_shader(const std::string& name) {
+    for (size_t i = 0; i < embedded_shader_count; i++) {
+        if (name == embedded_shaders[i].name) return &embedded_shaders[i];
+    }
+    return nullptr;
+}
+
+void ShaderModuleRegistry::create(VkDevice device) { this->device = device; }
+
+void ShaderModuleRegistry::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : modules) {
+        for (auto& module : entry.second) vkDestroyShaderModule(device, module.module, nullptr);
+    }
+    modules.clear();
+    stats.modules = 0;
+}
+
+VkShaderModule ShaderModuleRegistry::get(const uint32_t* code, size_t words, uint64_t hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto&                       bucket = modules[hash];
+    for (auto& module : bucket) {
+        if (module.code.size() == words && memcmp(module.code.data(), code, words * 4) == 0) {
+            stats.hits++;
+            return module.module;
+        }
+    }
+
+    VkShaderModuleCreateInfo create_info = {};
+    create_info.sType                    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    create_info.codeSize                 = words * 4;
+    create_info.pCode                    = code;
+
+    VkShaderModule module;
+    if (vkCreateShaderModule(device, &create_info, nullptr, &module) != VK_SUCCESS) {
+        std::cout << "failed to create shader module\n";
+        return VK_NULL_HANDLE;
+    }
+    bucket.push_back({std::vector<uint32_t>(code, code + words), module});
+    stats.misses++;
+    stats.modules++;
+    return module;
+}
+
+VkShaderModule ShaderModuleRegistry::get(const std::vector<uint32_t>& code) {
+    return get(code.data(), code.size(), fnv1a(code.data(), code.size() * 4));
+}
+
+ShaderModuleRegistry::Stats ShaderModuleRegistry::get_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+}  // namespace fl
@@ -0,0 +1,612 @@
+#include "fl/render/VulkanAccelerationStructures.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+// Mesh record read by the hit shaders, RTMesh in shader/rt_common.glsl
+struct RTMeshRecord {
+    uint32_t first_index;
+    int32_t  vertex_offset;
+    uint32_t index_count;
+    uint32_t pad;
+};
+
+static const VkBufferUsageFlags geometry_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                                 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+                                                 VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+int RayTracingFunctions::load(VkDevice device) {
+#define FL_LOAD_RT(member, name) member = (PFN_##name)vkGetDeviceProcAddr(device, #name)
+    FL_LOAD_RT(create_acceleration_structure, vkCreateAccelerationStructureKHR);
+    FL_LOAD_RT(destroy_acceleration_structure, vkDestroyAccelerationStructureKHR);
+    FL_LOAD_RT(get_acceleration_structure_build_sizes, vkGetAccelerationStructureBuildSizesKHR);
+    FL_LOAD_RT(get_acceleration_structure_device_address, vkGetAccelerationStructureDeviceAddressKHR);
+    FL_LOAD_RT(cmd_build_acceleration_structures, vkCmdBuildAccelerationStructuresKHR);
+    FL_LOAD_RT(cmd_copy_acceleration_structure, vkCmdCopyAccelerationStructureKHR);
+    FL_LOAD_RT(cmd_write_acceleration_structures_properties, vkCmdWriteAccelerationStructuresPropertiesKHR);
+    FL_LOAD_RT(create_ray_tracing_pipelines, vkCreateRayTracingPipelinesKHR);
+    FL_LOAD_RT(get_ray_tracing_shader_group_handles, vkGetRayTracingShaderGroupHandlesKHR);
+    FL_LOAD_RT(cmd_trace_rays, vkCmdTraceRaysKHR);
+#undef FL_LOAD_RT
+
+    if (!create_acceleration_structure || !destroy_acceleration_structure || !get_acceleration_structure_build_sizes ||
+        !get_acceleration_structure_device_address || !cmd_build_acceleration_structures ||
+        !cmd_copy_acceleration_structure || !cmd_write_acceleration_structures_properties ||
+        !create_ray_tracing_pipelines || !get_ray_tracing_shader_group_handles || !cmd_trace_rays) {
+        std::cout << "failed to load the ray tracing entry points\n";
+        return -1;
+    }
+    return 0;
+}
+
+VulkanAccelerationStructures::VulkanAccelerationStructures() {}
+
+VulkanAccelerationStructures::~VulkanAccelerationStructures() {}
+
+int VulkanAccelerationStructures::create(VulkanImpl* impl, RenderData* data, const RayTracingFunctions* fn,
+                                         const RTSceneDesc& desc) {
+    this->impl = impl;
+    this->data = data;
+    this->fn   = fn;
+    this->desc = desc;
+
+    VkPhysicalDeviceAccelerationStructurePropertiesKHR as_properties = {};
+    as_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType                       = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext                       = &as_properties;
+    vkGetPhysicalDeviceProperties2(impl->device.physical_device.physical_device, &properties);
+    scratch_alignment = std::max<VkDeviceSize>(as_properties.minAccelerationStructureScratchOffsetAlignment, 1);
+
+    if (create_buffer(position_buffer, (VkDeviceSize)desc.max_vertices * sizeof(glm::vec3), geometry_usage) ||
+        create_buffer(index_buffer, (VkDeviceSize)desc.max_indices * sizeof(uint32_t), geometry_usage) ||
+        create_buffer(mesh_buffer, (VkDeviceSize)desc.max_meshes * sizeof(RTMeshRecord),
+                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)) {
+        return -1;
+    }
+    for (auto& buffer : instance_buffers) {
+        if (create_buffer(buffer, (VkDeviceSize)desc.max_instances * sizeof(VkAccelerationStructureInstanceKHR),
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+                              VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                          true)) {
+            return -1;
+        }
+    }
+
+    auto& bindless         = impl->bindless;
+    position_buffer.handle = bindless.add_buffer(position_buffer.buffer);
+    index_buffer.handle    = bindless.add_buffer(index_buffer.buffer);
+    mesh_buffer.handle     = bindless.add_buffer(mesh_buffer.buffer);
+    if (position_buffer.handle == BINDLESS_INVALID || index_buffer.handle == BINDLESS_INVALID ||
+        mesh_buffer.handle == BINDLESS_INVALID) {
+        std::cout << "failed to register ray tracing buffers\n";
+        return -1;
+    }
+    return 0;
+}
+
+// Only once the GPU no longer runs frames that trace
+void VulkanAccelerationStructures::destroy() {
+    if (!impl) return;
+    impl->collect_retired(*data, true);  // what earlier records retired still refers to this
+    for (auto& fn : replaced) fn();
+    replaced.clear();
+    for (auto& compaction : compactions) vkDestroyQueryPool(impl->device.device, compaction.pool, nullptr);
+    compactions.clear();
+
+    for (auto& mesh : meshes) destroy_structure(mesh.blas);
+    meshes.clear();
+    destroy_structure(tlas);
+    tlas_capacity = 0;
+
+    destroy_buffer(position_buffer);
+    destroy_buffer(index_buffer);
+    destroy_buffer(mesh_buffer);
+    destroy_buffer(scratch);
+    for (auto& buffer : staging) destroy_buffer(buffer);
+    for (auto& buffer : instance_buffers) destroy_buffer(buffer);
+
+    instances.clear();
+    free_instances.clear();
+    pending.clear();
+    pending_bytes.clear();
+    vertex_count = 0;
+    index_count  = 0;
+    impl         = nullptr;
+}
+
+int VulkanAccelerationStructures::create_buffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage,
+                                                bool host_visible) {
+    VkBufferCreateInfo info = {};
+    info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size               = size;
+    info.usage              = usage;
+    info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkMemoryPropertyFlags required = host_visible
+                                         ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                         : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if (impl->allocator.create_buffer(info, required, buffer.buffer, buffer.allocation)) {
+        std::cout << "failed to create ray tracing buffer\n";
+        return -1;
+    }
+    buffer.size = size;
+    if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+        VkBufferDeviceAddressInfo address_info = {};
+        address_info.sType                     = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        address_info.buffer                    = buffer.buffer;
+        buffer.address                         = vkGetBufferDeviceAddress(impl->device.device, &address_info);
+    }
+    return 0;
+}
+
+void VulkanAccelerationStructures::destroy_buffer(Buffer& buffer) {
+    if (buffer.handle != BINDLESS_INVALID) impl->bindless.remove_buffer(buffer.handle);
+    if (buffer.buffer != VK_NULL_HANDLE) impl->allocator.destroy_buffer(buffer.buffer, buffer.allocation);
+    buffer = Buffer();
+}
+
+int VulkanAccelerationStructures::create_structure(AccelerationStructure& as, VkAccelerationStructureTypeKHR type,
+                                                   VkDeviceSize size) {
+    if (create_buffer(as.buffer, size,
+                      VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)) {
+        return -1;
+    }
+
+    VkAccelerationStructureCreateInfoKHR info = {};
+    info.sType                                = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+    info.buffer                               = as.buffer.buffer;
+    info.size                                 = size;
+    info.type                                 = type;
+    if (fn->create_acceleration_structure(impl->device.device, &info, nullptr, &as.handle) != VK_SUCCESS) {
+        std::cout << "failed to create acceleration structure\n";
+        destroy_buffer(as.buffer);
+        return -1;
+    }
+
+    VkAccelerationStructureDeviceAddressInfoKHR address_info = {};
+    address_info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+    address_info.accelerationStructure = as.handle;
+    as.address = fn->get_acceleration_structure_device_address(impl->device.device, &address_info);
+    return 0;
+}
+
+void VulkanAccelerationStructures::destroy_structure(AccelerationStructure& as) {
+    if (as.handle != VK_NULL_HANDLE) fn->destroy_acceleration_structure(impl->device.device, as.handle, nullptr);
+    destroy_buffer(as.buffer);
+    as = AccelerationStructure();
+}
+
+void VulkanAccelerationStructures::replace_structure(AccelerationStructure& as) {
+    if (as.handle == VK_NULL_HANDLE) return;
+    replaced.push_back([this, old = as]() mutable { destroy_structure(old); });
+    as = AccelerationStructure();
+}
+
+// Scratch is shared by every build of a frame, the builds are ordered by barriers
+int VulkanAccelerationStructures::reserve_scratch(VkDeviceSize size) {
+    size += scratch_alignment;  // room to align the start
+    if (scratch.size >= size) return 0;
+    if (scratch.buffer != VK_NULL_HANDLE) {
+        replaced.push_back([this, old = scratch]() mutable { destroy_buffer(old); });
+        scratch = Buffer();
+    }
+    return create_buffer(scratch, std::max<VkDeviceSize>(size, 1 << 20),
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+}
+
+void VulkanAccelerationStructures::queue_copy(VkBuffer buffer, VkDeviceSize offset, const void* bytes,
+                                              VkDeviceSize size) {
+    PendingCopy copy = {buffer, offset, pending_bytes.size(), size};
+    pending_bytes.insert(pending_bytes.end(), (const uint8_t*)bytes, (const uint8_t*)bytes + size);
+    pending.push_back(copy);
+}
+
+RTHandle VulkanAccelerationStructures::add_mesh(const RTMeshDesc& mesh_desc) {
+    if (meshes.size() >= desc.max_meshes || vertex_count + mesh_desc.vertex_count > desc.max_vertices ||
+        index_count + mesh_desc.index_count > desc.max_indices) {
+        std::cout << "ray tracing scene is out of mesh space\n";
+        return RT_INVALID;
+    }
+    if (mesh_desc.index_count == 0 || mesh_desc.index_count % 3) {
+        std::cout << "ray tracing meshes are triangle lists\n";
+        return RT_INVALID;
+    }
+
+    Mesh mesh         = {};
+    mesh.state        = MeshState::Pending;
+    mesh.dynamic      = mesh_desc.dynamic;
+    mesh.first_vertex = vertex_count;
+    mesh.vertex_count = mesh_desc.vertex_count;
+    mesh.first_index  = index_count;
+    mesh.index_count  = mesh_desc.index_count;
+
+    RTMeshRecord record  = {};
+    record.first_index   = mesh.first_index;
+    record.vertex_offset = (int32_t)mesh.first_vertex;
+    record.index_count   = mesh.index_count;
+
+    queue_copy(position_buffer.buffer, (VkDeviceSize)mesh.first_vertex * sizeof(glm::vec3), mesh_desc.positions,
+               (VkDeviceSize)mesh.vertex_count * sizeof(glm::vec3));
+    queue_copy(index_buffer.buffer, (VkDeviceSize)mesh.first_index * sizeof(uint32_t), mesh_desc.indices,
+               (VkDeviceSize)mesh.index_count * sizeof(uint32_t));
+    queue_copy(mesh_buffer.buffer, meshes.size() * sizeof(RTMeshRecord), &record, sizeof(RTMeshRecord));
+    vertex_count += mesh.vertex_count;
+    index_count += mesh.index_count;
+
+    meshes.push_back(mesh);
+    return (RTHandle)meshes.size() - 1;
+}
+
+void VulkanAccelerationStructures::update_mesh(RTHandle handle, const glm::vec3* positions) {
+    if (handle >= meshes.size() || meshes[handle].state == MeshState::Free || !meshes[handle].dynamic) return;
+    Mesh& mesh = meshes[handle];
+    queue_copy(position_buffer.buffer, (VkDeviceSize)mesh.first_vertex * sizeof(glm::vec3), positions,
+               (VkDeviceSize)mesh.vertex_count * sizeof(glm::vec3));
+    mesh.refit = mesh.state != MeshState::Pending;
+}
+
+void VulkanAccelerationStructures::remove_mesh(RTHandle handle) {
+    if (handle >= meshes.size()) return;
+    replace_structure(meshes[handle].blas);
+    meshes[handle].state = MeshState::Free;
+}
+
+RTHandle VulkanAccelerationStructures::add_instance(const RTInstance& instance) {
+    if (instance.mesh >= meshes.size()) return RT_INVALID;
+    RTHandle handle;
+    if (!free_instances.empty()) {
+        handle = free_instances.back();
+        free_instances.pop_back();
+    } else if (instances.size() < desc.max_instances) {
+        handle = (RTHandle)instances.size();
+        instances.emplace_back();
+    } else {
+        std::cout << "ray tracing scene is out of instance space\n";
+        return RT_INVALID;
+    }
+    instances[handle].desc = instance;
+    instances[handle].live = true;
+    return handle;
+}
+
+void VulkanAccelerationStructures::set_transform(RTHandle handle, const glm::mat4& transform) {
+    if (handle < instances.size()) instances[handle].desc.transform = transform;
+}
+
+void VulkanAccelerationStructures::remove_instance(RTHandle handle) {
+    if (handle >= instances.size() || !instances[handle].live) return;
+    instances[handle].live = false;
+    free_instances.push_back(handle);
+}
+
+VkAccelerationStructureGeometryKHR VulkanAccelerationStructures::mesh_geometry(const Mesh& mesh) const {
+    VkAccelerationStructureGeometryKHR geometry = {};
+    geometry.sType                              = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+    geometry.geometryType                       = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+    geometry.flags                              = VK_GEOMETRY_OPAQUE_BIT_KHR;
+
+    auto& triangles        = geometry.geometry.triangles;
+    triangles.sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+    triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+    triangles.vertexData.deviceAddress =
+        position_buffer.address + (VkDeviceAddress)mesh.first_vertex * sizeof(glm::vec3);
+    triangles.vertexStride            = sizeof(glm::vec3);
+    triangles.maxVertex               = mesh.vertex_count - 1;
+    triangles.indexType               = VK_INDEX_TYPE_UINT32;
+    triangles.indexData.deviceAddress = index_buffer.address + (VkDeviceAddress)mesh.first_index * sizeof(uint32_t);
+    return geometry;
+}
+
+void VulkanAccelerationStructures::record(VkCommandBuffer cmd) {
+    // what the previous frame replaced is only used by frames submitted so far
+    for (auto& fn : replaced) impl->retire(*data, std::move(fn));
+    replaced.clear();
+
+    // builds and copies of this frame overwrite scratch, the TLAS and geometry earlier frames still read
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask   = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR |
+                            VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR |
+                             VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+
+    record_copies(cmd);
+    record_blas_builds(cmd);
+    record_compactions(cmd);
+
+    // new and compacted BLASes, and the scratch the TLAS build reuses
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0,
+                         nullptr);
+
+    record_tlas_build(cmd);
+
+    barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanAccelerationStructures::record_copies(VkCommandBuffer cmd) {
+    if (pending.empty()) return;
+
+    Buffer& stage = staging[data->current_frame];
+    if (stage.size < pending_bytes.size()) {
+        if (stage.buffer != VK_NULL_HANDLE) {
+            impl->retire(*data, [this, old = stage]() mutable { destroy_buffer(old); });
+            stage = Buffer();
+        }
+        if (create_buffer(stage, std::max<VkDeviceSize>(pending_bytes.size(), 256 << 10),
+                          VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true)) {
+            return;
+        }
+    }
+    memcpy(stage.allocation.mapped, pending_bytes.data(), pending_bytes.size());
+
+    // one copy per destination buffer, in the order the changes were made
+    std::vector<VkBufferCopy> regions;
+    for (VkBuffer buffer : {position_buffer.buffer, index_buffer.buffer, mesh_buffer.buffer}) {
+        regions.clear();
+        for (auto& copy : pending) {
+            if (copy.buffer == buffer) regions.push_back({(VkDeviceSize)copy.source, copy.offset, copy.size});
+        }
+        if (!regions.empty()) vkCmdCopyBuffer(cmd, stage.buffer, buffer, (uint32_t)regions.size(), regions.data());
+    }
+    pending.clear();
+    pending_bytes.clear();
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR |
+                             VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+// New BLASes and refits of dynamic ones, all in one vkCmdBuildAccelerationStructuresKHR
+void VulkanAccelerationStructures::record_blas_builds(VkCommandBuffer cmd) {
+    std::vector<RTHandle> batch;
+    for (RTHandle i = 0; i < meshes.size(); i++) {
+        if (meshes[i].state == MeshState::Pending || (meshes[i].state == MeshState::Built && meshes[i].refit)) {
+            batch.push_back(i);
+        }
+    }
+    if (batch.empty()) return;
+
+    std::vector<VkAccelerationStructureGeometryKHR>              geometries(batch.size());
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR>     infos(batch.size());
+    std::vector<VkAccelerationStructureBuildRangeInfoKHR>        ranges(batch.size());
+    std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> range_pointers(batch.size());
+    std::vector<VkDeviceSize>                                    scratch_offsets(batch.size());
+    std::vector<VkAccelerationStructureKHR>                      compactable;
+    std::vector<RTHandle>                                        compactable_meshes;
+
+    VkDeviceSize scratch_size = 0;
+    size_t       built        = 0;
+    for (RTHandle handle : batch) {
+        Mesh& mesh   = meshes[handle];
+        bool  update = mesh.state == MeshState::Built;
+
+        geometries[built] = mesh_geometry(mesh);
+
+        auto& info = infos[built];
+        info       = {};
+        info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+        info.type  = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        if (mesh.dynamic) {
+            info.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR |
+                         VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+        } else {
+            info.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR |
+                         VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+        }
+        info.mode = update ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR
+                           : VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        info.geometryCount = 1;
+        info.pGeometries   = &geometries[built];
+
+        uint32_t                                 primitives = mesh.index_count / 3;
+        VkAccelerationStructureBuildSizesInfoKHR sizes      = {};
+        sizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+        fn->get_acceleration_structure_build_sizes(impl->device.device,
+                                                   VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &info,
+                                                   &primitives, &sizes);
+
+        if (!update && create_structure(mesh.blas, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+                                        sizes.accelerationStructureSize)) {
+            continue;  // stays pending, tried again next frame
+        }
+        info.srcAccelerationStructure = update ? mesh.blas.handle : VK_NULL_HANDLE;
+        info.dstAccelerationStructure = mesh.blas.handle;
+
+        scratch_offsets[built] = scratch_size;
+        scratch_size += align_up(update ? sizes.updateScratchSize : sizes.buildScratchSize, scratch_alignment);
+
+        ranges[built]                 = {};
+        ranges[built].primitiveCount  = primitives;
+        range_pointers[built]         = &ranges[built];
+        batch[built]                  = handle;
+        built++;
+    }
+    if (built == 0 || reserve_scratch(scratch_size)) return;
+
+    VkDeviceAddress scratch_base = align_up(scratch.address, scratch_alignment);
+    for (size_t i = 0; i < built; i++) {
+        infos[i].scratchData.deviceAddress = scratch_base + scratch_offsets[i];
+
+        Mesh& mesh = meshes[batch[i]];
+        if (mesh.state == MeshState::Built) {
+            stats.refits++;
+        } else {
+            stats.blas_builds++;
+            if (!mesh.dynamic) {
+                compactable.push_back(mesh.blas.handle);
+                compactable_meshes.push_back(batch[i]);
+            }
+        }
+        mesh.state = MeshState::Built;
+        mesh.refit = false;
+    }
+    fn->cmd_build_acceleration_structures(cmd, (uint32_t)built, infos.data(), range_pointers.data());
+    stats.build_batches++;
+    if (compactable.empty()) return;
+
+    // the compacted sizes can only be queried once the builds are done
+    VkQueryPoolCreateInfo pool_info = {};
+    pool_info.sType                 = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType             = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+    pool_info.queryCount            = (uint32_t)compactable.size();
+
+    Compaction compaction;
+    if (vkCreateQueryPool(impl->device.device, &pool_info, nullptr, &compaction.pool) != VK_SUCCESS) {
+        std::cout << "failed to create compaction query pool\n";
+        return;  // the BLASes stay as built
+    }
+    compaction.serial = data->frame_stats.submitted + 1;
+    compaction.meshes = std::move(compactable_meshes);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    barrier.dstAccessMask   = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0,
+                         nullptr);
+    vkCmdResetQueryPool(cmd, compaction.pool, 0, pool_info.queryCount);
+    fn->cmd_write_acceleration_structures_properties(cmd, pool_info.queryCount, compactable.data(),
+                                                     VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+                                                     compaction.pool, 0);
+    compactions.push_back(std::move(compaction));
+}
+
+// Copies the BLASes of retired build frames into structures of their compacted size
+void VulkanAccelerationStructures::record_compactions(VkCommandBuffer cmd) {
+    size_t kept = 0;
+    for (auto& compaction : compactions) {
+        if (compaction.serial > data->frame_stats.retired) {
+            compactions[kept++] = std::move(compaction);
+            continue;
+        }
+
+        std::vector<VkDeviceSize> sizes(compaction.meshes.size());
+        VkResult result = vkGetQueryPoolResults(impl->device.device, compaction.pool, 0, (uint32_t)sizes.size(),
+                                                sizes.size() * sizeof(VkDeviceSize), sizes.data(),
+                                                sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT);
+        for (size_t i = 0; i < compaction.meshes.size() && result == VK_SUCCESS; i++) {
+            Mesh& mesh = meshes[compaction.meshes[i]];
+            if (mesh.state != MeshState::Built || sizes[i] == 0 || sizes[i] >= mesh.blas.buffer.size) continue;
+
+            AccelerationStructure compacted;
+            if (create_structure(compacted, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, sizes[i])) continue;
+
+            VkCopyAccelerationStructureInfoKHR copy = {};
+            copy.sType                              = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+            copy.src                                = mesh.blas.handle;
+            copy.dst                                = compacted.handle;
+            copy.mode                               = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+            fn->cmd_copy_acceleration_structure(cmd, &copy);
+
+            stats.compactions++;
+            stats.compacted_bytes += mesh.blas.buffer.size - sizes[i];
+            replace_structure(mesh.blas);
+            mesh.blas  = compacted;
+            mesh.state = MeshState::Compacted;
+        }
+        vkDestroyQueryPool(impl->device.device, compaction.pool, nullptr);
+    }
+    compactions.resize(kept);
+}
+
+void VulkanAccelerationStructures::record_tlas_build(VkCommandBuffer cmd) {
+    Buffer& instance_buffer = instance_buffers[data->current_frame];
+    auto*   records         = (VkAccelerationStructureInstanceKHR*)instance_buffer.allocation.mapped;
+
+    uint32_t count = 0;
+    for (auto& instance : instances) {
+        if (!instance.live) continue;
+        const Mesh& mesh = meshes[instance.desc.mesh];
+        if (mesh.state == MeshState::Free || mesh.state == MeshState::Pending) continue;
+
+        VkAccelerationStructureInstanceKHR record = {};
+        const glm::mat4&                   m      = instance.desc.transform;
+        for (int row = 0; row < 3; row++) {
+            for (int column = 0; column < 4; column++) record.transform.matrix[row][column] = m[column][row];
+        }
+        record.instanceCustomIndex                    = instance.desc.mesh;
+        record.mask                                   = instance.desc.mask;
+        record.instanceShaderBindingTableRecordOffset = 0;
+        record.flags                                  = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+        record.accelerationStructureReference         = mesh.blas.address;
+        records[count++]                              = record;
+    }
+
+    VkAccelerationStructureGeometryKHR geometry = {};
+    geometry.sType                              = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+    geometry.geometryType                       = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+
+    auto& instances_data              = geometry.geometry.instances;
+    instances_data.sType              = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+    instances_data.data.deviceAddress = instance_buffer.address;
+
+    VkAccelerationStructureBuildGeometryInfoKHR info = {};
+    info.sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+    info.type          = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+    info.flags         = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+    info.mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    info.geometryCount = 1;
+    info.pGeometries   = &geometry;
+
+    // sized for a capacity, so the TLAS is only recreated when the instance count grows past it
+    if (tlas.handle == VK_NULL_HANDLE || count > tlas_capacity) {
+        uint32_t capacity = std::max(tlas_capacity, 64u);
+        while (capacity < count) capacity *= 2;
+        capacity = std::min(capacity, desc.max_instances);
+
+        VkAccelerationStructureBuildSizesInfoKHR sizes = {};
+        sizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+        fn->get_acceleration_structure_build_sizes(impl->device.device,
+                                                   VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &info, &capacity,
+                                                   &sizes);
+        replace_structure(tlas);
+        if (create_structure(tlas, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, sizes.accelerationStructureSize) ||
+            reserve_scratch(sizes.buildScratchSize)) {
+            tlas_capacity = 0;
+            return;
+        }
+        tlas_capacity = capacity;
+    }
+
+    info.dstAccelerationStructure  = tlas.handle;
+    info.scratchData.deviceAddress = align_up(scratch.address, scratch_alignment);
+
+    VkAccelerationStructureBuildRangeInfoKHR        range        = {};
+    range.primitiveCount                                         = count;
+    const VkAccelerationStructureBuildRangeInfoKHR* range_pointer = &range;
+    fn->cmd_build_acceleration_structures(cmd, 1, &info, &range_pointer);
+
+    stats.tlas_builds++;
+    stats.instances = count;
+}
+
+}  // namespace fl
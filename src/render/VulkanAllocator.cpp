@@ -0,0 +1,411 @@
+#include "fl/render/VulkanAllocator.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+VulkanAllocator::VulkanAllocator() {}
+
+VulkanAllocator::~VulkanAllocator() {}
+
+void VulkanAllocator::init(VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize block_size,
+                           bool device_address) {
+    this->physical_device = physical_device;
+    this->device          = device;
+    this->device_address  = device_address;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    // the buddy allocator needs a power of two block
+    VkDeviceSize size = min_size;
+    while (size < block_size) size <<= 1;
+    this->block_size = size;
+}
+
+void VulkanAllocator::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& block : blocks) {
+        if (block->allocation_count) {
+            std::cout << "VulkanAllocator: " << block->allocation_count << " allocations leaked in memory type "
+                      << block->memory_type << "\n";
+        }
+        if (block->mapped) vkUnmapMemory(device, block->memory);
+        vkFreeMemory(device, block->memory, nullptr);
+    }
+    blocks.clear();
+}
+
+uint32_t VulkanAllocator::order_for(VkDeviceSize size) const {
+    uint32_t order = 0;
+    while (size_of(order) < size) order++;
+    return order;
+}
+
+int VulkanAllocator::find_memory_type(uint32_t type_bits, VkMemoryPropertyFlags required,
+                                      VkMemoryPropertyFlags preferred) {
+    for (VkMemoryPropertyFlags wanted : {required | preferred, required}) {
+        for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+            if ((type_bits & (1u << i)) && (memory_properties.memoryTypes[i].propertyFlags & wanted) == wanted) {
+                return (int)i;
+            }
+        }
+    }
+    return -1;
+}
+
+MemoryBlock* VulkanAllocator::create_block(uint32_t memory_type, AllocationKind kind) {
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize       = block_size;
+    alloc_info.memoryTypeIndex      = memory_type;
+
+    VkMemoryAllocateFlagsInfo flags_info = {};
+    flags_info.sType                     = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    flags_info.flags                     = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    if (device_address && kind == AllocationKind::Linear) alloc_info.pNext = &flags_info;
+
+    auto block         = std::make_unique<MemoryBlock>();
+    block->size        = block_size;
+    block->memory_type = memory_type;
+    block->kind        = kind;
+    if (vkAllocateMemory(device, &alloc_info, nullptr, &block->memory) != VK_SUCCESS) {
+        std::cout << "VulkanAllocator: failed to allocate a " << (block_size >> 20) << " MB block\n";
+        return nullptr;
+    }
+    memory_objects++;
+
+    if (memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+    }
+
+    uint32_t max_order = order_for(block_size);
+    block->free_lists.resize(max_order + 1);
+    block->free_lists[max_order].insert(0);
+
+    blocks.push_back(std::move(block));
+    return blocks.back().get();
+}
+
+void VulkanAllocator::destroy_block(MemoryBlock* block) {
+    if (block->mapped) vkUnmapMemory(device, block->memory);
+    vkFreeMemory(device, block->memory, nullptr);
+    memory_objects--;
+    blocks.erase(std::find_if(blocks.begin(), blocks.end(), [&](auto& b) { return b.get() == block; }));
+}
+
+int VulkanAllocator::allocate_locked(const VkMemoryRequirements& requirements, uint32_t memory_type,
+                                     AllocationKind kind, const MemoryBlock* exclude, VulkanAllocation& out) {
+    uint32_t order = order_for(std::max(requirements.size, requirements.alignment));
+
+    // best fit over all blocks: the smallest free buddy that is large enough keeps big ranges intact
+    MemoryBlock* best       = nullptr;
+    uint32_t     best_order = UINT32_MAX;
+    for (auto& block : blocks) {
+        if (block.get() == exclude || block->memory_type != memory_type || block->kind != kind) continue;
+        for (uint32_t k = order; k < block->free_lists.size() && k < best_order; k++) {
+            if (!block->free_lists[k].empty()) {
+                best       = block.get();
+                best_order = k;
+                break;
+            }
+        }
+        if (best_order == order) break;
+    }
+
+    if (!best) {
+        if (exclude) return -1;  // defragmentation never grows the heap
+        best = create_block(memory_type, kind);
+        if (!best) return -1;
+        best_order = (uint32_t)best->free_lists.size() - 1;
+    }
+
+    auto         it     = best->free_lists[best_order].begin();
+    VkDeviceSize offset = *it;
+    best->free_lists[best_order].erase(it);
+    // split down, the upper halves become free buddies
+    for (uint32_t k = best_order; k > order; k--) best->free_lists[k - 1].insert(offset + size_of(k - 1));
+
+    best->used += size_of(order);
+    best->allocation_count++;
+
+    out             = VulkanAllocation();
+    out.memory      = best->memory;
+    out.offset      = offset;
+    out.size        = requirements.size;
+    out.mapped      = best->mapped ? (char*)best->mapped + offset : nullptr;
+    out.memory_type = memory_type;
+    out.block       = best;
+    out.order       = order;
+    return 0;
+}
+
+int VulkanAllocator::allocate_dedicated(const VkMemoryRequirements& requirements, uint32_t memory_type,
+                                        VkBuffer buffer, VkImage image, VulkanAllocation& out) {
+    VkMemoryDedicatedAllocateInfo dedicated_info = {};
+    dedicated_info.sType                         = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicated_info.buffer                        = buffer;
+    dedicated_info.image                         = image;
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize       = requirements.size;
+    alloc_info.memoryTypeIndex      = memory_type;
+    if (buffer != VK_NULL_HANDLE || image != VK_NULL_HANDLE) alloc_info.pNext = &dedicated_info;
+
+    // chained in front of the dedicated info, images never need an address
+    VkMemoryAllocateFlagsInfo flags_info = {};
+    flags_info.sType                     = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    flags_info.pNext                     = alloc_info.pNext;
+    flags_info.flags                     = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    if (device_address && image == VK_NULL_HANDLE) alloc_info.pNext = &flags_info;
+
+    out = VulkanAllocation();
+    if (vkAllocateMemory(device, &alloc_info, nullptr, &out.memory) != VK_SUCCESS) {
+        std::cout << "VulkanAllocator: failed to allocate dedicated memory of " << requirements.size << " bytes\n";
+        return -1;
+    }
+    memory_objects++;
+    out.size        = requirements.size;
+    out.memory_type = memory_type;
+    if (memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        vkMapMemory(device, out.memory, 0, VK_WHOLE_SIZE, 0, &out.mapped);
+    }
+
+    dedicated_stats[memory_type].dedicated_count++;
+    dedicated_stats[memory_type].dedicated_bytes += requirements.size;
+    return 0;
+}
+
+int VulkanAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+                              VkMemoryPropertyFlags preferred, AllocationKind kind, bool dedicated,
+                              VulkanAllocation& out) {
+    int memory_type = find_memory_type(requirements.memoryTypeBits, required, preferred);
+    if (memory_type < 0) {
+        std::cout << "VulkanAllocator: no memory type matches the requirements\n";
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (dedicated || requirements.size > block_size / 2)
+        return allocate_dedicated(requirements, memory_type, VK_NULL_HANDLE, VK_NULL_HANDLE, out);
+    return allocate_locked(requirements, memory_type, kind, nullptr, out);
+}
+
+void VulkanAllocator::free_locked(VulkanAllocation& allocation) {
+    MemoryBlock* block = allocation.block;
+    if (!block) {
+        if (allocation.mapped) vkUnmapMemory(device, allocation.memory);
+        vkFreeMemory(device, allocation.memory, nullptr);
+        memory_objects--;
+        dedicated_stats[allocation.memory_type].dedicated_count--;
+        dedicated_stats[allocation.memory_type].dedicated_bytes -= allocation.size;
+        allocation = VulkanAllocation();
+        return;
+    }
+
+    uint32_t     order  = allocation.order;
+    VkDeviceSize offset = allocation.offset;
+    block->used -= size_of(order);
+    block->allocation_count--;
+
+    // merge with the buddy as long as it is free as well
+    while (order + 1 < block->free_lists.size()) {
+        VkDeviceSize buddy = offset ^ size_of(order);
+        if (block->free_lists[order].erase(buddy) == 0) break;
+        offset = std::min(offset, buddy);
+        order++;
+    }
+    block->free_lists[order].insert(offset);
+    allocation = VulkanAllocation();
+}
+
+void VulkanAllocator::free(VulkanAllocation& allocation) {
+    if (!allocation.valid()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    free_locked(allocation);
+}
+
+int VulkanAllocator::create_buffer(const VkBufferCreateInfo& info, VkMemoryPropertyFlags required, VkBuffer& buffer,
+                                   VulkanAllocation& allocation, VkMemoryPropertyFlags preferred) {
+    if (vkCreateBuffer(device, &info, nullptr, &buffer) != VK_SUCCESS) {
+        std::cout << "VulkanAllocator: failed to create buffer\n";
+        return -1;
+    }
+
+    VkMemoryDedicatedRequirements dedicated_req = {};
+    dedicated_req.sType                         = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 req                   = {};
+    req.sType                                   = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    req.pNext                                   = &dedicated_req;
+    VkBufferMemoryRequirementsInfo2 req_info    = {};
+    req_info.sType                              = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    req_info.buffer                             = buffer;
+    vkGetBufferMemoryRequirements2(device, &req_info, &req);
+
+    int memory_type = find_memory_type(req.memoryRequirements.memoryTypeBits, required, preferred);
+    int err         = -1;
+    if (memory_type >= 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (dedicated_req.prefersDedicatedAllocation || req.memoryRequirements.size > block_size / 2)
+            err = allocate_dedicated(req.memoryRequirements, memory_type, buffer, VK_NULL_HANDLE, allocation);
+        else
+            err = allocate_locked(req.memoryRequirements, memory_type, AllocationKind::Linear, nullptr, allocation);
+    }
+    if (err || vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+        free(allocation);
+        vkDestroyBuffer(device, buffer, nullptr);
+        buffer = VK_NULL_HANDLE;
+        return -1;
+    }
+    return 0;
+}
+
+int VulkanAllocator::create_image(const VkImageCreateInfo& info, VkMemoryPropertyFlags required, VkImage& image,
+                                  VulkanAllocation& allocation) {
+    if (vkCreateImage(device, &info, nullptr, &image) != VK_SUCCESS) {
+        std::cout << "VulkanAllocator: failed to create image\n";
+        return -1;
+    }
+
+    VkMemoryDedicatedRequirements dedicated_req = {};
+    dedicated_req.sType                         = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 req                   = {};
+    req.sType                                   = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    req.pNext                                   = &dedicated_req;
+    VkImageMemoryRequirementsInfo2 req_info     = {};
+    req_info.sType                              = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    req_info.image                              = image;
+    vkGetImageMemoryRequirements2(device, &req_info, &req);
+
+    // render targets and other large images get their own memory, drivers can place them better
+    bool large     = req.memoryRequirements.size > block_size / 4;
+    bool dedicated = dedicated_req.prefersDedicatedAllocation || large;
+    auto kind      = info.tiling == VK_IMAGE_TILING_LINEAR ? AllocationKind::Linear : AllocationKind::Optimal;
+
+    int memory_type = find_memory_type(req.memoryRequirements.memoryTypeBits, required, 0);
+    int err         = -1;
+    if (memory_type >= 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (dedicated)
+            err = allocate_dedicated(req.memoryRequirements, memory_type, VK_NULL_HANDLE, image, allocation);
+        else
+            err = allocate_locked(req.memoryRequirements, memory_type, kind, nullptr, allocation);
+    }
+    if (err || vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+        free(allocation);
+        vkDestroyImage(device, image, nullptr);
+        image = VK_NULL_HANDLE;
+        return -1;
+    }
+    return 0;
+}
+
+void VulkanAllocator::destroy_buffer(VkBuffer buffer, VulkanAllocation& allocation) {
+    if (buffer != VK_NULL_HANDLE) vkDestroyBuffer(device, buffer, nullptr);
+    free(allocation);
+}
+
+void VulkanAllocator::destroy_image(VkImage image, VulkanAllocation& allocation) {
+    if (image != VK_NULL_HANDLE) vkDestroyImage(device, image, nullptr);
+    free(allocation);
+}
+
+// Empties the least used blocks first: their allocations are re-placed into other blocks of the same
+// memory type and kind, never into a new block, until max_bytes have been scheduled.
+std::vector<VulkanAllocator::DefragMove> VulkanAllocator::begin_defragmentation(
+    const std::vector<VulkanAllocation*>& movable, VkDeviceSize max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<MemoryBlock*> order;
+    for (auto& block : blocks) order.push_back(block.get());
+    std::stable_sort(order.begin(), order.end(), [](MemoryBlock* a, MemoryBlock* b) { return a->used < b->used; });
+
+    std::vector<DefragMove> moves;
+    VkDeviceSize            scheduled = 0;
+    for (MemoryBlock* source : order) {
+        for (VulkanAllocation* allocation : movable) {
+            if (allocation->block != source) continue;
+            if (scheduled + allocation->size > max_bytes) return moves;
+
+            VkMemoryRequirements req = {};
+            req.size                 = allocation->size;
+            req.alignment            = size_of(allocation->order);
+            req.memoryTypeBits       = 1u << source->memory_type;
+
+            DefragMove move;
+            move.allocation = allocation;
+            if (allocate_locked(req, source->memory_type, source->kind, source, move.destination)) continue;
+            // moving into an emptier block would only shift the fragmentation around
+            if (move.destination.block->used - size_of(allocation->order) < source->used) {
+                free_locked(move.destination);
+                continue;
+            }
+            scheduled += allocation->size;
+            moves.push_back(move);
+        }
+    }
+    return moves;
+}
+
+void VulkanAllocator::end_defragmentation(std::vector<DefragMove>& moves) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& move : moves) {
+            free_locked(*move.allocation);
+            *move.allocation = move.destination;
+        }
+    }
+    moves.clear();
+    release_empty_blocks();
+}
+
+void VulkanAllocator::release_empty_blocks() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<MemoryBlock*>   empty;
+    for (auto& block : blocks) {
+        if (block->allocation_count == 0) empty.push_back(block.get());
+    }
+    for (auto block : empty) destroy_block(block);
+}
+
+VulkanAllocator::Stats VulkanAllocator::get_stats(uint32_t memory_type) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats                       stats = dedicated_stats[memory_type];
+    for (auto& block : blocks) {
+        if (block->memory_type != memory_type) continue;
+        stats.block_count++;
+        stats.block_bytes += block->size;
+        stats.used_bytes += block->used;
+        stats.allocation_count += block->allocation_count;
+        for (uint32_t k = (uint32_t)block->free_lists.size(); k-- > 0;) {
+            if (!block->free_lists[k].empty()) {
+                stats.largest_free_range = std::max(stats.largest_free_range, size_of(k));
+                break;
+            }
+        }
+    }
+    return stats;
+}
+
+// Formatted on a stream of its own, the caller's keeps its flags and precision
+void VulkanAllocator::dump_stats(std::ostream& out) const {
+    std::ostringstream os;
+    os << "VulkanAllocator: " << memory_objects << " device memory objects, block size " << (block_size >> 20)
+       << " MB\n";
+    os << "  type heap  blocks  block MB   used MB  allocs  dedicated  dedicated MB  largest free KB\n";
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        Stats s = get_stats(i);
+        if (!s.block_count && !s.dedicated_count) continue;
+        os << "  " << std::setw(4) << i << std::setw(5) << memory_properties.memoryTypes[i].heapIndex
+           << std::setw(8) << s.block_count << std::setw(10) << (s.block_bytes >> 20) << std::setw(10)
+           << std::fixed << std::setprecision(2) << s.used_bytes / 1048576.0 << std::setw(8) << s.allocation_count
+           << std::setw(11) << s.dedicated_count << std::setw(14) << s.dedicated_bytes / 1048576.0 << std::setw(17)
+           << (s.largest_free_range >> 10) << "\n";
+    }
+    out << os.str();
+}
+
+}  // namespace fl
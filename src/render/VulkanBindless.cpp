@@ -0,0 +1,319 @@
+#include "fl/render/VulkanBindless.hpp"
+
+#include <algorithm>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+static const VkDescriptorType binding_types[BINDLESS_BINDING_COUNT] = {
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+};
+
+VulkanBindless::VulkanBindless() {}
+
+VulkanBindless::~VulkanBindless() {}
+
+int VulkanBindless::create(VkPhysicalDevice physical_device, VkDevice device, const BindlessLimits& limits) {
+    this->device = device;
+
+    // Update-after-bind descriptors have their own, usually much larger, limits. A set may hold no
+    // more than the per-stage limit since every binding is visible to all stages.
+    VkPhysicalDeviceVulkan12Properties props12 = {};
+    props12.sType                              = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 props          = {};
+    props.sType                                = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props.pNext                                = &props12;
+    vkGetPhysicalDeviceProperties2(physical_device, &props);
+
+    uint32_t total = props12.maxUpdateAfterBindDescriptorsInAllPools;
+    arrays[BINDLESS_SAMPLED_IMAGES].capacity =
+        std::min({limits.sampled_images, props12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                  props12.maxDescriptorSetUpdateAfterBindSampledImages});
+    arrays[BINDLESS_SAMPLERS].capacity =
+        std::min({limits.samplers, props12.maxPerStageDescriptorUpdateAfterBindSamplers,
+                  props12.maxDescriptorSetUpdateAfterBindSamplers});
+    arrays[BINDLESS_STORAGE_BUFFERS].capacity =
+        std::min({limits.storage_buffers, props12.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                  props12.maxDescriptorSetUpdateAfterBindStorageBuffers});
+    arrays[BINDLESS_STORAGE_IMAGES].capacity =
+        std::min({limits.storage_images, props12.maxPerStageDescriptorUpdateAfterBindStorageImages,
+                  props12.maxDescriptorSetUpdateAfterBindStorageImages});
+
+    uint32_t sum = 0;
+    for (auto& array : arrays) sum += array.capacity;
+    if (sum > total) {
+        for (auto& array : arrays) array.capacity = (uint32_t)((uint64_t)array.capacity * total / sum);
+    }
+    for (auto& array : arrays) {
+        if (array.capacity == 0) {
+            std::cout << "failed to create bindless set, the device has no update-after-bind descriptors\n";
+            return -1;
+        }
+    }
+
+    VkDescriptorSetLayoutBinding bindings[BINDLESS_BINDING_COUNT] = {};
+    VkDescriptorBindingFlags     flags[BINDLESS_BINDING_COUNT]    = {};
+    for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        bindings[i].binding         = i;
+        bindings[i].descriptorType  = binding_types[i];
+        bindings[i].descriptorCount = arrays[i].capacity;
+        bindings[i].stageFlags      = VK_SHADER_STAGE_ALL;
+
+        flags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+                   VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags = {};
+    binding_flags.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags.bindingCount  = BINDLESS_BINDING_COUNT;
+    binding_flags.pBindingFlags = flags;
+
+    VkDescriptorSetLayoutCreateInfo layout_info = {};
+    layout_info.sType                           = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext                           = &binding_flags;
+    layout_info.flags                           = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount                    = BINDLESS_BINDING_COUNT;
+    layout_info.pBindings                       = bindings;
+    if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &set_layout) != VK_SUCCESS) {
+        std::cout << "failed to create bindless descriptor set layout\n";
+        return -1;
+    }
+
+    VkPushConstantRange push_range = {};
+    push_range.stageFlags          = VK_SHADER_STAGE_ALL;
+    push_range.offset              = 0;
+    push_range.size                = push_constant_size;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+    pipeline_layout_info.sType                      = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount             = 1;
+    pipeline_layout_info.pSetLayouts                = &set_layout;
+    pipeline_layout_info.pushConstantRangeCount     = 1;
+    pipeline_layout_info.pPushConstantRanges        = &push_range;
+    if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS) {
+        std::cout << "failed to create bindless pipeline layout\n";
+        return -1;
+    }
+
+    VkDescriptorPoolSize pool_sizes[BINDLESS_BINDING_COUNT] = {};
+    for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        pool_sizes[i].type            = binding_types[i];
+        pool_sizes[i].descriptorCount = arrays[i].capacity;
+    }
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags                      = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets                    = 1;
+    pool_info.poolSizeCount              = BINDLESS_BINDING_COUNT;
+    pool_info.pPoolSizes                 = pool_sizes;
+    if (vkCreateDescriptorPool(device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+        std::cout << "failed to create bindless descriptor pool\n";
+        return -1;
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType                       = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool              = pool;
+    alloc_info.descriptorSetCount          = 1;
+    alloc_info.pSetLayouts                 = &set_layout;
+    if (vkAllocateDescriptorSets(device, &alloc_info, &set) != VK_SUCCESS) {
+        std::cout << "failed to allocate bindless descriptor set\n";
+        return -1;
+    }
+    return 0;
+}
+
+void VulkanBindless::destroy() {
+    if (device == VK_NULL_HANDLE) return;
+    if (pool != VK_NULL_HANDLE) vkDestroyDescriptorPool(device, pool, nullptr);  // frees the set
+    if (pipeline_layout != VK_NULL_HANDLE) vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    if (set_layout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+    pool            = VK_NULL_HANDLE;
+    pipeline_layout = VK_NULL_HANDLE;
+    set_layout      = VK_NULL_HANDLE;
+    set             = VK_NULL_HANDLE;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& array : arrays) {
+        array.next = 0;
+        array.free.clear();
+        array.live.clear();
+    }
+    pending.clear();
+}
+
+BindlessHandle VulkanBindless::allocate(BindlessBinding binding) {
+    Array& array = arrays[binding];
+    if (!array.free.empty()) {
+        BindlessHandle handle = array.free.back();
+        array.free.pop_back();
+        array.live[handle] = true;
+        stats.live[binding]++;
+        return handle;
+    }
+    if (array.next >= array.capacity) {
+        stats.full++;
+        return BINDLESS_INVALID;
+    }
+    array.live.push_back(true);
+    stats.live[binding]++;
+    return array.next++;
+}
+
+void VulkanBindless::queue(const Write& write) {
+    // a slot written twice before a flush only needs its last write
+    for (auto& w : pending) {
+        if (w.binding == write.binding && w.index == write.index) {
+            w = write;
+            return;
+        }
+    }
+    pending.push_back(write);
+}
+
+BindlessHandle VulkanBindless::add_texture(VkImageView view, VkImageLayout layout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    BindlessHandle handle = allocate(BINDLESS_SAMPLED_IMAGES);
+    if (handle == BINDLESS_INVALID) return handle;
+
+    Write write   = {};
+    write.binding = BINDLESS_SAMPLED_IMAGES;
+    write.index   = handle;
+    write.image   = {VK_NULL_HANDLE, view, layout};
+    pending.push_back(write);
+    return handle;
+}
+
+BindlessHandle VulkanBindless::add_sampler(VkSampler sampler) {
+    std::lock_guard<std::mutex> lock(mutex);
+    BindlessHandle handle = allocate(BINDLESS_SAMPLERS);
+    if (handle == BINDLESS_INVALID) return handle;
+
+    Write write   = {};
+    write.binding = BINDLESS_SAMPLERS;
+    write.index   = handle;
+    write.image   = {sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED};
+    pending.push_back(write);
+    return handle;
+}
+
+BindlessHandle VulkanBindless::add_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    std::lock_guard<std::mutex> lock(mutex);
+    BindlessHandle handle = allocate(BINDLESS_STORAGE_BUFFERS);
+    if (handle == BINDLESS_INVALID) return handle;
+
+    Write write   = {};
+    write.binding = BINDLESS_STORAGE_BUFFERS;
+    write.index   = handle;
+    write.buffer  = {buffer, offset, range};
+    pending.push_back(write);
+    return handle;
+}
+
+BindlessHandle VulkanBindless::add_storage_image(VkImageView view, VkImageLayout layout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    BindlessHandle handle = allocate(BINDLESS_STORAGE_IMAGES);
+    if (handle == BINDLESS_INVALID) return handle;
+
+    Write write   = {};
+    write.binding = BINDLESS_STORAGE_IMAGES;
+    write.index   = handle;
+    write.image   = {VK_NULL_HANDLE, view, layout};
+    pending.push_back(write);
+    return handle;
+}
+
+void VulkanBindless::update_texture(BindlessHandle handle, VkImageView view, VkImageLayout layout) {
+    if (handle == BINDLESS_INVALID) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    Write write   = {};
+    write.binding = BINDLESS_SAMPLED_IMAGES;
+    write.index   = handle;
+    write.image   = {VK_NULL_HANDLE, view, layout};
+    queue(write);
+}
+
+void VulkanBindless::update_buffer(BindlessHandle handle, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    if (handle == BINDLESS_INVALID) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    Write write   = {};
+    write.binding = BINDLESS_STORAGE_BUFFERS;
+    write.index   = handle;
+    write.buffer  = {buffer, offset, range};
+    queue(write);
+}
+
+void VulkanBindless::remove(BindlessBinding binding, BindlessHandle handle) {
+    if (handle == BINDLESS_INVALID) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // a second remove would put the slot on the free list twice and hand it out to two resources
+        Array& array = arrays[binding];
+        if (handle >= array.next || !array.live[handle]) {
+            std::cout << "bindless handle " << handle << " removed but not live\n";
+            return;
+        }
+        array.live[handle] = false;
+
+        // a write that was never flushed must not land on the slot after it has been reused
+        pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                     [&](const Write& w) { return w.binding == binding && w.index == handle; }),
+                      pending.end());
+        stats.live[binding]--;
+    }
+
+    // The descriptor stays as it is, partially bound lets frames in flight keep reading it. Only the
+    // index is recycled, once no submitted frame can reference it anymore.
+    auto release = [this, binding, handle]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        arrays[binding].free.push_back(handle);
+    };
+    if (retire) {
+        retire(release);
+    } else {
+        release();
+    }
+}
+
+void VulkanBindless::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pending.empty() || set == VK_NULL_HANDLE) return;
+
+    std::vector<VkWriteDescriptorSet> writes(pending.size());
+    for (size_t i = 0; i < pending.size(); i++) {
+        const Write&          w     = pending[i];
+        VkWriteDescriptorSet& write = writes[i];
+        write.sType                 = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet                = set;
+        write.dstBinding            = w.binding;
+        write.dstArrayElement       = w.index;
+        write.descriptorCount       = 1;
+        write.descriptorType        = binding_types[w.binding];
+        if (w.binding == BINDLESS_STORAGE_BUFFERS) {
+            write.pBufferInfo = &w.buffer;
+        } else {
+            write.pImageInfo = &w.image;
+        }
+    }
+    vkUpdateDescriptorSets(device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+    stats.writes += writes.size();
+    stats.flushes++;
+    pending.clear();
+}
+
+void VulkanBindless::bind(VkCommandBuffer cmd, VkPipelineBindPoint bind_point) const {
+    vkCmdBindDescriptorSets(cmd, bind_point, pipeline_layout, 0, 1, &set, 0, nullptr);
+}
+
+VulkanBindless::Stats VulkanBindless::get_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+}  // namespace fl
@@ -0,0 +1,300 @@
+#include "fl/render/VulkanCompute.hpp"
+
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+int ComputePipeline::create(VulkanImpl* impl, const std::string& spirv_path, const char* entry) {
+    this->impl = impl;
+    return create_pipeline(impl->getShaderModule(spirv_path), entry);
+}
+
+int ComputePipeline::create(VulkanImpl* impl, const std::vector<uint32_t>& code, const char* entry) {
+    this->impl = impl;
+    return create_pipeline(impl->getShaderModule(code), entry);
+}
+
+int ComputePipeline::create_pipeline(VkShaderModule module, const char* entry) {
+    if (module == VK_NULL_HANDLE) {
+        std::cout << "failed to create shader module\n";
+        return -1;
+    }
+
+    VkComputePipelineCreateInfo info = {};
+    info.sType                       = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    info.stage.sType                 = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    info.stage.stage                 = VK_SHADER_STAGE_COMPUTE_BIT;
+    info.stage.module                = module;
+    info.stage.pName                 = entry;
+    info.layout                      = impl->bindless.get_pipeline_layout();
+
+    if (impl->pipeline_cache.create_compute_pipeline(info, &pipeline) != VK_SUCCESS) {
+        std::cout << "failed to create compute pipeline\n";
+        return -1;
+    }
+    return 0;
+}
+
+void ComputePipeline::destroy() {
+    if (pipeline != VK_NULL_HANDLE) vkDestroyPipeline(impl->device.device, pipeline, nullptr);
+    pipeline = VK_NULL_HANDLE;
+}
+
+int ComputeBufferBase::create(VulkanImpl* impl, VkDeviceSize size, VkBufferUsageFlags usage, bool host_visible) {
+    this->impl = impl;
+
+    uint32_t families[2] = {impl->compute.get_family(), impl->compute.get_graphics_family()};
+
+    VkBufferCreateInfo info = {};
+    info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size               = size;
+    info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                 usage;
+    if (families[0] != families[1]) {
+        info.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+        info.queueFamilyIndexCount = 2;
+        info.pQueueFamilyIndices   = families;
+    } else {
+        info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    VkMemoryPropertyFlags required = host_visible
+                                         ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                         : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if (impl->allocator.create_buffer(info, required, buf, allocation)) {
+        std::cout << "failed to create compute buffer\n";
+        return -1;
+    }
+    bytes    = size;
+    bindless = impl->bindless.add_buffer(buf);
+    if (bindless == BINDLESS_INVALID) {
+        std::cout << "failed to register compute buffer in the bindless set\n";
+        destroy();
+        return -1;
+    }
+    return 0;
+}
+
+// Only once no submitted work uses the buffer, the bindless slot itself is recycled after the frames in flight
+void ComputeBufferBase::destroy() {
+    if (bindless != BINDLESS_INVALID) impl->bindless.remove_buffer(bindless);
+    if (buf != VK_NULL_HANDLE) impl->allocator.destroy_buffer(buf, allocation);
+    buf      = VK_NULL_HANDLE;
+    bindless = BINDLESS_INVALID;
+    bytes    = 0;
+}
+
+ComputeContext::ComputeContext() {}
+
+ComputeContext::~ComputeContext() {}
+
+int ComputeContext::create(VulkanImpl* impl, VkQueue queue, uint32_t queue_family, VkQueue graphics_queue,
+                           uint32_t graphics_family) {
+    this->impl            = impl;
+    this->device          = impl->device.device;
+    this->queue           = queue;
+    this->family          = queue_family;
+    this->graphics_queue  = graphics_queue;
+    this->graphics_family = graphics_family;
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.queueFamilyIndex        = family;
+    pool_info.flags                   = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (vkCreateCommandPool(device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
+        std::cout << "failed to create compute command pool\n";
+        return -1;
+    }
+
+    VkSemaphoreTypeCreateInfo type_info = {};
+    type_info.sType                     = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType             = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue              = 0;
+
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext                 = &type_info;
+    if (vkCreateSemaphore(device, &semaphore_info, nullptr, &semaphore) != VK_SUCCESS) {
+        std::cout << "failed to create compute timeline semaphore\n";
+        return -1;
+    }
+    return 0;
+}
+
+void ComputeContext::destroy() {
+    if (device == VK_NULL_HANDLE) return;
+
+    if (current.cmd != VK_NULL_HANDLE) {
+        vkEndCommandBuffer(current.cmd);  // recorded but never submitted, dropped
+        free_cmds.push_back(current.cmd);
+        current = Batch();
+    }
+    wait(ComputeToken{next_value - 1});
+    retire();
+
+    vkDestroyCommandPool(device, command_pool, nullptr);
+    vkDestroySemaphore(device, semaphore, nullptr);
+    free_cmds.clear();
+    device = VK_NULL_HANDLE;
+}
+
+uint64_t ComputeContext::completed_value() {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(device, semaphore, &value);
+    return value;
+}
+
+// Give the command buffers of every finished batch back
+void ComputeContext::retire() {
+    if (in_flight.empty()) return;
+    uint64_t completed = completed_value();
+    while (!in_flight.empty() && in_flight.front().value <= completed) {
+        free_cmds.push_back(in_flight.front().cmd);
+        in_flight.pop_front();
+    }
+}
+
+VkCommandBuffer ComputeContext::begin() {
+    if (current.cmd != VK_NULL_HANDLE) return current.cmd;
+
+    retire();
+    if (free_cmds.empty()) {
+        VkCommandBufferAllocateInfo alloc_info = {};
+        alloc_info.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool                 = command_pool;
+        alloc_info.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount          = 1;
+
+        VkCommandBuffer cmd;
+        if (vkAllocateCommandBuffers(device, &alloc_info, &cmd) != VK_SUCCESS) {
+            std::cout << "failed to allocate compute command buffer\n";
+            return VK_NULL_HANDLE;
+        }
+        free_cmds.push_back(cmd);
+    }
+
+    VkCommandBuffer cmd = free_cmds.back();
+    free_cmds.pop_back();
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(cmd, &begin_info) != VK_SUCCESS) {
+        std::cout << "failed to begin compute command buffer\n";
+        free_cmds.push_back(cmd);
+        return VK_NULL_HANDLE;
+    }
+    impl->bindless.bind(cmd, VK_PIPELINE_BIND_POINT_COMPUTE);
+    current.cmd = cmd;
+    return cmd;
+}
+
+void ComputeContext::push(const void* constants, uint32_t size) {
+    VkCommandBuffer cmd = begin();
+    if (cmd == VK_NULL_HANDLE) return;
+    vkCmdPushConstants(cmd, impl->bindless.get_pipeline_layout(), VK_SHADER_STAGE_ALL, 0, size, constants);
+}
+
+void ComputeContext::dispatch(const ComputePipeline& pipeline, uint32_t x, uint32_t y, uint32_t z) {
+    VkCommandBuffer cmd = begin();
+    if (cmd == VK_NULL_HANDLE) return;
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.get());
+    vkCmdDispatch(cmd, x, y, z);
+    stats.dispatches++;
+}
+
+void ComputeContext::barrier() {
+    VkCommandBuffer cmd = begin();
+    if (cmd == VK_NULL_HANDLE) return;
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ComputeContext::wait_frame(uint64_t serial) {
+    if (serial > frame_wait) frame_wait = serial;
+}
+
+// The work recorded so far is lost, the next begin() starts a new batch in a reset command buffer
+void ComputeContext::drop_batch() {
+    vkResetCommandBuffer(current.cmd, 0);
+    free_cmds.push_back(current.cmd);
+    current    = Batch();
+    frame_wait = 0;
+}
+
+// Nothing recorded still returns a token, the one of the last batch
+ComputeToken ComputeContext::submit() {
+    if (current.cmd == VK_NULL_HANDLE) return ComputeToken{next_value - 1};
+
+    if (vkEndCommandBuffer(current.cmd) != VK_SUCCESS) {
+        std::cout << "failed to record compute command buffer\n";
+        drop_batch();
+        return ComputeToken{next_value - 1};
+    }
+
+    // buffers registered since the last frame must be in the set before the dispatches run
+    impl->bindless.flush();
+
+    current.value = next_value;
+
+    VkPipelineStageFlags          wait_stage    = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType                         = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.signalSemaphoreValueCount     = 1;
+    timeline_info.pSignalSemaphoreValues        = &current.value;
+
+    VkSubmitInfo submit_info         = {};
+    submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext                = &timeline_info;
+    submit_info.commandBufferCount   = 1;
+    submit_info.pCommandBuffers      = &current.cmd;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores    = &semaphore;
+    if (frame_wait && frame_timeline != VK_NULL_HANDLE) {
+        timeline_info.waitSemaphoreValueCount = 1;
+        timeline_info.pWaitSemaphoreValues    = &frame_wait;
+        submit_info.waitSemaphoreCount        = 1;
+        submit_info.pWaitSemaphores           = &frame_timeline;
+        submit_info.pWaitDstStageMask         = &wait_stage;
+        stats.frame_waits++;
+    }
+    std::unique_lock<std::mutex> queue_lock(impl->queue_mutex);
+    VkResult                     result = vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+    queue_lock.unlock();
+    if (result != VK_SUCCESS) {
+        std::cout << "failed to submit compute command buffer\n";
+        drop_batch();
+        return ComputeToken{next_value - 1};
+    }
+    next_value++;
+    frame_wait = 0;
+
+    in_flight.push_back(current);
+    current = Batch();
+    stats.batches++;
+    return ComputeToken{next_value - 1};
+}
+
+bool ComputeContext::is_complete(ComputeToken token) {
+    return completed_value() >= token.value;
+}
+
+// Blocks the calling thread, for readbacks and shutdown; frames wait on the GPU through wait_compute()
+void ComputeContext::wait(ComputeToken token) {
+    if (token.value == 0) return;
+
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType               = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount      = 1;
+    wait_info.pSemaphores         = &semaphore;
+    wait_info.pValues             = &token.value;
+    vkWaitSemaphores(device, &wait_info, UINT64_MAX);
+}
+
+}  // namespace fl
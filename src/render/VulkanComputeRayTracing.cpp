@@ -0,0 +1,458 @@
+#include "fl/render/VulkanComputeRayTracing.hpp"
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+// Node of the BVHs rt_compute.glsl traverses, RTNode there. The children of a Bvh4Node on a grid over
+// the node bounds: child i spans origin + byte i of min_* and max_* times 2^(exponent - 127) per axis,
+// rounded outwards so the quantized box always contains the exact one.
+struct RTWideNode {
+    glm::vec3 origin;
+    uint32_t  exponents;  // biased, one byte per axis
+    uint32_t  min_x, min_y, min_z;
+    uint32_t  max_x, max_y, max_z;
+    uint32_t  counts;  // byte i: primitives of leaf child i, 0 for an inner node
+    uint32_t  pad;
+    uint32_t  child[4];  // absolute node or first primitive, BVH4_EMPTY for an empty slot
+};
+static_assert(sizeof(RTWideNode) == 64, "RTWideNode must match RTNode in rt_compute.glsl");
+
+// Instance record the instance BVH leaves point at, RTInstanceRecord in rt_compute.glsl
+struct RTInstanceRecord {
+    glm::vec4 world_to_object[3];  // rows
+    uint32_t  root;                // of the mesh BVH in the node buffer
+    uint32_t  mask;
+    uint32_t  pad[2];
+};
+static_assert(sizeof(RTInstanceRecord) == sizeof(RTWideNode), "instance records share the top buffer with nodes");
+
+static float grid_scale(int exponent) {
+    return std::ldexp(1.0f, exponent);
+}
+
+// inner children are node_base + child, leaf children leaf_base + first primitive
+static RTWideNode quantize(const Bvh4Node& node, uint32_t node_base, uint32_t leaf_base) {
+    Aabb bounds;
+    for (int i = 0; i < 4; i++) {
+        if (node.child[i] == BVH4_EMPTY) continue;
+        bounds.grow(glm::vec3(node.min_x[i], node.min_y[i], node.min_z[i]));
+        bounds.grow(glm::vec3(node.max_x[i], node.max_y[i], node.max_z[i]));
+    }
+
+    RTWideNode out = {};
+    out.origin     = bounds.min;
+    int exponents[3];
+    for (int axis = 0; axis < 3; axis++) {
+        // the smallest power of two for which 255 steps cover the node, as the shader adds them up
+        float extent   = bounds.max[axis] - bounds.min[axis];
+        int   exponent = -126;
+        if (extent > 0.0f) std::frexp(extent / 255.0f, &exponent);
+        exponent = std::max(exponent, -126);
+        while (exponent < 127 && out.origin[axis] + 255.0f * grid_scale(exponent) < bounds.max[axis]) exponent++;
+        exponents[axis] = exponent;
+        out.exponents |= (uint32_t)(exponent + 127) << (axis * 8);
+    }
+
+    uint32_t*    mins[3]  = {&out.min_x, &out.min_y, &out.min_z};
+    uint32_t*    maxs[3]  = {&out.max_x, &out.max_y, &out.max_z};
+    const float* lows[3]  = {node.min_x, node.min_y, node.min_z};
+    const float* highs[3] = {node.max_x, node.max_y, node.max_z};
+    for (int i = 0; i < 4; i++) {
+        if (node.child[i] == BVH4_EMPTY) {
+            out.child[i] = BVH4_EMPTY;
+            continue;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            float origin = out.origin[axis];
+            float scale  = grid_scale(exponents[axis]);
+            float low    = std::floor((lows[axis][i] - origin) / scale);
+            float high   = std::ceil((highs[axis][i] - origin) / scale);
+            int   q_min  = (int)std::min(std::max(low, 0.0f), 255.0f);
+            int   q_max  = (int)std::min(std::max(high, 0.0f), 255.0f);
+            while (q_min > 0 && origin + (float)q_min * scale > lows[axis][i]) q_min--;
+            while (q_max < 255 && origin + (float)q_max * scale < highs[axis][i]) q_max++;
+            *mins[axis] |= (uint32_t)q_min << (i * 8);
+            *maxs[axis] |= (uint32_t)q_max << (i * 8);
+        }
+        out.counts |= std::min(node.count[i], 255u) << (i * 8);
+        out.child[i] = (node.count[i] ? leaf_base : node_base) + node.child[i];
+    }
+    return out;
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+VulkanComputeRayTracing::VulkanComputeRayTracing() {}
+
+VulkanComputeRayTracing::~VulkanComputeRayTracing() {}
+
+int VulkanComputeRayTracing::create(VulkanImpl* impl, RenderData* data, const RTSceneDesc& desc) {
+    this->impl = impl;
+    this->data = data;
+    this->desc = desc;
+
+    // SAH leaves hold a few triangles and four of them share a node, one node per three triangles is plenty
+    max_nodes = std::max(desc.max_indices / 9, 1024u);
+
+    if (position_buffer.create(impl, (VkDeviceSize)desc.max_vertices * sizeof(glm::vec3)) ||
+        index_buffer.create(impl, (VkDeviceSize)desc.max_indices * sizeof(uint32_t)) ||
+        node_buffer.create(impl, (VkDeviceSize)max_nodes * sizeof(RTWideNode))) {
+        std::cout << "failed to create ray tracing buffers\n";
+        return -1;
+    }
+    for (auto& buffer : top_buffers) {
+        // the instance BVH has at most one node per instance
+        if (buffer.create(impl, (size_t)desc.max_instances * 2 * sizeof(RTWideNode), 0, true)) {
+            std::cout << "failed to create ray tracing instance buffer\n";
+            return -1;
+        }
+    }
+    if (pipeline.create(impl, "rt_compute.spv")) return -1;
+
+    // the traversal is rebuilt when rt_compute.glsl is saved, with hot reload on
+    if (impl->shaders.running()) {
+        shader_watch = impl->shaders.watch({{"rt_compute.glsl", "compute", "rt_compute.spv"}}, [this] {
+            ComputePipeline next;
+            if (next.create(this->impl, "rt_compute.spv")) return -1;
+            ComputePipeline old = pipeline;
+            this->impl->retire(*this->data, [old]() mutable { old.destroy(); });
+            pipeline = next;
+            return 0;
+        });
+    }
+    return 0;
+}
+
+void VulkanComputeRayTracing::destroy() {
+    if (!impl) return;
+    if (shader_watch != ~0u) impl->shaders.unwatch(shader_watch);
+    shader_watch = ~0u;
+    pipeline.destroy();
+    position_buffer.destroy();
+    index_buffer.destroy();
+    node_buffer.destroy();
+    for (auto& buffer : staging) buffer.destroy();
+    for (auto& buffer : top_buffers) buffer.destroy();
+
+    meshes.clear();
+    instances.clear();
+    free_instances.clear();
+    pending.clear();
+    pending_bytes.clear();
+    top.clear();
+    top_dirty    = true;
+    vertex_count = 0;
+    index_count  = 0;
+    stats.nodes  = 0;
+    impl         = nullptr;
+}
+
+void VulkanComputeRayTracing::queue_copy(VkBuffer buffer, VkDeviceSize offset, const void* bytes, VkDeviceSize size) {
+    PendingCopy copy = {buffer, offset, pending_bytes.size(), size};
+    pending_bytes.insert(pending_bytes.end(), (const uint8_t*)bytes, (const uint8_t*)bytes + size);
+    pending.push_back(copy);
+}
+
+RTHandle VulkanComputeRayTracing::add_mesh(const RTMeshDesc& mesh_desc) {
+    if (meshes.size() >= desc.max_meshes || vertex_count + mesh_desc.vertex_count > desc.max_vertices ||
+        index_count + mesh_desc.index_count > desc.max_indices) {
+        std::cout << "ray tracing scene is out of mesh space\n";
+        return RT_INVALID;
+    }
+    if (mesh_desc.index_count == 0 || mesh_desc.index_count % 3) {
+        std::cout << "ray tracing meshes are triangle lists\n";
+        return RT_INVALID;
+    }
+    for (uint32_t i = 0; i < mesh_desc.index_count; i++) {
+        if (mesh_desc.indices[i] >= mesh_desc.vertex_count) {
+            std::cout << "ray tracing mesh index out of range\n";
+            return RT_INVALID;
+        }
+    }
+
+    Mesh mesh;
+    mesh.live         = true;
+    mesh.dynamic      = mesh_desc.dynamic;
+    mesh.first_vertex = vertex_count;
+    mesh.first_index  = index_count;
+    mesh.positions.assign(mesh_desc.positions, mesh_desc.positions + mesh_desc.vertex_count);
+    mesh.indices.assign(mesh_desc.indices, mesh_desc.indices + mesh_desc.index_count);
+
+    // the indices follow once the BVH gave them their leaf order
+    queue_copy(position_buffer.buffer(), (VkDeviceSize)mesh.first_vertex * sizeof(glm::vec3), mesh_desc.positions,
+               (VkDeviceSize)mesh_desc.vertex_count * sizeof(glm::vec3));
+    vertex_count += mesh_desc.vertex_count;
+    index_count += mesh_desc.index_count;
+
+    meshes.push_back(std::move(mesh));
+    return (RTHandle)meshes.size() - 1;
+}
+
+void VulkanComputeRayTracing::update_mesh(RTHandle handle, const glm::vec3* positions) {
+    if (handle >= meshes.size() || !meshes[handle].live || !meshes[handle].dynamic) return;
+    Mesh& mesh = meshes[handle];
+    std::copy(positions, positions + mesh.positions.size(), mesh.positions.begin());
+    queue_copy(position_buffer.buffer(), (VkDeviceSize)mesh.first_vertex * sizeof(glm::vec3), positions,
+               (VkDeviceSize)mesh.positions.size() * sizeof(glm::vec3));
+    mesh.refit = mesh.built;
+}
+
+void VulkanComputeRayTracing::remove_mesh(RTHandle handle) {
+    if (handle >= meshes.size() || !meshes[handle].live) return;
+    Mesh& mesh = meshes[handle];
+    mesh.live  = false;
+    mesh.positions.clear();
+    mesh.indices.clear();
+    mesh.bvh  = Bvh();
+    mesh.bvh4 = Bvh4();
+    top_dirty = true;
+}
+
+RTHandle VulkanComputeRayTracing::add_instance(const RTInstance& instance) {
+    if (instance.mesh >= meshes.size()) return RT_INVALID;
+    RTHandle handle;
+    if (!free_instances.empty()) {
+        handle = free_instances.back();
+        free_instances.pop_back();
+    } else if (instances.size() < desc.max_instances) {
+        handle = (RTHandle)instances.size();
+        instances.emplace_back();
+    } else {
+        std::cout << "ray tracing scene is out of instance space\n";
+        return RT_INVALID;
+    }
+    instances[handle].desc = instance;
+    instances[handle].live = true;
+    top_dirty              = true;
+    return handle;
+}
+
+void VulkanComputeRayTracing::set_transform(RTHandle handle, const glm::mat4& transform) {
+    if (handle >= instances.size()) return;
+    instances[handle].desc.transform = transform;
+    top_dirty                        = true;
+}
+
+void VulkanComputeRayTracing::remove_instance(RTHandle handle) {
+    if (handle >= instances.size() || !instances[handle].live) return;
+    instances[handle].live = false;
+    free_instances.push_back(handle);
+    top_dirty = true;
+}
+
+static void triangle_bounds(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices,
+                            std::vector<Aabb>& bounds) {
+    bounds.resize(indices.size() / 3);
+    for (size_t i = 0; i < bounds.size(); i++) {
+        bounds[i] = Aabb();
+        for (int k = 0; k < 3; k++) bounds[i].grow(positions[indices[i * 3 + k]]);
+    }
+}
+
+void VulkanComputeRayTracing::queue_nodes(const Mesh& mesh) {
+    const auto&             nodes = mesh.bvh4.get_nodes();
+    std::vector<RTWideNode> wide(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) wide[i] = quantize(nodes[i], mesh.first_node, mesh.first_index / 3);
+    queue_copy(node_buffer.buffer(), (VkDeviceSize)mesh.first_node * sizeof(RTWideNode), wide.data(),
+               wide.size() * sizeof(RTWideNode));
+}
+
+// New meshes are built and dynamic ones refit on TBB workers, then queued for upload in handle order
+void VulkanComputeRayTracing::build_meshes() {
+    std::vector<Mesh*> builds, refits;
+    for (auto& mesh : meshes) {
+        if (!mesh.live) continue;
+        if (!mesh.built) {
+            builds.push_back(&mesh);
+        } else if (mesh.refit) {
+            refits.push_back(&mesh);
+        }
+    }
+    if (builds.empty() && refits.empty()) return;
+    auto start = std::chrono::steady_clock::now();
+
+    tbb::parallel_for(size_t(0), builds.size(), [&](size_t i) {
+        Mesh&             mesh = *builds[i];
+        std::vector<Aabb> bounds;
+        triangle_bounds(mesh.positions, mesh.indices, bounds);
+        mesh.bvh.build(bounds.data(), (uint32_t)bounds.size());
+        mesh.bvh4.build(mesh.bvh);
+    });
+    tbb::parallel_for(size_t(0), refits.size(), [&](size_t i) {
+        Mesh&             mesh = *refits[i];
+        std::vector<Aabb> bounds;
+        triangle_bounds(mesh.positions, mesh.indices, bounds);
+        mesh.bvh.refit(bounds.data());
+        mesh.bvh4.refit(mesh.bvh);
+    });
+
+    for (Mesh* mesh : builds) {
+        uint32_t node_count = (uint32_t)mesh->bvh4.get_nodes().size();
+        if (stats.nodes + node_count > max_nodes) {
+            std::cout << "ray tracing scene is out of BVH space\n";
+            mesh->live = false;
+            continue;
+        }
+        mesh->first_node = stats.nodes;
+        mesh->bounds     = mesh->bvh.get_nodes()[0].bounds;
+        mesh->built      = true;
+        mesh->refit      = false;
+        stats.nodes += node_count;
+
+        // triangles in leaf order, so a leaf reads a contiguous run of them
+        const auto&           order = mesh->bvh4.get_indices();
+        std::vector<uint32_t> ordered(mesh->indices.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            for (int k = 0; k < 3; k++) ordered[i * 3 + k] = mesh->indices[order[i] * 3 + k] + mesh->first_vertex;
+        }
+        queue_copy(index_buffer.buffer(), (VkDeviceSize)mesh->first_index * sizeof(uint32_t), ordered.data(),
+                   ordered.size() * sizeof(uint32_t));
+        queue_nodes(*mesh);
+        stats.blas_builds++;
+
+        // static meshes are done with their CPU side
+        if (!mesh->dynamic) {
+            mesh->positions = std::vector<glm::vec3>();
+            mesh->indices   = std::vector<uint32_t>();
+            mesh->bvh       = Bvh();
+            mesh->bvh4      = Bvh4();
+        }
+    }
+    for (Mesh* mesh : refits) {
+        mesh->bounds = mesh->bvh.get_nodes()[0].bounds;
+        mesh->refit  = false;
+        queue_nodes(*mesh);
+        stats.refits++;
+    }
+
+    top_dirty      = true;
+    stats.build_ms = elapsed_ms(start);
+}
+
+// The instance BVH from node 0, followed by the instance records in leaf order its leaves index
+void VulkanComputeRayTracing::build_top() {
+    std::vector<Aabb>     bounds;
+    std::vector<RTHandle> handles;
+    for (RTHandle i = 0; i < instances.size(); i++) {
+        const Instance& instance = instances[i];
+        if (!instance.live || !meshes[instance.desc.mesh].live || !meshes[instance.desc.mesh].built) continue;
+
+        const Aabb& local = meshes[instance.desc.mesh].bounds;
+        Aabb        world;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 p(corner & 1 ? local.max.x : local.min.x, corner & 2 ? local.max.y : local.min.y,
+                        corner & 4 ? local.max.z : local.min.z);
+            world.grow(glm::vec3(instance.desc.transform * glm::vec4(p, 1.0f)));
+        }
+        bounds.push_back(world);
+        handles.push_back(i);
+    }
+    tlas.build(bounds.data(), (uint32_t)bounds.size());
+    tlas4.build(tlas);
+
+    const auto& nodes      = tlas4.get_nodes();
+    uint32_t    node_count = (uint32_t)nodes.size();
+    top.resize((node_count + handles.size()) * sizeof(RTWideNode));
+
+    auto* wide = (RTWideNode*)top.data();
+    for (uint32_t i = 0; i < node_count; i++) wide[i] = quantize(nodes[i], 0, node_count);
+
+    auto*       records = (RTInstanceRecord*)(wide + node_count);
+    const auto& order   = tlas4.get_indices();
+    for (size_t i = 0; i < order.size(); i++) {
+        const RTInstance& instance = instances[handles[order[i]]].desc;
+        glm::mat4         m        = glm::inverse(instance.transform);
+        for (int row = 0; row < 3; row++) {
+            records[i].world_to_object[row] = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+        }
+        records[i].root = meshes[instance.mesh].first_node;
+        records[i].mask = instance.mask;
+    }
+
+    top_dirty = false;
+    stats.tlas_builds++;
+    stats.instances = (uint32_t)handles.size();
+}
+
+void VulkanComputeRayTracing::record_copies(VkCommandBuffer cmd) {
+    if (pending.empty()) return;
+
+    ComputeBuffer<uint8_t>& stage = staging[data->current_frame];
+    if (stage.size() < pending_bytes.size()) {
+        if (stage.buffer() != VK_NULL_HANDLE) {
+            impl->retire(*data, [old = stage]() mutable { old.destroy(); });
+            stage = ComputeBuffer<uint8_t>();
+        }
+        if (stage.create(impl, std::max<size_t>(pending_bytes.size(), 256 << 10), 0, true)) return;
+    }
+    memcpy(stage.data(), pending_bytes.data(), pending_bytes.size());
+
+    // copies overwrite nodes and positions the frames recorded so far traverse
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.dstAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+
+    // one copy per destination buffer, in the order the changes were made
+    std::vector<VkBufferCopy> regions;
+    for (VkBuffer buffer : {position_buffer.buffer(), index_buffer.buffer(), node_buffer.buffer()}) {
+        regions.clear();
+        for (auto& copy : pending) {
+            if (copy.buffer == buffer) regions.push_back({(VkDeviceSize)copy.source, copy.offset, copy.size});
+        }
+        if (!regions.empty()) vkCmdCopyBuffer(cmd, stage.buffer(), buffer, (uint32_t)regions.size(), regions.data());
+    }
+    pending.clear();
+    pending_bytes.clear();
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+}
+
+void VulkanComputeRayTracing::record(VkCommandBuffer cmd, const RTTraceParams& params) {
+    build_meshes();
+    if (top_dirty) build_top();
+    record_copies(cmd);
+    if (top.empty() || params.output == BINDLESS_INVALID) return;
+
+    // every frame slot has its own copy, earlier frames may still traverse theirs
+    ComputeBuffer<uint8_t>& top_buffer = top_buffers[data->current_frame];
+    memcpy(top_buffer.data(), top.data(), top.size());
+
+    RTTraceConstants constants        = {};
+    constants.inverse_view_projection = params.inverse_view_projection;
+    constants.light                   = glm::vec4(glm::normalize(params.light_direction), params.ao_radius);
+    constants.scene[0]                = top_buffer.handle();
+    constants.scene[1]                = node_buffer.handle();
+    constants.output                  = params.output;
+    constants.meshes                  = BINDLESS_INVALID;  // normals come from the triangles themselves
+    constants.positions               = position_buffer.handle();
+    constants.indices                 = index_buffer.handle();
+    constants.width                   = params.width;
+    constants.height                  = params.height;
+    constants.ao_samples              = params.ao_samples;
+    constants.frame                   = params.frame;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.get());
+    impl->bindless.bind(cmd, VK_PIPELINE_BIND_POINT_COMPUTE);
+    vkCmdPushConstants(cmd, impl->bindless.get_pipeline_layout(), VK_SHADER_STAGE_ALL, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(cmd, (params.width + group_size - 1) / group_size, (params.height + group_size - 1) / group_size,
+                  1);
+}
+
+}  // namespace fl
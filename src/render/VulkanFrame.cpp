@@ -0,0 +1,100 @@
+#include "fl/render/VulkanFrame.hpp"
+
+#include <cstdlib>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+FrameAllocator::FrameAllocator(size_t page_size) : page_size(page_size) {}
+
+FrameAllocator::~FrameAllocator() {
+    for (auto& page : pages) std::free(page.memory);
+}
+
+void* FrameAllocator::allocate(size_t size, size_t alignment) {
+    while (current < pages.size()) {
+        Page&  page    = pages[current];
+        size_t aligned = (page.offset + alignment - 1) & ~(alignment - 1);
+        if (aligned + size <= page.size) {
+            page.offset = aligned + size;
+            return page.memory + aligned;
+        }
+        current++;
+    }
+
+    // oversized requests get a page of their own, it is reused by later frames like any other page
+    size_t new_size = size + alignment > page_size ? size + alignment : page_size;
+    Page   page     = {(char*)std::malloc(new_size), new_size, 0};
+    if (!page.memory) throw std::bad_alloc();
+    pages.push_back(page);
+    current = pages.size() - 1;
+    return allocate(size, alignment);
+}
+
+void FrameAllocator::reset() {
+    for (auto& page : pages) page.offset = 0;
+    current = 0;
+}
+
+size_t FrameAllocator::used() const {
+    size_t total = 0;
+    for (auto& page : pages) total += page.offset;
+    return total;
+}
+
+size_t FrameAllocator::capacity() const {
+    size_t total = 0;
+    for (auto& page : pages) total += page.size;
+    return total;
+}
+
+int FrameContext::create(VkDevice device, uint32_t queue_family) {
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.queueFamilyIndex        = queue_family;
+    pool_info.flags                   = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    if (vkCreateCommandPool(device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
+        std::cout << "failed to create frame command pool\n";
+        return -1;
+    }
+
+    VkCommandBufferAllocateInfo alloc_info = {};
+    alloc_info.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool                 = command_pool;
+    alloc_info.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount          = 1;
+    if (vkAllocateCommandBuffers(device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+        std::cout << "failed to allocate frame command buffer\n";
+        return -1;
+    }
+
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType             = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags             = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    if (vkCreateSemaphore(device, &semaphore_info, nullptr, &image_available) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphore_info, nullptr, &render_finished) != VK_SUCCESS ||
+        vkCreateFence(device, &fence_info, nullptr, &in_flight) != VK_SUCCESS) {
+        std::cout << "failed to create sync objects\n";
+        return -1;
+    }
+    return 0;
+}
+
+void FrameContext::reset(VkDevice device) {
+    vkResetCommandPool(device, command_pool, 0);
+    allocator.reset();
+}
+
+void FrameContext::destroy(VkDevice device) {
+    vkDestroySemaphore(device, render_finished, nullptr);
+    vkDestroySemaphore(device, image_available, nullptr);
+    vkDestroyFence(device, in_flight, nullptr);
+    vkDestroyCommandPool(device, command_pool, nullptr);
+}
+
+}  // namespace fl
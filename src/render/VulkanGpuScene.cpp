@@ -0,0 +1,589 @@
+#include "fl/render/VulkanGpuScene.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+// Push constants of shader/cull.glsl and shader/gpu_scene_vert.glsl
+struct CullConstants {
+    glm::vec4 planes[6];
+    uint32_t  instances;
+    uint32_t  meshes;
+    uint32_t  buckets;
+    uint32_t  draws;
+    uint32_t  counts;
+    uint32_t  instance_count;
+    uint32_t  culling;
+};
+
+struct DrawConstants {
+    glm::mat4 view_projection;
+    uint32_t  vertices;
+    uint32_t  instances;
+};
+
+static_assert(sizeof(CullConstants) <= VulkanBindless::push_constant_size, "cull constants too large");
+static_assert(sizeof(GpuInstance) == 96 && sizeof(GpuMesh) == 32 && sizeof(GpuVertex) == 32, "std430 layouts");
+
+static const uint32_t cull_group_size = 64;
+
+VulkanGpuScene::VulkanGpuScene() { set_view_projection(glm::mat4(1.0f)); }
+
+VulkanGpuScene::~VulkanGpuScene() {}
+
+int VulkanGpuScene::create(VulkanImpl* impl, RenderData* data, const GpuSceneDesc& desc) {
+    this->impl = impl;
+    this->data = data;
+    this->desc = desc;
+
+    const VkBufferUsageFlags storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (create_buffer(vertex_buffer, (VkDeviceSize)desc.max_vertices * sizeof(GpuVertex), storage) ||
+        create_buffer(index_buffer, (VkDeviceSize)desc.max_indices * sizeof(uint32_t),
+                      VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT) ||
+        create_buffer(mesh_buffer, (VkDeviceSize)desc.max_meshes * sizeof(GpuMesh), storage) ||
+        create_buffer(instance_buffer, (VkDeviceSize)desc.max_instances * sizeof(GpuInstance), storage) ||
+        create_buffer(bucket_buffer, (VkDeviceSize)desc.max_materials * sizeof(uint32_t), storage) ||
+        create_buffer(draw_buffer, (VkDeviceSize)desc.max_instances * sizeof(VkDrawIndexedIndirectCommand),
+                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) ||
+        create_buffer(count_buffer, (VkDeviceSize)desc.max_materials * sizeof(uint32_t),
+                      storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT)) {
+        return -1;
+    }
+
+    auto& bindless         = impl->bindless;
+    vertex_buffer.handle   = bindless.add_buffer(vertex_buffer.buffer);
+    mesh_buffer.handle     = bindless.add_buffer(mesh_buffer.buffer);
+    instance_buffer.handle = bindless.add_buffer(instance_buffer.buffer);
+    bucket_buffer.handle   = bindless.add_buffer(bucket_buffer.buffer);
+    draw_buffer.handle     = bindless.add_buffer(draw_buffer.buffer);
+    count_buffer.handle    = bindless.add_buffer(count_buffer.buffer);
+    if (count_buffer.handle == BINDLESS_INVALID) {
+        std::cout << "failed to add gpu scene buffers to the bindless set\n";
+        return -1;
+    }
+
+    if (create_cull_pipeline()) return -1;
+
+    // with hot reload on, saving the cull or default material shaders rebuilds their pipelines
+    if (impl->shaders.running()) {
+        std::vector<ShaderSource> cull_sources     = {{"cull.glsl", "compute", "cull.spv"}};
+        std::vector<ShaderSource> material_sources = {{"gpu_scene_vert.glsl", "vertex", "gpu_scene_vert.spv"},
+                                                      {"gpu_scene_frag.glsl", "fragment", "gpu_scene_frag.spv"}};
+        cull_watch     = impl->shaders.watch(cull_sources, [this] { return reload_cull_pipeline(); });
+        material_watch = impl->shaders.watch(material_sources, [this] { return reload_material_pipelines(); });
+    }
+
+    instances.resize(desc.max_instances);
+    dirty_flags.resize(desc.max_instances, 0);
+
+    // The cull pass goes in front of the scene pass, which reads what it writes. Its first use of each
+    // buffer is a write, so the graph orders it after the previous frame's reads.
+    auto&      graph  = data->graph;
+    RGResource draws  = graph.import_buffer("gpu_draws", draw_buffer.buffer, draw_buffer.size);
+    RGResource counts = graph.import_buffer("gpu_draw_counts", count_buffer.buffer, count_buffer.size);
+    RGResource insts  = graph.import_buffer("gpu_instances", instance_buffer.buffer, instance_buffer.size);
+    RGResource bucket = graph.import_buffer("gpu_buckets", bucket_buffer.buffer, bucket_buffer.size);
+
+    const VkPipelineStageFlags copy_and_cull = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    cull_pass = &graph.add_pass_before("cull", RGPassType::Compute, "scene");
+    cull_pass->write_buffer(insts, copy_and_cull, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT);
+    cull_pass->write_buffer(bucket, copy_and_cull, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT);
+    cull_pass->write_buffer(counts, copy_and_cull,
+                            VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    cull_pass->write_buffer(draws, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    cull_pass->execute = [this](RGContext& ctx) { record_cull(ctx.cmd); };
+
+    RGPass* scene = data->scene_pass;
+    scene->read_buffer(draws, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    scene->read_buffer(counts, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    scene->read_buffer(insts, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    data->draw_items.push_back([this](VkCommandBuffer cmd) { record_draws(cmd); });
+
+    return impl->compile_render_graph(*data);
+}
+
+void VulkanGpuScene::destroy() {
+    if (!impl) return;
+    VkDevice device = impl->device.device;
+    impl->wait_idle();
+
+    for (uint32_t* watch : {&cull_watch, &material_watch}) {
+        if (*watch != ~0u) impl->shaders.unwatch(*watch);
+        *watch = ~0u;
+    }
+    for (auto& material : materials) {
+        if (material.pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, material.pipeline, nullptr);
+    }
+    materials.clear();
+    if (cull_pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, cull_pipeline, nullptr);
+    cull_pipeline = VK_NULL_HANDLE;
+
+    for (Buffer* buffer : {&vertex_buffer, &index_buffer, &mesh_buffer, &instance_buffer, &bucket_buffer, &draw_buffer,
+                           &count_buffer}) {
+        destroy_buffer(*buffer);
+    }
+    for (auto& buffer : staging) destroy_buffer(buffer);
+    impl = nullptr;
+}
+
+int VulkanGpuScene::create_buffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool host_visible) {
+    VkBufferCreateInfo info = {};
+    info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size               = size;
+    info.usage              = usage;
+    info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkMemoryPropertyFlags required = host_visible
+                                         ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                         : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if (impl->allocator.create_buffer(info, required, buffer.buffer, buffer.allocation)) {
+        std::cout << "failed to create gpu scene buffer\n";
+        return -1;
+    }
+    buffer.size = size;
+    return 0;
+}
+
+void VulkanGpuScene::destroy_buffer(Buffer& buffer) {
+    if (buffer.handle != BINDLESS_INVALID) impl->bindless.remove_buffer(buffer.handle);
+    if (buffer.buffer != VK_NULL_HANDLE) impl->allocator.destroy_buffer(buffer.buffer, buffer.allocation);
+    buffer = Buffer();
+}
+
+int VulkanGpuScene::create_cull_pipeline() {
+    VkShaderModule module = impl->getShaderModule("cull.spv");
+    if (module == VK_NULL_HANDLE) {
+        std::cout << "failed to create shader module\n";
+        return -1;
+    }
+
+    VkComputePipelineCreateInfo info = {};
+    info.sType                       = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    info.stage.sType                 = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    info.stage.stage                 = VK_SHADER_STAGE_COMPUTE_BIT;
+    info.stage.module                = module;
+    info.stage.pName                 = "main";
+    info.layout                      = impl->bindless.get_pipeline_layout();
+
+    if (impl->pipeline_cache.create_compute_pipeline(info, &cull_pipeline) != VK_SUCCESS) {
+        std::cout << "failed to create cull pipeline\n";
+        return -1;
+    }
+    return 0;
+}
+
+// Same fixed state as the scene pipeline; vertices come from the bindless set, so there is no vertex input
+int VulkanGpuScene::create_material_pipeline(Material& material) {
+    VkShaderModule vert_module = impl->getShaderModule(material.desc.vertex_shader);
+    VkShaderModule frag_module = impl->getShaderModule(material.desc.fragment_shader);
+    if (vert_module == VK_NULL_HANDLE || frag_module == VK_NULL_HANDLE) {
+        std::cout << "failed to create shader module\n";
+        return -1;
+    }
+
+    VkPipelineShaderStageCreateInfo stages[2] = {};
+    stages[0].sType                           = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage                           = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module                          = vert_module;
+    stages[0].pName                           = "main";
+    stages[1].sType                           = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage                           = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module                          = frag_module;
+    stages[1].pName                           = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertex_input = {};
+    vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+    input_assembly.sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewport_state = {};
+    viewport_state.sType                             = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount                     = 1;
+    viewport_state.scissorCount                      = 1;
+
+    // tiles and sprites are often mirrored by a negative scale, so both windings are drawn
+    VkPipelineRasterizationStateCreateInfo rasterizer = {};
+    rasterizer.sType                                  = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode                            = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth                              = 1.0f;
+    rasterizer.cullMode                               = VK_CULL_MODE_NONE;
+    rasterizer.frontFace                              = VK_FRONT_FACE_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {};
+    multisampling.sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState blend = {};
+    blend.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    blend.blendEnable         = material.desc.alpha_blend ? VK_TRUE : VK_FALSE;
+    blend.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    blend.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blend.colorBlendOp        = VK_BLEND_OP_ADD;
+    blend.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blend.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blend.alphaBlendOp        = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo color_blending = {};
+    color_blending.sType                               = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.attachmentCount                     = 1;
+    color_blending.pAttachments                        = &blend;
+
+    VkDynamicState                   dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_info     = {};
+    dynamic_info.sType                                = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_info.dynamicStateCount                    = 2;
+    dynamic_info.pDynamicStates                       = dynamic_states;
+
+    VkGraphicsPipelineCreateInfo info = {};
+    info.sType                        = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    info.stageCount                   = 2;
+    info.pStages                      = stages;
+    info.pVertexInputState            = &vertex_input;
+    info.pInputAssemblyState          = &input_assembly;
+    info.pViewportState               = &viewport_state;
+    info.pRasterizationState          = &rasterizer;
+    info.pMultisampleState            = &multisampling;
+    info.pColorBlendState             = &color_blending;
+    info.pDynamicState                = &dynamic_info;
+    info.layout                       = impl->bindless.get_pipeline_layout();
+    info.renderPass                   = data->scene_pass->get_render_pass();
+    info.subpass                      = data->scene_pass->get_subpass();
+
+    if (impl->pipeline_cache.create_graphics_pipeline(info, &material.pipeline) != VK_SUCCESS) {
+        std::cout << "failed to create material pipeline\n";
+        material.pipeline = VK_NULL_HANDLE;
+        return -1;
+    }
+    return 0;
+}
+
+// Material pipelines follow the render pass of the scene pass, like the scene pipeline does
+int VulkanGpuScene::update_pipelines() {
+    VkRenderPass render_pass = data->scene_pass->get_render_pass();
+    if (render_pass != pipeline_render_pass) {
+        VkDevice device = impl->device.device;
+        for (auto& material : materials) {
+            if (material.pipeline == VK_NULL_HANDLE) continue;
+            VkPipeline old = material.pipeline;
+            impl->retire(*data, [device, old]() { vkDestroyPipeline(device, old, nullptr); });
+            material.pipeline = VK_NULL_HANDLE;
+        }
+        pipeline_render_pass = render_pass;
+    }
+
+    int result = 0;
+    for (auto& material : materials) {
+        if (material.pipeline == VK_NULL_HANDLE && create_material_pipeline(material)) result = -1;
+    }
+    return result;
+}
+
+// Materials with shaders of their own are not watched, their SPIR-V may not come from shader/
+static bool uses_default_shaders(const GpuMaterial& material) {
+    return material.vertex_shader == GpuMaterial().vertex_shader &&
+           material.fragment_shader == GpuMaterial().fragment_shader;
+}
+
+// Hot reload: the new pipelines are built first, the old ones retired only once they all exist
+int VulkanGpuScene::reload_cull_pipeline() {
+    VkPipeline old = cull_pipeline;
+    cull_pipeline  = VK_NULL_HANDLE;
+    if (create_cull_pipeline()) {
+        cull_pipeline = old;
+        return -1;
+    }
+    VkDevice device = impl->device.device;
+    impl->retire(*data, [device, old]() { vkDestroyPipeline(device, old, nullptr); });
+    return 0;
+}
+
+int VulkanGpuScene::reload_material_pipelines() {
+    VkDevice              device = impl->device.device;
+    std::vector<Material> next(materials.size());
+    int                   result = 0;
+    for (size_t m = 0; m < materials.size() && !result; m++) {
+        if (materials[m].pipeline == VK_NULL_HANDLE || !uses_default_shaders(materials[m].desc)) continue;
+        next[m].desc = materials[m].desc;
+        result       = create_material_pipeline(next[m]);
+    }
+    for (size_t m = 0; m < materials.size(); m++) {
+        if (next[m].pipeline == VK_NULL_HANDLE) continue;
+        VkPipeline old = result ? next[m].pipeline : materials[m].pipeline;
+        if (!result) materials[m].pipeline = next[m].pipeline;
+        impl->retire(*data, [device, old]() { vkDestroyPipeline(device, old, nullptr); });
+    }
+    return result;
+}
+
+GpuHandle VulkanGpuScene::add_mesh(const GpuVertex* vertices, uint32_t vertex_count, const uint32_t* indices,
+                                   uint32_t index_count) {
+    if (!vertices || !vertex_count || !indices || !index_count) {
+        std::cout << "gpu scene mesh has no vertices or indices\n";
+        return GPU_INVALID;
+    }
+    if (meshes.size() >= desc.max_meshes || this->vertex_count + vertex_count > desc.max_vertices ||
+        this->index_count + index_count > desc.max_indices) {
+        std::cout << "gpu scene is out of mesh space\n";
+        return GPU_INVALID;
+    }
+
+    glm::vec3 lo = vertices[0].position, hi = vertices[0].position;
+    for (uint32_t i = 1; i < vertex_count; i++) {
+        lo = glm::min(lo, vertices[i].position);
+        hi = glm::max(hi, vertices[i].position);
+    }
+    glm::vec3 center = (lo + hi) * 0.5f;
+    float     radius = 0.0f;
+    for (uint32_t i = 0; i < vertex_count; i++) radius = std::max(radius, glm::length(vertices[i].position - center));
+
+    GpuMesh mesh       = {};
+    mesh.bounds        = glm::vec4(center, radius);
+    mesh.index_count   = index_count;
+    mesh.first_index   = this->index_count;
+    mesh.vertex_offset = (int32_t)this->vertex_count;
+
+    auto&       uploader = impl->uploader;
+    UploadToken tokens[] = {
+        uploader.upload_buffer(vertex_buffer.buffer, (VkDeviceSize)this->vertex_count * sizeof(GpuVertex), vertices,
+                               (VkDeviceSize)vertex_count * sizeof(GpuVertex)),
+        uploader.upload_buffer(index_buffer.buffer, (VkDeviceSize)this->index_count * sizeof(uint32_t), indices,
+                               (VkDeviceSize)index_count * sizeof(uint32_t)),
+        uploader.upload_buffer(mesh_buffer.buffer, meshes.size() * sizeof(GpuMesh), &mesh, sizeof(GpuMesh)),
+    };
+    if (!tokens[0].value || !tokens[1].value || !tokens[2].value) {
+        // The copies that were staged land past the used ranges, which the next mesh reuses, so they have
+        // to finish first. Their acquire barriers stay, the buffers hold the meshes added before.
+        uploader.wait(uploader.flush());
+        std::cout << "failed to upload gpu scene mesh\n";
+        return GPU_INVALID;
+    }
+    this->vertex_count += vertex_count;
+    this->index_count += index_count;
+
+    // uploads are acquired when a frame begins, one added while a frame is recorded waits for the next
+    mesh_ready.push_back(data->frame_stats.submitted + (data->frame_acquired ? 2 : 1));
+    meshes.push_back(mesh);
+    stats.meshes = (uint32_t)meshes.size();
+    return (GpuHandle)meshes.size() - 1;
+}
+
+GpuHandle VulkanGpuScene::add_material(const GpuMaterial& material) {
+    if (materials.size() >= desc.max_materials) {
+        std::cout << "gpu scene is out of material slots\n";
+        return GPU_INVALID;
+    }
+    Material entry;
+    entry.desc = material;
+    materials.push_back(entry);
+    buckets_dirty   = true;
+    stats.materials = (uint32_t)materials.size();
+    return (GpuHandle)materials.size() - 1;
+}
+
+GpuHandle VulkanGpuScene::add_instance(const GpuInstance& instance) {
+    uint32_t slot;
+    if (!free_instances.empty()) {
+        slot = free_instances.back();
+        free_instances.pop_back();
+    } else if (instance_count < desc.max_instances) {
+        slot = instance_count++;
+    } else {
+        std::cout << "gpu scene is out of instance slots\n";
+        return GPU_INVALID;
+    }
+    instances[slot].mesh = GPU_INVALID;
+    set_instance(slot, instance);
+    return slot;
+}
+
+void VulkanGpuScene::set_instance(GpuHandle handle, const GpuInstance& instance) {
+    if (handle >= instance_count) return;
+    if (instance.mesh != GPU_INVALID && (instance.mesh >= meshes.size() || instance.material >= materials.size())) {
+        std::cout << "gpu scene instance refers to an unknown mesh or material\n";
+        return;
+    }
+
+    // the draw buffer range of a material holds one slot per live instance of it
+    GpuInstance& old = instances[handle];
+    if (old.mesh != GPU_INVALID) materials[old.material].instances--;
+    if (instance.mesh != GPU_INVALID) materials[instance.material].instances++;
+    if (old.mesh != instance.mesh || old.material != instance.material) buckets_dirty = true;
+    if (old.mesh == GPU_INVALID && instance.mesh != GPU_INVALID) stats.instances++;
+    if (old.mesh != GPU_INVALID && instance.mesh == GPU_INVALID) stats.instances--;
+
+    old = instance;
+    mark_dirty(handle);
+}
+
+void VulkanGpuScene::set_transform(GpuHandle handle, const glm::mat4& transform) {
+    if (handle >= instance_count) return;
+    instances[handle].transform = transform;
+    mark_dirty(handle);
+}
+
+void VulkanGpuScene::remove_instance(GpuHandle handle) {
+    if (handle >= instance_count || instances[handle].mesh == GPU_INVALID) return;
+    GpuInstance instance = instances[handle];
+    instance.mesh        = GPU_INVALID;
+    set_instance(handle, instance);
+    free_instances.push_back(handle);
+}
+
+void VulkanGpuScene::mark_dirty(uint32_t slot) {
+    if (dirty_flags[slot]) return;
+    dirty_flags[slot] = 1;
+    dirty.push_back(slot);
+}
+
+// Gribb-Hartmann: each plane is a sum or difference of rows of the matrix, Vulkan clip depth is 0..w
+void VulkanGpuScene::set_view_projection(const glm::mat4& view_projection) {
+    this->view_projection = view_projection;
+
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+    }
+    planes[0] = row[3] + row[0];
+    planes[1] = row[3] - row[0];
+    planes[2] = row[3] + row[1];
+    planes[3] = row[3] - row[1];
+    planes[4] = row[2];
+    planes[5] = row[3] - row[2];
+    for (auto& plane : planes) {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.0f) plane /= length;
+    }
+}
+
+// Changed instances and the material ranges are staged in this frame's host buffer and copied on the
+// graphics queue, ordered after the previous frame's reads by the cull pass barriers.
+int VulkanGpuScene::record_uploads(VkCommandBuffer cmd) {
+    uint64_t serial  = data->frame_stats.submitted + 1;  // the frame being recorded
+    size_t   buckets = buckets_dirty ? materials.size() : 0;
+    if (dirty.empty() && !buckets) return 0;
+
+    Buffer&      stage  = staging[data->current_frame];
+    VkDeviceSize needed = dirty.size() * sizeof(GpuInstance) + buckets * sizeof(uint32_t);
+    if (stage.size < needed) {
+        if (stage.buffer != VK_NULL_HANDLE) {
+            Buffer old = stage;
+            impl->retire(*data, [this, old]() mutable { impl->allocator.destroy_buffer(old.buffer, old.allocation); });
+        }
+        stage = Buffer();
+        if (create_buffer(stage, std::max<VkDeviceSize>(needed, 64 << 10), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true)) {
+            return -1;
+        }
+    }
+
+    uint8_t*                  mapped = (uint8_t*)stage.allocation.mapped;
+    VkDeviceSize              cursor = 0;
+    std::vector<VkBufferCopy> regions;
+    std::vector<uint32_t>     later;
+
+    // consecutive slots become one copy region
+    std::sort(dirty.begin(), dirty.end());
+    for (uint32_t slot : dirty) {
+        GpuInstance instance = instances[slot];
+        if (instance.mesh != GPU_INVALID && mesh_ready[instance.mesh] > serial) {
+            instance.mesh = GPU_INVALID;  // its mesh is not acquired by this frame yet, drawn from the next
+            later.push_back(slot);
+        } else {
+            dirty_flags[slot] = 0;
+        }
+        memcpy(mapped + cursor, &instance, sizeof(GpuInstance));
+
+        VkDeviceSize offset = (VkDeviceSize)slot * sizeof(GpuInstance);
+        if (!regions.empty() && regions.back().dstOffset + regions.back().size == offset) {
+            regions.back().size += sizeof(GpuInstance);
+        } else {
+            regions.push_back({cursor, offset, sizeof(GpuInstance)});
+        }
+        cursor += sizeof(GpuInstance);
+    }
+    dirty.swap(later);
+    if (!regions.empty()) {
+        vkCmdCopyBuffer(cmd, stage.buffer, instance_buffer.buffer, (uint32_t)regions.size(), regions.data());
+    }
+
+    if (buckets) {
+        uint32_t* first = (uint32_t*)(mapped + cursor);
+        uint32_t  sum   = 0;
+        for (size_t m = 0; m < materials.size(); m++) {
+            first[m] = sum;
+            sum += materials[m].instances;
+        }
+        VkBufferCopy region = {cursor, 0, buckets * sizeof(uint32_t)};
+        vkCmdCopyBuffer(cmd, stage.buffer, bucket_buffer.buffer, 1, &region);
+        buckets_dirty = false;
+    }
+
+    stats.upload_bytes += needed;
+    return 0;
+}
+
+void VulkanGpuScene::record_cull(VkCommandBuffer cmd) {
+    stats.frames++;
+    if (update_pipelines()) std::cout << "failed to create gpu scene pipelines\n";
+    record_uploads(cmd);
+    vkCmdFillBuffer(cmd, count_buffer.buffer, 0, count_buffer.size, 0);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+    if (instance_count == 0) return;
+
+    CullConstants constants  = {};
+    constants.instances      = instance_buffer.handle;
+    constants.meshes         = mesh_buffer.handle;
+    constants.buckets        = bucket_buffer.handle;
+    constants.draws          = draw_buffer.handle;
+    constants.counts         = count_buffer.handle;
+    constants.instance_count = instance_count;
+    constants.culling        = culling ? 1 : 0;
+    for (int i = 0; i < 6; i++) constants.planes[i] = planes[i];
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+    impl->bindless.bind(cmd, VK_PIPELINE_BIND_POINT_COMPUTE);
+    vkCmdPushConstants(cmd, impl->bindless.get_pipeline_layout(), VK_SHADER_STAGE_ALL, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(cmd, (instance_count + cull_group_size - 1) / cull_group_size, 1, 1);
+}
+
+// One indirect draw per material; the count is what the cull pass wrote, at most the material's instances
+void VulkanGpuScene::record_draws(VkCommandBuffer cmd) {
+    stats.draw_calls = 0;
+    if (stats.instances == 0) return;
+
+    DrawConstants constants   = {};
+    constants.view_projection = view_projection;
+    constants.vertices        = vertex_buffer.handle;
+    constants.instances       = instance_buffer.handle;
+    vkCmdPushConstants(cmd, impl->bindless.get_pipeline_layout(), VK_SHADER_STAGE_ALL, 0, sizeof(constants),
+                       &constants);
+    vkCmdBindIndexBuffer(cmd, index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+    const VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+    uint32_t           first  = 0;
+    for (size_t m = 0; m < materials.size(); m++) {
+        const Material& material = materials[m];
+        if (material.instances && material.pipeline != VK_NULL_HANDLE) {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline);
+            vkCmdDrawIndexedIndirectCount(cmd, draw_buffer.buffer, first * stride, count_buffer.buffer,
+                                          m * sizeof(uint32_t), material.instances, (uint32_t)stride);
+            stats.draw_calls++;
+        }
+        first += material.instances;
+    }
+}
+
+}  // namespace fl
@@ -0,0 +1,16 @@
+#include "fl/render/VulkanHeadlessRender.hpp"
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+VulkanHeadlessRender::VulkanHeadlessRender() {}
+
+VulkanHeadlessRender::~VulkanHeadlessRender() {}
+
+void VulkanHeadlessRender::Init() {
+    VulkanRender::Init();
+    if (enableReadback()) throw std::runtime_error("Failed to create readback buffers");
+}
+
+}  // namespace fl
@@ -1,7 +1,8 @@
 #include "fl/render/VulkanImpl.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
-#include <array>
 
 #include "fl/stdafx.hpp"
 
@@ -11,11 +12,16 @@ VulkanImpl::VulkanImpl() {}
 
 VulkanImpl::~VulkanImpl() {}
 
+// Without a loader or a window the instance is created headless: no surface, no swapchain, frames are
+// rendered into offscreen images, see create_offscreen_targets.
 void VulkanImpl::bootstrap(VulkanLoader loader, void* window) {
+    headless = !loader || !window;
+
     vkb::InstanceBuilder builder;
 
     auto inst_ret = builder
                         .require_api_version(1, 2)
+                        .set_headless(headless)
                         .request_validation_layers()    // validate correctness
                         .use_default_debug_messenger()  // use DebugUtilsMessage
                         .build();
@@ -23,13 +29,45 @@ void VulkanImpl::bootstrap(VulkanLoader loader, void* window) {
         throw std::runtime_error("Failed to create Vulkan instance. Error: " + inst_ret.error().message());
     }
     instance = inst_ret.value();
-    surface  = (VkSurfaceKHR)loader(instance.instance, window);
+    surface  = headless ? VK_NULL_HANDLE : (VkSurfaceKHR)loader(instance.instance, window);
 
     vkb::PhysicalDeviceSelector selector{instance};
+    if (!headless) selector.set_surface(surface);
+
+    // uploads signal a timeline semaphore that the graphics submit waits on, the bindless set needs
+    // update-after-bind, partially bound arrays indexed with non-uniform values
+    VkPhysicalDeviceVulkan12Features features_12              = {};
+    features_12.sType                                         = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features_12.timelineSemaphore                             = VK_TRUE;
+    features_12.descriptorIndexing                            = VK_TRUE;
+    features_12.runtimeDescriptorArray                        = VK_TRUE;
+    features_12.descriptorBindingPartiallyBound               = VK_TRUE;
+    features_12.descriptorBindingUpdateUnusedWhilePending     = VK_TRUE;
+    features_12.descriptorBindingSampledImageUpdateAfterBind  = VK_TRUE;
+    features_12.descriptorBindingStorageImageUpdateAfterBind  = VK_TRUE;
+    features_12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    features_12.shaderSampledImageArrayNonUniformIndexing     = VK_TRUE;
+    features_12.shaderStorageBufferArrayNonUniformIndexing    = VK_TRUE;
+    features_12.drawIndirectCount                             = VK_TRUE;
+    features_12.bufferDeviceAddress                           = VK_TRUE;  // geometry and binding tables of ray tracing
+
+    // GPU driven draws: many draws per indirect call, each naming its instance through firstInstance
+    VkPhysicalDeviceFeatures features  = {};
+    features.multiDrawIndirect         = VK_TRUE;
+    features.drawIndirectFirstInstance = VK_TRUE;
+
+    // hardware ray tracing is optional, the extensions are only enabled when the device has all of them
+    selector.add_desired_extension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+    if (hardware_ray_tracing) {
+        selector.add_desired_extension(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME)
+            .add_desired_extension(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME)
+            .add_desired_extension(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+    }
 
-    auto phys_ret = selector.set_surface(surface)
+    auto phys_ret = selector
                         .set_minimum_version(1, 2)  // require a vulkan 1.2 capable device
-                        .require_dedicated_transfer_queue()
+                        .set_required_features(features)
+                        .set_required_features_12(features_12)
                         .select();
     if (!phys_ret) {
         throw std::runtime_error("Failed to select Vulkan Physical Device. Error: " + phys_ret.error().message());
@@ -38,6 +76,31 @@ void VulkanImpl::bootstrap(VulkanLoader loader, void* window) {
 
     vkb::DeviceBuilder device_builder{vbk_phys_device};
 
+    VkPhysicalDeviceAccelerationStructureFeaturesKHR as_features = {};
+    as_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+    VkPhysicalDeviceRayTracingPipelineFeaturesKHR rt_features = {};
+    rt_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR;
+    VkPhysicalDevice physical = vbk_phys_device.physical_device;
+    if (hardware_ray_tracing && has_device_extension(physical, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) &&
+        has_device_extension(physical, VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME) &&
+        has_device_extension(physical, VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME)) {
+        as_features.pNext                   = &rt_features;
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType                     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext                     = &as_features;
+        vkGetPhysicalDeviceFeatures2(physical, &features2);
+
+        // only what the backend uses is enabled
+        caps.ray_tracing = as_features.accelerationStructure && rt_features.rayTracingPipeline;
+        as_features      = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR};
+        rt_features      = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR};
+        if (caps.ray_tracing) {
+            as_features.accelerationStructure = VK_TRUE;
+            rt_features.rayTracingPipeline    = VK_TRUE;
+            device_builder.add_pNext(&as_features).add_pNext(&rt_features);
+        }
+    }
+
     // automatically propagate needed data from instance & physical device
     auto dev_ret = device_builder.build();
     if (!dev_ret) {
@@ -45,28 +108,82 @@ void VulkanImpl::bootstrap(VulkanLoader loader, void* window) {
     }
     device = dev_ret.value();
 
+    caps.pipeline_creation_feedback =
+        has_device_extension(device.physical_device.physical_device, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+
+    allocator.init(device.physical_device.physical_device, device.device, 64ull << 20, true);
+
+    // Devices with a single queue (lavapipe, some integrated GPUs) upload on the graphics queue. Loader
+    // threads then submit to the render thread's queue, queue_mutex keeps those submits apart.
+    auto transfer_queue  = device.get_dedicated_queue(vkb::QueueType::transfer);
+    auto transfer_family = device.get_dedicated_queue_index(vkb::QueueType::transfer);
+    auto graphics_family = device.get_queue_index(vkb::QueueType::graphics);
+    if (!transfer_queue || !transfer_family) {
+        transfer_queue  = device.get_queue(vkb::QueueType::graphics);
+        transfer_family = device.get_queue_index(vkb::QueueType::graphics);
+    }
+    if (!transfer_queue || !transfer_family || !graphics_family) {
+        throw std::runtime_error("Failed to get a queue for uploads");
+    }
+    if (uploader.create(device.device, &allocator, transfer_queue.value(), transfer_family.value(),
+                        graphics_family.value(), &queue_mutex)) {
+        throw std::runtime_error("Failed to create the upload service");
+    }
+
+    if (pipeline_cache.load(device.device, device.physical_device.physical_device, pipeline_cache_path,
+                            caps.pipeline_creation_feedback)) {
+        throw std::runtime_error("Failed to create Vulkan pipeline cache");
+    }
+    shader_modules.create(device.device);
+
+    if (bindless.create(device.physical_device.physical_device, device.device)) {
+        throw std::runtime_error("Failed to create the bindless descriptor set");
+    }
+
+    // Async compute prefers a family of its own, then any compute family without graphics. Without one
+    // the compute work shares the graphics queue and keeps its ordering, only the overlap is lost.
+    auto graphics_queue = device.get_queue(vkb::QueueType::graphics);
+    auto compute_queue  = device.get_dedicated_queue(vkb::QueueType::compute);
+    auto compute_family = device.get_dedicated_queue_index(vkb::QueueType::compute);
+    if (!compute_queue || !compute_family) {
+        compute_queue  = device.get_queue(vkb::QueueType::compute);
+        compute_family = device.get_queue_index(vkb::QueueType::compute);
+    }
+    if (!compute_queue || !compute_family) {
+        compute_queue  = graphics_queue;
+        compute_family = graphics_family;
+    }
+    if (!compute_queue || !compute_family || !graphics_queue ||
+        compute.create(this, compute_queue.value(), compute_family.value(), graphics_queue.value(),
+                       graphics_family.value())) {
+        throw std::runtime_error("Failed to create the compute context");
+    }
+
     createDescriptorPool();
 }
 
+bool VulkanImpl::has_device_extension(VkPhysicalDevice physical_device, const char* name) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> extensions(count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, extensions.data());
+    for (auto& ext : extensions) {
+        if (strcmp(ext.extensionName, name) == 0) return true;
+    }
+    return false;
+}
+
+// Scene resources live in the bindless set, this pool only serves the ImGui backend and the few combined
+// image sampler sets it allocates, the font atlas being the first.
 void VulkanImpl::createDescriptorPool() {
-    VkDescriptorPoolSize pool_sizes[] = {{VK_DESCRIPTOR_TYPE_SAMPLER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000},
-                                         {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000},
-                                         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000},
-                                         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000},
-                                         {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000}};
+    VkDescriptorPoolSize pool_sizes[] = {{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 64}};
 
     VkDescriptorPoolCreateInfo pool_info = {};
 
     pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     pool_info.flags         = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
     pool_info.poolSizeCount = ((uint32_t)(sizeof(pool_sizes) / sizeof(*(pool_sizes))));
-    pool_info.maxSets       = 1000 * pool_info.poolSizeCount;
+    pool_info.maxSets       = 64;
     pool_info.pPoolSizes    = pool_sizes;
     VkResult err = vkCreateDescriptorPool(device.device, &pool_info, instance.allocation_callbacks, &descriptor_pool);
     if (err != VK_SUCCESS) throw std::runtime_error("Failed to create VkDescriptorPool");
@@ -75,28 +192,44 @@ void VulkanImpl::createDescriptorPool() {
 RenderData* VulkanImpl::createRenderData() {
     RenderData* data = new RenderData();
     data->parent     = this;
-    if (create_swapchain()) return nullptr;
+    if (headless) {
+        if (create_offscreen_targets(*data)) return nullptr;
+    } else {
+        if (create_swapchain()) return nullptr;
+        if (get_swapchain_images(*data)) return nullptr;
+    }
+    data->requested_extent = data->extent;
+    bindless.set_retire([this, data](std::function<void()> fn) { retire(*data, std::move(fn)); });
     if (get_queues(*data)) return nullptr;
-    if (create_render_pass(*data)) return nullptr;
-    if (create_graphics_pipeline(*data)) return nullptr;
-    if (create_framebuffers(*data)) return nullptr;
-    if (create_command_pool(*data)) return nullptr;
-    if (create_command_buffers(*data)) return nullptr;
-    if (create_sync_objects(*data)) return nullptr;
-    if (create_imgui_render_pass(*data)) return nullptr;
-    if (create_imgui_framebuffers(*data)) return nullptr;
-    if (create_imgui_command_buffers(*data)) return nullptr;
+    if (create_render_graph(*data)) return nullptr;
+    if (create_frames(*data)) return nullptr;
+
+    // editing vert.glsl, frag.glsl or what they include rebuilds the scene pipeline between two frames
+    if (shader_hot_reload && shaders.start(shader_dir) == 0) {
+        shaders.watch({{"vert.glsl", "vertex", "vert.spv"}, {"frag.glsl", "fragment", "frag.spv"}},
+                      [this, data] { return reload_graphics_pipeline(*data); });
+    }
     return data;
 }
 
-int VulkanImpl::create_swapchain() {
+// The previous swapchain is passed as oldSwapchain and left to the caller, frames in flight may still
+// render into its images.
+int VulkanImpl::create_swapchain(VkExtent2D desired) {
     vkb::SwapchainBuilder swapchain_builder{device};
-    auto                  swap_ret = swapchain_builder.set_old_swapchain(swapchain).build();
+    swapchain_builder.set_old_swapchain(swapchain);
+    if (desired.width && desired.height) swapchain_builder.set_desired_extent(desired.width, desired.height);
+    if (!present_modes.empty()) swapchain_builder.set_desired_present_mode(present_modes[0]);
+    for (size_t i = 1; i < present_modes.size(); i++) swapchain_builder.add_fallback_present_mode(present_modes[i]);
+    swapchain_builder.add_fallback_present_mode(VK_PRESENT_MODE_FIFO_KHR);
+
+    // transfer source for readback and frame capture
+    auto swap_ret = swapchain_builder
+                        .set_image_usage_flags(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+                        .build();
     if (!swap_ret) {
         std::cout << swap_ret.error().message() << " " << swap_ret.vk_result() << "\n";
         return -1;
     }
-    vkb::destroy_swapchain(swapchain);
     swapchain = swap_ret.value();
     return 0;
 }
@@ -111,6 +244,12 @@ int VulkanImpl::get_queues(RenderData& data) {
     data.graphics_queue        = gq.value();
     data.graphics_queue_family = gqi.value();
 
+    if (headless) {
+        data.present_queue        = data.graphics_queue;
+        data.present_queue_family = data.graphics_queue_family;
+        return 0;
+    }
+
     auto pqi = device.get_queue_index(vkb::QueueType::present);
     if (!pqi.has_value()) {
         std::cout << "failed to get present queue: " << pqi.error().message() << "\n";
@@ -122,148 +261,141 @@ int VulkanImpl::get_queues(RenderData& data) {
     return 0;
 }
 
-int VulkanImpl::create_imgui_render_pass(RenderData& data) {
-    // To create this render pass we first need to create a VkAttachmentDescription. Let’s get rid of the boring fields
-    // first: we don’t need any stencil so we don’t care about its operators and the number of samples should probably
-    // be 1. Dear ImGui’s output looks fine without MSAA. The format used depends on your swapchain and you should be
-    // able to find the relevant VkFormat somewhere in your code. It is usually extracted from the
-    // SwapChainSupportDetails structure returned by the function querySwapChainSupport.
-
-    // Ok, so two of the most relevant parts here are loadOp and initialLayout. The first one should be
-    // VK_ATTACHMENT_LOAD_OP_LOAD because you want your GUI to be drawn over your main rendering. This tells Vulkan you
-    // don’t want to clear the content of the framebuffer but you want to draw over it instead. Since we’re going to
-    // draw some stuff, we also want initialLayout to be set to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL for optimal
-    // performance. And because this render pass is the last one, we want finalLayout to be set to
-    // VK_IMAGE_LAYOUT_PRESENT_SRC_KHR. This will automatically transition our attachment to the right layout for
-    // presentation.
-    VkAttachmentDescription attachment = {};
-    attachment.format                  = swapchain.image_format;
-    attachment.samples                 = VK_SAMPLE_COUNT_1_BIT;
-    attachment.loadOp                  = VK_ATTACHMENT_LOAD_OP_LOAD;
-    attachment.storeOp                 = VK_ATTACHMENT_STORE_OP_STORE;
-    attachment.stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachment.stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachment.initialLayout           = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    attachment.finalLayout             = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    // Now that we have this VkAttachmentDescription we can create the actual color VkAttachmentReference that our
-    // render pass needs. As we described above, the layout we’re using to draw is
-    // VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL.
-
-    VkAttachmentReference color_attachment = {};
-    color_attachment.attachment            = 0;
-    color_attachment.layout                = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    // We can now create a subpass for our render pass using the previously created attachment. It is obviously a
-    // graphics subpass.
-
-    VkSubpassDescription subpass = {};
-    subpass.pipelineBindPoint    = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments    = &color_attachment;
-
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass          = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass          = 0;
-    dependency.srcStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask       = 0;  // or VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependency.dstAccessMask       = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    VkRenderPassCreateInfo info = {};
-    info.sType                  = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    info.attachmentCount        = 1;
-    info.pAttachments           = &attachment;
-    info.subpassCount           = 1;
-    info.pSubpasses             = &subpass;
-    info.dependencyCount        = 1;
-    info.pDependencies          = &dependency;
-    if (vkCreateRenderPass(device.device, &info, nullptr, &data.imgui_render_pass) != VK_SUCCESS) {
-        throw std::runtime_error("Could not create Dear ImGui's render pass");
+int VulkanImpl::get_swapchain_images(RenderData& data) {
+    auto images = swapchain.get_images();
+    auto views  = swapchain.get_image_views();
+    if (!images || !views) {
+        std::cout << "failed to get swapchain images\n";
+        return -1;
     }
-
+    data.swapchain_images      = images.value();
+    data.swapchain_image_views = views.value();
+    data.extent                = swapchain.extent;
+    data.format                = swapchain.image_format;
     return 0;
 }
 
-int VulkanImpl::create_imgui_command_buffers(RenderData& data) {
-    data.imgui_command_buffers.resize(data.swapchain_image_views.size());
-
-    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
-    commandBufferAllocateInfo.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferAllocateInfo.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferAllocateInfo.commandPool                 = data.command_pool;
-    commandBufferAllocateInfo.commandBufferCount          = data.imgui_command_buffers.size();
-    vkAllocateCommandBuffers(device.device, &commandBufferAllocateInfo, data.imgui_command_buffers.data());
+// The headless stand-in for the swapchain: frames go round robin through ring images that are only
+// ever read back, never presented.
+int VulkanImpl::create_offscreen_targets(RenderData& data) {
+    uint32_t count = std::max(offscreen_ring_size, 1u);
+    data.extent    = offscreen_extent;
+    data.format    = offscreen_format;
+    data.swapchain_images.resize(count, VK_NULL_HANDLE);
+    data.swapchain_image_views.resize(count, VK_NULL_HANDLE);
+    data.offscreen_memory.resize(count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        VkImageCreateInfo info = {};
+        info.sType             = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        info.imageType         = VK_IMAGE_TYPE_2D;
+        info.format            = data.format;
+        info.extent            = {data.extent.width, data.extent.height, 1};
+        info.mipLevels         = 1;
+        info.arrayLayers       = 1;
+        info.samples           = VK_SAMPLE_COUNT_1_BIT;
+        info.tiling            = VK_IMAGE_TILING_OPTIMAL;
+        info.usage             = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        info.sharingMode       = VK_SHARING_MODE_EXCLUSIVE;
+        info.initialLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (allocator.create_image(info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, data.swapchain_images[i],
+                                   data.offscreen_memory[i])) {
+            std::cout << "failed to create offscreen image\n";
+            return -1;
+        }
 
+        VkImageViewCreateInfo view_info           = {};
+        view_info.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image                           = data.swapchain_images[i];
+        view_info.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format                          = data.format;
+        view_info.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.baseMipLevel   = 0;
+        view_info.subresourceRange.levelCount     = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount     = 1;
+        if (vkCreateImageView(device.device, &view_info, nullptr, &data.swapchain_image_views[i]) != VK_SUCCESS) {
+            std::cout << "failed to create offscreen image view\n";
+            return -1;
+        }
+    }
     return 0;
 }
 
-int VulkanImpl::create_imgui_framebuffers(RenderData& data) {
-    data.swapchain_images      = swapchain.get_images().value();
-    data.swapchain_image_views = swapchain.get_image_views().value();
-
-    data.imgui_framebuffers.resize(data.swapchain_image_views.size());
-
-    for (size_t i = 0; i < data.swapchain_image_views.size(); i++) {
-        VkImageView attachments[] = {data.swapchain_image_views[i]};
-
-        VkFramebufferCreateInfo framebuffer_info = {};
-        framebuffer_info.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_info.renderPass              = data.imgui_render_pass;
-        framebuffer_info.attachmentCount         = 1;
-        framebuffer_info.pAttachments            = attachments;
-        framebuffer_info.width                   = swapchain.extent.width;
-        framebuffer_info.height                  = swapchain.extent.height;
-        framebuffer_info.layers                  = 1;
+// The swapchain image is imported each frame in an undefined state and handed back for presentation,
+// the scene pass clears it. Passes added later (the UI) load what the scene left behind. Offscreen
+// images stay in whatever layout the last pass (usually a readback) left them.
+int VulkanImpl::create_render_graph(RenderData& data) {
+    auto& graph = data.graph;
+    graph.init(device.device, &allocator);
+    graph.set_retire([this, &data](std::function<void()> fn) { retire(data, std::move(fn)); });
+    graph.set_extent(data.extent);
+
+    VkImageLayout final_layout = headless ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    RGImageDesc   desc         = {};
+    desc.format                = data.format;
+    data.backbuffer            = graph.import_image("backbuffer", desc, VK_IMAGE_LAYOUT_UNDEFINED, final_layout,
+                                                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    graph.mark_output(data.backbuffer);
+
+    RGPass& scene = graph.add_pass("scene", RGPassType::Raster);
+    scene.write_color(data.backbuffer, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    scene.execute = [&data](RGContext& ctx) {
+        VkViewport viewport = {};
+        viewport.x          = 0.0f;
+        viewport.y          = 0.0f;
+        viewport.width      = (float)ctx.extent.width;
+        viewport.height     = (float)ctx.extent.height;
+        viewport.minDepth   = 0.0f;
+        viewport.maxDepth   = 1.0f;
+
+        VkRect2D scissor = {};
+        scissor.offset   = {0, 0};
+        scissor.extent   = ctx.extent;
+
+        auto prologue = [&](VkCommandBuffer buffer) {
+            vkCmdSetViewport(buffer, 0, 1, &viewport);
+            vkCmdSetScissor(buffer, 0, 1, &scissor);
+            vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, data.graphics_pipeline);
+            data.parent->bindless.bind(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+        };
+
+        if (data.scene_pass->contents == VK_SUBPASS_CONTENTS_INLINE) {
+            prologue(ctx.cmd);
+            if (data.draw_items.empty()) vkCmdDraw(ctx.cmd, 3, 1, 0, 0);
+            for (auto& item : data.draw_items) item(ctx.cmd);
+            return;
+        }
 
-        if (vkCreateFramebuffer(device.device, &framebuffer_info, nullptr, &data.imgui_framebuffers[i]) != VK_SUCCESS) {
-            return -1;  // failed to create framebuffer
+        VkCommandBufferInheritanceInfo inheritance = {};
+        inheritance.sType                          = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance.renderPass                     = ctx.render_pass;
+        inheritance.subpass                        = ctx.subpass;
+        inheritance.framebuffer                    = ctx.framebuffer;
+        if (data.recorder.record(data.current_frame, ctx.cmd, inheritance, prologue, data.draw_items)) {
+            std::cout << "failed to record scene draw items\n";
         }
-    }
-    return 0;
+    };
+    data.scene_pass = &scene;
+
+    return compile_render_graph(data);
 }
 
-int VulkanImpl::create_render_pass(RenderData& data) {
-    VkAttachmentDescription color_attachment = {};
-    color_attachment.format                  = swapchain.image_format;
-    color_attachment.samples                 = VK_SAMPLE_COUNT_1_BIT;
-    color_attachment.loadOp                  = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    color_attachment.storeOp                 = VK_ATTACHMENT_STORE_OP_STORE;
-    color_attachment.stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    color_attachment.stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    color_attachment.initialLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment.finalLayout             = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference color_attachment_ref = {};
-    color_attachment_ref.attachment            = 0;
-    color_attachment_ref.layout                = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass = {};
-    subpass.pipelineBindPoint    = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments    = &color_attachment_ref;
-
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass          = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass          = 0;
-    dependency.srcStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask       = 0;
-    dependency.dstStageMask        = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask       = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    VkRenderPassCreateInfo render_pass_info = {};
-    render_pass_info.sType                  = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_info.attachmentCount        = 1;
-    render_pass_info.pAttachments           = &color_attachment;
-    render_pass_info.subpassCount           = 1;
-    render_pass_info.pSubpasses             = &subpass;
-    render_pass_info.dependencyCount        = 1;
-    render_pass_info.pDependencies          = &dependency;
-
-    if (vkCreateRenderPass(device.device, &render_pass_info, nullptr, &data.render_pass) != VK_SUCCESS) {
-        std::cout << "failed to create render pass\n";
-        return -1;  // failed to create render pass!
+// Passes may only be added while no frame is in flight, the compile destroys transient resources. The
+// scene pipeline follows the render pass of the scene pass, which changes when another pass is merged
+// into it as a subpass.
+int VulkanImpl::compile_render_graph(RenderData& data) {
+    wait_idle();
+    if (data.graph.compile()) {
+        std::cout << "failed to compile render graph\n";
+        return -1;
     }
+    data.graph.dump(std::cout);
+
+    if (data.scene_pass->get_render_pass() == data.pipeline_render_pass) return 0;
+    if (data.graphics_pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device.device, data.graphics_pipeline, nullptr);
+    if (create_graphics_pipeline(data)) return -1;
+    data.pipeline_render_pass = data.scene_pass->get_render_pass();
     return 0;
 }
 
@@ -284,27 +416,18 @@ std::vector<uint32_t> VulkanImpl::readFile(const std::string& filename) {
     return buffer;
 }
 
-VkShaderModule VulkanImpl::createShaderModule(const std::vector<uint32_t>& code) {
-    VkShaderModuleCreateInfo create_info = {};
-
-    create_info.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    create_info.codeSize = code.size() * 4;
-    create_info.pCode    = code.data();
-
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(device.device, &create_info, nullptr, &shaderModule) != VK_SUCCESS) {
-        return VK_NULL_HANDLE;  // failed to create shader module
-    }
-
-    return shaderModule;
+VkShaderModule VulkanImpl::getShaderModule(const std::string& name) {
+    if (auto code = shaders.compiled(name)) return shader_modules.get(*code);
+    if (auto embedded = find_embedded_shader(name))
+        return shader_modules.get(embedded->code, embedded->words, embedded->hash);
+    return shader_modules.get(readFile(name));
 }
 
-int VulkanImpl::create_graphics_pipeline(RenderData& data) {
-    auto vert_code = readFile("vert.spv");
-    auto frag_code = readFile("frag.spv");
+VkShaderModule VulkanImpl::getShaderModule(const std::vector<uint32_t>& code) { return shader_modules.get(code); }
 
-    VkShaderModule vert_module = createShaderModule(vert_code);
-    VkShaderModule frag_module = createShaderModule(frag_code);
+int VulkanImpl::create_graphics_pipeline(RenderData& data) {
+    VkShaderModule vert_module = getShaderModule("vert.spv");
+    VkShaderModule frag_module = getShaderModule("frag.spv");
     if (vert_module == VK_NULL_HANDLE || frag_module == VK_NULL_HANDLE) {
         std::cout << "failed to create shader module\n";
         return -1;  // failed to create shader modules
@@ -341,14 +464,14 @@ int VulkanImpl::create_graphics_pipeline(RenderData& data) {
     VkViewport viewport = {};
     viewport.x          = 0.0f;
     viewport.y          = 0.0f;
-    viewport.width      = (float)swapchain.extent.width;
-    viewport.height     = (float)swapchain.extent.height;
+    viewport.width      = (float)data.extent.width;
+    viewport.height     = (float)data.extent.height;
     viewport.minDepth   = 0.0f;
     viewport.maxDepth   = 1.0f;
 
     VkRect2D scissor = {};
     scissor.offset   = {0, 0};
-    scissor.extent   = swapchain.extent;
+    scissor.extent   = data.extent;
 
     VkPipelineViewportStateCreateInfo viewport_state = {};
 
@@ -392,16 +515,8 @@ int VulkanImpl::create_graphics_pipeline(RenderData& data) {
     color_blending.blendConstants[2] = 0.0f;
     color_blending.blendConstants[3] = 0.0f;
 
-    VkPipelineLayoutCreateInfo pipeline_layout_info = {};
-
-    pipeline_layout_info.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_info.setLayoutCount         = 0;
-    pipeline_layout_info.pushConstantRangeCount = 0;
-
-    if (vkCreatePipelineLayout(device.device, &pipeline_layout_info, nullptr, &data.pipeline_layout) != VK_SUCCESS) {
-        std::cout << "failed to create pipeline layout\n";
-        return -1;  // failed to create pipeline layout
-    }
+    // every pipeline shares the bindless layout, so the set stays bound across pipeline switches
+    data.pipeline_layout = bindless.get_pipeline_layout();
 
     std::vector<VkDynamicState> dynamic_states = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
 
@@ -424,291 +539,381 @@ int VulkanImpl::create_graphics_pipeline(RenderData& data) {
     pipeline_info.pColorBlendState    = &color_blending;
     pipeline_info.pDynamicState       = &dynamic_info;
     pipeline_info.layout              = data.pipeline_layout;
-    pipeline_info.renderPass          = data.render_pass;
-    pipeline_info.subpass             = 0;
+    pipeline_info.renderPass          = data.scene_pass->get_render_pass();
+    pipeline_info.subpass             = data.scene_pass->get_subpass();
     pipeline_info.basePipelineHandle  = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(device.device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &data.graphics_pipeline) !=
-        VK_SUCCESS) {
+    if (pipeline_cache.create_graphics_pipeline(pipeline_info, &data.graphics_pipeline) != VK_SUCCESS) {
         std::cout << "failed to create pipline\n";
         return -1;  // failed to create graphics pipeline
     }
-
-    vkDestroyShaderModule(device.device, frag_module, nullptr);
-    vkDestroyShaderModule(device.device, vert_module, nullptr);
     return 0;
 }
 
-int VulkanImpl::create_framebuffers(RenderData& data) {
-    data.swapchain_images      = swapchain.get_images().value();
-    data.swapchain_image_views = swapchain.get_image_views().value();
-
-    data.framebuffers.resize(data.swapchain_image_views.size());
-
-    for (size_t i = 0; i < data.swapchain_image_views.size(); i++) {
-        VkImageView attachments[] = {data.swapchain_image_views[i]};
-
-        VkFramebufferCreateInfo framebuffer_info = {};
-        framebuffer_info.sType                   = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_info.renderPass              = data.render_pass;
-        framebuffer_info.attachmentCount         = 1;
-        framebuffer_info.pAttachments            = attachments;
-        framebuffer_info.width                   = swapchain.extent.width;
-        framebuffer_info.height                  = swapchain.extent.height;
-        framebuffer_info.layers                  = 1;
-
-        if (vkCreateFramebuffer(device.device, &framebuffer_info, nullptr, &data.framebuffers[i]) != VK_SUCCESS) {
-            return -1;  // failed to create framebuffer
-        }
+// Frames in flight keep drawing with the old pipeline, this frame records with the new one
+int VulkanImpl::reload_graphics_pipeline(RenderData& data) {
+    VkPipeline old = data.graphics_pipeline;
+    if (create_graphics_pipeline(data)) {
+        data.graphics_pipeline = old;
+        return -1;
     }
+    VkDevice device_handle = device.device;
+    retire(data, [device_handle, old] { vkDestroyPipeline(device_handle, old, nullptr); });
     return 0;
 }
 
-int VulkanImpl::create_command_pool(RenderData& data) {
-    VkCommandPoolCreateInfo pool_info = {};
-    pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    pool_info.queueFamilyIndex        = device.get_queue_index(vkb::QueueType::graphics).value();
-    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    if (vkCreateCommandPool(device.device, &pool_info, nullptr, &data.command_pool) != VK_SUCCESS) {
-        std::cout << "failed to create command pool\n";
-        return -1;  // failed to create command pool
+int VulkanImpl::create_frames(RenderData& data) {
+    for (auto& frame : data.frames) {
+        if (frame.create(device.device, data.graphics_queue_family)) return -1;
+    }
+    data.image_in_flight.resize(data.swapchain_images.size(), VK_NULL_HANDLE);
+    data.recorder.create(device.device, data.graphics_queue_family);
+
+    // signaled with the frame serial by every submit, what compute work waits on to use a frame's output
+    VkSemaphoreTypeCreateInfo type_info = {};
+    type_info.sType                     = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType             = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue              = 0;
+
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext                 = &type_info;
+    if (vkCreateSemaphore(device.device, &semaphore_info, nullptr, &data.frame_timeline) != VK_SUCCESS) {
+        std::cout << "failed to create frame timeline semaphore\n";
+        return -1;
     }
+    compute.set_frame_timeline(data.frame_timeline);
     return 0;
 }
 
-int VulkanImpl::create_command_buffers(RenderData& data) {
-    data.command_buffers.resize(data.framebuffers.size());
+// Wait until the GPU has finished with the commands previously submitted from this frame slot, then
+// acquire the swapchain image (or take the next offscreen image) the new frame will render into. This
+// is the only point where the CPU blocks on the GPU, so up to MAX_FRAMES_IN_FLIGHT frames can be queued
+// at once.
+int VulkanImpl::begin_frame(RenderData& data) {
+    if (data.frame_acquired) return 0;
+    auto& frame = data.frame();
 
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool                 = data.command_pool;
-    allocInfo.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount          = (uint32_t)data.command_buffers.size();
+    vkWaitForFences(device.device, 1, &frame.in_flight, VK_TRUE, UINT64_MAX);
+    if (frame.serial > data.frame_stats.retired) data.frame_stats.retired = frame.serial;
+    collect_retired(data);
 
-    if (vkAllocateCommandBuffers(device.device, &allocInfo, data.command_buffers.data()) != VK_SUCCESS) {
-        return -1;  // failed to allocate command buffers;
+    // nothing of this frame is recorded yet, shaders saved since the last frame take effect here
+    shaders.apply();
+
+    if (data.resize_pending && !headless) {
+        if (!data.requested_extent.width || !data.requested_extent.height) return 1;  // minimized
+        if (recreate_swapchain(data)) return -1;
     }
 
+    VkResult result = VK_SUCCESS;
+    if (headless)
+        data.image_index = (uint32_t)(data.frame_stats.submitted % data.swapchain_images.size());
+    else
+        result = vkAcquireNextImageKHR(device.device, swapchain.swapchain, UINT64_MAX, frame.image_available,
+                                       VK_NULL_HANDLE, &data.image_index);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        recreate_swapchain(data);
+        return 1;  // skip this frame, nothing was acquired
+    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+        std::cout << "failed to acquire swapchain image. Error " << result << "\n";
+        return -1;
+    }
+
+    // the image may still be used by an older frame when the swapchain hands images out of order
+    if (data.image_in_flight[data.image_index] != VK_NULL_HANDLE &&
+        data.image_in_flight[data.image_index] != frame.in_flight) {
+        vkWaitForFences(device.device, 1, &data.image_in_flight[data.image_index], VK_TRUE, UINT64_MAX);
+    }
+    data.image_in_flight[data.image_index] = frame.in_flight;
+
+    // the GPU is done with everything recorded from this slot, recycle all of it in one go
+    frame.reset(device.device);
+    data.recorder.reset(data.current_frame);
+
+    data.frame_acquired = true;
     return 0;
 }
 
 int VulkanImpl::begin(RenderData& data) {
-    auto i = data.current_frame;
+    if (begin_frame(data) != 0) return -1;
+
+    auto                     cmd        = data.frame().command_buffer;
     VkCommandBufferBeginInfo begin_info = {};
     begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    if (vkBeginCommandBuffer(data.command_buffers[i], &begin_info) != VK_SUCCESS) {
+    if (vkBeginCommandBuffer(cmd, &begin_info) != VK_SUCCESS) {
         return -1;  // failed to begin recording command buffer
     }
 
-    VkRenderPassBeginInfo render_pass_info = {};
-    render_pass_info.sType                 = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    render_pass_info.renderPass            = data.render_pass;
-    render_pass_info.framebuffer           = data.framebuffers[i];
-    render_pass_info.renderArea.offset     = {0, 0};
-    render_pass_info.renderArea.extent     = swapchain.extent;
-    VkClearValue clearColor{{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    render_pass_info.clearValueCount = 1;
-    render_pass_info.pClearValues    = &clearColor;
+    // take ownership of everything uploaded so far, the submit waits for the transfer queue on the GPU
+    data.frame().transfer_wait = uploader.acquire(cmd);
 
-    VkViewport viewport = {};
-    viewport.x          = 0.0f;
-    viewport.y          = 0.0f;
-    viewport.width      = (float)swapchain.extent.width;
-    viewport.height     = (float)swapchain.extent.height;
-    viewport.minDepth   = 0.0f;
-    viewport.maxDepth   = 1.0f;
-
-    VkRect2D scissor = {};
-    scissor.offset   = {0, 0};
-    scissor.extent   = swapchain.extent;
-
-    vkCmdSetViewport(data.command_buffers[i], 0, 1, &viewport);
-    vkCmdSetScissor(data.command_buffers[i], 0, 1, &scissor);
-
-    vkCmdBeginRenderPass(data.command_buffers[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(data.command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, data.graphics_pipeline);
-    vkCmdDraw(data.command_buffers[i], 3, 1, 0, 0);
+    // slots added since the last frame, written before this frame's submit as update-after-bind allows
+    bindless.flush();
 
+    data.graph.set_image(data.backbuffer, data.swapchain_images[data.image_index],
+                         data.swapchain_image_views[data.image_index]);
+    VkClearValue clear = {};
+    clear.color        = data.clear_color;
+    data.scene_pass->set_clear(data.backbuffer, clear);
     return 0;
 }
 
+// Passes are recorded here, after every module had the chance to fill in its part of the frame
 int VulkanImpl::end(RenderData& data) {
-    auto i = data.current_frame;
-    vkCmdEndRenderPass(data.command_buffers[i]);
+    if (!data.frame_acquired) return -1;
+    auto cmd = data.frame().command_buffer;
+
+    // long draw lists are split over TBB workers into secondary command buffers
+    data.scene_pass->contents = data.draw_items.size() >= data.parallel_threshold
+                                    ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                                    : VK_SUBPASS_CONTENTS_INLINE;
+    if (data.graph.execute(cmd)) {
+        std::cout << "failed to execute render graph\n";
+        return -1;
+    }
 
-    if (vkEndCommandBuffer(data.command_buffers[i]) != VK_SUCCESS) {
+    if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
         std::cout << "failed to record command buffer\n";
         return -1;  // failed to record command buffer!
     }
     return 0;
 }
 
-int VulkanImpl::create_sync_objects(RenderData& data) {
-    data.available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    data.finished_semaphore.resize(MAX_FRAMES_IN_FLIGHT);
-    data.in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
-    data.image_in_flight.resize(swapchain.image_count, VK_NULL_HANDLE);
-
-    VkSemaphoreCreateInfo semaphore_info = {};
-    semaphore_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-    VkFenceCreateInfo fence_info = {};
-    fence_info.sType             = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_info.flags             = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if (vkCreateSemaphore(device.device, &semaphore_info, nullptr, &data.available_semaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(device.device, &semaphore_info, nullptr, &data.finished_semaphore[i]) != VK_SUCCESS ||
-            vkCreateFence(device.device, &fence_info, nullptr, &data.in_flight_fences[i]) != VK_SUCCESS) {
-            std::cout << "failed to create sync objects\n";
-            return -1;  // failed to create synchronization objects for a frame
-        }
-    }
-    return 0;
-}
-
+// Only what depends on the size is rebuilt: swapchain, views and the graph's framebuffers and transients.
+// Nothing waits for the GPU, the old objects are retired once the frames that use them have finished.
 int VulkanImpl::recreate_swapchain(RenderData& data) {
-    vkDeviceWaitIdle(device.device);
-
-    vkDestroyCommandPool(device.device, data.command_pool, nullptr);
-
-    for (auto framebuffer : data.framebuffers) {
-        vkDestroyFramebuffer(device.device, framebuffer, nullptr);
-    }
-
-    swapchain.destroy_image_views(data.swapchain_image_views);
-
-    if (0 != create_swapchain()) return -1;
-    if (0 != create_framebuffers(data)) return -1;
-    if (0 != create_command_pool(data)) return -1;
-    if (0 != create_command_buffers(data)) return -1;
+    vkb::Swapchain           old_swapchain = swapchain;
+    std::vector<VkImageView> old_views     = data.swapchain_image_views;
+
+    if (0 != create_swapchain(data.requested_extent)) return -1;
+    retire(data, [old_swapchain, old_views]() mutable {
+        old_swapchain.destroy_image_views(old_views);
+        vkb::destroy_swapchain(old_swapchain);
+    });
+    if (0 != get_swapchain_images(data)) return -1;
+
+    // fences of frames that rendered into the old images say nothing about the new ones
+    data.image_in_flight.assign(data.swapchain_images.size(), VK_NULL_HANDLE);
+    data.requested_extent = data.extent;
+    data.resize_pending   = false;
+    data.frame_stats.resizes++;
+
+    // framebuffers hold the old views, transients follow the new extent on the next execute
+    data.graph.invalidate_framebuffers();
+    data.graph.set_extent(data.extent);
     return 0;
 }
 
-int VulkanImpl::imgui_begin(RenderData& data) {
-    VkResult                 err;
-    VkCommandBufferBeginInfo binfo = {};
-    binfo.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    // binfo.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    err = vkBeginCommandBuffer(data.imgui_command_buffers[data.current_frame], &binfo);
-
-    VkRenderPassBeginInfo info = {};
-    info.sType                 = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    info.renderPass            = data.imgui_render_pass;
-    info.framebuffer           = data.imgui_framebuffers[data.current_frame];
-    info.renderArea.offset     = {0, 0};
-    info.renderArea.extent     = swapchain.extent;
-    info.clearValueCount       = 1;
-    VkClearValue clearColor{{{0.0f, 0.0f, 0.0f, 1.0f}}};
-    info.pClearValues = &clearColor;
-    vkCmdBeginRenderPass(data.imgui_command_buffers[data.current_frame], &info, VK_SUBPASS_CONTENTS_INLINE);
-    return 0;
+void VulkanImpl::request_resize(RenderData& data, uint32_t width, uint32_t height) {
+    if (!data.resize_pending && width == data.extent.width && height == data.extent.height) return;
+    data.requested_extent = {width, height};
+    data.resize_pending   = true;
 }
 
-int VulkanImpl::imgui_end(RenderData& data) {
-    
-    // Submit command buffer
-    vkCmdEndRenderPass(data.imgui_command_buffers[data.current_frame]);
-    vkEndCommandBuffer(data.imgui_command_buffers[data.current_frame]);
-    return 0;
+void VulkanImpl::retire(RenderData& data, std::function<void()> fn) {
+    data.retiring.emplace_back(data.frame_stats.submitted, std::move(fn));
 }
 
-int VulkanImpl::draw_frame(RenderData& data) {
-    vkWaitForFences(device.device, 1, &data.in_flight_fences[data.current_frame], VK_TRUE, UINT64_MAX);
-
-    uint32_t image_index = 0;
-    VkResult result =
-        vkAcquireNextImageKHR(device.device, swapchain.swapchain, UINT64_MAX,
-                              data.available_semaphores[data.current_frame], VK_NULL_HANDLE, &image_index);
-
-    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-        return recreate_swapchain(data);
-    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-        std::cout << "failed to acquire swapchain image. Error " << result << "\n";
-        return -1;
+// Frames finish in submission order, so everything up to the retired serial is free
+void VulkanImpl::collect_retired(RenderData& data, bool all) {
+    size_t kept = 0;
+    for (auto& entry : data.retiring) {
+        if (all || entry.first <= data.frame_stats.retired)
+            entry.second();
+        else
+            data.retiring[kept++] = std::move(entry);
     }
+    data.retiring.resize(kept);
+}
 
-    if (data.image_in_flight[image_index] != VK_NULL_HANDLE) {
-        vkWaitForFences(device.device, 1, &data.image_in_flight[image_index], VK_TRUE, UINT64_MAX);
-    }
-    data.image_in_flight[image_index] = data.in_flight_fences[data.current_frame];
-
-
-    std::array<VkCommandBuffer, 2> submitCommandBuffers = 
-    { data.command_buffers[image_index], data.imgui_command_buffers[image_index] };
+int VulkanImpl::draw_frame(RenderData& data) {
+    if (!data.frame_acquired) return 0;  // the frame was skipped in begin_frame
+    data.frame_acquired = false;
 
+    auto& frame = data.frame();
 
     VkSubmitInfo submitInfo = {};
     submitInfo.sType        = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore          wait_semaphores[] = {data.available_semaphores[data.current_frame]};
-    VkPipelineStageFlags wait_stages[]     = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount          = 1;
-    submitInfo.pWaitSemaphores             = wait_semaphores;
-    submitInfo.pWaitDstStageMask           = wait_stages;
-
-    submitInfo.commandBufferCount = 2;
-    submitInfo.pCommandBuffers    = submitCommandBuffers.data();
-
-    VkSemaphore signal_semaphores[] = {data.finished_semaphore[data.current_frame]};
-    submitInfo.signalSemaphoreCount = 1;
+    // offscreen images need no acquire, their reuse is ordered by the image_in_flight fences
+    VkSemaphore          wait_semaphores[3];
+    VkPipelineStageFlags wait_stages[3];
+    uint64_t             wait_values[3];  // binary semaphores ignore the value
+    uint32_t             wait_count = 0;
+    if (!headless) {
+        wait_semaphores[wait_count] = frame.image_available;
+        wait_stages[wait_count]     = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        wait_values[wait_count++]   = 0;
+    }
+    if (frame.transfer_wait) {
+        wait_semaphores[wait_count] = uploader.timeline();
+        wait_stages[wait_count]     = VulkanUploader::consumer_stages;
+        wait_values[wait_count++]   = frame.transfer_wait;
+    }
+    if (frame.compute_wait) {
+        wait_semaphores[wait_count] = compute.timeline();
+        wait_stages[wait_count]     = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+                                      VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        wait_values[wait_count++]   = frame.compute_wait;
+        frame.compute_wait          = 0;
+    }
+    submitInfo.waitSemaphoreCount = wait_count;
+    submitInfo.pWaitSemaphores    = wait_semaphores;
+    submitInfo.pWaitDstStageMask  = wait_stages;
+
+    // the frame timeline gets the serial update_frame_stats gives this frame, render_finished is binary
+    uint64_t    serial              = data.frame_stats.submitted + 1;
+    VkSemaphore signal_semaphores[] = {data.frame_timeline, frame.render_finished};
+    uint64_t    signal_values[]     = {serial, 0};
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType                         = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount       = submitInfo.waitSemaphoreCount;
+    timeline_info.pWaitSemaphoreValues          = wait_values;
+    timeline_info.signalSemaphoreValueCount     = headless ? 1 : 2;
+    timeline_info.pSignalSemaphoreValues        = signal_values;
+    submitInfo.pNext                            = &timeline_info;
+
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers    = &frame.command_buffer;
+
+    submitInfo.signalSemaphoreCount = headless ? 1 : 2;
     submitInfo.pSignalSemaphores    = signal_semaphores;
 
-    vkResetFences(device.device, 1, &data.in_flight_fences[data.current_frame]);
+    vkResetFences(device.device, 1, &frame.in_flight);
 
-    if (vkQueueSubmit(data.graphics_queue, 1, &submitInfo, data.in_flight_fences[data.current_frame]) != VK_SUCCESS) {
+    std::unique_lock<std::mutex> queue_lock(queue_mutex);
+    if (vkQueueSubmit(data.graphics_queue, 1, &submitInfo, frame.in_flight) != VK_SUCCESS) {
         std::cout << "failed to submit draw command buffer\n";
         return -1;  //"failed to submit draw command buffer
     }
+    queue_lock.unlock();
+    update_frame_stats(data);
 
-    vkDeviceWaitIdle(device.device);
+    if (headless) {
+        data.current_frame = (data.current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+        return 0;
+    }
 
     VkPresentInfoKHR present_info = {};
     present_info.sType            = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
     present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores    = signal_semaphores;
+    present_info.pWaitSemaphores    = &frame.render_finished;
 
     VkSwapchainKHR swapChains[] = {swapchain.swapchain};
     present_info.swapchainCount = 1;
     present_info.pSwapchains    = swapChains;
 
-    present_info.pImageIndices = &image_index;
+    present_info.pImageIndices = &data.image_index;
 
-    result = vkQueuePresentKHR(data.present_queue, &present_info);
+    data.current_frame = (data.current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+    queue_lock.lock();
+    VkResult result = vkQueuePresentKHR(data.present_queue, &present_info);
+    queue_lock.unlock();
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-        return recreate_swapchain(data);
+        data.resize_pending = true;  // recreated by the next begin_frame, together with any window resize
     } else if (result != VK_SUCCESS) {
         std::cout << "failed to present swapchain image\n";
         return -1;
     }
-
-    data.current_frame = (data.current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
     return 0;
 }
 
-void VulkanImpl::cleanup(RenderData& data) {
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(device.device, data.finished_semaphore[i], nullptr);
-        vkDestroySemaphore(device.device, data.available_semaphores[i], nullptr);
-        vkDestroyFence(device.device, data.in_flight_fences[i], nullptr);
-    }
+void VulkanImpl::wait_compute(RenderData& data, ComputeToken token) {
+    auto& frame = data.frame();
+    if (token.value > frame.compute_wait) frame.compute_wait = token.value;
+}
 
-    vkDestroyCommandPool(device.device, data.command_pool, nullptr);
+void VulkanImpl::wait_idle() {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    vkDeviceWaitIdle(device.device);
+}
 
-    for (auto framebuffer : data.framebuffers) {
-        vkDestroyFramebuffer(device.device, framebuffer, nullptr);
+// Called right after a submit: every other frame slot whose fence is still unsignaled is a frame the GPU
+// has not finished yet, so the CPU is running ahead of it.
+void VulkanImpl::update_frame_stats(RenderData& data) {
+    auto& stats         = data.frame_stats;
+    data.frame().serial = ++stats.submitted;
+
+    uint32_t in_flight = 1;
+    for (size_t s = 0; s < MAX_FRAMES_IN_FLIGHT; s++) {
+        auto& other = data.frames[s];
+        if (s == data.current_frame || other.serial <= stats.retired) continue;
+        if (vkGetFenceStatus(device.device, other.in_flight) == VK_NOT_READY)
+            in_flight++;
+        else
+            stats.retired = other.serial;
     }
+    stats.latency = in_flight;
+    if (in_flight > stats.max_latency) stats.max_latency = in_flight;
+    if (in_flight > 1) stats.overlapped++;
+}
+
+void VulkanImpl::cleanup(RenderData& data) {
+    shaders.stop();
+    wait_idle();
+
+    auto& stats = data.frame_stats;
+    std::cout << "frames submitted: " << stats.submitted << ", max frames in flight: " << stats.max_latency
+              << ", overlapped submits: " << stats.overlapped << " (" << stats.overlapRatio() * 100.0 << "%)\n";
+
+    pipeline_cache.report(std::cout);
+    pipeline_cache.save();
+    pipeline_cache.destroy();
+
+    auto module_stats = shader_modules.get_stats();
+    std::cout << "shader modules: " << module_stats.modules << " for " << module_stats.hits + module_stats.misses
+              << " pipeline stages\n";
+    shader_modules.destroy();
+
+    collect_retired(data, true);
+
+    for (auto& frame : data.frames) frame.destroy(device.device);
+    data.recorder.destroy();
+
+    auto& compute_stats = compute.stats;
+    std::cout << "compute: " << compute_stats.dispatches << " dispatches in " << compute_stats.batches << " batches on "
+              << (compute.is_async() ? "an async" : "the graphics") << " queue, " << compute_stats.frame_waits
+              << " waited on a frame\n";
+    compute.destroy();
+    vkDestroySemaphore(device.device, data.frame_timeline, nullptr);
+
+    data.graph.destroy();
 
     vkDestroyPipeline(device.device, data.graphics_pipeline, nullptr);
-    vkDestroyPipelineLayout(device.device, data.pipeline_layout, nullptr);
-    vkDestroyRenderPass(device.device, data.render_pass, nullptr);
 
-    swapchain.destroy_image_views(data.swapchain_image_views);
+    if (headless) {
+        for (size_t i = 0; i < data.swapchain_images.size(); i++) {
+            vkDestroyImageView(device.device, data.swapchain_image_views[i], nullptr);
+            allocator.destroy_image(data.swapchain_images[i], data.offscreen_memory[i]);
+        }
+    } else {
+        swapchain.destroy_image_views(data.swapchain_image_views);
+    }
+
+    vkDestroyDescriptorPool(device.device, descriptor_pool, nullptr);
+
+    auto bindless_stats = bindless.get_stats();
+    std::cout << "bindless: " << bindless_stats.writes << " descriptor writes in " << bindless_stats.flushes
+              << " flushes, " << bindless_stats.full << " adds failed on a full array\n";
+    bindless.destroy();
+
+    auto& uploads = uploader.stats;
+    std::cout << "uploads: " << uploads.copies << " copies, " << (uploads.bytes >> 10) << " KB in " << uploads.batches
+              << " batches, " << (uploads.overflow >> 10) << " KB outside the staging ring, " << uploads.ring_stalls
+              << " ring stalls\n";
+    uploader.destroy();
+
+    allocator.dump_stats(std::cout);
+    allocator.destroy();
 
-    vkb::destroy_swapchain(swapchain);
+    if (!headless) vkb::destroy_swapchain(swapchain);
     vkb::destroy_device(device);
     vkDestroySurfaceKHR(instance.instance, surface, nullptr);
     vkb::destroy_instance(instance);
@@ -0,0 +1,438 @@
+#include "fl/render/VulkanMeshletCull.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/render/VulkanModel.hpp"
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+// Layouts shared with shader/meshlet.glsl, std430
+struct MeshletNode {
+    glm::mat4 transform;
+    uint32_t  submesh;
+    uint32_t  pad[3];
+};
+
+struct MeshletFrame {
+    glm::mat4 view_projection;
+    glm::vec4 planes[6];
+    glm::vec4 camera;
+    uint32_t  instance_count;
+    uint32_t  cluster_count;
+    uint32_t  flags;
+    uint32_t  max_draws;
+    // followed by instance_count transforms
+};
+
+// Push constants of shader/meshlet_cull.glsl and shader/meshlet_vert.glsl
+struct MeshletConstants {
+    uint32_t frame;
+    uint32_t vertices;
+    uint32_t submeshes;
+    uint32_t meshlets;
+    uint32_t nodes;
+    uint32_t clusters;
+    uint32_t draws;
+    uint32_t visible;
+    uint32_t counts;
+};
+
+static_assert(sizeof(MeshletConstants) <= VulkanBindless::push_constant_size, "meshlet constants too large");
+static_assert(sizeof(MeshletNode) == 80 && sizeof(MeshletFrame) == 192, "std430 layouts");
+static_assert(sizeof(ModelSubmesh) == 15 * sizeof(uint32_t), "shader/meshlet.glsl reads submeshes as 15 words");
+
+static const uint32_t meshlet_group_size = 64;
+static const uint32_t flag_culling       = 1;
+static const uint32_t flag_cone_culling  = 2;
+static const uint32_t flag_show_meshlets = 4;
+
+int VulkanMeshletCull::create(VulkanImpl* impl, RenderData* data, const VulkanModel& model, const ModelView& view,
+                              uint32_t max_instances) {
+    this->impl          = impl;
+    this->data          = data;
+    this->model         = &model;
+    this->max_instances = std::max(max_instances, 1u);
+    set_view(glm::mat4(1.0f), glm::vec3(0.0f));
+
+    // a cluster is a meshlet placed by a node, in node order
+    std::vector<MeshletNode> nodes(view.node_count);
+    std::vector<glm::uvec2>  clusters;
+    for (uint32_t n = 0; n < view.node_count; n++) {
+        const ModelSubmesh& submesh = view.submeshes[view.nodes[n].submesh];
+        nodes[n]                    = {view.nodes[n].transform, view.nodes[n].submesh, {0, 0, 0}};
+        for (uint32_t m = 0; m < submesh.meshlet_count; m++) clusters.push_back({submesh.first_meshlet + m, n});
+    }
+    cluster_count  = (uint32_t)clusters.size();
+    stats.clusters = cluster_count;
+    if (!cluster_count) std::cout << "model has no meshlets to draw\n";
+
+    const VkBufferUsageFlags storage   = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    const VkDeviceSize       max_draws = (VkDeviceSize)std::max(cluster_count, 1u) * this->max_instances;
+    if (create_buffer(node_buffer, std::max<size_t>(nodes.size(), 1) * sizeof(MeshletNode), storage) ||
+        create_buffer(cluster_buffer, std::max<size_t>(clusters.size(), 1) * sizeof(glm::uvec2), storage) ||
+        create_buffer(draw_buffer, max_draws * sizeof(VkDrawIndexedIndirectCommand),
+                      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) ||
+        create_buffer(visible_buffer, max_draws * sizeof(glm::uvec2), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) ||
+        create_buffer(count_buffer, sizeof(uint32_t), storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT)) {
+        return -1;
+    }
+    for (auto& frame : frames) {
+        VkDeviceSize size = sizeof(MeshletFrame) + (VkDeviceSize)this->max_instances * sizeof(glm::mat4);
+        if (create_buffer(frame, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true)) return -1;
+    }
+
+    // the shaders reach every buffer through the bindless set
+    std::vector<Buffer*> bound = {&node_buffer, &cluster_buffer, &draw_buffer, &visible_buffer, &count_buffer};
+    for (auto& frame : frames) bound.push_back(&frame);
+    for (Buffer* buffer : bound) {
+        buffer->handle = impl->bindless.add_buffer(buffer->buffer);
+        if (buffer->handle == BINDLESS_INVALID) {
+            std::cout << "failed to add meshlet buffers to the bindless set\n";
+            return -1;
+        }
+    }
+
+    auto& uploader = impl->uploader;
+    bool  uploaded = true;
+    if (!nodes.empty()) {
+        UploadToken token =
+            uploader.upload_buffer(node_buffer.buffer, 0, nodes.data(), nodes.size() * sizeof(MeshletNode));
+        uploaded = token.value != 0;
+    }
+    if (uploaded && !clusters.empty()) {
+        UploadToken token =
+            uploader.upload_buffer(cluster_buffer.buffer, 0, clusters.data(), clusters.size() * sizeof(glm::uvec2));
+        uploaded = token.value != 0;
+    }
+    if (!uploaded) {
+        // destroy() forgets the acquire barriers, once the copies that were staged have finished
+        uploader.wait(uploader.flush());
+        std::cout << "failed to upload meshlet clusters\n";
+        return -1;
+    }
+    uploader.flush();
+    // uploads are acquired when a frame begins, the model's were flushed before ours
+    ready = data->frame_stats.submitted + (data->frame_acquired ? 2 : 1);
+
+    if (create_cull_pipeline()) return -1;
+
+    // with hot reload on, saving the shaders rebuilds the pipelines, the draw one lazily as before
+    if (impl->shaders.running()) {
+        std::vector<ShaderSource> cull_sources = {{"meshlet_cull.glsl", "compute", "meshlet_cull.spv"}};
+        std::vector<ShaderSource> draw_sources = {{"meshlet_vert.glsl", "vertex", "meshlet_vert.spv"},
+                                                  {"meshlet_frag.glsl", "fragment", "meshlet_frag.spv"}};
+        cull_watch = impl->shaders.watch(cull_sources, [this] {
+            return reload_pipeline(cull_pipeline, &VulkanMeshletCull::create_cull_pipeline);
+        });
+        draw_watch = impl->shaders.watch(draw_sources, [this] {
+            return reload_pipeline(draw_pipeline, &VulkanMeshletCull::create_draw_pipeline);
+        });
+    }
+
+    // Same arrangement as the gpu scene: the cull pass writes the draws in front of the scene pass
+    auto&      graph   = data->graph;
+    RGResource draws   = graph.import_buffer("meshlet_draws", draw_buffer.buffer, draw_buffer.size);
+    RGResource visible = graph.import_buffer("meshlet_visible", visible_buffer.buffer, visible_buffer.size);
+    RGResource counts  = graph.import_buffer("meshlet_draw_count", count_buffer.buffer, count_buffer.size);
+
+    cull_pass = &graph.add_pass_before("meshlet_cull", RGPassType::Compute, "scene");
+    cull_pass->write_buffer(counts, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    cull_pass->write_buffer(draws, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    cull_pass->write_buffer(visible, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    cull_pass->execute = [this](RGContext& ctx) { record_cull(ctx.cmd); };
+
+    RGPass* scene = data->scene_pass;
+    scene->read_buffer(draws, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    scene->read_buffer(counts, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    scene->read_buffer(visible, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+    data->draw_items.push_back([this](VkCommandBuffer cmd) { record_draws(cmd); });
+
+    return impl->compile_render_graph(*data);
+}
+
+void VulkanMeshletCull::destroy() {
+    if (!impl) return;
+    VkDevice device = impl->device.device;
+    impl->wait_idle();
+
+    for (uint32_t* watch : {&cull_watch, &draw_watch}) {
+        if (*watch != ~0u) impl->shaders.unwatch(*watch);
+        *watch = ~0u;
+    }
+    for (VkPipeline* pipeline : {&cull_pipeline, &draw_pipeline}) {
+        if (*pipeline != VK_NULL_HANDLE) vkDestroyPipeline(device, *pipeline, nullptr);
+        *pipeline = VK_NULL_HANDLE;
+    }
+    for (Buffer* buffer : {&node_buffer, &cluster_buffer, &draw_buffer, &visible_buffer, &count_buffer}) {
+        destroy_buffer(*buffer);
+    }
+    for (auto& frame : frames) destroy_buffer(frame);
+    impl  = nullptr;
+    model = nullptr;
+}
+
+int VulkanMeshletCull::create_buffer(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool host_visible) {
+    VkBufferCreateInfo info = {};
+    info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size               = size;
+    info.usage              = usage;
+    info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkMemoryPropertyFlags required = host_visible
+                                         ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                         : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    if (impl->allocator.create_buffer(info, required, buffer.buffer, buffer.allocation)) {
+        std::cout << "failed to create meshlet buffer\n";
+        return -1;
+    }
+    buffer.size = size;
+    return 0;
+}
+
+void VulkanMeshletCull::destroy_buffer(Buffer& buffer) {
+    if (buffer.handle != BINDLESS_INVALID) impl->bindless.remove_buffer(buffer.handle);
+    if (buffer.buffer != VK_NULL_HANDLE) {
+        impl->uploader.forget(buffer.buffer);
+        impl->allocator.destroy_buffer(buffer.buffer, buffer.allocation);
+    }
+    buffer = Buffer();
+}
+
+int VulkanMeshletCull::create_cull_pipeline() {
+    VkShaderModule module = impl->getShaderModule("meshlet_cull.spv");
+    if (module == VK_NULL_HANDLE) {
+        std::cout << "failed to create shader module\n";
+        return -1;
+    }
+
+    VkComputePipelineCreateInfo info = {};
+    info.sType                       = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    info.stage.sType                 = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    info.stage.stage                 = VK_SHADER_STAGE_COMPUTE_BIT;
+    info.stage.module                = module;
+    info.stage.pName                 = "main";
+    info.layout                      = impl->bindless.get_pipeline_layout();
+
+    if (impl->pipeline_cache.create_compute_pipeline(info, &cull_pipeline) != VK_SUCCESS) {
+        std::cout << "failed to create meshlet cull pipeline\n";
+        return -1;
+    }
+    return 0;
+}
+
+// Like the gpu scene's material pipelines: vertices come from the bindless set, both windings are drawn
+// since mirroring nodes are common in imported files, the cone test already dropped what faces away
+int VulkanMeshletCull::create_draw_pipeline() {
+    VkShaderModule vert_module = impl->getShaderModule("meshlet_vert.spv");
+    VkShaderModule frag_module = impl->getShaderModule("meshlet_frag.spv");
+    if (vert_module == VK_NULL_HANDLE || frag_module == VK_NULL_HANDLE) {
+        std::cout << "failed to create shader module\n";
+        return -1;
+    }
+
+    VkPipelineShaderStageCreateInfo stages[2] = {};
+    stages[0].sType                           = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage                           = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module                          = vert_module;
+    stages[0].pName                           = "main";
+    stages[1].sType                           = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage                           = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module                          = frag_module;
+    stages[1].pName                           = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertex_input = {};
+    vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+    input_assembly.sType    = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewport_state = {};
+    viewport_state.sType                             = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount                     = 1;
+    viewport_state.scissorCount                      = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {};
+    rasterizer.sType                                  = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode                            = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth                              = 1.0f;
+    rasterizer.cullMode                               = VK_CULL_MODE_NONE;
+    rasterizer.frontFace                              = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {};
+    multisampling.sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState blend = {};
+    blend.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo color_blending = {};
+    color_blending.sType                               = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.attachmentCount                     = 1;
+    color_blending.pAttachments                        = &blend;
+
+    VkDynamicState                   dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_info     = {};
+    dynamic_info.sType                                = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_info.dynamicStateCount                    = 2;
+    dynamic_info.pDynamicStates                       = dynamic_states;
+
+    VkGraphicsPipelineCreateInfo info = {};
+    info.sType                        = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    info.stageCount                   = 2;
+    info.pStages                      = stages;
+    info.pVertexInputState            = &vertex_input;
+    info.pInputAssemblyState          = &input_assembly;
+    info.pViewportState               = &viewport_state;
+    info.pRasterizationState          = &rasterizer;
+    info.pMultisampleState            = &multisampling;
+    info.pColorBlendState             = &color_blending;
+    info.pDynamicState                = &dynamic_info;
+    info.layout                       = impl->bindless.get_pipeline_layout();
+    info.renderPass                   = data->scene_pass->get_render_pass();
+    info.subpass                      = data->scene_pass->get_subpass();
+
+    if (impl->pipeline_cache.create_graphics_pipeline(info, &draw_pipeline) != VK_SUCCESS) {
+        std::cout << "failed to create meshlet pipeline\n";
+        draw_pipeline = VK_NULL_HANDLE;
+        return -1;
+    }
+    return 0;
+}
+
+void VulkanMeshletCull::set_instances(const glm::mat4* transforms, uint32_t count) {
+    if (count > max_instances) {
+        std::cout << "too many meshlet instances, drawing the first " << max_instances << "\n";
+        count = max_instances;
+    }
+    this->transforms.assign(transforms, transforms + count);
+    stats.instances = count;
+}
+
+// Gribb-Hartmann, as VulkanGpuScene::set_view_projection
+void VulkanMeshletCull::set_view(const glm::mat4& view_projection, const glm::vec3& camera) {
+    this->view_projection = view_projection;
+    this->camera          = camera;
+
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+    }
+    planes[0] = row[3] + row[0];
+    planes[1] = row[3] - row[0];
+    planes[2] = row[3] + row[1];
+    planes[3] = row[3] - row[1];
+    planes[4] = row[2];
+    planes[5] = row[3] - row[2];
+    for (auto& plane : planes) {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.0f) plane /= length;
+    }
+}
+
+// The view and transforms go straight into this frame's host buffer, the previous user of it has retired
+void VulkanMeshletCull::record_cull(VkCommandBuffer cmd) {
+    stats.frames++;
+    stats.work_items = 0;
+    if (update_pipeline()) std::cout << "failed to create meshlet pipeline\n";
+    vkCmdFillBuffer(cmd, count_buffer.buffer, 0, count_buffer.size, 0);
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+    if (transforms.empty() || !cluster_count || data->frame_stats.submitted + 1 < ready) return;
+
+    Buffer&  buffer = frames[data->current_frame];
+    uint8_t* mapped = (uint8_t*)buffer.allocation.mapped;
+
+    MeshletFrame frame    = {};
+    frame.view_projection = view_projection;
+    frame.camera          = glm::vec4(camera, 1.0f);
+    frame.instance_count  = (uint32_t)transforms.size();
+    frame.cluster_count   = cluster_count;
+    frame.flags           = (culling ? flag_culling : 0) | (cone_culling ? flag_cone_culling : 0) |
+                            (show_meshlets ? flag_show_meshlets : 0);
+    frame.max_draws       = (uint32_t)(draw_buffer.size / sizeof(VkDrawIndexedIndirectCommand));
+    for (int i = 0; i < 6; i++) frame.planes[i] = planes[i];
+    memcpy(mapped, &frame, sizeof(frame));
+    memcpy(mapped + sizeof(frame), transforms.data(), transforms.size() * sizeof(glm::mat4));
+
+    MeshletConstants constants = {};
+    constants.frame            = buffer.handle;
+    constants.submeshes        = model->submesh_handle();
+    constants.meshlets         = model->meshlet_handle();
+    constants.nodes            = node_buffer.handle;
+    constants.clusters         = cluster_buffer.handle;
+    constants.draws            = draw_buffer.handle;
+    constants.visible          = visible_buffer.handle;
+    constants.counts           = count_buffer.handle;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+    impl->bindless.bind(cmd, VK_PIPELINE_BIND_POINT_COMPUTE);
+    vkCmdPushConstants(cmd, impl->bindless.get_pipeline_layout(), VK_SHADER_STAGE_ALL, 0, sizeof(constants),
+                       &constants);
+    vkCmdDispatch(cmd, (cluster_count + meshlet_group_size - 1) / meshlet_group_size, frame.instance_count, 1);
+    stats.work_items = (uint64_t)cluster_count * frame.instance_count;
+}
+
+// The draw pipeline follows the render pass of the scene pass. Called by the cull pass, draw items may
+// be recorded on other threads.
+int VulkanMeshletCull::update_pipeline() {
+    VkRenderPass render_pass = data->scene_pass->get_render_pass();
+    if (render_pass != pipeline_render_pass) {
+        if (draw_pipeline != VK_NULL_HANDLE) {
+            VkDevice   device = impl->device.device;
+            VkPipeline old    = draw_pipeline;
+            impl->retire(*data, [device, old]() { vkDestroyPipeline(device, old, nullptr); });
+            draw_pipeline = VK_NULL_HANDLE;
+        }
+        pipeline_render_pass = render_pass;
+    }
+    return draw_pipeline == VK_NULL_HANDLE ? create_draw_pipeline() : 0;
+}
+
+// Hot reload: the old pipeline is kept when the new one fails, retired once it exists
+int VulkanMeshletCull::reload_pipeline(VkPipeline& pipeline, int (VulkanMeshletCull::*create)()) {
+    VkPipeline old = pipeline;
+    if (old == VK_NULL_HANDLE) return 0;  // not built yet, it will be from the new SPIR-V
+    pipeline = VK_NULL_HANDLE;
+    if ((this->*create)()) {
+        pipeline = old;
+        return -1;
+    }
+    VkDevice device = impl->device.device;
+    impl->retire(*data, [device, old]() { vkDestroyPipeline(device, old, nullptr); });
+    return 0;
+}
+
+// One indirect draw for every surviving cluster of every instance, the count is what the cull pass wrote
+void VulkanMeshletCull::record_draws(VkCommandBuffer cmd) {
+    if (!stats.work_items || draw_pipeline == VK_NULL_HANDLE) return;
+
+    MeshletConstants constants = {};
+    constants.frame            = frames[data->current_frame].handle;
+    constants.vertices         = model->vertex_handle();
+    constants.submeshes        = model->submesh_handle();
+    constants.meshlets         = model->meshlet_handle();
+    constants.nodes            = node_buffer.handle;
+    constants.clusters         = cluster_buffer.handle;
+    constants.visible          = visible_buffer.handle;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw_pipeline);
+    vkCmdPushConstants(cmd, impl->bindless.get_pipeline_layout(), VK_SHADER_STAGE_ALL, 0, sizeof(constants),
+                       &constants);
+    vkCmdBindIndexBuffer(cmd, model->indices(), 0, model->index_type());
+    vkCmdDrawIndexedIndirectCount(cmd, draw_buffer.buffer, 0, count_buffer.buffer, 0,
+                                  (uint32_t)(draw_buffer.size / sizeof(VkDrawIndexedIndirectCommand)),
+                                  sizeof(VkDrawIndexedIndirectCommand));
+}
+
+}  // namespace fl
@@ -0,0 +1,67 @@
+#include "fl/render/VulkanModel.hpp"
+
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+int VulkanModel::create(VulkanImpl* impl, const ModelView& model) {
+    this->impl = impl;
+    index_size = model.index_size;
+
+    const VkBufferUsageFlags storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (create_buffer(vertex_buffer, model.vertices, (VkDeviceSize)model.vertex_count * sizeof(ModelVertex),
+                      storage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) ||
+        create_buffer(index_buffer, model.indices, (VkDeviceSize)model.index_count * model.index_size,
+                      storage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT) ||
+        create_buffer(submesh_buffer, model.submeshes, (VkDeviceSize)model.submesh_count * sizeof(ModelSubmesh),
+                      storage) ||
+        create_buffer(meshlet_buffer, model.meshlets, (VkDeviceSize)model.meshlet_count * sizeof(ModelMeshlet),
+                      storage)) {
+        impl->uploader.wait(impl->uploader.flush());  // copies already recorded must not outlive the buffers
+        destroy();
+        return -1;
+    }
+    token = impl->uploader.flush();
+    return 0;
+}
+
+void VulkanModel::destroy() {
+    if (!impl) return;
+    for (Buffer* buffer : {&vertex_buffer, &index_buffer, &submesh_buffer, &meshlet_buffer}) destroy_buffer(*buffer);
+    impl = nullptr;
+}
+
+int VulkanModel::create_buffer(Buffer& buffer, const void* data, VkDeviceSize size, VkBufferUsageFlags usage) {
+    VkBufferCreateInfo info = {};
+    info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size               = size ? size : 4;  // an empty model still gets valid buffers
+    info.usage              = usage;
+    info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (impl->allocator.create_buffer(info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer.buffer, buffer.allocation)) {
+        std::cout << "failed to create model buffer\n";
+        return -1;
+    }
+    buffer.handle = impl->bindless.add_buffer(buffer.buffer);
+    if (buffer.handle == BINDLESS_INVALID) {
+        std::cout << "failed to add model buffer to the bindless set\n";
+        return -1;
+    }
+    if (size && !impl->uploader.upload_buffer(buffer.buffer, 0, data, size).value) {
+        std::cout << "failed to upload model buffer\n";
+        return -1;
+    }
+    return 0;
+}
+
+void VulkanModel::destroy_buffer(Buffer& buffer) {
+    if (buffer.handle != BINDLESS_INVALID) impl->bindless.remove_buffer(buffer.handle);
+    if (buffer.buffer != VK_NULL_HANDLE) {
+        impl->uploader.forget(buffer.buffer);
+        impl->allocator.destroy_buffer(buffer.buffer, buffer.allocation);
+    }
+    buffer = Buffer();
+}
+
+}  // namespace fl
@@ -0,0 +1,179 @@
+#include "fl/render/VulkanPipelineCache.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+int VulkanPipelineCache::load(VkDevice device, VkPhysicalDevice physical_device, const std::string& path,
+                              bool creation_feedback) {
+    this->device   = device;
+    this->path     = path;
+    this->feedback = creation_feedback;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    std::vector<char> blob;
+    std::ifstream     file(path, std::ios::ate | std::ios::binary);
+    if (file.is_open()) {
+        blob.resize((size_t)file.tellg());
+        file.seekg(0);
+        file.read(blob.data(), static_cast<std::streamsize>(blob.size()));
+        if (!file || !validate_header(blob.data(), blob.size())) {
+            std::cout << "pipeline cache " << path << " is stale or broken, starting with an empty cache\n";
+            blob.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo info = {};
+    info.sType                     = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.initialDataSize           = blob.size();
+    info.pInitialData              = blob.empty() ? nullptr : blob.data();
+    if (vkCreatePipelineCache(device, &info, nullptr, &cache) != VK_SUCCESS) {
+        std::cout << "failed to create pipeline cache\n";
+        return -1;
+    }
+    stat.loaded_bytes = blob.size();
+    return 0;
+}
+
+// The blob starts with a VkPipelineCacheHeaderVersionOne, a cache from another driver or GPU is useless
+bool VulkanPipelineCache::validate_header(const char* blob, size_t size) const {
+    if (size < 32) return false;
+
+    uint32_t header_size, header_version, vendor_id, device_id;
+    std::memcpy(&header_size, blob + 0, 4);
+    std::memcpy(&header_version, blob + 4, 4);
+    std::memcpy(&vendor_id, blob + 8, 4);
+    std::memcpy(&device_id, blob + 12, 4);
+
+    if (header_size < 32 || header_size > size) return false;
+    if (header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) return false;
+    if (vendor_id != properties.vendorID || device_id != properties.deviceID) return false;
+    return std::memcmp(blob + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+int VulkanPipelineCache::save() {
+    if (cache == VK_NULL_HANDLE || path.empty()) return -1;
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS) return -1;
+    std::vector<char> blob(size);
+    if (vkGetPipelineCacheData(device, cache, &size, blob.data()) != VK_SUCCESS) return -1;
+
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(blob.data(), static_cast<std::streamsize>(size));
+        if (!file) {
+            std::cout << "failed to write pipeline cache " << tmp_path << "\n";
+            return -1;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec) {
+        std::cout << "failed to replace pipeline cache " << path << ": " << ec.message() << "\n";
+        std::filesystem::remove(tmp_path, ec);
+        return -1;
+    }
+    return 0;
+}
+
+void VulkanPipelineCache::destroy() {
+    if (cache != VK_NULL_HANDLE) vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+}
+
+VkResult VulkanPipelineCache::create_graphics_pipeline(const VkGraphicsPipelineCreateInfo& info,
+                                                       VkPipeline*                         pipeline) {
+    VkGraphicsPipelineCreateInfo               create_info = info;
+    VkPipelineCreationFeedbackEXT              result      = {};
+    std::vector<VkPipelineCreationFeedbackEXT> stages(info.stageCount);
+
+    VkPipelineCreationFeedbackCreateInfoEXT feedback_info = {};
+    feedback_info.sType                              = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+    feedback_info.pNext                              = info.pNext;
+    feedback_info.pPipelineCreationFeedback          = &result;
+    feedback_info.pipelineStageCreationFeedbackCount = info.stageCount;
+    feedback_info.pPipelineStageCreationFeedbacks    = stages.data();
+    if (feedback) create_info.pNext = &feedback_info;
+
+    auto     start = std::chrono::steady_clock::now();
+    VkResult err   = vkCreateGraphicsPipelines(device, cache, 1, &create_info, nullptr, pipeline);
+    auto     end   = std::chrono::steady_clock::now();
+    if (err == VK_SUCCESS) record(result, std::chrono::duration<double, std::milli>(end - start).count());
+    return err;
+}
+
+VkResult VulkanPipelineCache::create_compute_pipeline(const VkComputePipelineCreateInfo& info,
+                                                      VkPipeline*                        pipeline) {
+    VkComputePipelineCreateInfo   create_info = info;
+    VkPipelineCreationFeedbackEXT result      = {};
+    VkPipelineCreationFeedbackEXT stage       = {};
+
+    VkPipelineCreationFeedbackCreateInfoEXT feedback_info = {};
+    feedback_info.sType                              = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+    feedback_info.pNext                              = info.pNext;
+    feedback_info.pPipelineCreationFeedback          = &result;
+    feedback_info.pipelineStageCreationFeedbackCount = 1;
+    feedback_info.pPipelineStageCreationFeedbacks    = &stage;
+    if (feedback) create_info.pNext = &feedback_info;
+
+    auto     start = std::chrono::steady_clock::now();
+    VkResult err   = vkCreateComputePipelines(device, cache, 1, &create_info, nullptr, pipeline);
+    auto     end   = std::chrono::steady_clock::now();
+    if (err == VK_SUCCESS) record(result, std::chrono::duration<double, std::milli>(end - start).count());
+    return err;
+}
+
+// The entry point comes from VK_KHR_ray_tracing_pipeline, which the loader does not export
+VkResult VulkanPipelineCache::create_ray_tracing_pipeline(PFN_vkCreateRayTracingPipelinesKHR       create,
+                                                          const VkRayTracingPipelineCreateInfoKHR& info,
+                                                          VkPipeline*                              pipeline) {
+    VkRayTracingPipelineCreateInfoKHR          create_info = info;
+    VkPipelineCreationFeedbackEXT              result      = {};
+    std::vector<VkPipelineCreationFeedbackEXT> stages(info.stageCount);
+
+    VkPipelineCreationFeedbackCreateInfoEXT feedback_info = {};
+    feedback_info.sType                              = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+    feedback_info.pNext                              = info.pNext;
+    feedback_info.pPipelineCreationFeedback          = &result;
+    feedback_info.pipelineStageCreationFeedbackCount = info.stageCount;
+    feedback_info.pPipelineStageCreationFeedbacks    = stages.data();
+    if (feedback) create_info.pNext = &feedback_info;
+
+    auto     start = std::chrono::steady_clock::now();
+    VkResult err   = create(device, VK_NULL_HANDLE, cache, 1, &create_info, nullptr, pipeline);
+    auto     end   = std::chrono::steady_clock::now();
+    if (err == VK_SUCCESS) record(result, std::chrono::duration<double, std::milli>(end - start).count());
+    return err;
+}
+
+void VulkanPipelineCache::record(const VkPipelineCreationFeedbackEXT& result, double ms) {
+    if (!feedback || !(result.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+        stat.unknown++;
+        stat.unknown_ms += ms;
+    } else if (result.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) {
+        stat.hits++;
+        stat.hit_ms += ms;
+    } else {
+        stat.misses++;
+        stat.miss_ms += ms;
+    }
+}
+
+void VulkanPipelineCache::report(std::ostream& os) const {
+    os << "pipeline cache: " << (stat.loaded_bytes ? "warm" : "cold") << " start (" << stat.loaded_bytes
+       << " bytes loaded), " << stat.hits << " hits in " << stat.hit_ms << " ms, " << stat.misses << " misses in "
+       << stat.miss_ms << " ms";
+    if (stat.unknown) os << ", " << stat.unknown << " without feedback in " << stat.unknown_ms << " ms";
+    os << "\n";
+}
+
+}  // namespace fl
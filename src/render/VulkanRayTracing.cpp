@@ -0,0 +1,261 @@
+#include "fl/render/VulkanRayTracing.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+uint32_t VulkanRayTracingPipeline::add_raygen(const std::string& spirv_path) {
+    raygen_groups.push_back({spirv_path, "", ""});
+    return (uint32_t)raygen_groups.size() - 1;
+}
+
+uint32_t VulkanRayTracingPipeline::add_miss(const std::string& spirv_path) {
+    miss_groups.push_back({spirv_path, "", ""});
+    return (uint32_t)miss_groups.size() - 1;
+}
+
+uint32_t VulkanRayTracingPipeline::add_hit_group(const std::string& closest_hit_path,
+                                                 const std::string& any_hit_path) {
+    hit_groups.push_back({"", closest_hit_path, any_hit_path});
+    return (uint32_t)hit_groups.size() - 1;
+}
+
+int VulkanRayTracingPipeline::create(VulkanImpl* impl, const RayTracingFunctions* fn, uint32_t max_recursion) {
+    this->impl = impl;
+    this->fn   = fn;
+    if (raygen_groups.empty()) {
+        std::cout << "ray tracing pipeline needs a raygen shader\n";
+        return -1;
+    }
+
+    std::vector<VkPipelineShaderStageCreateInfo>      stages;
+    std::vector<VkRayTracingShaderGroupCreateInfoKHR> groups;
+
+    // one stage per shader file, shared by the groups naming the same file
+    auto add_stage = [&](const std::string& path, VkShaderStageFlagBits stage) -> uint32_t {
+        if (path.empty()) return VK_SHADER_UNUSED_KHR;
+        VkShaderModule module = impl->getShaderModule(path);
+        if (module == VK_NULL_HANDLE) {
+            std::cout << "failed to create ray tracing shader " << path << "\n";
+            return VK_SHADER_UNUSED_KHR;
+        }
+
+        VkPipelineShaderStageCreateInfo info = {};
+        info.sType                           = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        info.stage                           = stage;
+        info.module                          = module;
+        info.pName                           = "main";
+        stages.push_back(info);
+        return (uint32_t)stages.size() - 1;
+    };
+    auto add_group = [&](VkRayTracingShaderGroupTypeKHR type, uint32_t general, uint32_t closest_hit,
+                         uint32_t any_hit) {
+        VkRayTracingShaderGroupCreateInfoKHR info = {};
+        info.sType                                = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+        info.type                                 = type;
+        info.generalShader                        = general;
+        info.closestHitShader                     = closest_hit;
+        info.anyHitShader                         = any_hit;
+        info.intersectionShader                   = VK_SHADER_UNUSED_KHR;
+        groups.push_back(info);
+    };
+
+    bool missing = false;
+    for (auto& group : raygen_groups) {
+        uint32_t raygen = add_stage(group.general, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+        missing |= raygen == VK_SHADER_UNUSED_KHR;
+        add_group(VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR, raygen, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR);
+    }
+    for (auto& group : miss_groups) {
+        uint32_t miss = add_stage(group.general, VK_SHADER_STAGE_MISS_BIT_KHR);
+        missing |= miss == VK_SHADER_UNUSED_KHR;
+        add_group(VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR, miss, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR);
+    }
+    for (auto& group : hit_groups) {
+        uint32_t closest_hit = add_stage(group.closest_hit, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+        uint32_t any_hit     = add_stage(group.any_hit, VK_SHADER_STAGE_ANY_HIT_BIT_KHR);
+        missing |= (!group.closest_hit.empty() && closest_hit == VK_SHADER_UNUSED_KHR) ||
+                   (!group.any_hit.empty() && any_hit == VK_SHADER_UNUSED_KHR);
+        add_group(VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR, VK_SHADER_UNUSED_KHR, closest_hit,
+                  any_hit);
+    }
+
+    VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    if (!missing) {
+        VkRayTracingPipelineCreateInfoKHR info = {};
+        info.sType                             = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
+        info.stageCount                        = (uint32_t)stages.size();
+        info.pStages                           = stages.data();
+        info.groupCount                        = (uint32_t)groups.size();
+        info.pGroups                           = groups.data();
+        info.maxPipelineRayRecursionDepth      = max_recursion;
+        info.layout                            = impl->bindless.get_pipeline_layout();
+        result = impl->pipeline_cache.create_ray_tracing_pipeline(fn->create_ray_tracing_pipelines, info, &pipeline);
+    }
+    if (result != VK_SUCCESS) {
+        std::cout << "failed to create ray tracing pipeline\n";
+        return -1;
+    }
+    return create_binding_table((uint32_t)groups.size());
+}
+
+// Handles are spaced by shaderGroupHandleAlignment inside a region, regions start at shaderGroupBaseAlignment.
+// A raygen region holds a single record, its size has to equal its stride.
+int VulkanRayTracingPipeline::create_binding_table(uint32_t group_count) {
+    VkPhysicalDeviceRayTracingPipelinePropertiesKHR rt_properties = {};
+    rt_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType                       = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext                       = &rt_properties;
+    vkGetPhysicalDeviceProperties2(impl->device.physical_device.physical_device, &properties);
+
+    VkDeviceSize handle_size   = rt_properties.shaderGroupHandleSize;
+    VkDeviceSize handle_stride = align_up(handle_size, rt_properties.shaderGroupHandleAlignment);
+    VkDeviceSize base          = rt_properties.shaderGroupBaseAlignment;
+
+    raygen_region.stride = align_up(handle_stride, base);
+    raygen_region.size   = raygen_region.stride;
+    miss_region.stride   = handle_stride;
+    miss_region.size     = align_up(handle_stride * miss_groups.size(), base);
+    hit_region.stride    = handle_stride;
+    hit_region.size      = align_up(handle_stride * hit_groups.size(), base);
+
+    VkDeviceSize raygen_bytes = raygen_region.stride * raygen_groups.size();
+
+    std::vector<uint8_t> handles(handle_size * group_count);
+    if (fn->get_ray_tracing_shader_group_handles(impl->device.device, pipeline, 0, group_count, handles.size(),
+                                                 handles.data()) != VK_SUCCESS) {
+        std::cout << "failed to get shader group handles\n";
+        return -1;
+    }
+
+    VkBufferCreateInfo info = {};
+    info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size               = raygen_bytes + miss_region.size + hit_region.size + base;  // room to align the start
+    info.usage = VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (impl->allocator.create_buffer(info, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                      sbt, sbt_allocation)) {
+        std::cout << "failed to create shader binding table\n";
+        return -1;
+    }
+
+    VkBufferDeviceAddressInfo address_info = {};
+    address_info.sType                     = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    address_info.buffer                    = sbt;
+    VkDeviceAddress address                = vkGetBufferDeviceAddress(impl->device.device, &address_info);
+    VkDeviceAddress start                  = align_up(address, base);
+
+    raygen_region.deviceAddress = start;
+    miss_region.deviceAddress   = start + raygen_bytes;
+    hit_region.deviceAddress    = miss_region.deviceAddress + miss_region.size;
+    if (miss_groups.empty()) miss_region = {};
+    if (hit_groups.empty()) hit_region = {};
+
+    uint8_t* mapped = (uint8_t*)sbt_allocation.mapped + (start - address);
+    uint32_t group  = 0;
+    for (size_t i = 0; i < raygen_groups.size(); i++, group++) {
+        memcpy(mapped + i * raygen_region.stride, handles.data() + group * handle_size, handle_size);
+    }
+    for (size_t i = 0; i < miss_groups.size(); i++, group++) {
+        memcpy(mapped + raygen_bytes + i * handle_stride, handles.data() + group * handle_size, handle_size);
+    }
+    for (size_t i = 0; i < hit_groups.size(); i++, group++) {
+        memcpy(mapped + raygen_bytes + miss_region.size + i * handle_stride, handles.data() + group * handle_size,
+               handle_size);
+    }
+    return 0;
+}
+
+void VulkanRayTracingPipeline::destroy() {
+    if (!impl) return;
+    if (pipeline != VK_NULL_HANDLE) vkDestroyPipeline(impl->device.device, pipeline, nullptr);
+    if (sbt != VK_NULL_HANDLE) impl->allocator.destroy_buffer(sbt, sbt_allocation);
+    pipeline = VK_NULL_HANDLE;
+    sbt      = VK_NULL_HANDLE;
+}
+
+void VulkanRayTracingPipeline::trace(VkCommandBuffer cmd, uint32_t width, uint32_t height, uint32_t raygen) const {
+    VkStridedDeviceAddressRegionKHR region = raygen_region;
+    region.deviceAddress += raygen * raygen_region.stride;
+    fn->cmd_trace_rays(cmd, &region, &miss_region, &hit_region, &callable_region, width, height, 1);
+}
+
+int VulkanRayTracing::create_pipeline(VulkanRayTracingPipeline& target) {
+    target.add_raygen("rt_raygen.spv");
+    target.add_miss("rt_miss.spv");         // primary rays
+    target.add_miss("rt_shadow_miss.spv");  // shadow and ambient occlusion rays
+    target.add_hit_group("rt_hit.spv");
+    return target.create(impl, &fn);
+}
+
+int VulkanRayTracing::create(VulkanImpl* impl, RenderData* data, const RTSceneDesc& desc) {
+    this->impl = impl;
+    this->data = data;
+    if (fn.load(impl->device.device)) return -1;
+    if (scene.create(impl, data, &fn, desc)) return -1;
+    if (create_pipeline(pipeline)) return -1;
+
+    // the pipeline and its binding table are rebuilt together when a trace shader is saved
+    if (impl->shaders.running()) {
+        std::vector<ShaderSource> sources = {{"rt_raygen.glsl", "rgen", "rt_raygen.spv"},
+                                             {"rt_miss.glsl", "rmiss", "rt_miss.spv"},
+                                             {"rt_shadow_miss.glsl", "rmiss", "rt_shadow_miss.spv"},
+                                             {"rt_hit.glsl", "rchit", "rt_hit.spv"}};
+        shader_watch = impl->shaders.watch(sources, [this] {
+            VulkanRayTracingPipeline next;
+            if (create_pipeline(next)) {
+                next.destroy();
+                return -1;
+            }
+            VulkanRayTracingPipeline old = pipeline;
+            this->impl->retire(*this->data, [old]() mutable { old.destroy(); });
+            pipeline = next;
+            return 0;
+        });
+    }
+    return 0;
+}
+
+void VulkanRayTracing::destroy() {
+    if (shader_watch != ~0u) impl->shaders.unwatch(shader_watch);
+    shader_watch = ~0u;
+    pipeline.destroy();
+    scene.destroy();
+}
+
+void VulkanRayTracing::record(VkCommandBuffer cmd, const RTTraceParams& params) {
+    scene.record(cmd);
+    if (scene.get_tlas_address() == 0 || params.output == BINDLESS_INVALID) return;
+
+    VkDeviceAddress  tlas      = scene.get_tlas_address();
+    RTTraceConstants constants = {};
+    constants.inverse_view_projection = params.inverse_view_projection;
+    constants.light                   = glm::vec4(glm::normalize(params.light_direction), params.ao_radius);
+    constants.scene[0]                = (uint32_t)tlas;
+    constants.scene[1]                = (uint32_t)(tlas >> 32);
+    constants.output                  = params.output;
+    constants.meshes                  = scene.get_meshes();
+    constants.positions               = scene.get_positions();
+    constants.indices                 = scene.get_indices();
+    constants.width                   = params.width;
+    constants.height                  = params.height;
+    constants.ao_samples              = params.ao_samples;
+    constants.frame                   = params.frame;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipeline.get());
+    impl->bindless.bind(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR);
+    vkCmdPushConstants(cmd, impl->bindless.get_pipeline_layout(), VK_SHADER_STAGE_ALL, 0, sizeof(constants),
+                       &constants);
+    pipeline.trace(cmd, params.width, params.height);
+}
+
+}  // namespace fl
@@ -0,0 +1,105 @@
+#include "fl/render/VulkanReadback.hpp"
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+VulkanReadback::VulkanReadback() {}
+
+VulkanReadback::~VulkanReadback() {}
+
+int VulkanReadback::create(VkDevice device, VulkanAllocator* allocator, VkExtent2D extent, VkFormat format,
+                           uint32_t ring_size) {
+    this->device    = device;
+    this->allocator = allocator;
+    this->extent    = extent;
+    this->format    = format;
+    size            = (VkDeviceSize)extent.width * extent.height * 4;
+
+    // cached memory, the CPU reads every byte; coherent so that no invalidate is needed
+    slots.resize(ring_size);
+    for (auto& slot : slots) {
+        VkBufferCreateInfo info = {};
+        info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        info.size               = size;
+        info.usage              = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+        if (allocator->create_buffer(info, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     slot.buffer, slot.allocation, VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+            std::cout << "failed to create readback buffer\n";
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void VulkanReadback::destroy() {
+    for (auto& slot : slots) {
+        if (slot.buffer != VK_NULL_HANDLE) allocator->destroy_buffer(slot.buffer, slot.allocation);
+    }
+    slots.clear();
+    next = 0;
+}
+
+int VulkanReadback::record(VkCommandBuffer cmd, VkImage image, uint64_t serial) {
+    Slot& slot = slots[next];
+    if (slot.pending) {
+        stats.dropped++;
+        return -1;
+    }
+
+    VkBufferImageCopy region               = {};
+    region.bufferOffset                    = 0;
+    region.bufferRowLength                 = 0;  // tightly packed
+    region.bufferImageHeight               = 0;
+    region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel       = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount     = 1;
+    region.imageOffset                     = {0, 0, 0};
+    region.imageExtent                     = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+    // the fence only makes the copy available to the device, the host read needs its own barrier
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType                 = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask         = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer                = slot.buffer;
+    barrier.offset                = 0;
+    barrier.size                  = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0,
+                         nullptr);
+
+    slot.serial  = serial;
+    slot.pending = true;
+    next         = (next + 1) % (uint32_t)slots.size();
+    return 0;
+}
+
+void VulkanReadback::poll(uint64_t retired_serial) {
+    // the oldest pending copy sits right after the newest one
+    for (size_t i = 0; i < slots.size(); i++) {
+        Slot& slot = slots[(next + i) % slots.size()];
+        if (!slot.pending) continue;
+        if (slot.serial > retired_serial) break;
+
+        if (callback) {
+            ReadbackFrame frame = {};
+            frame.serial        = slot.serial;
+            frame.width         = extent.width;
+            frame.height        = extent.height;
+            frame.format        = format;
+            frame.row_pitch     = extent.width * 4;
+            frame.pixels        = (const uint8_t*)slot.allocation.mapped;
+            callback(frame);
+        }
+        slot.pending = false;
+        stats.delivered++;
+        stats.bytes += size;
+    }
+}
+
+}  // namespace fl
@@ -0,0 +1,111 @@
+#include "fl/render/VulkanRecorder.hpp"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+ParallelRecorder::ParallelRecorder() {}
+
+ParallelRecorder::~ParallelRecorder() {}
+
+void ParallelRecorder::create(VkDevice device, uint32_t queue_family) {
+    this->device       = device;
+    this->queue_family = queue_family;
+}
+
+void ParallelRecorder::destroy() {
+    for (auto& local : thread_pools) {
+        for (auto pool : local.pools) {
+            if (pool != VK_NULL_HANDLE) vkDestroyCommandPool(device, pool, nullptr);
+        }
+    }
+    thread_pools.clear();
+}
+
+// Only called from the main thread between frames, when no worker is recording
+void ParallelRecorder::reset(size_t frame_slot) {
+    for (auto& local : thread_pools) {
+        if (local.pools[frame_slot] == VK_NULL_HANDLE) continue;
+        vkResetCommandPool(device, local.pools[frame_slot], 0);
+        local.used[frame_slot] = 0;
+    }
+}
+
+VkCommandBuffer ParallelRecorder::acquire(ThreadPools& local, size_t frame_slot) {
+    if (local.pools[frame_slot] == VK_NULL_HANDLE) {
+        VkCommandPoolCreateInfo pool_info = {};
+        pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.queueFamilyIndex        = queue_family;
+        pool_info.flags                   = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        if (vkCreateCommandPool(device, &pool_info, nullptr, &local.pools[frame_slot]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create worker command pool");
+        }
+    }
+
+    auto& buffers = local.buffers[frame_slot];
+    if (local.used[frame_slot] == buffers.size()) {
+        VkCommandBufferAllocateInfo alloc_info = {};
+        alloc_info.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool                 = local.pools[frame_slot];
+        alloc_info.level                       = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        alloc_info.commandBufferCount          = 1;
+
+        VkCommandBuffer buffer;
+        if (vkAllocateCommandBuffers(device, &alloc_info, &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate secondary command buffer");
+        }
+        buffers.push_back(buffer);
+    }
+    return buffers[local.used[frame_slot]++];
+}
+
+int ParallelRecorder::record(size_t frame_slot, VkCommandBuffer primary,
+                             const VkCommandBufferInheritanceInfo& inheritance, const RecordFn& prologue,
+                             const std::vector<RecordFn>& items) {
+    if (items.empty()) return 0;
+
+    size_t                       chunk_count = (items.size() + chunk_size - 1) / chunk_size;
+    std::vector<VkCommandBuffer> chunks(chunk_count, VK_NULL_HANDLE);
+    std::atomic<bool>            failed{false};
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, chunk_count), [&](const tbb::blocked_range<size_t>& range) {
+        ThreadPools& local = thread_pools.local();
+        for (size_t c = range.begin(); c != range.end(); ++c) {
+            VkCommandBuffer cmd = acquire(local, frame_slot);
+
+            VkCommandBufferBeginInfo begin_info = {};
+            begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags            = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            begin_info.flags           |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            begin_info.pInheritanceInfo = &inheritance;
+            if (vkBeginCommandBuffer(cmd, &begin_info) != VK_SUCCESS) {
+                failed = true;
+                continue;
+            }
+
+            if (prologue) prologue(cmd);
+            size_t last = std::min(items.size(), (c + 1) * chunk_size);
+            for (size_t i = c * chunk_size; i < last; i++) items[i](cmd);
+
+            if (vkEndCommandBuffer(cmd) != VK_SUCCESS) failed = true;
+            chunks[c] = cmd;
+        }
+    });
+
+    if (failed) {
+        std::cout << "failed to record secondary command buffers\n";
+        return -1;
+    }
+
+    // chunk order, not completion order, so the result does not depend on scheduling
+    vkCmdExecuteCommands(primary, (uint32_t)chunks.size(), chunks.data());
+    return 0;
+}
+
+}  // namespace fl
@@ -8,27 +8,112 @@ namespace fl {
 
 VulkanRender::VulkanRender() {}
 
-VulkanRender::~VulkanRender() {}
+VulkanRender::~VulkanRender() {
+    if (impl && data) {
+        flush();
+        readback.destroy();
+        impl->cleanup(*data);
+    }
+    delete data;
+    delete impl;
+}
 
 void VulkanRender::Init() {
     impl = new VulkanImpl();
-    impl->bootstrap(window->getVulkanLoader(), window->getWindow());
+    if (config) {
+        impl->offscreen_extent     = {config->width, config->height};
+        impl->offscreen_ring_size  = config->offscreen_ring_size;
+        impl->present_modes        = presentModes(*config);
+        impl->hardware_ray_tracing = config->hardware_ray_tracing;
+        impl->shader_hot_reload    = config->shader_hot_reload;
+        impl->shader_dir           = config->shader_dir;
+    }
+    impl->bootstrap(window->getVulkanLoader(), window->getWindow());  // headless when the window has no surface
     data = impl->createRenderData();
+    if (!data) throw std::runtime_error("Failed to create Vulkan render data");
+    if (config) data->graph.set_merge_subpasses(config->merge_ui_subpass);  // applied by setRenderTree
     window->setPresentCallback(this);
 }
 
-void VulkanRender::setRenderTree() { printf("set Render Tree!\n"); }
+std::vector<VkPresentModeKHR> VulkanRender::presentModes(const Config& config) {
+    switch (config.present_mode) {
+        case PresentMode::Fifo: return {VK_PRESENT_MODE_FIFO_KHR};
+        case PresentMode::Mailbox: return {VK_PRESENT_MODE_MAILBOX_KHR};
+        case PresentMode::Immediate: return {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+        case PresentMode::Auto: break;
+    }
+    if (config.enable_vsync) return {VK_PRESENT_MODE_FIFO_KHR};
+    return {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+}
 
+// Modules add their passes to the render graph during Init, this compiles the final frame layout
+void VulkanRender::setRenderTree() {
+    if (readback_enabled) addReadbackPass();
+    impl->compile_render_graph(*data);
+}
 
 void VulkanRender::clear(glm::vec4 color) {
+    data->clear_color = {{color.r, color.g, color.b, color.a}};
     impl->begin(*data);
-    impl->end(*data);
+    if (readback_enabled) {
+        resizeReadback();
+        readback.poll(data->frame_stats.retired);  // begin_frame just retired the frame using this slot
+    }
 }
 
 void VulkanRender::present() {
+    if (readback_enabled && !readback_pass) {
+        // enabled after setRenderTree, nothing has been recorded into the graph for this frame yet
+        addReadbackPass();
+        impl->compile_render_graph(*data);
+    }
+    impl->end(*data);
     impl->draw_frame(*data);
+    if (readback_enabled) readback.poll(data->frame_stats.retired);
 }
 
+void VulkanRender::resize(uint32_t width, uint32_t height) { impl->request_resize(*data, width, height); }
+
+int VulkanRender::enableReadback(uint32_t ring_size) {
+    readback_ring    = ring_size ? ring_size : (config ? config->offscreen_ring_size : 3);
+    readback_enabled = true;
+    return resizeReadback();
+}
 
+void VulkanRender::flush() {
+    if (!impl || !data) return;
+    impl->wait_idle();
+    readback.poll(data->frame_stats.submitted);
+}
+
+// Added last, so it copies the frame after every other pass wrote the backbuffer
+void VulkanRender::addReadbackPass() {
+    if (readback_pass) return;
+
+    RGPass& pass = data->graph.add_pass("readback", RGPassType::Transfer);
+    pass.copy_from(data->backbuffer);
+    pass.set_side_effect();
+    pass.execute = [this](RGContext& ctx) {
+        if (!readback_enabled) return;
+        // end() records before draw_frame() counts the submission
+        readback.record(ctx.cmd, data->swapchain_images[data->image_index], data->frame_stats.submitted + 1);
+    };
+    readback_pass = &pass;
+}
+
+// The buffers follow the backbuffer size, frames of the old size are delivered first
+int VulkanRender::resizeReadback() {
+    VkExtent2D extent = readback.get_extent();
+    if (readback.is_created() && extent.width == data->extent.width && extent.height == data->extent.height)
+        return 0;
+    flush();
+    readback.destroy();
+    if (readback.create(impl->device.device, &impl->allocator, data->extent, data->format, readback_ring)) {
+        std::cout << "failed to create readback buffers\n";
+        readback_enabled = false;
+        return -1;
+    }
+    return 0;
+}
 
 }  // namespace fl
\ No newline at end of file
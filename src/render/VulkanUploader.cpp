@@ -0,0 +1,404 @@
+#include "fl/render/VulkanUploader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+VulkanUploader::VulkanUploader() {}
+
+VulkanUploader::~VulkanUploader() {}
+
+int VulkanUploader::create(VkDevice device, VulkanAllocator* allocator, VkQueue transfer_queue,
+                           uint32_t transfer_family, uint32_t graphics_family, std::mutex* queue_mutex,
+                           VkDeviceSize ring_size) {
+    this->device          = device;
+    this->allocator       = allocator;
+    this->queue           = transfer_queue;
+    this->queue_mutex     = queue_mutex;
+    this->transfer_family = transfer_family;
+    this->graphics_family = graphics_family;
+    this->ring_size       = (ring_size + alignment - 1) & ~(alignment - 1);
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.queueFamilyIndex        = transfer_family;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if (vkCreateCommandPool(device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
+        std::cout << "failed to create transfer command pool\n";
+        return -1;
+    }
+
+    VkSemaphoreTypeCreateInfo type_info = {};
+    type_info.sType                     = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType             = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue              = 0;
+
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext                 = &type_info;
+    if (vkCreateSemaphore(device, &semaphore_info, nullptr, &semaphore) != VK_SUCCESS) {
+        std::cout << "failed to create upload timeline semaphore\n";
+        return -1;
+    }
+
+    VkBufferCreateInfo buffer_info = {};
+    buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size               = this->ring_size;
+    buffer_info.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+    if (allocator->create_buffer(buffer_info, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 ring.buffer, ring.allocation)) {
+        std::cout << "failed to create staging ring\n";
+        return -1;
+    }
+    ring_memory = (char*)ring.allocation.mapped;
+    return 0;
+}
+
+void VulkanUploader::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (device == VK_NULL_HANDLE) return;
+
+    if (next_value > 1) {
+        uint64_t            last      = next_value - 1;
+        VkSemaphoreWaitInfo wait_info = {};
+        wait_info.sType               = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount      = 1;
+        wait_info.pSemaphores         = &semaphore;
+        wait_info.pValues             = &last;
+        vkWaitSemaphores(device, &wait_info, UINT64_MAX);
+    }
+    retire_locked();
+    for (auto& staging : current.overflow) allocator->destroy_buffer(staging.buffer, staging.allocation);
+    current = Batch();
+
+    allocator->destroy_buffer(ring.buffer, ring.allocation);
+    ring        = Staging();
+    ring_memory = nullptr;
+
+    vkDestroyCommandPool(device, command_pool, nullptr);
+    vkDestroySemaphore(device, semaphore, nullptr);
+    free_cmds.clear();
+    acquire_buffers.clear();
+    acquire_images.clear();
+    device = VK_NULL_HANDLE;
+}
+
+uint64_t VulkanUploader::completed_value() {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(device, semaphore, &value);
+    return value;
+}
+
+// Give the ring space and command buffers of every finished batch back
+void VulkanUploader::retire_locked() {
+    if (in_flight.empty()) return;
+    uint64_t completed = completed_value();
+    while (!in_flight.empty() && in_flight.front().value <= completed) {
+        Batch& batch = in_flight.front();
+        ring_tail    = batch.ring_end;
+        for (auto& staging : batch.overflow) allocator->destroy_buffer(staging.buffer, staging.allocation);
+        free_cmds.push_back(batch.cmd);
+        in_flight.pop_front();
+    }
+}
+
+int VulkanUploader::begin_batch() {
+    if (current.cmd != VK_NULL_HANDLE) return 0;
+
+    if (free_cmds.empty()) {
+        VkCommandBufferAllocateInfo alloc_info = {};
+        alloc_info.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool                 = command_pool;
+        alloc_info.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount          = 1;
+
+        VkCommandBuffer cmd;
+        if (vkAllocateCommandBuffers(device, &alloc_info, &cmd) != VK_SUCCESS) {
+            std::cout << "failed to allocate transfer command buffer\n";
+            return -1;
+        }
+        free_cmds.push_back(cmd);
+    }
+    current.cmd = free_cmds.back();
+    free_cmds.pop_back();
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(current.cmd, &begin_info) != VK_SUCCESS) {
+        std::cout << "failed to begin transfer command buffer\n";
+        free_cmds.push_back(current.cmd);
+        current.cmd = VK_NULL_HANDLE;
+        return -1;
+    }
+    return 0;
+}
+
+// Copies data into staging memory visible to the transfer queue. Blocks only when the ring is full of
+// batches the GPU has not finished yet.
+int VulkanUploader::stage_locked(const void* data, VkDeviceSize size, VkBuffer& src, VkDeviceSize& src_offset) {
+    VkDeviceSize aligned = (size + alignment - 1) & ~(alignment - 1);
+
+    if (aligned > ring_size / 2) {
+        Staging            staging;
+        VkBufferCreateInfo buffer_info = {};
+        buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.size               = size;
+        buffer_info.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        buffer_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+        if (allocator->create_buffer(buffer_info,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                     staging.buffer, staging.allocation)) {
+            std::cout << "failed to create a staging buffer of " << size << " bytes\n";
+            return -1;
+        }
+        std::memcpy(staging.allocation.mapped, data, size);
+        current.overflow.push_back(staging);
+        stats.overflow += size;
+        src        = staging.buffer;
+        src_offset = 0;
+        return 0;
+    }
+
+    bool stalled = false;
+    while (true) {
+        VkDeviceSize position = ring_head % ring_size;
+        VkDeviceSize padding  = position + aligned > ring_size ? ring_size - position : 0;  // no wrapped copies
+        if (ring_head + padding + aligned - ring_tail <= ring_size) {
+            ring_head += padding;
+            break;
+        }
+
+        retire_locked();
+        if (ring_head + padding + aligned - ring_tail <= ring_size) continue;
+
+        // the space is held by the batch being built or by batches still executing
+        if (in_flight.empty() && submit_locked()) return -1;
+        uint64_t            value     = in_flight.front().value;
+        VkSemaphoreWaitInfo wait_info = {};
+        wait_info.sType               = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount      = 1;
+        wait_info.pSemaphores         = &semaphore;
+        wait_info.pValues             = &value;
+        vkWaitSemaphores(device, &wait_info, UINT64_MAX);
+        stalled = true;
+    }
+    if (stalled) stats.ring_stalls++;
+
+    // submitting above may have ended the batch this copy goes into
+    if (begin_batch()) return -1;
+
+    src_offset = ring_head % ring_size;
+    src        = ring.buffer;
+    std::memcpy(ring_memory + src_offset, data, size);
+    ring_head += aligned;
+    return 0;
+}
+
+UploadToken VulkanUploader::upload_buffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (begin_batch()) return UploadToken();
+
+    VkBuffer     src;
+    VkDeviceSize src_offset;
+    if (stage_locked(data, size, src, src_offset)) return UploadToken();
+
+    VkBufferCopy region = {};
+    region.srcOffset    = src_offset;
+    region.dstOffset    = offset;
+    region.size         = size;
+    vkCmdCopyBuffer(current.cmd, src, buffer, 1, &region);
+
+    // without a queue family change the timeline semaphore wait alone makes the copy visible
+    if (ownership_transfer()) {
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType                 = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask         = 0;
+        barrier.srcQueueFamilyIndex   = transfer_family;
+        barrier.dstQueueFamilyIndex   = graphics_family;
+        barrier.buffer                = buffer;
+        barrier.offset                = offset;
+        barrier.size                  = size;
+        current.release_buffers.push_back(barrier);
+    }
+
+    stats.copies++;
+    stats.bytes += size;
+    return UploadToken{next_value};
+}
+
+UploadToken VulkanUploader::upload_image(VkImage image, const VkImageSubresourceLayers& subresource,
+                                         VkExtent3D extent, const void* data, VkDeviceSize size,
+                                         VkImageLayout final_layout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (begin_batch()) return UploadToken();
+
+    VkBuffer     src;
+    VkDeviceSize src_offset;
+    if (stage_locked(data, size, src, src_offset)) return UploadToken();
+
+    VkImageSubresourceRange range = {};
+    range.aspectMask              = subresource.aspectMask;
+    range.baseMipLevel            = subresource.mipLevel;
+    range.levelCount              = 1;
+    range.baseArrayLayer          = subresource.baseArrayLayer;
+    range.layerCount              = subresource.layerCount;
+
+    VkImageMemoryBarrier to_transfer = {};
+    to_transfer.sType                = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    to_transfer.srcAccessMask        = 0;
+    to_transfer.dstAccessMask        = VK_ACCESS_TRANSFER_WRITE_BIT;
+    to_transfer.oldLayout            = VK_IMAGE_LAYOUT_UNDEFINED;
+    to_transfer.newLayout            = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    to_transfer.srcQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+    to_transfer.dstQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+    to_transfer.image                = image;
+    to_transfer.subresourceRange     = range;
+    vkCmdPipelineBarrier(current.cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &to_transfer);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset      = src_offset;
+    region.imageSubresource  = subresource;
+    region.imageOffset       = {0, 0, 0};
+    region.imageExtent       = extent;
+    vkCmdCopyBufferToImage(current.cmd, src, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    // the layout change happens as part of the ownership transfer, both halves name the same layouts
+    VkImageMemoryBarrier release = {};
+    release.sType                = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    release.srcAccessMask        = VK_ACCESS_TRANSFER_WRITE_BIT;
+    release.dstAccessMask        = 0;
+    release.oldLayout            = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    release.newLayout            = final_layout;
+    release.srcQueueFamilyIndex  = ownership_transfer() ? transfer_family : VK_QUEUE_FAMILY_IGNORED;
+    release.dstQueueFamilyIndex  = ownership_transfer() ? graphics_family : VK_QUEUE_FAMILY_IGNORED;
+    release.image                = image;
+    release.subresourceRange     = range;
+    current.release_images.push_back(release);
+
+    stats.copies++;
+    stats.bytes += size;
+    return UploadToken{next_value};
+}
+
+int VulkanUploader::submit_locked() {
+    if (current.cmd == VK_NULL_HANDLE) return 0;
+
+    if (!current.release_buffers.empty() || !current.release_images.empty()) {
+        vkCmdPipelineBarrier(current.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                             nullptr, (uint32_t)current.release_buffers.size(), current.release_buffers.data(),
+                             (uint32_t)current.release_images.size(), current.release_images.data());
+    }
+    if (vkEndCommandBuffer(current.cmd) != VK_SUCCESS) {
+        std::cout << "failed to record transfer command buffer\n";
+        return -1;
+    }
+
+    current.value    = next_value;
+    current.ring_end = ring_head;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType                         = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.signalSemaphoreValueCount     = 1;
+    timeline_info.pSignalSemaphoreValues        = &current.value;
+
+    VkSubmitInfo submit_info         = {};
+    submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext                = &timeline_info;
+    submit_info.commandBufferCount   = 1;
+    submit_info.pCommandBuffers      = &current.cmd;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores    = &semaphore;
+
+    // loader threads may get here while the render thread submits to the same queue
+    std::unique_lock<std::mutex> queue_lock;
+    if (queue_mutex) queue_lock = std::unique_lock<std::mutex>(*queue_mutex);
+    VkResult result = vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+    if (queue_lock) queue_lock.unlock();
+    if (result != VK_SUCCESS) {
+        std::cout << "failed to submit transfer command buffer\n";
+        return -1;
+    }
+    next_value++;
+
+    if (ownership_transfer()) {
+        // the acquire barriers repeat the release barriers with the access on the graphics side
+        for (auto barrier : current.release_buffers) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                                    VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT |
+                                    VK_ACCESS_SHADER_READ_BIT;
+            acquire_buffers.push_back(barrier);
+        }
+        for (auto barrier : current.release_images) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            acquire_images.push_back(barrier);
+        }
+    }
+    current.release_buffers.clear();
+    current.release_images.clear();
+
+    in_flight.push_back(std::move(current));
+    current = Batch();
+    stats.batches++;
+    return 0;
+}
+
+UploadToken VulkanUploader::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    submit_locked();
+    retire_locked();
+    return UploadToken{next_value - 1};
+}
+
+bool VulkanUploader::is_complete(UploadToken token) {
+    return completed_value() >= token.value;
+}
+
+// Only for loaders that need the data on the GPU before going on, the render thread never calls this
+void VulkanUploader::wait(UploadToken token) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (token.value >= next_value) submit_locked();  // still in the batch being built
+    }
+    VkSemaphoreWaitInfo wait_info = {};
+    wait_info.sType               = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount      = 1;
+    wait_info.pSemaphores         = &semaphore;
+    wait_info.pValues             = &token.value;
+    vkWaitSemaphores(device, &wait_info, UINT64_MAX);
+}
+
+void VulkanUploader::forget(VkBuffer buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    acquire_buffers.erase(std::remove_if(acquire_buffers.begin(), acquire_buffers.end(),
+                                         [buffer](const VkBufferMemoryBarrier& b) { return b.buffer == buffer; }),
+                          acquire_buffers.end());
+}
+
+uint64_t VulkanUploader::acquire(VkCommandBuffer graphics_cmd) {
+    std::lock_guard<std::mutex> lock(mutex);
+    submit_locked();
+    retire_locked();
+
+    if (!acquire_buffers.empty() || !acquire_images.empty()) {
+        // the source stage matches the semaphore wait stage, so the barrier is ordered after the transfer
+        vkCmdPipelineBarrier(graphics_cmd, consumer_stages, consumer_stages, 0, 0, nullptr,
+                             (uint32_t)acquire_buffers.size(), acquire_buffers.data(), (uint32_t)acquire_images.size(),
+                             acquire_images.data());
+        acquire_buffers.clear();
+        acquire_images.clear();
+    }
+
+    uint64_t last = next_value - 1;
+    return in_flight.empty() ? 0 : last;
+}
+
+}  // namespace fl
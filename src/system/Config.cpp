@@ -20,10 +20,23 @@ Config::Config()
     window_title = "Fresnel";
 
     enable_vsync = false;
+    present_mode = PresentMode::Auto;
+    target_fps = 0.0;
+    low_latency = false;
     OpenGL_Version_Major = 4;
     OpenGL_Version_Minor = 3;
     enable_opengl_support = false;
     enable_vulkan_support = true;
+    merge_ui_subpass = true;
+    hardware_ray_tracing = true;
+    shader_hot_reload = false;
+#ifdef FL_SHADER_DIR
+    shader_dir = FL_SHADER_DIR;
+#else
+    shader_dir = "shader";
+#endif
+    offscreen_ring_size = 3;
+    headless_frames = 0;
 }
 
 
@@ -0,0 +1,171 @@
+#include "fl/system/FramePacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+namespace fl {
+
+using Seconds = std::chrono::duration<double>;
+
+FramePacer::FramePacer() {
+    intervals.resize(history, 0.0);
+    jitters.resize(history, 0.0);
+    cpu_times.resize(history, 0.0);
+#ifdef _WIN32
+    // Windows 10 1803 and later, older versions fall back to Sleep()
+    timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+}
+
+FramePacer::~FramePacer() {
+#ifdef _WIN32
+    if (timer) CloseHandle((HANDLE)timer);
+#endif
+}
+
+void FramePacer::configure(double target_fps, bool low_latency) {
+    interval          = target_fps > 0.0 ? 1.0 / target_fps : 0.0;
+    this->low_latency = low_latency;
+    started           = false;
+    resetStats();
+}
+
+void FramePacer::beginFrame() {
+    Clock::time_point now    = Clock::now();
+    Clock::time_point target = now;
+    if (interval > 0.0) {
+        if (!started) {
+            next_start = now;
+            started    = true;
+        }
+        target = next_start;
+        if (low_latency) {
+            // finish the frame about a millisecond before the next cadence point
+            double delay = std::max(0.0, interval - predictWork() - 0.001);
+            target += std::chrono::duration_cast<Clock::duration>(Seconds(delay));
+        }
+
+        if (now - target > Seconds(interval)) {
+            next_start = now;  // a stall (loading, dragging the window), restart the cadence
+            target     = now;
+            late++;
+        } else {
+            waitUntil(target);
+        }
+        next_start += std::chrono::duration_cast<Clock::duration>(Seconds(interval));
+    }
+    frame_start = Clock::now();
+
+    double jitter     = interval > 0.0 ? Seconds(frame_start - target).count() : 0.0;
+    intervals[cursor] = frames ? Seconds(frame_start - last_start).count() : 0.0;
+    jitters[cursor]   = jitter;
+    if (jitter > 0.001) late++;
+    last_start = frame_start;
+}
+
+void FramePacer::endFrame() {
+    cpu_times[cursor] = Seconds(Clock::now() - frame_start).count();
+    cursor            = (cursor + 1) % history;
+    frames++;
+}
+
+// 90th percentile of the recent CPU frame times, one slow frame in ten may still miss
+double FramePacer::predictWork() const {
+    size_t count = (size_t)std::min<uint64_t>(frames, 32);
+    if (!count) return 0.0;
+
+    double recent[32];
+    for (size_t i = 0; i < count; i++) recent[i] = cpu_times[(cursor + history - 1 - i) % history];
+    size_t nth = count * 9 / 10;
+    std::nth_element(recent, recent + nth, recent + count);
+    return recent[nth];
+}
+
+// Sleeps most of the way and spins the rest: sleeps end late by a scheduler tick or so, spinning is exact
+void FramePacer::waitUntil(Clock::time_point deadline) {
+    double remaining = Seconds(deadline - Clock::now()).count();
+    if (remaining > sleep_margin) {
+        double            requested = remaining - sleep_margin;
+        Clock::time_point before    = Clock::now();
+        sleepFor(requested);
+        double oversleep = Seconds(Clock::now() - before).count() - requested;
+
+        // the margin follows the oversleep with some headroom, it grows fast and shrinks slowly
+        double wanted = std::max(0.0, oversleep) * 1.5 + 0.0001;
+        sleep_margin  = wanted > sleep_margin ? wanted : sleep_margin * 0.95 + wanted * 0.05;
+        sleep_margin  = std::min(std::max(sleep_margin, 0.0001), 0.004);
+    }
+    while (Clock::now() < deadline) {
+    }
+}
+
+void FramePacer::sleepFor(double seconds) {
+#ifdef _WIN32
+    if (timer) {
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)(seconds * 1e7);  // relative, in 100 ns units
+        if (SetWaitableTimerEx((HANDLE)timer, &due, 0, nullptr, nullptr, nullptr, 0)) {
+            WaitForSingleObject((HANDLE)timer, INFINITE);
+            return;
+        }
+    }
+    Sleep((DWORD)(seconds * 1000.0));
+#else
+    std::this_thread::sleep_for(Seconds(seconds));
+#endif
+}
+
+FramePacer::Stats FramePacer::getStats() const {
+    Stats  stats;
+    size_t count = (size_t)std::min<uint64_t>(frames, history);
+    stats.frames = frames;
+    stats.late   = late;
+    if (!count) return stats;
+
+    // the oldest interval in a full ring is valid, the very first frame has none
+    size_t              first = frames > history ? 0 : 1;
+    std::vector<double> sorted;
+    double              interval_sum = 0.0, interval_sq = 0.0, jitter_sum = 0.0, cpu_sum = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        size_t at = (cursor + history - count + i) % history;
+        if (i >= first) {
+            interval_sum += intervals[at];
+            interval_sq += intervals[at] * intervals[at];
+        }
+        jitter_sum += jitters[at];
+        cpu_sum += cpu_times[at];
+        sorted.push_back(jitters[at]);
+        stats.jitter_max = std::max(stats.jitter_max, jitters[at] * 1000.0);
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    size_t intervals_used = count - first;
+    if (intervals_used) {
+        double mean       = interval_sum / (double)intervals_used;
+        stats.interval    = mean * 1000.0;
+        stats.interval_sd = std::sqrt(std::max(0.0, interval_sq / (double)intervals_used - mean * mean)) * 1000.0;
+    }
+    stats.jitter_mean = jitter_sum / (double)count * 1000.0;
+    stats.jitter_p99  = sorted[std::min(count - 1, count * 99 / 100)] * 1000.0;
+    stats.cpu_time    = cpu_sum / (double)count * 1000.0;
+    return stats;
+}
+
+void FramePacer::resetStats() {
+    std::fill(intervals.begin(), intervals.end(), 0.0);
+    std::fill(jitters.begin(), jitters.end(), 0.0);
+    std::fill(cpu_times.begin(), cpu_times.end(), 0.0);
+    cursor = 0;
+    frames = 0;
+    late   = 0;
+}
+
+}  // namespace fl
@@ -0,0 +1,16 @@
+#include "fl/system/Hash.hpp"
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+uint64_t fnv1a(const void* data, size_t bytes, uint64_t hash) {
+    auto p = (const uint8_t*)data;
+    for (size_t i = 0; i < bytes; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+}  // namespace fl
@@ -0,0 +1,313 @@
+#include "fl/system/ImageEncoder.hpp"
+
+#include <cstring>
+#include <fstream>
+
+#include "fl/stdafx.hpp"
+
+namespace fl {
+
+namespace {
+
+void put_u32_be(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back((uint8_t)(v >> 24));
+    out.push_back((uint8_t)(v >> 16));
+    out.push_back((uint8_t)(v >> 8));
+    out.push_back((uint8_t)v);
+}
+
+// Converts one row to RGBA
+void load_row(const ImagePixels& image, uint32_t y, uint8_t* rgba) {
+    const uint8_t* src = image.pixels + (size_t)y * image.row_pitch;
+    if (!image.bgra) {
+        memcpy(rgba, src, (size_t)image.width * 4);
+        return;
+    }
+    for (uint32_t x = 0; x < image.width; x++) {
+        rgba[x * 4 + 0] = src[x * 4 + 2];
+        rgba[x * 4 + 1] = src[x * 4 + 1];
+        rgba[x * 4 + 2] = src[x * 4 + 0];
+        rgba[x * 4 + 3] = src[x * 4 + 3];
+    }
+}
+
+// ---- PNG checksums ----
+
+struct Crc32Table {
+    uint32_t entries[256];
+    Crc32Table() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+};
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const Crc32Table table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size) {
+        size_t n = size < 5552 ? size : 5552;  // largest block that cannot overflow before the modulo
+        size -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// ---- deflate, one block with the fixed Huffman codes of RFC 1951 3.2.6 ----
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+
+    void put(uint32_t value, uint32_t count) {  // LSB first
+        bits |= (uint64_t)value << used;
+        used += count;
+        while (used >= 8) {
+            out.push_back((uint8_t)bits);
+            bits >>= 8;
+            used -= 8;
+        }
+    }
+
+    // Huffman codes go MSB first
+    void put_code(uint32_t code, uint32_t length) {
+        uint32_t reversed = 0;
+        for (uint32_t i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+        put(reversed, length);
+    }
+
+    void flush() {
+        if (used) out.push_back((uint8_t)bits);
+        bits = 0;
+        used = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint64_t              bits = 0;
+    uint32_t              used = 0;
+};
+
+const uint16_t length_base[29]  = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                   31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t  length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t dist_base[30]    = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                   193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t  dist_extra[30]   = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+void put_literal(BitWriter& bw, uint32_t symbol) {
+    if (symbol < 144)
+        bw.put_code(0x30 + symbol, 8);
+    else if (symbol < 256)
+        bw.put_code(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        bw.put_code(symbol - 256, 7);
+    else
+        bw.put_code(0xC0 + symbol - 280, 8);
+}
+
+void put_match(BitWriter& bw, uint32_t length, uint32_t distance) {
+    uint32_t l = 0;
+    while (l < 28 && length_base[l + 1] <= length) l++;
+    put_literal(bw, 257 + l);
+    if (length_extra[l]) bw.put(length - length_base[l], length_extra[l]);
+
+    uint32_t d = 0;
+    while (d < 29 && dist_base[d + 1] <= distance) d++;
+    bw.put_code(d, 5);
+    if (dist_extra[d]) bw.put(distance - dist_base[d], dist_extra[d]);
+}
+
+// Greedy LZ77 with one candidate per hash, the last position the 3 byte prefix was seen at
+void deflate_fixed(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    constexpr uint32_t hash_bits  = 15;
+    constexpr size_t   window     = 32768;
+    constexpr uint32_t min_match  = 3;
+    constexpr uint32_t max_match  = 258;
+    std::vector<int64_t> head((size_t)1 << hash_bits, -1);
+
+    BitWriter bw(out);
+    bw.put(1, 1);  // BFINAL
+    bw.put(1, 2);  // BTYPE = fixed Huffman
+
+    size_t pos = 0;
+    while (pos < size) {
+        uint32_t best = 0;
+        size_t   dist = 0;
+        if (pos + min_match <= size) {
+            uint32_t h = ((uint32_t)data[pos] << 16 | (uint32_t)data[pos + 1] << 8 | data[pos + 2]) * 2654435761u >>
+                         (32 - hash_bits);
+            int64_t candidate = head[h];
+            head[h]           = (int64_t)pos;
+            if (candidate >= 0 && pos - (size_t)candidate <= window) {
+                size_t   limit = size - pos < max_match ? size - pos : max_match;
+                uint32_t len   = 0;
+                while (len < limit && data[candidate + len] == data[pos + len]) len++;
+                if (len >= min_match) {
+                    best = len;
+                    dist = pos - (size_t)candidate;
+                }
+            }
+        }
+        if (best) {
+            put_match(bw, best, (uint32_t)dist);
+            pos += best;
+        } else {
+            put_literal(bw, data[pos]);
+            pos++;
+        }
+    }
+    put_literal(bw, 256);  // end of block
+    bw.flush();
+}
+
+void put_chunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+    put_u32_be(out, (uint32_t)size);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    put_u32_be(out, crc32(out.data() + start, size + 4));
+}
+
+}  // namespace
+
+int ImageEncoder::encode(ImageFormat format, const ImagePixels& image, std::vector<uint8_t>& out) {
+    switch (format) {
+        case ImageFormat::PNG: return encode_png(image, out);
+        case ImageFormat::QOI: return encode_qoi(image, out);
+    }
+    return -1;
+}
+
+const char* ImageEncoder::extension(ImageFormat format) { return format == ImageFormat::PNG ? "png" : "qoi"; }
+
+// https://qoiformat.org/qoi-specification.pdf
+int ImageEncoder::encode_qoi(const ImagePixels& image, std::vector<uint8_t>& out) {
+    if (!image.pixels || !image.width || !image.height) return -1;
+
+    out.clear();
+    out.reserve(14 + (size_t)image.width * image.height * 2 + 8);
+    out.insert(out.end(), {'q', 'o', 'i', 'f'});
+    put_u32_be(out, image.width);
+    put_u32_be(out, image.height);
+    out.push_back(4);  // channels
+    out.push_back(0);  // sRGB with linear alpha
+
+    uint8_t              index[64][4] = {};
+    uint8_t              prev[4]      = {0, 0, 0, 255};
+    uint32_t             run          = 0;
+    std::vector<uint8_t> row((size_t)image.width * 4);
+
+    for (uint32_t y = 0; y < image.height; y++) {
+        load_row(image, y, row.data());
+        for (uint32_t x = 0; x < image.width; x++) {
+            const uint8_t* px = &row[x * 4];
+            if (memcmp(px, prev, 4) == 0) {
+                if (++run == 62) {
+                    out.push_back(0xC0 | (run - 1));  // QOI_OP_RUN
+                    run = 0;
+                }
+                continue;
+            }
+            if (run) {
+                out.push_back(0xC0 | (run - 1));
+                run = 0;
+            }
+
+            uint32_t h = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+            if (memcmp(index[h], px, 4) == 0) {
+                out.push_back((uint8_t)h);  // QOI_OP_INDEX
+            } else {
+                memcpy(index[h], px, 4);
+                if (px[3] == prev[3]) {
+                    int8_t dr  = (int8_t)(px[0] - prev[0]);
+                    int8_t dg  = (int8_t)(px[1] - prev[1]);
+                    int8_t db  = (int8_t)(px[2] - prev[2]);
+                    int8_t drg = (int8_t)(dr - dg);
+                    int8_t dbg = (int8_t)(db - dg);
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out.push_back(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));  // QOI_OP_DIFF
+                    } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                        out.push_back(0x80 | (dg + 32));  // QOI_OP_LUMA
+                        out.push_back((uint8_t)((drg + 8) << 4 | (dbg + 8)));
+                    } else {
+                        out.insert(out.end(), {0xFE, px[0], px[1], px[2]});  // QOI_OP_RGB
+                    }
+                } else {
+                    out.insert(out.end(), {0xFF, px[0], px[1], px[2], px[3]});  // QOI_OP_RGBA
+                }
+            }
+            memcpy(prev, px, 4);
+        }
+    }
+    if (run) out.push_back(0xC0 | (run - 1));
+    out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+    return 0;
+}
+
+int ImageEncoder::encode_png(const ImagePixels& image, std::vector<uint8_t>& out) {
+    if (!image.pixels || !image.width || !image.height) return -1;
+
+    // filtered scanlines: a filter type byte, then the Sub filtered RGBA row
+    size_t               stride = (size_t)image.width * 4 + 1;
+    std::vector<uint8_t> raw(stride * image.height);
+    std::vector<uint8_t> row((size_t)image.width * 4);
+    for (uint32_t y = 0; y < image.height; y++) {
+        load_row(image, y, row.data());
+        uint8_t* dst = &raw[y * stride];
+        dst[0]       = 1;  // Sub
+        for (size_t i = 0; i < row.size(); i++) dst[1 + i] = (uint8_t)(row[i] - (i >= 4 ? row[i - 4] : 0));
+    }
+
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() / 2 + 64);
+    zlib.push_back(0x78);  // deflate, 32K window
+    zlib.push_back(0x01);  // fastest, FCHECK makes the header a multiple of 31
+    deflate_fixed(raw.data(), raw.size(), zlib);
+    put_u32_be(zlib, adler32(raw.data(), raw.size()));
+
+    uint8_t ihdr[13];
+    for (int i = 0; i < 4; i++) {
+        ihdr[i]     = (uint8_t)(image.width >> (24 - i * 8));
+        ihdr[4 + i] = (uint8_t)(image.height >> (24 - i * 8));
+    }
+    ihdr[8]  = 8;  // bit depth
+    ihdr[9]  = 6;  // RGBA
+    ihdr[10] = 0;  // deflate
+    ihdr[11] = 0;  // adaptive filtering
+    ihdr[12] = 0;  // not interlaced
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    out.clear();
+    out.reserve(zlib.size() + 64);
+    out.insert(out.end(), signature, signature + 8);
+    put_chunk(out, "IHDR", ihdr, sizeof(ihdr));
+    put_chunk(out, "IDAT", zlib.data(), zlib.size());
+    put_chunk(out, "IEND", nullptr, 0);
+    return 0;
+}
+
+int ImageEncoder::write_file(const std::string& path, const std::vector<uint8_t>& data) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "failed to open " << path << " for writing\n";
+        return -1;
+    }
+    file.write((const char*)data.data(), (std::streamsize)data.size());
+    return file ? 0 : -1;
+}
+
+}  // namespace fl
@@ -1,10 +1,262 @@
 #include "fl/system/ModelLoader.hpp"
 
+#include <tbb/parallel_for.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "glm/gtc/type_ptr.hpp"
+
+#include "fl/model/MeshOptimizer.hpp"
+#include "fl/system/Hash.hpp"
+#include "fl/stdafx.hpp"
+
 namespace fl {
 
+// aiMatrix4x4 is row major
+static glm::mat4 to_glm(const aiMatrix4x4& m) { return glm::transpose(glm::make_mat4(&m.a1)); }
+
+static glm::vec3 to_glm(const aiVector3D& v) { return glm::vec3(v.x, v.y, v.z); }
+
+static uint32_t add_texture(Model& model, const aiMaterial* material, aiTextureType type) {
+    aiString path;
+    if (material->GetTextureCount(type) == 0 || material->GetTexture(type, 0, &path) != AI_SUCCESS) {
+        return model_no_texture;
+    }
+    return model.add_string(path.C_Str());
+}
+
+static ModelMaterial convert_material(Model& model, const aiMaterial* material) {
+    ModelMaterial result;
+    aiColor4D     color;
+    if (material->Get(AI_MATKEY_COLOR_DIFFUSE, color) == AI_SUCCESS) {
+        result.base_color = glm::vec4(color.r, color.g, color.b, color.a);
+    }
+#ifdef AI_MATKEY_BASE_COLOR
+    if (material->Get(AI_MATKEY_BASE_COLOR, color) == AI_SUCCESS) {
+        result.base_color = glm::vec4(color.r, color.g, color.b, color.a);
+    }
+#endif
+    if (material->Get(AI_MATKEY_COLOR_EMISSIVE, color) == AI_SUCCESS) {
+        result.emissive = glm::vec3(color.r, color.g, color.b);
+    }
+#ifdef AI_MATKEY_METALLIC_FACTOR
+    material->Get(AI_MATKEY_METALLIC_FACTOR, result.metallic);
+    material->Get(AI_MATKEY_ROUGHNESS_FACTOR, result.roughness);
+#endif
+
+    result.base_color_texture = add_texture(model, material, aiTextureType_BASE_COLOR);
+    if (result.base_color_texture == model_no_texture) {
+        result.base_color_texture = add_texture(model, material, aiTextureType_DIFFUSE);
+    }
+    result.normal_texture = add_texture(model, material, aiTextureType_NORMALS);
+    // glTF metallic-roughness, older assimp versions report it as unknown
+    result.metallic_roughness_texture = add_texture(model, material, aiTextureType_METALNESS);
+    if (result.metallic_roughness_texture == model_no_texture) {
+        result.metallic_roughness_texture = add_texture(model, material, aiTextureType_UNKNOWN);
+    }
+    result.emissive_texture = add_texture(model, material, aiTextureType_EMISSIVE);
+    return result;
+}
+
+static void convert_mesh(const aiMesh* mesh, Model& model, ModelSubmesh& submesh) {
+    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+    for (uint32_t i = 0; i < mesh->mNumVertices; i++) {
+        low  = glm::min(low, to_glm(mesh->mVertices[i]));
+        high = glm::max(high, to_glm(mesh->mVertices[i]));
+    }
+    submesh.bounds_min = low;
+    submesh.bounds_max = high;
+
+    bool has_uvs = mesh->HasTextureCoords(0);
+    for (uint32_t i = 0; i < mesh->mNumVertices; i++) {
+        ModelVertex& vertex = model.vertices[submesh.base_vertex + i];
+        vertex              = ModelVertex();
+        encode_position(submesh, to_glm(mesh->mVertices[i]), vertex);
+
+        glm::vec3 normal = mesh->HasNormals() ? to_glm(mesh->mNormals[i]) : glm::vec3(0.0f, 0.0f, 1.0f);
+        encode_direction(normal, vertex.normal);
+
+        if (has_uvs && mesh->HasTangentsAndBitangents()) {
+            // Gram-Schmidt against the normal, the bitangent only contributes its side
+            glm::vec3 tangent   = to_glm(mesh->mTangents[i]);
+            glm::vec3 bitangent = to_glm(mesh->mBitangents[i]);
+            tangent             = tangent - normal * glm::dot(normal, tangent);
+            encode_direction(tangent, vertex.tangent);
+            vertex.tangent_sign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1 : 1;
+        }
+        if (has_uvs) encode_uv(glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y), vertex);
+    }
+
+    uint8_t* out = model.indices.data() + (size_t)submesh.first_index * model.index_size;
+    for (uint32_t f = 0; f < mesh->mNumFaces; f++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t index = mesh->mFaces[f].mIndices[k];
+            if (model.index_size == 2) {
+                uint16_t small = (uint16_t)index;
+                memcpy(out, &small, 2);
+            } else {
+                memcpy(out, &index, 4);
+            }
+            out += model.index_size;
+        }
+    }
+}
+
+static void add_nodes(const aiNode* node, const glm::mat4& parent, const std::vector<uint32_t>& submesh_of,
+                      Model& model) {
+    glm::mat4 transform = parent * to_glm(node->mTransformation);
+    for (uint32_t i = 0; i < node->mNumMeshes; i++) {
+        uint32_t submesh = submesh_of[node->mMeshes[i]];
+        if (submesh == ~0u) continue;
+        ModelNode entry;
+        entry.transform = transform;
+        entry.submesh   = submesh;
+        model.nodes.push_back(entry);
+    }
+    for (uint32_t i = 0; i < node->mNumChildren; i++) add_nodes(node->mChildren[i], transform, submesh_of, model);
+}
+
+int ModelLoader::import_file(const std::string& path, Model& model, const ModelLoadOptions& options) {
+    Assimp::Importer importer;
+    importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+
+    unsigned int flags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals |
+                         aiProcess_CalcTangentSpace | aiProcess_SortByPType | aiProcess_RemoveRedundantMaterials;
+    if (!options.optimize) flags |= aiProcess_ImproveCacheLocality;  // MeshOptimizer does this and more
+    if (options.flatten) flags |= aiProcess_PreTransformVertices;
+    if (options.flip_uvs) flags |= aiProcess_FlipUVs;
+
+    const aiScene* scene = importer.ReadFile(path, flags);
+    if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode) {
+        std::cout << "failed to load model " << path << ": " << importer.GetErrorString() << "\n";
+        return -1;
+    }
+
+    model.clear();
+    for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
+        model.materials.push_back(convert_material(model, scene->mMaterials[i]));
+    }
+    if (model.materials.empty()) model.materials.push_back(ModelMaterial());
+
+    // the ranges of every mesh first, then the meshes fill them in parallel
+    std::vector<uint32_t>      submesh_of(scene->mNumMeshes, ~0u);
+    std::vector<const aiMesh*> sources;
+    uint32_t                   vertex_count = 0, index_count = 0, largest = 0;
+    for (uint32_t i = 0; i < scene->mNumMeshes; i++) {
+        const aiMesh* mesh = scene->mMeshes[i];
+        if (mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE || !mesh->mNumVertices || !mesh->mNumFaces) continue;
+
+        ModelSubmesh submesh;
+        submesh.first_index  = index_count;
+        submesh.index_count  = mesh->mNumFaces * 3;
+        submesh.base_vertex  = vertex_count;
+        submesh.vertex_count = mesh->mNumVertices;
+        submesh.material     = mesh->mMaterialIndex < model.materials.size() ? mesh->mMaterialIndex : 0;
+        submesh_of[i]        = (uint32_t)model.submeshes.size();
+        model.submeshes.push_back(submesh);
+        sources.push_back(mesh);
+
+        vertex_count += submesh.vertex_count;
+        index_count += submesh.index_count;
+        largest = std::max(largest, submesh.vertex_count);
+    }
+    if (model.submeshes.empty()) {
+        std::cout << "failed to load model " << path << ": no triangles\n";
+        return -1;
+    }
+
+    // indices are relative to the submesh, so 16 bits hold any submesh of up to 65536 vertices
+    model.index_size = largest <= 65536 ? 2 : 4;
+    model.vertices.resize(vertex_count);
+    model.indices.resize((size_t)index_count * model.index_size);
+    tbb::parallel_for(size_t(0), sources.size(),
+                      [&](size_t i) { convert_mesh(sources[i], model, model.submeshes[i]); });
+
+    add_nodes(scene->mRootNode, glm::mat4(1.0f), submesh_of, model);
+    if (options.lods.levels) MeshSimplifier::generate_lods(model, options.lods);
+    if (options.optimize) MeshOptimizer::optimize(model);
+    return 0;
+}
+
+uint64_t ModelLoader::cache_key(const std::string& path, const ModelLoadOptions& options) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return 0;
+
+    std::vector<char> chunk(1 << 20);
+    uint64_t          key = fnv1a_offset;
+    while (file) {
+        file.read(chunk.data(), (std::streamsize)chunk.size());
+        key = fnv1a(chunk.data(), (size_t)file.gcount(), key);
+    }
+    uint32_t settings[4] = {model_cache_version, options.flatten, options.flip_uvs, options.optimize};
+    key                  = fnv1a(settings, sizeof(settings), key);
+    key                  = fnv1a(&options.lods, sizeof(options.lods), key);
+    return key ? key : 1;
+}
+
+std::string ModelLoader::cache_path(const std::string& path, const ModelLoadOptions& options, uint64_t key) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+    return (std::filesystem::path(options.cache_dir) / std::filesystem::path(path).filename()).string() + "." + hex +
+           ".flmodel";
+}
+
+static int write_cache(const std::string& cache, const ModelLoadOptions& options, const Model& model, uint64_t key) {
+    std::error_code ec;
+    std::filesystem::create_directories(options.cache_dir, ec);
+    return ModelCache::write(cache, model, key);
+}
+
+// A cache that cannot be written is not an error here, the imported model is returned as it is
+int ModelLoader::load(const std::string& path, Model& model, const ModelLoadOptions& options) {
+    if (options.cache_dir.empty()) return import_file(path, model, options);
 
+    uint64_t key = cache_key(path, options);
+    if (!key) {
+        std::cout << "failed to load model " << path << ": cannot read it\n";
+        return -1;
+    }
+    std::string cache = cache_path(path, options, key);
+    MappedModel mapped;
+    if (mapped.open(cache, key) == 0) {
+        mapped.to_model(model);
+        return 0;
+    }
 
+    if (import_file(path, model, options)) return -1;
+    if (write_cache(cache, options, model, key)) std::cout << "model " << path << " imported without a cache\n";
+    return 0;
+}
 
+// The cache file is what gets mapped, so here failing to write it fails the load
+int ModelLoader::load(const std::string& path, MappedModel& model, const ModelLoadOptions& options) {
+    if (options.cache_dir.empty()) {
+        std::cout << "failed to map model " << path << ": no cache_dir\n";
+        return -1;
+    }
+    uint64_t key = cache_key(path, options);
+    if (!key) {
+        std::cout << "failed to load model " << path << ": cannot read it\n";
+        return -1;
+    }
+    std::string cache = cache_path(path, options, key);
+    if (model.open(cache, key) == 0) return 0;
 
+    Model imported;
+    if (import_file(path, imported, options)) return -1;
+    if (write_cache(cache, options, imported, key) || model.open(cache, key)) {
+        std::cout << "failed to map model cache " << cache << "\n";
+        return -1;
+    }
+    return 0;
+}
 
-}
\ No newline at end of file
+}  // namespace fl
@@ -6,12 +6,20 @@
 #include <imgui_impl_sdl.h>
 #include <imgui_impl_vulkan.h>
 
+#include <algorithm>
+
 #include "fl/render/VulkanImpl.hpp"
 
 namespace fl {
 
 UIFramework::UIFramework() {}
-UIFramework::~UIFramework() {}
+UIFramework::~UIFramework() {
+    // the Vulkan backend owns pipelines and buffers that must go before the render destroys the device
+    if (render && render->getType() == IRender::RenderType::Vulkan) {
+        finishFontUpload(true);
+        ImGui_ImplVulkan_Shutdown();
+    }
+}
 
 void UIFramework::Init() {
     // Setup Dear ImGui context
@@ -51,18 +59,20 @@ void UIFramework::renderUI() {
     if (render->getType() == IRender::RenderType::Vulkan) ImGui_ImplVulkan_NewFrame();
     if (window->getType() == IWindow::WindowType::GLFW) ImGui_ImplGlfw_NewFrame();
     if (window->getType() == IWindow::WindowType::SDL2) ImGui_ImplSDL2_NewFrame((SDL_Window*)(window->getWindow()));
+    if (window->getType() == IWindow::WindowType::Headless && vulkan_data) {
+        // no platform backend: the frame fills the offscreen target and time advances at a fixed rate
+        ImGuiIO& io    = ImGui::GetIO();
+        io.DisplaySize = ImVec2((float)vulkan_data->extent.width, (float)vulkan_data->extent.height);
+        io.DeltaTime   = 1.0f / 60.0f;
+    }
 
     ImGui::NewFrame();
     if (uicb) uicb->onRenderUI();
     ImGui::Render();
 
     if (render->getType() == IRender::RenderType::OpenGL) ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    if (render->getType() == IRender::RenderType::Vulkan) {
-        vulkan_data->parent->imgui_begin(*vulkan_data);
-        ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(),
-                                        vulkan_data->imgui_command_buffers[vulkan_data->current_frame]);
-        vulkan_data->parent->imgui_end(*vulkan_data);
-    }
+    // the Vulkan draw data is recorded by the "ui" pass of the render graph when the frame is presented
+    if (render->getType() == IRender::RenderType::Vulkan) finishFontUpload(false);
 }
 
 static void check_vk_result(VkResult err) {
@@ -77,18 +87,30 @@ void UIFramework::initVulkan() {
     auto& inst  = vulkan_data->parent->instance;
     auto& dev   = vulkan_data->parent->device;
 
+    // drawn over the scene, after every pass that writes the backbuffer before it
+    auto&   graph = vulkan_data->graph;
+    RGPass& ui    = graph.add_pass("ui", RGPassType::Raster);
+    ui.write_color(vulkan_data->backbuffer, VK_ATTACHMENT_LOAD_OP_LOAD);
+    ui.execute = [](RGContext& ctx) {
+        ImDrawData* draw_data = ImGui::GetDrawData();
+        if (draw_data) ImGui_ImplVulkan_RenderDrawData(draw_data, ctx.cmd);
+    };
+    render->setRenderTree();
+
     ImGui_ImplVulkan_InitInfo init_info = {};
     init_info.Instance                  = inst.instance;
     init_info.PhysicalDevice            = dev.physical_device.physical_device;
     init_info.Device                    = dev.device;
     init_info.QueueFamily               = vulkan_data->graphics_queue_family;
     init_info.Queue                     = vulkan_data->graphics_queue;
+    init_info.PipelineCache             = vulkan_data->parent->pipeline_cache.get();
     init_info.DescriptorPool            = vulkan_data->parent->descriptor_pool;
+    init_info.Subpass                   = ui.get_subpass();  // 1 when merged into the scene render pass
     init_info.Allocator                 = inst.allocation_callbacks;
     init_info.MinImageCount             = 3;
-    init_info.ImageCount                = vulkan_data->swapchain_images.size();
+    init_info.ImageCount                = std::max<uint32_t>((uint32_t)vulkan_data->swapchain_images.size(), 3);
     init_info.CheckVkResultFn           = check_vk_result;
-    ImGui_ImplVulkan_Init(&init_info, vulkan_data->render_pass);
+    ImGui_ImplVulkan_Init(&init_info, ui.get_render_pass());
     LoadFonts();
     uploadFontsForVulkan();
 }
@@ -103,43 +125,67 @@ void UIFramework::initGLFW() {
 
 void UIFramework::uploadFontsForVulkan() {
     VkResult err;
-    // Use any command queue
-    VkCommandPool command_pool = vulkan_data->command_pool;
-    auto          dev          = vulkan_data->parent->device.device;
+    auto     dev = vulkan_data->parent->device.device;
+
+    // A pool of its own: the frame pools are reset on their own fences, which do not cover this submit
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.queueFamilyIndex        = vulkan_data->graphics_queue_family;
+    pool_info.flags                   = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    err = vkCreateCommandPool(dev, &pool_info, nullptr, &font_upload_pool);
+    check_vk_result(err);
 
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool                 = command_pool;
+    allocInfo.commandPool                 = font_upload_pool;
     allocInfo.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     allocInfo.commandBufferCount          = 1;
 
     VkCommandBuffer command_buffer;
-    vkAllocateCommandBuffers(dev, &allocInfo, &command_buffer);
+    err = vkAllocateCommandBuffers(dev, &allocInfo, &command_buffer);
+    check_vk_result(err);
 
-    // err                 = vkResetCommandPool(dev, command_pool, 0);
-    // check_vk_result(err);
     VkCommandBufferBeginInfo begin_info = {};
     begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     begin_info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     err = vkBeginCommandBuffer(command_buffer, &begin_info);
     check_vk_result(err);
 
+    // The ImGui backend records the copy together with the transition for fragment shader reads, which a
+    // transfer queue cannot execute, so this one goes to the graphics queue ahead of the first frame.
     ImGui_ImplVulkan_CreateFontsTexture(command_buffer);
 
     err = vkEndCommandBuffer(command_buffer);
     check_vk_result(err);
 
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType             = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    err = vkCreateFence(dev, &fence_info, nullptr, &font_upload_fence);
+    check_vk_result(err);
+
     VkSubmitInfo end_info       = {};
     end_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     end_info.commandBufferCount = 1;
     end_info.pCommandBuffers    = &command_buffer;
 
-    err = vkQueueSubmit(vulkan_data->present_queue, 1, &end_info, VK_NULL_HANDLE);
+    {
+        std::lock_guard<std::mutex> lock(vulkan_data->parent->queue_mutex);
+        err = vkQueueSubmit(vulkan_data->graphics_queue, 1, &end_info, font_upload_fence);
+    }
     check_vk_result(err);
+}
+
+void UIFramework::finishFontUpload(bool wait) {
+    if (font_upload_fence == VK_NULL_HANDLE) return;
+    auto dev = vulkan_data->parent->device.device;
+    if (wait) vkWaitForFences(dev, 1, &font_upload_fence, VK_TRUE, UINT64_MAX);
+    if (vkGetFenceStatus(dev, font_upload_fence) != VK_SUCCESS) return;
 
-    err = vkDeviceWaitIdle(dev);
-    check_vk_result(err);
     ImGui_ImplVulkan_DestroyFontUploadObjects();
+    vkDestroyFence(dev, font_upload_fence, nullptr);
+    vkDestroyCommandPool(dev, font_upload_pool, nullptr);
+    font_upload_fence = VK_NULL_HANDLE;
+    font_upload_pool  = VK_NULL_HANDLE;
 }
 
 }  // namespace fl
\ No newline at end of file
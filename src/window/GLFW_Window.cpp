@@ -11,9 +11,8 @@ static void glfw_error_callback(int error, const char* description) {
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 static void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-    // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    auto self = (GLFW_Window*)glfwGetWindowUserPointer(window);
+    if (self) self->onFramebufferResize(width, height);
 }
 
 GLFW_Window::GLFW_Window() {}
@@ -59,20 +58,58 @@ void GLFW_Window::createWindow() {
         glfwMakeContextCurrent(window);
         glfwSwapInterval(config->enable_vsync ? 1 : 0);  // Enable vsync
     }
+    // low latency without a frame rate limit paces to the monitor
+    double fps = config->target_fps;
+    if (config->low_latency && fps <= 0.0) {
+        const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        if (mode) fps = mode->refreshRate;
+    }
+    pacer.configure(fps, config->low_latency);
+
+    glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+    glfwSetWindowUserPointer(window, this);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 }
 
+// Dragging a window edge sends many events per frame, only the last size is kept
+void GLFW_Window::onFramebufferResize(int width, int height) {
+    framebuffer_width  = width;
+    framebuffer_height = height;
+    resize_pending     = true;
+}
+
+void GLFW_Window::applyResize() {
+    if (!resize_pending) return;
+    resize_pending = false;
+
+    // make sure the viewport matches the new window dimensions; note that width and
+    // height will be significantly larger than specified on retina displays.
+    if (enable_gl) glViewport(0, 0, framebuffer_width, framebuffer_height);
+    if (render) render->resize((uint32_t)framebuffer_width, (uint32_t)framebuffer_height);
+}
+
 void GLFW_Window::mainLoop() {
     // render loop
     // -----------
     while (!glfwWindowShouldClose(window)) {
+        // waits for the frame's start time, so that the input below is as fresh as possible
+        pacer.beginFrame();
+
         // poll IO events and handle them (keys pressed/released, mouse moved etc.)
         processInput();
+        applyResize();
+
+        // minimized, there is nothing to render into until the window comes back
+        if (framebuffer_width == 0 || framebuffer_height == 0) {
+            glfwWaitEvents();
+            continue;
+        }
 
         if (render_cb) render_cb->onRender();
 
         // glfw: swap buffers
         swapBuffers();
+        pacer.endFrame();
     }
     cleanUp();
 }
@@ -83,6 +120,14 @@ void GLFW_Window::swapBuffers() {
 }
 
 void GLFW_Window::cleanUp() {
+    if (pacer.isActive()) {
+        auto stats = pacer.getStats();
+        printf("frame pacing: %.3f ms interval (sd %.3f), jitter %.3f ms mean, %.3f ms p99, %.3f ms max, "
+               "%llu late of %llu, cpu %.3f ms\n",
+               stats.interval, stats.interval_sd, stats.jitter_mean, stats.jitter_p99, stats.jitter_max,
+               (unsigned long long)stats.late, (unsigned long long)stats.frames, stats.cpu_time);
+    }
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -93,7 +138,10 @@ void GLFW_Window::processInput() {
     glfwPollEvents();
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) glfwSetWindowShouldClose(window, true);
 }
-void GLFW_Window::setPresentCallback(IRender* render) { this->render = render; }
+void GLFW_Window::setPresentCallback(IRender* render) {
+    this->render = render;
+    if (render) render->resize((uint32_t)framebuffer_width, (uint32_t)framebuffer_height);
+}
 void GLFW_Window::setRenderCallback(IWindowRenderCallback* callback) { render_cb = callback; }
 void GLFW_Window::setKeyboardCallback(IWindowKeyboardCallback* callback) { keyboard_cb = callback; }
 void GLFW_Window::setMouseCallback(IWindowMouseCallback* callback) { mouse_cb = callback; }
@@ -0,0 +1,30 @@
+#include "fl/window/HeadlessWindow.hpp"
+
+#include "fl/render/IRender.hpp"
+
+namespace fl {
+
+HeadlessWindow::HeadlessWindow() {}
+
+HeadlessWindow::~HeadlessWindow() {}
+
+void HeadlessWindow::mainLoop() {
+    if (config) pacer.configure(config->target_fps, false);
+    uint64_t first = frame_count;  // each call runs headless_frames frames
+    while (!should_close) {
+        pacer.beginFrame();
+        if (render_cb) render_cb->onRender();
+        if (render) render->present();
+        pacer.endFrame();
+
+        frame_count++;
+        if (config && config->headless_frames && frame_count - first >= config->headless_frames) break;
+    }
+}
+
+void HeadlessWindow::setPresentCallback(IRender* render) { this->render = render; }
+void HeadlessWindow::setRenderCallback(IWindowRenderCallback* callback) { render_cb = callback; }
+void HeadlessWindow::setKeyboardCallback(IWindowKeyboardCallback* callback) {}
+void HeadlessWindow::setMouseCallback(IWindowMouseCallback* callback) {}
+
+}  // namespace fl
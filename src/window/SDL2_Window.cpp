@@ -1,5 +1,8 @@
 #include "fl/window/SDL2_Window.hpp"
 #include <SDL.h>
+#include <SDL_vulkan.h>
+
+#include "fl/render/IRender.hpp"
 
 namespace fl {
 
@@ -42,6 +45,12 @@ void SDL2_Window::createWindow() {
         config->width, config->height,
         createFlags());
 
+    // low latency without a frame rate limit paces to the monitor
+    double fps = config->target_fps;
+    SDL_DisplayMode mode;
+    if (config->low_latency && fps <= 0.0 && SDL_GetCurrentDisplayMode(0, &mode) == 0) fps = mode.refresh_rate;
+    pacer.configure(fps, config->low_latency);
+
 }
 
 void SDL2_Window::mainLoop() {
@@ -49,11 +58,14 @@ void SDL2_Window::mainLoop() {
     // -----------
     
     while (!done) {
+        pacer.beginFrame();
+
         // input
         processInput();
         if (render_cb) render_cb->onRender();
 
         // swap buffers 
+        pacer.endFrame();
     }
     cleanUp();
 }
@@ -72,6 +84,20 @@ void SDL2_Window::processInput() {
             event.window.event == SDL_WINDOWEVENT_CLOSE &&
             event.window.windowID == SDL_GetWindowID(window))
             done = true;
+        if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED &&
+            event.window.windowID == SDL_GetWindowID(window))
+            resize_pending = true;
+    }
+
+    // a burst of size events ends up as one resize with the last drawable size
+    if (resize_pending && render) {
+        resize_pending = false;
+        int width = 0, height = 0;
+        if (config->enable_vulkan_support)
+            SDL_Vulkan_GetDrawableSize(window, &width, &height);
+        else
+            SDL_GL_GetDrawableSize(window, &width, &height);
+        render->resize((uint32_t)width, (uint32_t)height);
     }
 }
 
@@ -0,0 +1,132 @@
+// Draws an isometric tile map through the GPU scene and grows it between runs, to show that the CPU
+// cost of a frame does not follow the number of tiles. Runs without a window, e.g. on lavapipe:
+//
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench_gpu_scene [frames]
+//
+// The camera pans across the map, so the cull pass discards most tiles in every frame.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "fl/render/VulkanGpuScene.hpp"
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/render/VulkanRender.hpp"
+#include "fl/system/Config.hpp"
+#include "fl/window/HeadlessWindow.hpp"
+
+using namespace fl;
+
+static uint32_t frames = 300;
+
+class MapRenderer : public IWindowRenderCallback {
+public:
+    MapRenderer(sptr<VulkanRender> render, VulkanGpuScene& scene) : render(render), scene(scene) {}
+
+    virtual void onRender() {
+        auto now = std::chrono::steady_clock::now();
+        if (count > 0) times.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+        last = now;
+
+        // orthographic isometric camera, 40 tiles across, panning diagonally over the map
+        float     pan  = (float)(count++ % 600) * 0.25f;
+        glm::mat4 proj = glm::mat4(1.0f);
+        proj[0][0]     = 2.0f / 40.0f;
+        proj[1][1]     = 2.0f / 22.5f;
+        proj[2][2]     = 0.5f;
+        proj[3]        = glm::vec4(-pan * 2.0f / 40.0f, -pan * 2.0f / 22.5f, 0.5f, 1.0f);
+        scene.set_view_projection(proj);
+
+        render->clear(glm::vec4(0.1f, 0.1f, 0.12f, 1.0f));
+    }
+
+    sptr<VulkanRender>                    render;
+    VulkanGpuScene&                       scene;
+    uint32_t                              count = 0;
+    std::chrono::steady_clock::time_point last;
+    std::vector<double>                   times;
+};
+
+void configDI(DI& di) {
+    di["IWindow"] = []() -> IModule* { return new HeadlessWindow(); };
+    di["IRender"] = []() -> IModule* { return new VulkanRender(); };
+    di["Config"]  = []() -> IModule* {
+        auto p                   = new Config();
+        p->enable_vulkan_support = true;
+        p->width                 = 1280;
+        p->height                = 720;
+        p->headless_frames       = frames;
+        return p;
+    };
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) frames = (uint32_t)std::max(1, atoi(argv[1]));
+
+    DI di;
+    configDI(di);
+    auto          render = std::static_pointer_cast<VulkanRender>(di.get<IRender>("IRender"));
+    sptr<IWindow> window = di.get<IWindow>("IWindow");
+    RenderData*   data   = render->getVulkanRenderData();
+
+    VulkanGpuScene scene;
+    GpuSceneDesc   desc = {};
+    desc.max_instances  = 256 * 256;
+    if (scene.create(data->parent, data, desc)) return 1;
+
+    // a diamond shaped tile, one unit wide
+    GpuVertex vertices[4] = {};
+    vertices[0].position  = glm::vec3(0.0f, -0.25f, 0.0f);
+    vertices[1].position  = glm::vec3(0.5f, 0.0f, 0.0f);
+    vertices[2].position  = glm::vec3(0.0f, 0.25f, 0.0f);
+    vertices[3].position  = glm::vec3(-0.5f, 0.0f, 0.0f);
+    uint32_t  indices[6]  = {0, 1, 2, 0, 2, 3};
+    GpuHandle tile        = scene.add_mesh(vertices, 4, indices, 6);
+    GpuHandle grass       = scene.add_material(GpuMaterial());
+    GpuHandle water       = scene.add_material(GpuMaterial());
+
+    MapRenderer* cb = new MapRenderer(render, scene);
+    window->setRenderCallback(cb);
+
+    uint32_t side = 0;
+    for (uint32_t target : {32u, 100u, 256u}) {
+        for (uint32_t y = 0; y < target; y++) {
+            for (uint32_t x = 0; x < target; x++) {
+                if (x < side && y < side) continue;
+                bool      wet = (x * 7 + y * 13) % 11 == 0;
+                glm::vec2 pos((float)x - (float)y, ((float)x + (float)y) * 0.5f);
+
+                GpuInstance instance  = {};
+                instance.transform    = glm::mat4(1.0f);
+                instance.transform[3] = glm::vec4(pos * 0.5f, 0.0f, 1.0f);
+                instance.color        = wet ? glm::vec4(0.2f, 0.4f, 0.9f, 1.0f) : glm::vec4(0.3f, 0.7f, 0.3f, 1.0f);
+                instance.mesh         = tile;
+                instance.material     = wet ? water : grass;
+                scene.add_instance(instance);
+            }
+        }
+        side = target;
+
+        cb->times.clear();
+        cb->count         = 0;
+        auto     stats    = scene.get_stats();
+        uint64_t uploaded = stats.upload_bytes;
+        window->mainLoop();
+
+        std::sort(cb->times.begin(), cb->times.end());
+        double total = 0.0;
+        for (double t : cb->times) total += t;
+        double mean = cb->times.empty() ? 0.0 : total / (double)cb->times.size();
+        double p99  = cb->times.empty() ? 0.0 : cb->times[cb->times.size() * 99 / 100];
+
+        stats = scene.get_stats();
+        printf("%6u tiles: %u indirect draws per frame, %.1f KB uploaded, frame %.3f ms mean, %.3f ms p99\n",
+               stats.instances, stats.draw_calls, (stats.upload_bytes - uploaded) / 1024.0, mean, p99);
+    }
+
+    render->flush();
+    scene.destroy();
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Compares the UI drawn in its own render pass against the UI merged into the scene render pass as a
+// second subpass. Each mode runs in a separate process, the ImGui backends can only be set up once.
+//
+//   bench_ui_subpass                 run both modes and print one line each
+//   bench_ui_subpass merged|separate [frames]
+//
+// Attachment traffic is what the load and store ops of the compiled render graph imply, frame time is
+// measured on the CPU over the whole frame loop.
+
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/render/VulkanRender.hpp"
+#include "fl/system/App.hpp"
+#include "fl/system/Config.hpp"
+#include "fl/window/GLFW_Window.hpp"
+#include "imgui.h"
+
+using namespace fl;
+
+static bool     merged = true;
+static uint32_t frames = 2000;
+static uint32_t warmup = 200;
+
+class BenchApp : public App {
+public:
+    virtual void onRender() {
+        auto now = std::chrono::steady_clock::now();
+        if (count > warmup) times.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+        last = now;
+
+        App::onRender();
+        if (++count == warmup + frames) {
+            report();
+            glfwSetWindowShouldClose((GLFWwindow*)window->getWindow(), GLFW_TRUE);
+        }
+    }
+
+    // something UI-heavy enough to cover a good part of the screen
+    virtual void onRenderUI() { ImGui::ShowDemoWindow(); }
+
+protected:
+    uint32_t                              count = 0;
+    std::chrono::steady_clock::time_point last;
+    std::vector<double>                   times;
+
+    void report() {
+        const RGStats& stats = render->getVulkanRenderData()->graph.get_stats();
+
+        std::sort(times.begin(), times.end());
+        double total = 0.0;
+        for (double t : times) total += t;
+        double mean = total / (double)times.size();
+        double p99  = times[times.size() * 99 / 100];
+
+        double traffic = (double)(stats.load_bytes + stats.store_bytes) / (1024.0 * 1024.0);
+        printf("%-8s render passes %u, subpasses %u, attachment traffic %.2f MB/frame (%.2f GB/s), "
+               "frame %.3f ms mean, %.3f ms p99\n",
+               merged ? "merged" : "separate", stats.render_passes, stats.subpasses, traffic,
+               traffic * 1000.0 / mean / 1024.0, mean, p99);
+    }
+};
+
+void configDI(DI& di) {
+    di["IWindow"] = []() -> IModule* { return new GLFW_Window(); };
+    di["IRender"] = []() -> IModule* { return new VulkanRender(); };
+    di["Config"]  = []() -> IModule* {
+        auto p                   = new Config();
+        p->enable_vulkan_support = true;
+        p->merge_ui_subpass      = merged;
+        return p;
+    };
+    di["UIFramework"] = []() -> IModule* { return new UIFramework(); };
+    di["App"]         = []() -> IModule* { return new BenchApp(); };
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::string self = argv[0];
+        int         err  = std::system((self + " separate").c_str());
+        err |= std::system((self + " merged").c_str());
+        return err ? 1 : 0;
+    }
+    merged = strcmp(argv[1], "separate") != 0;
+    if (argc > 2) frames = (uint32_t)std::max(1, atoi(argv[2]));
+
+    DI di;
+    configDI(di);
+    sptr<App> app = di.get<App>("App");
+    app->startApp();
+    return 0;
+}
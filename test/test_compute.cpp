@@ -0,0 +1,137 @@
+// Steps a particle system on the async compute queue while frames render, then checks the result against
+// the same integration on the CPU. Runs without a window, e.g. on lavapipe:
+//
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./test_compute [frames]
+//
+// Every frame waits for its particle step on the GPU only, the CPU never blocks on the compute queue.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "fl/render/VulkanCompute.hpp"
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/render/VulkanRender.hpp"
+#include "fl/system/Config.hpp"
+#include "fl/window/HeadlessWindow.hpp"
+
+using namespace fl;
+
+static uint32_t frames = 300;
+
+// Layouts of shader/particles.glsl
+struct Particle {
+    glm::vec4 position;  // w: remaining life
+    glm::vec4 velocity;
+};
+
+struct Step {
+    glm::vec4 gravity;
+    uint32_t  particles;
+    uint32_t  count;
+    float     dt;
+};
+
+static const uint32_t  particle_count = 1 << 16;
+static const float     dt             = 1.0f / 60.0f;
+static const glm::vec4 gravity(0.0f, -9.81f, 0.0f, 0.0f);
+
+class ParticleRenderer : public IWindowRenderCallback {
+public:
+    ParticleRenderer(sptr<VulkanRender> render, RenderData* data, ComputePipeline& pipeline,
+                     ComputeBuffer<Particle>& particles)
+        : render(render), data(data), pipeline(pipeline), particles(particles) {}
+
+    virtual void onRender() {
+        auto& compute = data->parent->compute;
+
+        Step step      = {};
+        step.gravity   = gravity;
+        step.particles = particles.handle();
+        step.count     = (uint32_t)particles.size();
+        step.dt        = dt;
+        compute.dispatch(pipeline, step, (step.count + 63) / 64);
+        last = compute.submit();
+
+        data->parent->wait_compute(*data, last);
+        render->clear(glm::vec4(0.1f, 0.1f, 0.12f, 1.0f));
+    }
+
+    sptr<VulkanRender>       render;
+    RenderData*              data;
+    ComputePipeline&         pipeline;
+    ComputeBuffer<Particle>& particles;
+    ComputeToken             last;
+};
+
+void configDI(DI& di) {
+    di["IWindow"] = []() -> IModule* { return new HeadlessWindow(); };
+    di["IRender"] = []() -> IModule* { return new VulkanRender(); };
+    di["Config"]  = []() -> IModule* {
+        auto p                   = new Config();
+        p->enable_vulkan_support = true;
+        p->width                 = 640;
+        p->height                = 360;
+        p->headless_frames       = frames;
+        return p;
+    };
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) frames = (uint32_t)std::max(1, atoi(argv[1]));
+
+    DI di;
+    configDI(di);
+    auto          render = std::static_pointer_cast<VulkanRender>(di.get<IRender>("IRender"));
+    sptr<IWindow> window = di.get<IWindow>("IWindow");
+    RenderData*   data   = render->getVulkanRenderData();
+    VulkanImpl*   impl   = data->parent;
+
+    ComputePipeline pipeline;
+    if (pipeline.create(impl, "particles.spv")) return 1;
+
+    // host visible, so the result can be read without a copy
+    ComputeBuffer<Particle> particles;
+    if (particles.create(impl, particle_count, 0, true)) return 1;
+
+    std::vector<Particle> expected(particle_count);
+    for (uint32_t i = 0; i < particle_count; i++) {
+        float angle          = (float)i * 0.001f;
+        expected[i].position = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f + (float)(i % 600) * 0.01f);
+        expected[i].velocity = glm::vec4(std::cos(angle) * 2.0f, 10.0f, std::sin(angle) * 2.0f, 0.0f);
+    }
+    std::copy(expected.begin(), expected.end(), particles.data());
+
+    ParticleRenderer* cb = new ParticleRenderer(render, data, pipeline, particles);
+    window->setRenderCallback(cb);
+    window->mainLoop();
+
+    impl->compute.wait(cb->last);
+    render->flush();
+
+    for (uint32_t f = 0; f < frames; f++) {
+        for (auto& p : expected) {
+            if (p.position.w <= 0.0f) continue;
+            p.velocity += gravity * dt;
+            p.position += glm::vec4(glm::vec3(p.velocity) * dt, -dt);
+        }
+    }
+
+    uint32_t        mismatches = 0;
+    const Particle* result     = particles.data();
+    for (uint32_t i = 0; i < particle_count; i++) {
+        float error = glm::length(glm::vec3(result[i].position) - glm::vec3(expected[i].position));
+        if (error > 1e-2f * (1.0f + glm::length(glm::vec3(expected[i].position)))) mismatches++;
+    }
+
+    auto& stats = impl->compute.stats;
+    printf("%u frames, %llu dispatches in %llu batches on %s queue, %u of %u particles differ from the CPU\n", frames,
+           (unsigned long long)stats.dispatches, (unsigned long long)stats.batches,
+           impl->compute.is_async() ? "an async compute" : "the graphics", mismatches, particle_count);
+
+    particles.destroy();
+    pipeline.destroy();
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,199 @@
+// Renders the scene of test_ray_tracing with the CPU reference tracer, no GPU needed:
+//
+//   ./test_cpu_tracer [passes] [output.png]
+//
+// Checks the BVH against brute force intersection of random rays, and that one thread and all threads
+// produce the same image, then writes the converged image.
+
+#include <tbb/task_arena.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "fl/render/CpuPathTracer.hpp"
+#include "fl/system/ImageEncoder.hpp"
+
+using namespace fl;
+
+static const uint32_t width = 640, height = 360;
+
+struct Geometry {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t>  indices;
+};
+
+// a box subdivided into n x n quads per face, so the mesh BVHs have some depth
+static Geometry make_box(int n) {
+    Geometry box;
+    for (int face = 0; face < 6; face++) {
+        int       axis = face / 2;
+        float     side = face & 1 ? 0.5f : -0.5f;
+        uint32_t  base = (uint32_t)box.positions.size();
+        glm::vec3 p;
+        for (int j = 0; j <= n; j++) {
+            for (int i = 0; i <= n; i++) {
+                p[axis]           = side;
+                p[(axis + 1) % 3] = (float)i / (float)n - 0.5f;
+                p[(axis + 2) % 3] = (float)j / (float)n - 0.5f;
+                box.positions.push_back(p);
+            }
+        }
+        for (int j = 0; j < n; j++) {
+            for (int i = 0; i < n; i++) {
+                uint32_t a = base + j * (n + 1) + i, b = a + 1, c = a + n + 1, d = c + 1;
+                box.indices.insert(box.indices.end(), {a, b, c, b, d, c});
+            }
+        }
+    }
+    return box;
+}
+
+static Geometry make_plane(float size) {
+    Geometry plane;
+    plane.positions = {{-size, 0.0f, -size}, {size, 0.0f, -size}, {-size, 0.0f, size}, {size, 0.0f, size}};
+    plane.indices   = {0, 2, 1, 1, 2, 3};
+    return plane;
+}
+
+struct Scene {
+    Geometry               plane, box;
+    std::vector<glm::mat4> plane_transforms, box_transforms;
+};
+
+static Scene make_scene() {
+    Scene scene;
+    scene.plane = make_plane(20.0f);
+    scene.box   = make_box(16);
+    scene.plane_transforms.push_back(glm::mat4(1.0f));
+    for (int z = -4; z <= 4; z++) {
+        for (int x = -4; x <= 4; x++) {
+            float height_scale = 1.0f + (float)((x * 7 + z * 13) & 3);
+            scene.box_transforms.push_back(
+                glm::translate(glm::mat4(1.0f), glm::vec3(x * 2.0f, height_scale * 0.5f, z * 2.0f)) *
+                glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, height_scale, 1.0f)));
+        }
+    }
+    return scene;
+}
+
+static RTHandle add_mesh(CpuPathTracer& tracer, const Geometry& geometry) {
+    RTMeshDesc desc   = {};
+    desc.positions    = geometry.positions.data();
+    desc.vertex_count = (uint32_t)geometry.positions.size();
+    desc.indices      = geometry.indices.data();
+    desc.index_count  = (uint32_t)geometry.indices.size();
+    return tracer.add_mesh(desc);
+}
+
+// Nearest hit over every triangle of every instance
+static float brute_force(const Scene& scene, const glm::vec3& origin, const glm::vec3& direction) {
+    float best = FLT_MAX;
+    auto  test = [&](const Geometry& geometry, const std::vector<glm::mat4>& transforms) {
+        for (auto& transform : transforms) {
+            for (size_t i = 0; i < geometry.indices.size(); i += 3) {
+                glm::vec3 v0 = glm::vec3(transform * glm::vec4(geometry.positions[geometry.indices[i + 0]], 1.0f));
+                glm::vec3 v1 = glm::vec3(transform * glm::vec4(geometry.positions[geometry.indices[i + 1]], 1.0f));
+                glm::vec3 v2 = glm::vec3(transform * glm::vec4(geometry.positions[geometry.indices[i + 2]], 1.0f));
+                glm::vec3 e1 = v1 - v0, e2 = v2 - v0;
+                glm::vec3 p   = glm::cross(direction, e2);
+                float     det = glm::dot(e1, p);
+                if (std::abs(det) < 1e-20f) continue;
+                glm::vec3 s = origin - v0;
+                float     u = glm::dot(s, p) / det;
+                glm::vec3 q = glm::cross(s, e1);
+                float     v = glm::dot(direction, q) / det;
+                float     t = glm::dot(e2, q) / det;
+                if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f) best = std::min(best, t);
+            }
+        }
+    };
+    test(scene.plane, scene.plane_transforms);
+    test(scene.box, scene.box_transforms);
+    return best;
+}
+
+int main(int argc, char** argv) {
+    uint32_t    passes = argc > 1 ? (uint32_t)std::max(1, atoi(argv[1])) : 16;
+    std::string path   = argc > 2 ? argv[2] : "cpu_trace.png";
+
+    Scene         scene = make_scene();
+    CpuPathTracer tracer;
+    RTInstance    instance = {};
+    instance.mesh          = add_mesh(tracer, scene.plane);
+    tracer.add_instance(instance);
+    instance.mesh = add_mesh(tracer, scene.box);
+    for (auto& transform : scene.box_transforms) {
+        instance.transform = transform;
+        tracer.add_instance(instance);
+    }
+    tracer.commit();
+
+    auto& stats = tracer.get_stats();
+    printf("built %u BVHs in %.2f ms, %u BVH4 nodes, depth %u\n", stats.blas_builds + 1, stats.build_ms,
+           stats.bvh4_nodes, stats.max_depth);
+
+    // the BVH finds what testing every triangle finds
+    std::mt19937                          rng(1234);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    uint32_t                              mismatches = 0;
+    const uint32_t                        rays       = 2000;
+    for (uint32_t i = 0; i < rays; i++) {
+        glm::vec3 origin(uniform(rng) * 12.0f, 2.0f + uniform(rng) * 4.0f, uniform(rng) * 12.0f);
+        glm::vec3 direction = glm::normalize(glm::vec3(uniform(rng), uniform(rng), uniform(rng)));
+        float     expected  = brute_force(scene, origin, direction);
+        RTHit     hit;
+        bool      found = tracer.intersect(origin, direction, FLT_MAX, hit);
+        if (found != (expected < FLT_MAX) || (found && std::abs(hit.t - expected) > 1e-3f * (1.0f + expected))) {
+            mismatches++;
+        }
+    }
+    printf("%u of %u random rays differ from brute force\n", mismatches, rays);
+
+    glm::mat4 view       = glm::lookAt(glm::vec3(0.0f, 8.0f, 14.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)width / (float)height, 0.1f, 100.0f);
+    projection[1][1] *= -1.0f;  // Vulkan clip space
+
+    RTTraceParams params           = {};
+    params.inverse_view_projection = glm::inverse(projection * view);
+    params.light_direction         = glm::normalize(glm::vec3(-0.4f, -1.0f, -0.3f));
+    params.ao_radius               = 2.0f;
+    params.ao_samples              = 4;
+    params.width                   = width;
+    params.height                  = height;
+
+    // one pass on a single thread, then the same pass on every thread
+    tbb::task_arena single(1);
+    single.execute([&] { tracer.render(params); });
+    std::vector<uint8_t> serial(tracer.image().pixels, tracer.image().pixels + width * height * 4);
+    tracer.reset();
+    tracer.render(params);
+    bool deterministic = memcmp(serial.data(), tracer.image().pixels, serial.size()) == 0;
+    printf("one thread and %d threads give %s images\n", tbb::this_task_arena::max_concurrency(),
+           deterministic ? "identical" : "different");
+
+    // progressive: the first pass is already in, one render per pass as a viewer would
+    double total_ms = stats.render_ms;
+    for (uint32_t i = 1; i < passes; i++) {
+        tracer.render(params);
+        total_ms += stats.render_ms;
+    }
+    printf("%u passes of %ux%u in %.1f ms, %.1f Mrays/s\n", tracer.get_samples(), width, height, total_ms,
+           (double)stats.rays * passes / (total_ms * 1000.0));
+
+    ReadbackFrame        frame = tracer.image();
+    ImagePixels          image = {frame.pixels, frame.width, frame.height, frame.row_pitch, false};
+    std::vector<uint8_t> png;
+    if (ImageEncoder::encode_png(image, png) || ImageEncoder::write_file(path, png)) {
+        printf("failed to write %s\n", path.c_str());
+        return 1;
+    }
+    printf("wrote %s\n", path.c_str());
+    return mismatches || !deterministic ? 1 : 0;
+}
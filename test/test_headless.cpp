@@ -0,0 +1,72 @@
+// Renders a few hundred frames without a window and reads every one of them back, e.g. on lavapipe:
+//
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./test_headless [frames]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "fl/render/VulkanHeadlessRender.hpp"
+#include "fl/system/Config.hpp"
+#include "fl/window/HeadlessWindow.hpp"
+
+using namespace fl;
+
+static uint32_t frames = 300;
+
+class RenderCallback : public IWindowRenderCallback {
+public:
+    RenderCallback(sptr<IRender> render) : render(render) {}
+    virtual void onRender() {
+        float t = (float)(count++ % 100) / 100.0f;
+        render->clear(glm::vec4(t, 0.5f, 1.0f - t, 1.0f));
+    }
+
+    sptr<IRender> render;
+    uint32_t      count = 0;
+};
+
+void configDI(DI& di) {
+    di["IWindow"] = []() -> IModule* { return new HeadlessWindow(); };
+    di["IRender"] = []() -> IModule* { return new VulkanHeadlessRender(); };
+    di["Config"]  = []() -> IModule* {
+        auto p                   = new Config();
+        p->enable_vulkan_support = true;
+        p->width                 = 640;
+        p->height                = 360;
+        p->headless_frames       = frames;
+        return p;
+    };
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) frames = (uint32_t)std::max(1, atoi(argv[1]));
+
+    DI di;
+    configDI(di);
+    sptr<IRender> render = di.get<IRender>("IRender");
+    sptr<IWindow> window = di.get<IWindow>("IWindow");
+
+    auto     headless = std::static_pointer_cast<VulkanHeadlessRender>(render);
+    uint64_t checksum = 0;
+    headless->setReadbackCallback([&](const ReadbackFrame& frame) {
+        // the center pixel, enough to see the clear color change from frame to frame
+        const uint8_t* p = frame.pixels + (frame.height / 2) * frame.row_pitch + (frame.width / 2) * 4;
+        checksum         = checksum * 31 + (p[0] | p[1] << 8 | p[2] << 16);
+    });
+
+    RenderCallback* cb = new RenderCallback(render);
+    window->setRenderCallback(cb);
+
+    auto start = std::chrono::steady_clock::now();
+    window->mainLoop();
+    headless->flush();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const auto& stats = headless->getReadback().stats;
+    printf("%u frames in %.2f s (%.1f fps), read back %llu (%.1f MB), dropped %llu, checksum %016llx\n", frames,
+           seconds, frames / seconds, (unsigned long long)stats.delivered, stats.bytes / (1024.0 * 1024.0),
+           (unsigned long long)stats.dropped, (unsigned long long)checksum);
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Imports a model and prints what the engine format made of it, no GPU needed:
+//
+//   ./test_model model.gltf [--flatten] [--cache dir]
+//
+// The mesh optimizer runs after the import so its before and after cache statistics can be printed, it
+// also builds the meshlets whose sizes and normal cones are summed up.
+// With --cache it also times mapping the binary cache in dir against the import, writing it first if needed.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "fl/model/LodSelector.hpp"
+#include "fl/model/MeshOptimizer.hpp"
+#include "fl/system/ModelLoader.hpp"
+
+using namespace fl;
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("usage: %s model [--flatten] [--cache dir]\n", argv[0]);
+        return 1;
+    }
+    ModelLoadOptions options;
+    std::string      cache_dir;
+    options.optimize = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--flatten") == 0) options.flatten = true;
+        if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) cache_dir = argv[++i];
+    }
+
+    Model model;
+    auto  begin = std::chrono::steady_clock::now();
+    if (ModelLoader::load(argv[1], model, options)) return 1;
+    MeshOptimizerStats stats = MeshOptimizer::optimize(model);
+    auto               end   = std::chrono::steady_clock::now();
+    double             ms    = std::chrono::duration<double, std::milli>(end - begin).count();
+
+    size_t index_count = 0;  // of the full submeshes, without their levels of detail
+    for (auto& submesh : model.submeshes) index_count += submesh.index_count;
+    printf("loaded %s in %.1f ms\n", argv[1], ms);
+    printf("%zu submeshes, %zu materials, %zu nodes, %zu vertices, %zu triangles, %u bit indices, %zu lods\n",
+           model.submeshes.size(), model.materials.size(), model.nodes.size(), model.vertices.size(),
+           index_count / 3, model.index_size * 8, model.lods.size());
+
+    // position, normal, tangent and uv as floats with 32 bit indices, what the file usually gets expanded to
+    size_t unpacked = model.vertices.size() * 48 + index_count * 4;
+    size_t packed   = model.vertices.size() * sizeof(ModelVertex) + index_count * model.index_size;
+    printf("vertex and index data: %zu bytes, %.2fx smaller than unpacked floats\n", packed,
+           (double)unpacked / (double)packed);
+
+    printf("vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %llu overdraw clusters\n", stats.acmr_before(),
+           stats.acmr_after(), stats.atvr_before(), stats.atvr_after(), (unsigned long long)stats.clusters);
+
+    glm::vec3 low = model.bounds_min(), high = model.bounds_max();
+    printf("bounds (%g %g %g) - (%g %g %g)\n", low.x, low.y, low.z, high.x, high.y, high.z);
+
+    // meshlets and how many of them the normal cone test drops for a camera 4x the size away on +z
+    glm::vec3 camera = (low + high) * 0.5f + glm::vec3(0.0f, 0.0f, glm::length(high - low) * 4.0f);
+    uint64_t  meshlet_vertices = 0, meshlet_triangles = 0, cones = 0, placed = 0, facing_away = 0;
+    for (auto& meshlet : model.meshlets) {
+        meshlet_vertices += meshlet.vertex_count;
+        meshlet_triangles += meshlet.index_count / 3;
+        cones += meshlet.cone_cutoff < 1.0f;
+    }
+    for (auto& node : model.nodes) {
+        const ModelSubmesh& submesh = model.submeshes[node.submesh];
+        for (uint32_t m = 0; m < submesh.meshlet_count; m++) {
+            const ModelMeshlet& meshlet = model.meshlets[submesh.first_meshlet + m];
+            glm::vec3           center  = glm::vec3(node.transform * glm::vec4(meshlet.center, 1.0f));
+            glm::vec3           axis    = glm::normalize(glm::mat3(node.transform) * meshlet.cone_axis);
+            float               scale   = glm::length(glm::vec3(node.transform[0]));
+            placed++;
+            if (meshlet.cone_cutoff < 1.0f && glm::determinant(glm::mat3(node.transform)) > 0.0f &&
+                glm::dot(center - camera, axis) >=
+                    meshlet.cone_cutoff * glm::length(center - camera) + meshlet.radius * scale) {
+                facing_away++;
+            }
+        }
+    }
+    size_t meshlet_count = std::max<size_t>(model.meshlets.size(), 1);
+    printf("%zu meshlets, %.1f vertices and %.1f triangles each, %.0f%% with a normal cone\n", model.meshlets.size(),
+           (double)meshlet_vertices / meshlet_count, (double)meshlet_triangles / meshlet_count,
+           100.0 * cones / meshlet_count);
+    printf("cone culling from +z: %llu of %llu placed meshlets face away\n", (unsigned long long)facing_away,
+           (unsigned long long)placed);
+
+    // what LodSelector draws of every node at a few distances from a 1080p camera with a 60 degree fov
+    LodSelector selector;
+    selector.set_projection(glm::radians(60.0f), 1080.0f);
+    ModelView view = model.view();
+    float     size = glm::length(high - low);
+    for (float times : {1.0f, 4.0f, 16.0f, 64.0f}) {
+        uint64_t drawn = 0, full = 0;
+        for (auto& node : model.nodes) {
+            uint32_t level = selector.select(view, node.submesh, size * times);
+            uint32_t first, count;
+            LodSelector::range(view, node.submesh, level, first, count);
+            drawn += count / 3;
+            full += model.submeshes[node.submesh].index_count / 3;
+        }
+        printf("at %2.0fx its size away: %llu of %llu triangles\n", times, (unsigned long long)drawn,
+               (unsigned long long)full);
+    }
+    for (size_t i = 0; i < model.materials.size(); i++) {
+        auto& material = model.materials[i];
+        printf("material %zu: base color %s\n", i,
+               material.base_color_texture != model_no_texture ? model.string(material.base_color_texture) : "-");
+    }
+
+    if (!cache_dir.empty()) {
+        options.cache_dir = cache_dir;
+        options.optimize  = true;
+        MappedModel mapped;
+        if (ModelLoader::load(argv[1], mapped, options)) return 1;  // writes the cache when it is missing
+        mapped.close();
+
+        begin = std::chrono::steady_clock::now();
+        if (ModelLoader::load(argv[1], mapped, options)) return 1;
+        double mapped_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        printf("mapped %s (%zu bytes) in %.2f ms, %.0fx faster than the import\n",
+               ModelLoader::cache_path(argv[1], options, ModelLoader::cache_key(argv[1], options)).c_str(),
+               mapped.size_bytes(), mapped_ms, ms / std::max(mapped_ms, 1e-3));
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+// Records a few thousand overlapping draws of the scene pipeline, once inline and once split over TBB
+// workers into secondary command buffers, and checks that both read back the same image. Runs without a
+// window, e.g. on lavapipe:
+//
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./test_parallel_record [draws] [frames]
+//
+// The triangles overlap and differ in size, so the image only matches when the chunks are executed in
+// draw order.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "fl/render/VulkanHeadlessRender.hpp"
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/system/Config.hpp"
+#include "fl/window/HeadlessWindow.hpp"
+
+using namespace fl;
+
+static uint32_t draws  = 4096;
+static uint32_t frames = 60;
+
+class RenderCallback : public IWindowRenderCallback {
+public:
+    RenderCallback(sptr<IRender> render) : render(render) {}
+    virtual void onRender() { render->clear(glm::vec4(0.1f, 0.1f, 0.12f, 1.0f)); }
+
+    sptr<IRender> render;
+};
+
+void configDI(DI& di) {
+    di["IWindow"] = []() -> IModule* { return new HeadlessWindow(); };
+    di["IRender"] = []() -> IModule* { return new VulkanHeadlessRender(); };
+    di["Config"]  = []() -> IModule* {
+        auto p                   = new Config();
+        p->enable_vulkan_support = true;
+        p->width                 = 640;
+        p->height                = 360;
+        p->headless_frames       = frames;
+        return p;
+    };
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) draws = (uint32_t)std::max(1, atoi(argv[1]));
+    if (argc > 2) frames = (uint32_t)std::max(1, atoi(argv[2]));
+
+    DI di;
+    configDI(di);
+    sptr<IRender> render = di.get<IRender>("IRender");
+    sptr<IWindow> window = di.get<IWindow>("IWindow");
+    RenderData*   data   = render->getVulkanRenderData();
+
+    // every item draws the scene triangle into a viewport of its own, the prologue binds the pipeline
+    for (uint32_t i = 0; i < draws; i++) {
+        VkViewport viewport = {};
+        viewport.width      = 64.0f + (float)(i % 5) * 16.0f;
+        viewport.height     = 64.0f + (float)(i % 7) * 8.0f;
+        viewport.x          = (float)((i * 37) % (640 - 128));
+        viewport.y          = (float)((i * 23) % (360 - 128));
+        viewport.maxDepth   = 1.0f;
+        data->draw_items.push_back([viewport](VkCommandBuffer cmd) {
+            vkCmdSetViewport(cmd, 0, 1, &viewport);
+            vkCmdDraw(cmd, 3, 1, 0, 0);
+        });
+    }
+
+    auto     headless = std::static_pointer_cast<VulkanHeadlessRender>(render);
+    uint64_t checksum = 0;
+    headless->setReadbackCallback([&](const ReadbackFrame& frame) {
+        // FNV-1a over the whole frame, every frame of a run is the same image
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t y = 0; y < frame.height; y++) {
+            const uint8_t* row = frame.pixels + (size_t)y * frame.row_pitch;
+            for (uint32_t x = 0; x < frame.width * 4; x++) hash = (hash ^ row[x]) * 1099511628211ull;
+        }
+        checksum = hash;
+    });
+
+    RenderCallback* cb = new RenderCallback(render);
+    window->setRenderCallback(cb);
+
+    uint64_t checksums[2] = {};
+    bool     secondary[2] = {};
+    for (int parallel = 0; parallel < 2; parallel++) {
+        data->parallel_threshold = parallel ? std::min<size_t>(draws, 256) : ~size_t(0);
+        checksum                 = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        window->mainLoop();
+        headless->flush();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        checksums[parallel] = checksum;
+        // set by VulkanImpl::end for the last frame, whether ParallelRecorder recorded the scene pass
+        secondary[parallel] = data->scene_pass->contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS;
+        printf("%s: %u draws, %u frames in %.2f s (%.2f ms/frame), checksum %016llx\n",
+               parallel ? "parallel" : "inline  ", draws, frames, seconds, seconds * 1000.0 / frames,
+               (unsigned long long)checksum);
+    }
+
+    if (secondary[0] || !secondary[1]) {
+        printf("FAILED: the scene pass was not recorded the way the threshold asks for\n");
+        return 1;
+    }
+    if (checksums[0] == 0 || checksums[0] != checksums[1]) {
+        printf("FAILED: parallel recording does not match inline recording\n");
+        return 1;
+    }
+    printf("parallel recording matches inline recording\n");
+    return 0;
+}
@@ -0,0 +1,242 @@
+// Traces shadows and ambient occlusion of a field of boxes into a storage image every frame, with a few
+// boxes moving (TLAS rebuilds) and one deforming (BLAS refits). Runs without a window:
+//
+//   ./test_ray_tracing [frames] [--compute]
+//
+// --compute traces with the compute shader backend even where hardware ray tracing is available, which
+// is what lavapipe and older GPUs get anyway.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "fl/render/RayTracing.hpp"
+#include "fl/render/VulkanComputeRayTracing.hpp"
+#include "fl/render/VulkanImpl.hpp"
+#include "fl/render/VulkanRayTracing.hpp"
+#include "fl/render/VulkanRender.hpp"
+#include "fl/system/Config.hpp"
+#include "fl/window/HeadlessWindow.hpp"
+
+using namespace fl;
+
+static uint32_t frames         = 300;
+static bool     prefer_compute = false;
+
+static const uint32_t width = 640, height = 360;
+
+struct Geometry {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t>  indices;
+};
+
+static Geometry make_box() {
+    Geometry box;
+    for (int i = 0; i < 8; i++) {
+        box.positions.push_back(glm::vec3(i & 1 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 4 ? 0.5f : -0.5f));
+    }
+    box.indices = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                   2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+    return box;
+}
+
+static Geometry make_plane(float size) {
+    Geometry plane;
+    plane.positions = {{-size, 0.0f, -size}, {size, 0.0f, -size}, {-size, 0.0f, size}, {size, 0.0f, size}};
+    plane.indices   = {0, 2, 1, 1, 2, 3};
+    return plane;
+}
+
+class TraceRenderer : public IWindowRenderCallback {
+public:
+    TraceRenderer(sptr<VulkanRender> render, IRayTracingBackend* backend) : render(render), backend(backend) {}
+
+    virtual void onRender() {
+        float t = (float)frame * (1.0f / 60.0f);
+        for (size_t i = 0; i < movers.size(); i++) {
+            glm::vec3 position(std::cos(t + (float)i) * 6.0f, 0.5f, std::sin(t + (float)i) * 6.0f);
+            backend->set_transform(movers[i], glm::translate(glm::mat4(1.0f), position));
+        }
+
+        // the deforming box breathes, a refit of its BLAS
+        deformed = box.positions;
+        for (auto& p : deformed) p *= 1.0f + 0.25f * std::sin(t * 3.0f);
+        backend->update_mesh(dynamic_mesh, deformed.data());
+
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 8.0f, 14.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)width / (float)height, 0.1f, 100.0f);
+        projection[1][1] *= -1.0f;  // Vulkan clip space
+
+        params.inverse_view_projection = glm::inverse(projection * view);
+        params.light_direction         = glm::normalize(glm::vec3(-0.4f, -1.0f, -0.3f));
+        params.frame                   = frame++;
+        render->clear(glm::vec4(0.1f, 0.1f, 0.12f, 1.0f));
+    }
+
+    sptr<VulkanRender>     render;
+    IRayTracingBackend*    backend;
+    RTTraceParams          params;
+    Geometry               box;
+    std::vector<glm::vec3> deformed;
+    RTHandle               dynamic_mesh = RT_INVALID;
+    std::vector<RTHandle>  movers;
+    uint32_t               frame = 0;
+};
+
+void configDI(DI& di) {
+    di["IWindow"] = []() -> IModule* { return new HeadlessWindow(); };
+    di["IRender"] = []() -> IModule* { return new VulkanRender(); };
+    di["Config"]  = []() -> IModule* {
+        auto p                   = new Config();
+        p->enable_vulkan_support = true;
+        p->width                 = width;
+        p->height                = height;
+        p->headless_frames       = frames;
+        p->hardware_ray_tracing  = !prefer_compute;
+        return p;
+    };
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--compute") == 0) {
+            prefer_compute = true;
+        } else {
+            frames = (uint32_t)std::max(1, atoi(argv[i]));
+        }
+    }
+
+    DI di;
+    configDI(di);
+    auto          render = std::static_pointer_cast<VulkanRender>(di.get<IRender>("IRender"));
+    sptr<IWindow> window = di.get<IWindow>("IWindow");
+    RenderData*   data   = render->getVulkanRenderData();
+    VulkanImpl*   impl   = data->parent;
+
+    auto backend = create_ray_tracing_backend(impl, data, prefer_compute);
+    if (!backend) {
+        printf("failed to create a ray tracing backend\n");
+        return 1;
+    }
+    printf("ray tracing backend: %s\n", backend->name());
+
+    // the output, rgba8 to match bindless_images
+    VkImageCreateInfo image_info = {};
+    image_info.sType             = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType         = VK_IMAGE_TYPE_2D;
+    image_info.format            = VK_FORMAT_R8G8B8A8_UNORM;
+    image_info.extent            = {width, height, 1};
+    image_info.mipLevels         = 1;
+    image_info.arrayLayers       = 1;
+    image_info.samples           = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling            = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage             = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_info.initialLayout     = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImage          image;
+    VulkanAllocation image_memory;
+    if (impl->allocator.create_image(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, image_memory)) return 1;
+
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType                 = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image                 = image;
+    view_info.viewType              = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format                = image_info.format;
+    view_info.subresourceRange      = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    VkImageView view;
+    if (vkCreateImageView(impl->device.device, &view_info, nullptr, &view) != VK_SUCCESS) return 1;
+
+    TraceRenderer* cb     = new TraceRenderer(render, backend.get());
+    cb->params.output     = impl->bindless.add_storage_image(view);
+    cb->params.width      = width;
+    cb->params.height     = height;
+    cb->params.ao_radius  = 2.0f;
+    cb->params.ao_samples = 4;
+
+    // the scene: a ground plane, a grid of static boxes, boxes circling them and one deforming box
+    cb->box             = make_box();
+    Geometry   plane    = make_plane(20.0f);
+    RTMeshDesc mesh     = {};
+    mesh.positions      = plane.positions.data();
+    mesh.vertex_count   = (uint32_t)plane.positions.size();
+    mesh.indices        = plane.indices.data();
+    mesh.index_count    = (uint32_t)plane.indices.size();
+    RTHandle plane_mesh = backend->add_mesh(mesh);
+    mesh.positions      = cb->box.positions.data();
+    mesh.vertex_count   = (uint32_t)cb->box.positions.size();
+    mesh.indices        = cb->box.indices.data();
+    mesh.index_count    = (uint32_t)cb->box.indices.size();
+    RTHandle box_mesh   = backend->add_mesh(mesh);
+    mesh.dynamic        = true;
+    cb->dynamic_mesh    = backend->add_mesh(mesh);
+
+    RTInstance instance = {};
+    instance.mesh       = plane_mesh;
+    backend->add_instance(instance);
+    instance.mesh = box_mesh;
+    for (int z = -4; z <= 4; z++) {
+        for (int x = -4; x <= 4; x++) {
+            float height_scale = 1.0f + (float)((x * 7 + z * 13) & 3);
+            instance.transform = glm::translate(glm::mat4(1.0f), glm::vec3(x * 2.0f, height_scale * 0.5f, z * 2.0f)) *
+                                 glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, height_scale, 1.0f));
+            backend->add_instance(instance);
+        }
+    }
+    instance.transform = glm::mat4(1.0f);
+    for (int i = 0; i < 8; i++) cb->movers.push_back(backend->add_instance(instance));
+    instance.mesh      = cb->dynamic_mesh;
+    instance.transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 3.0f, 0.0f));
+    backend->add_instance(instance);
+
+    // traced in front of the scene pass, kept alive by its side effect since nothing reads the image
+    RGImageDesc desc = {};
+    desc.format      = image_info.format;
+    desc.width       = width;
+    desc.height      = height;
+    RGResource output =
+        data->graph.import_image("rt_output", desc, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    data->graph.set_image(output, image, view);
+    RGPass& trace = data->graph.add_pass_before("trace", RGPassType::Compute, "scene");
+    trace.write_storage_image(output, backend->trace_stages());
+    trace.set_side_effect();
+    trace.execute = [cb](RGContext& ctx) { cb->backend->record(ctx.cmd, cb->params); };
+    if (impl->compile_render_graph(*data)) return 1;
+
+    window->setRenderCallback(cb);
+    auto start = std::chrono::steady_clock::now();
+    window->mainLoop();
+    render->flush();
+    auto   end = std::chrono::steady_clock::now();
+    double ms  = std::chrono::duration<double, std::milli>(end - start).count();
+
+    printf("%u frames of %ux%u in %.1f ms, %.3f ms per frame\n", frames, width, height, ms, ms / frames);
+    if (auto hardware = dynamic_cast<VulkanRayTracing*>(backend.get())) {
+        auto& stats = hardware->get_scene().get_stats();
+        printf("%llu BLAS builds in %llu batches, %llu refits, %llu compactions freeing %llu KiB, %llu TLAS builds of "
+               "%u instances\n",
+               (unsigned long long)stats.blas_builds, (unsigned long long)stats.build_batches,
+               (unsigned long long)stats.refits, (unsigned long long)stats.compactions,
+               (unsigned long long)(stats.compacted_bytes >> 10), (unsigned long long)stats.tlas_builds,
+               stats.instances);
+    }
+    if (auto compute = dynamic_cast<VulkanComputeRayTracing*>(backend.get())) {
+        auto& stats = compute->get_stats();
+        printf("%llu BVH builds, %llu refits, %llu instance BVH builds of %u instances, %u nodes (%u KiB), last "
+               "build %.2f ms\n",
+               (unsigned long long)stats.blas_builds, (unsigned long long)stats.refits,
+               (unsigned long long)stats.tlas_builds, stats.instances, stats.nodes, stats.nodes * 64 / 1024,
+               stats.build_ms);
+    }
+
+    backend->destroy();
+    impl->bindless.remove_storage_image(cb->params.output);
+    vkDestroyImageView(impl->device.device, view, nullptr);
+    impl->allocator.destroy_image(image, image_memory);
+    return 0;
+}
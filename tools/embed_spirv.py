@@ -0,0 +1,55 @@
+import sys
+import os
+
+# Writes the SPIR-V files given on the command line into a C++ source as constexpr arrays, together with
+# the table ShaderModuleRegistry looks them up in:
+#
+#   python embed_spirv.py out.cpp vert.spv frag.spv ...
+#
+# The hash is 64-bit FNV-1a over the bytes, the same as fl::fnv1a in fl/system/Hash.hpp computes.
+
+FNV_OFFSET = 0xcbf29ce484222325
+FNV_PRIME = 0x100000001b3
+
+
+def fnv1a(data):
+    h = FNV_OFFSET
+    for byte in data:
+        h = ((h ^ byte) * FNV_PRIME) & 0xffffffffffffffff
+    return h
+
+
+def identifier(name):
+    return "".join(c if c.isalnum() else "_" for c in name)
+
+
+def gen_array(name, data):
+    words = [int.from_bytes(data[i:i + 4], "little") for i in range(0, len(data), 4)]
+    lines = []
+    for i in range(0, len(words), 8):
+        lines.append("    " + ", ".join("0x%08x" % w for w in words[i:i + 8]) + ",")
+    return "static constexpr uint32_t %s[] = {\n%s\n};\n" % (identifier(name), "\n".join(lines))
+
+
+shaders = []
+for path in sys.argv[2:]:
+    with open(path, "rb") as file:
+        data = file.read()
+    if len(data) == 0 or len(data) % 4:
+        sys.exit("%s is not SPIR-V" % path)
+    shaders.append((os.path.basename(path), data))
+
+with open(sys.argv[1], "w") as out:
+    out.write("// generated by tools/embed_spirv.py, do not edit\n")
+    out.write("#include \"fl/render/ShaderModuleRegistry.hpp\"\n")
+    out.write("\nnamespace fl {\n\n")
+    for name, data in shaders:
+        out.write(gen_array(name, data))
+        out.write("\n")
+    out.write("const EmbeddedShader embedded_shaders[] = {\n")
+    for name, data in shaders:
+        out.write("    {\"%s\", %s, %d, 0x%016xull},\n" % (name, identifier(name), len(data) // 4, fnv1a(data)))
+    out.write("    {nullptr, nullptr, 0, 0},\n")
+    out.write("};\n")
+    out.write("const size_t embedded_shader_count = %d;\n" % len(shaders))
+    out.write("\n}  // namespace fl\n")